@@ -1,15 +1,92 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <dnp3hammer.h>
+#include "src/crc.h"
 
 #define BUFLEN 16
 
+// benchmark all CRC implementations on typical input sizes
+static int benchmark(void)
+{
+    static uint8_t buf[4096+64];
+    struct {
+        const char *name;
+        uint16_t (*f)(const uint8_t *, size_t);
+    } impls[] = {
+        {"bytewise", dnp3_crc_bytewise},
+        {"slice8",   dnp3_crc_slice8},
+        {"clmul",    dnp3_crc_clmul},
+        {"dnp3_crc", dnp3_crc}
+    };
+    size_t sizes[] = {8, 16, 250, 4096};    // header, block, frame, long
+    int nimpls = sizeof(impls) / sizeof(*impls);
+    int nsizes = sizeof(sizes) / sizeof(*sizes);
+
+    dnp3_crc_init();
+    for(size_t i=0; i<sizeof(buf); i++)
+        buf[i] = rand();
+
+    // cross-check
+    for(size_t n=0; n<=300; n++) {
+        uint16_t ref = dnp3_crc_bytewise(buf, n);
+        for(int i=0; i<nimpls; i++) {
+            if(!dnp3_crc_have_clmul() && impls[i].f == dnp3_crc_clmul)
+                continue;
+            if(impls[i].f(buf, n) != ref) {
+                fprintf(stderr, "%s: wrong result on %zu bytes\n",
+                        impls[i].name, n);
+                return 1;
+            }
+        }
+    }
+
+    printf("dnp3_crc uses %s\n", dnp3_crc_impl());
+    for(int s=0; s<nsizes; s++) {
+        size_t n = sizes[s];
+        long iters = 100000000 / n;
+
+        for(int i=0; i<nimpls; i++) {
+            if(!dnp3_crc_have_clmul() && impls[i].f == dnp3_crc_clmul)
+                continue;
+
+            volatile uint16_t x = 0;
+            clock_t t = clock();
+            for(long j=0; j<iters; j++)
+                x ^= impls[i].f(buf + (j & 63), n);
+            double sec = (double)(clock() - t) / CLOCKS_PER_SEC;
+
+            printf("%-9s %5zu bytes  %8.2f ns/call  %6.3f ns/byte\n",
+                   impls[i].name, n, sec/iters*1e9, sec/iters/n*1e9);
+        }
+    }
+
+    // whole frames through the batch interface
+    {
+        long iters = 1000000;
+        volatile bool x = 0;
+        clock_t t = clock();
+        for(long j=0; j<iters; j++)
+            x ^= dnp3_crc_blocks_valid(buf + (j & 63), 250);
+        double sec = (double)(clock() - t) / CLOCKS_PER_SEC;
+        printf("dnp3_crc_blocks_valid  250 bytes  %8.2f ns/frame\n",
+               sec/iters*1e9);
+    }
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     uint8_t buf[BUFLEN];
     size_t n=0, m;
 
+    if(argc > 1 && strcmp(argv[1], "-b") == 0)
+        return benchmark();
+
     // while stdin open, read additional input into buf
     do {
         m = read(0, buf+n, BUFLEN-n);
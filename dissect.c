@@ -1,27 +1,162 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
 
 #include <dnp3hammer.h>
 
 
+/// buffered output ///
+
+// all output goes through one large buffer that is written out with
+// write(2) when full, instead of a stdio call per line.
+// with fd -1, the buffer is collected in memory instead (see -P).
+typedef struct {
+    int fd;
+    int err;
+    size_t len;
+    char *mem;                          // fd -1: collected output
+    size_t nmem, memcap;
+    char buf[1 << 16];
+} Output;
+
+static Output out = {1};
+
+// fd -1: append the buffer to mem
+static void out_collect(Output *o)
+{
+    if(o->nmem + o->len > o->memcap) {
+        size_t cap = o->memcap ? o->memcap : 256;
+        while(cap < o->nmem + o->len)
+            cap *= 2;
+        char *m = realloc(o->mem, cap);
+        if(!m) {
+            fprintf(stderr, "out of memory\n");
+            o->err = 1;
+            o->len = 0;
+            return;
+        }
+        o->mem = m;
+        o->memcap = cap;
+    }
+    memcpy(o->mem + o->nmem, o->buf, o->len);
+    o->nmem += o->len;
+    o->len = 0;
+}
+
+static void out_flush(Output *o)
+{
+    size_t off = 0;
+
+    if(o->fd < 0) {
+        out_collect(o);
+        return;
+    }
+
+    while(off < o->len && !o->err) {
+        ssize_t n = write(o->fd, o->buf + off, o->len - off);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("write");
+            o->err = 1;
+        } else {
+            off += n;
+        }
+    }
+    o->len = 0;
+}
+
+static void out_write(Output *o, const void *p, size_t n)
+{
+    if(o->len + n > sizeof o->buf)
+        out_flush(o);
+    if(n > sizeof o->buf) {
+        // too large to buffer; pass it straight through
+        while(n > 0 && o->fd < 0 && !o->err) {
+            size_t k = n < sizeof o->buf ? n : sizeof o->buf;
+            memcpy(o->buf, p, k);
+            o->len = k;
+            out_collect(o);
+            p = (const char *)p + k;
+            n -= k;
+        }
+        while(n > 0 && o->fd >= 0 && !o->err) {
+            ssize_t k = write(o->fd, p, n);
+            if(k < 0) {
+                if(errno == EINTR)
+                    continue;
+                perror("write");
+                o->err = 1;
+            } else {
+                p = (const char *)p + k;
+                n -= k;
+            }
+        }
+        return;
+    }
+    memcpy(o->buf + o->len, p, n);
+    o->len += n;
+}
+
+
 /// helpers ///
 
 static void output(void *env, const uint8_t *input, size_t len)
 {
-    fwrite(input, 1, len, (FILE *)env); // XXX loop; use write(2)?
+    out_write(env, input, len);
 }
 
 static void print(void *env, const char *fmt, ...)
 {
+    Output *o = env;
     va_list args;
+    int n;
 
+    // format in place if it fits, else flush and try again
+    for(int i=0; i<2; i++) {
+        va_start(args, fmt);
+        n = vsnprintf(o->buf + o->len, sizeof o->buf - o->len, fmt, args);
+        va_end(args);
+        if(n < 0)
+            return;
+        if(o->len + n < sizeof o->buf) {
+            o->len += n;
+            return;
+        }
+        out_flush(o);
+    }
+
+    // longer than the whole buffer
+    char *s = malloc(n + 1);
+    if(!s)
+        return;
     va_start(args, fmt);
-    vfprintf((FILE *)env, fmt, args);
+    vsnprintf(s, n + 1, fmt, args);
     va_end(args);
+    out_write(o, s, n);
+    free(s);
+}
+
+// DNP3_FormatWriter for the output buffer
+static int write_out(void *env, const char *s, size_t len)
+{
+    Output *o = env;
+
+    out_write(o, s, len);
+    return o->err ? -1 : 0;
 }
 
 static const char *errorname(DNP3_ParseError e)
@@ -69,24 +204,42 @@ void output_fragment(void *env, const DNP3_Fragment *fragment,
 int print_frame(void *env, const DNP3_Frame *frame,
                 const uint8_t *buf, size_t len)
 {
-    print(env, "L> %s\n", dnp3_format_frame(frame));
+    print(env, "L> ");
+    dnp3_format_frame_to(write_out, env, frame);
+    print(env, "\n");
     return 0;
 }
 
 void print_link_invalid(void *env, const DNP3_Frame *frame)
 {
-    print(env, "L: invalid %s\n", dnp3_format_frame(frame));
+    print(env, "L: invalid ");
+    dnp3_format_frame_to(write_out, env, frame);
+    print(env, "\n");
 }
 
 void print_fragment(void *env, const DNP3_Fragment *fragment,
                      const uint8_t *buf, size_t len)
 {
-    print(env, "A> %s\n", dnp3_format_fragment(fragment));
+    print(env, "A> ");
+    dnp3_format_fragment_to(write_out, env, fragment);
+    print(env, "\n");
+}
+
+static DNP3_ExportFormat export_format;
+
+void export_fragment(void *env, const DNP3_Fragment *fragment,
+                     const uint8_t *buf, size_t len)
+{
+    dnp3_export_fragment(export_format, write_out, env, fragment);
+    if(export_format == DNP3_EXPORT_JSON)
+        print(env, "\n");
 }
 
 void print_segment(void *env, const DNP3_Segment *segment)
 {
-    print(env, "T> %s\n", dnp3_format_segment(segment));
+    print(env, "T> ");
+    dnp3_format_segment_to(write_out, env, segment);
+    print(env, "\n");
 }
 
 void print_transport_discard(void *env, size_t n)
@@ -113,10 +266,16 @@ void print_app_invalid(void *env, DNP3_ParseError e)
 /// main ///
 
 const char *usage =
-    "usage: dissect [-TAf]\n"
+    "usage: dissect [-TAfjbl] [-r file] [-p port] [-P threads]\n"
     "    -T  read a single transport segment from stdin\n"
     "    -A  read a single app-layer fragment from stdin\n"
     "    -f  filter: pass valid traffic to stdout\n"
+    "    -j  export: print fragments as JSON, one per line\n"
+    "    -b  export: print fragments as a sequence of CBOR items\n"
+    "    -r  read DNP3 flows from a pcap/pcapng file instead of stdin\n"
+    "    -l  listen for DNP3 over TCP and UDP instead, until interrupted\n"
+    "    -p  TCP/UDP port for -r and -l [20000]\n"
+    "    -P  with -r: dissect flows on this many threads [1]\n"
     ;
 
 DNP3_Callbacks callbacks = {NULL};
@@ -124,6 +283,790 @@ DNP3_Callbacks callbacks = {NULL};
 int main_app(void);
 int main_transport(void);
 int main_full(void);
+int main_pcap(void);
+int main_live(void);
+
+/// capture files ///
+
+// dissect DNP3 traffic straight out of a pcap or pcapng file. the file is
+// mapped into memory and the TCP/UDP payloads of each flow (one direction
+// of a connection) are fed to a dissector of their own via feed_external,
+// i.e. without copying them.
+//
+// XXX TCP reassembly only follows sequence numbers in capture order;
+//     retransmitted data is dropped, gaps (lost segments) are fed through
+//     and left to the dissector's resync. IP fragments are not reassembled.
+
+static const char *pcap_file;           // -r
+static uint16_t dnp3_port = 20000;      // -p
+static unsigned njobs = 1;              // -P
+
+// link types
+#define LT_NULL         0
+#define LT_ETHERNET     1
+#define LT_RAW          101
+#define LT_LINUX_SLL    113
+#define LT_IPV4         228
+#define LT_IPV6         229
+#define LT_LINUX_SLL2   276
+
+typedef struct {
+    uint8_t src[16], dst[16];           // IPv4 addresses in the first 4
+    uint16_t sport, dport;
+    uint8_t proto;                      // 6 = TCP, 17 = UDP
+    uint8_t v6;
+} FlowKey;
+
+typedef struct Flow_ Flow;
+struct Flow_ {
+    FlowKey key;
+    StreamProcessor *p;
+    uint32_t next_seq;                  // TCP only
+    bool have_seq;
+    unsigned worker;                    // -P
+    Flow *next;
+};
+
+static struct {
+    Flow **tab;
+    size_t size;                        // power of two
+    size_t n;
+    Flow *last;                         // flow of the last printed payload
+} flows;
+
+static bool print_flows;                // print mode: mark flow changes
+
+static Output *flow_output(const Flow *f);      // see -P below
+
+static uint32_t flow_hash(const FlowKey *k)
+{
+    const uint8_t *p = (const uint8_t *)k;
+    uint32_t h = 2166136261u;           // FNV-1a
+
+    for(size_t i=0; i<sizeof *k; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static bool flows_grow(void)
+{
+    size_t size = flows.size ? flows.size * 2 : 64;
+    Flow **tab = calloc(size, sizeof *tab);
+
+    if(!tab)
+        return false;
+    for(size_t i=0; i<flows.size; i++) {
+        Flow *f, *next;
+        for(f=flows.tab[i]; f; f=next) {
+            next = f->next;
+            f->next = tab[flow_hash(&f->key) & (size - 1)];
+            tab[flow_hash(&f->key) & (size - 1)] = f;
+        }
+    }
+    free(flows.tab);
+    flows.tab = tab;
+    flows.size = size;
+    return true;
+}
+
+static Flow *flow_get(const FlowKey *k)
+{
+    Flow *f;
+
+    if(flows.size) {
+        for(f=flows.tab[flow_hash(k) & (flows.size - 1)]; f; f=f->next) {
+            if(memcmp(&f->key, k, sizeof *k) == 0)
+                return f;
+        }
+    }
+
+    if(flows.n >= flows.size && !flows_grow())
+        return NULL;
+    if(!(f = calloc(1, sizeof *f)))
+        return NULL;
+    f->key = *k;
+    f->worker = flow_hash(k) % njobs;
+    if(!(f->p = dnp3_dissector(callbacks, flow_output(f)))) {
+        free(f);
+        return NULL;
+    }
+    size_t i = flow_hash(k) & (flows.size - 1);
+    f->next = flows.tab[i];
+    flows.tab[i] = f;
+    flows.n++;
+    return f;
+}
+
+static void flows_finish(void)
+{
+    for(size_t i=0; i<flows.size; i++) {
+        Flow *f, *next;
+        for(f=flows.tab[i]; f; f=next) {
+            next = f->next;
+            if(njobs == 1)
+                f->p->finish(f->p);     // else done by the workers
+            free(f);
+        }
+    }
+    free(flows.tab);
+    memset(&flows, 0, sizeof flows);
+}
+
+static void print_addr(Output *o, const uint8_t *a, bool v6, uint16_t port)
+{
+    if(!v6) {
+        print(o, "%u.%u.%u.%u:%u", a[0], a[1], a[2], a[3], port);
+        return;
+    }
+    print(o, "[");
+    for(int i=0; i<16; i+=2)
+        print(o, "%s%x", i ? ":" : "", (unsigned)(a[i] << 8 | a[i+1]));
+    print(o, "]:%u", port);
+}
+
+static void print_flow(Output *o, const FlowKey *k)
+{
+    print(o, "F> ");
+    print_addr(o, k->src, k->v6, k->sport);
+    print(o, " -> ");
+    print_addr(o, k->dst, k->v6, k->dport);
+    print(o, "\n");
+}
+
+
+/// parallel processing (-P) ///
+
+// with -P n, the flows of a capture file are spread over n worker threads;
+// a flow and its dissector stay on one worker. the packets are numbered in
+// capture order and every worker collects the output for a packet in a
+// buffer of its own (fd -1) that it hands back under that number. the main
+// thread writes the output out in order, through a reorder window of
+// JOBWIN packets. when the window is full, reading waits for the oldest.
+// so the output is the same as without -P.
+
+#define JOBWIN 4096                     // reorder window, packets
+#define JOBQ   1024                     // queued packets per worker
+
+typedef struct {
+    Flow *flow;
+    const uint8_t *data;                // NULL: finish the flow
+    size_t len;
+    bool mark;                          // print the flow first
+    size_t seq;
+} Job;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;                // queue not empty / not full
+    Job q[JOBQ];
+    size_t head, tail;                  // protected by lock
+    bool done;                          // ditto
+    pthread_t thread;
+    Output out;
+} Worker;
+
+// the output of one packet
+typedef struct {
+    char *text;
+    size_t len;
+    int state;                          // 0 pending, 1 done, -1 failed
+} Chunk;
+
+static struct {
+    Worker *w;
+    size_t seq;                         // next packet number
+    size_t next;                        // next to write out
+    bool failed;
+    pthread_mutex_t lock;               // for win[].state
+    pthread_cond_t ready;
+    Chunk win[JOBWIN];
+} par = {.lock = PTHREAD_MUTEX_INITIALIZER,
+         .ready = PTHREAD_COND_INITIALIZER};
+
+static Output *flow_output(const Flow *f)
+{
+    return (njobs == 1) ? &out : &par.w[f->worker].out;
+}
+
+static void *worker_main(void *arg)
+{
+    Worker *w = arg;
+
+    for(;;) {
+        pthread_mutex_lock(&w->lock);
+        while(w->head == w->tail && !w->done)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if(w->head == w->tail) {
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+        Job j = w->q[w->tail++ % JOBQ];
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+
+        int r = 0;
+        if(j.mark)
+            print_flow(&w->out, &j.flow->key);
+        if(j.data)
+            r = j.flow->p->feed_external(j.flow->p, j.data, j.len);
+        else
+            j.flow->p->finish(j.flow->p);
+        out_flush(&w->out);
+
+        Chunk *c = &par.win[j.seq % JOBWIN];
+        pthread_mutex_lock(&par.lock);
+        c->text = w->out.mem;
+        c->len = w->out.nmem;
+        c->state = (r < 0 || w->out.err) ? -1 : 1;
+        pthread_cond_signal(&par.ready);
+        pthread_mutex_unlock(&par.lock);
+        w->out.mem = NULL;
+        w->out.nmem = w->out.memcap = 0;
+        w->out.err = 0;
+    }
+
+    return NULL;
+}
+
+// write out the output of all packets before upto, waiting for them, and
+// of any later ones that are done already
+static void jobs_drain(size_t upto)
+{
+    pthread_mutex_lock(&par.lock);
+    while(par.next < par.seq) {
+        Chunk *c = &par.win[par.next % JOBWIN];
+        if(c->state == 0) {
+            if(par.next >= upto)
+                break;
+            pthread_cond_wait(&par.ready, &par.lock);
+            continue;
+        }
+        Chunk done = *c;
+        c->state = 0;
+        par.next++;
+        pthread_mutex_unlock(&par.lock);
+
+        out_write(&out, done.text, done.len);
+        free(done.text);
+        if(done.state < 0 && !par.failed) {
+            fprintf(stderr, "processing error\n");
+            par.failed = true;
+        }
+
+        pthread_mutex_lock(&par.lock);
+    }
+    pthread_mutex_unlock(&par.lock);
+}
+
+// queue a packet (or finish) for the worker of its flow
+static int jobs_push(Flow *f, const uint8_t *data, size_t len, bool mark)
+{
+    Worker *w = &par.w[f->worker];
+
+    if(par.seq - par.next >= JOBWIN)
+        jobs_drain(par.seq - JOBWIN + 1);
+
+    Job j = {f, data, len, mark, par.seq++};
+    pthread_mutex_lock(&w->lock);
+    while(w->head - w->tail == JOBQ)
+        pthread_cond_wait(&w->cond, &w->lock);
+    w->q[w->head++ % JOBQ] = j;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+
+    jobs_drain(0);
+    return par.failed ? -1 : 0;
+}
+
+static bool jobs_start(void)
+{
+    if(!(par.w = calloc(njobs, sizeof *par.w))) {
+        njobs = 0;              // for jobs_finish
+        return false;
+    }
+    for(unsigned i=0; i<njobs; i++) {
+        Worker *w = &par.w[i];
+        w->out.fd = -1;
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->cond, NULL);
+        if(pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            njobs = i;          // for jobs_finish
+            return false;
+        }
+    }
+    return true;
+}
+
+// finish all flows in the workers, in table order, and stop them
+static void jobs_finish(void)
+{
+    for(size_t i=0; i<flows.size; i++) {
+        for(Flow *f=flows.tab[i]; f; f=f->next)
+            jobs_push(f, NULL, 0, false);
+    }
+    jobs_drain(par.seq);
+
+    for(unsigned i=0; i<njobs; i++) {
+        Worker *w = &par.w[i];
+        pthread_mutex_lock(&w->lock);
+        w->done = true;
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->thread, NULL);
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+    }
+    free(par.w);
+    par.w = NULL;
+}
+
+static inline uint16_t be16(const uint8_t *p)
+{
+    return p[0] << 8 | p[1];
+}
+
+static inline uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// transport header at p; key has the addresses filled in
+static int pcap_l4(FlowKey *k, const uint8_t *p, size_t n)
+{
+    const uint8_t *data;
+    size_t len;
+    uint32_t seq = 0;
+    bool syn = false;
+
+    if(k->proto == 6) {
+        if(n < 20 || n < (size_t)(p[12] >> 4) * 4)
+            return 0;
+        seq = be32(p + 4);
+        syn = p[13] & 0x02;
+        data = p + (p[12] >> 4) * 4;
+    } else if(k->proto == 17) {
+        if(n < 8)
+            return 0;
+        data = p + 8;
+    } else {
+        return 0;
+    }
+    len = n - (data - p);
+
+    k->sport = be16(p);
+    k->dport = be16(p + 2);
+    if(k->sport != dnp3_port && k->dport != dnp3_port)
+        return 0;
+    if(len == 0 && !syn)
+        return 0;
+
+    Flow *f = flow_get(k);
+    if(!f) {
+        fprintf(stderr, "protocol init failed\n");
+        return -1;
+    }
+
+    if(k->proto == 6) {
+        if(syn) {
+            f->next_seq = seq + 1;
+            f->have_seq = true;
+        } else if(f->have_seq) {
+            int32_t d = seq - f->next_seq;
+            if(d < 0) {
+                // (partial) retransmission
+                if((size_t)-(int64_t)d >= len)
+                    return 0;
+                data += -(int64_t)d;
+                len -= -(int64_t)d;
+                seq = f->next_seq;
+            }
+        }
+        f->next_seq = seq + len;
+        f->have_seq = true;
+        if(len == 0)
+            return 0;
+    }
+
+    bool mark = print_flows && f != flows.last;
+    if(mark)
+        flows.last = f;
+
+    if(njobs > 1)
+        return jobs_push(f, data, len, mark);
+
+    if(mark)
+        print_flow(&out, k);
+    if(f->p->feed_external(f->p, data, len) < 0) {
+        fprintf(stderr, "processing error\n");
+        return -1;
+    }
+    return 0;
+}
+
+// IP packet (either version) at p
+static int pcap_ip(const uint8_t *p, size_t n)
+{
+    FlowKey k;
+
+    memset(&k, 0, sizeof k);
+    if(n < 1)
+        return 0;
+
+    if(p[0] >> 4 == 4) {
+        size_t hl = (p[0] & 0x0F) * 4;
+        if(n < 20 || hl < 20 || n < hl)
+            return 0;
+        if(be16(p + 2) < n)
+            n = be16(p + 2);            // trim link-layer padding
+        if(be16(p + 6) & 0x3FFF)
+            return 0;                   // fragment
+        k.proto = p[9];
+        memcpy(k.src, p + 12, 4);
+        memcpy(k.dst, p + 16, 4);
+        if(n < hl)
+            return 0;
+        return pcap_l4(&k, p + hl, n - hl);
+    }
+
+    if(p[0] >> 4 == 6) {
+        if(n < 40)
+            return 0;
+        if(40 + (size_t)be16(p + 4) < n)
+            n = 40 + be16(p + 4);
+        k.v6 = 1;
+        memcpy(k.src, p + 8, 16);
+        memcpy(k.dst, p + 24, 16);
+
+        // skip extension headers
+        uint8_t nh = p[6];
+        size_t off = 40;
+        while(nh == 0 || nh == 43 || nh == 60) {
+            if(n < off + 8)
+                return 0;
+            nh = p[off];
+            off += (p[off + 1] + 1) * 8;
+        }
+        if(nh == 44 || n < off)
+            return 0;                   // fragment
+        k.proto = nh;
+        return pcap_l4(&k, p + off, n - off);
+    }
+
+    return 0;
+}
+
+// one captured packet
+static int pcap_packet(uint32_t linktype, const uint8_t *p, size_t n)
+{
+    uint16_t et;
+
+    switch(linktype) {
+    case LT_NULL:
+        // address family in the capturing host's byte order
+        if(n < 4)
+            return 0;
+        return pcap_ip(p + 4, n - 4);
+    case LT_ETHERNET:
+        if(n < 14)
+            return 0;
+        et = be16(p + 12);
+        p += 14; n -= 14;
+        while(et == 0x8100 || et == 0x88A8) {   // VLAN tags
+            if(n < 4)
+                return 0;
+            et = be16(p + 2);
+            p += 4; n -= 4;
+        }
+        break;
+    case LT_LINUX_SLL:
+        if(n < 16)
+            return 0;
+        et = be16(p + 14);
+        p += 16; n -= 16;
+        break;
+    case LT_LINUX_SLL2:
+        if(n < 20)
+            return 0;
+        et = be16(p);
+        p += 20; n -= 20;
+        break;
+    case LT_RAW:
+    case LT_IPV4:
+    case LT_IPV6:
+        return pcap_ip(p, n);
+    default:
+        return 0;
+    }
+
+    if(et != 0x0800 && et != 0x86DD)
+        return 0;
+    return pcap_ip(p, n);
+}
+
+// integers in file byte order
+static bool swapped;
+
+static inline uint16_t rd16(const uint8_t *p)
+{
+    return swapped ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]);
+}
+
+static inline uint32_t rd32(const uint8_t *p)
+{
+    return swapped ? be32(p)
+                   : ((uint32_t)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0]);
+}
+
+static int pcap_classic(const uint8_t *p, size_t n)
+{
+    if(n < 24)
+        return -1;
+    uint32_t linktype = rd32(p + 20) & 0x0FFFFFFF;
+
+    for(size_t off = 24; off + 16 <= n; ) {
+        size_t caplen = rd32(p + off + 8);
+        off += 16;
+        if(caplen > n - off) {
+            fprintf(stderr, "%s: truncated packet\n", pcap_file);
+            break;
+        }
+        if(pcap_packet(linktype, p + off, caplen) < 0)
+            return -1;
+        off += caplen;
+    }
+    return 0;
+}
+
+static int pcapng(const uint8_t *p, size_t n)
+{
+    uint32_t *linktypes = NULL;         // per interface in this section
+    uint32_t *snaplens = NULL;
+    size_t nif = 0, cap = 0;
+    int r = 0;
+
+    for(size_t off = 0; off + 12 <= n && r == 0; ) {
+        const uint8_t *b = p + off;
+        uint32_t type = rd32(b);
+
+        if(type == 0x0A0D0D0A) {
+            // section header; sets byte order, resets interfaces
+            uint32_t bom = b[8] | b[9] << 8 | b[10] << 16 | (uint32_t)b[11] << 24;
+            if(bom == 0x1A2B3C4D)
+                swapped = false;
+            else if(bom == 0x4D3C2B1A)
+                swapped = true;
+            else
+                break;
+            nif = 0;
+        }
+
+        size_t blen = rd32(b + 4);
+        if(blen < 12 || blen > n - off) {
+            fprintf(stderr, "%s: truncated block\n", pcap_file);
+            break;
+        }
+        const uint8_t *body = b + 8;
+        size_t bodylen = blen - 12;
+
+        switch(type) {
+        case 1:                         // interface description
+            if(bodylen < 8)
+                break;
+            if(nif == cap) {
+                cap = cap ? cap * 2 : 4;
+                uint32_t *lt = realloc(linktypes, cap * sizeof *lt);
+                uint32_t *sl = lt ? realloc(snaplens, cap * sizeof *sl) : NULL;
+                if(lt) linktypes = lt;
+                if(sl) snaplens = sl;
+                if(!lt || !sl) {
+                    fprintf(stderr, "out of memory\n");
+                    r = -1;
+                    break;
+                }
+            }
+            linktypes[nif] = rd16(body);
+            snaplens[nif] = rd32(body + 4);
+            nif++;
+            break;
+        case 6: {                       // enhanced packet
+            if(bodylen < 20)
+                break;
+            uint32_t ifid = rd32(body);
+            size_t caplen = rd32(body + 12);
+            if(ifid < nif && caplen <= bodylen - 20)
+                r = pcap_packet(linktypes[ifid], body + 20, caplen);
+            break; }
+        case 3: {                       // simple packet (interface 0)
+            if(bodylen < 4 || nif == 0)
+                break;
+            size_t caplen = rd32(body);
+            if(caplen > bodylen - 4)
+                caplen = bodylen - 4;
+            if(snaplens[0] && caplen > snaplens[0])
+                caplen = snaplens[0];
+            r = pcap_packet(linktypes[0], body + 4, caplen);
+            break; }
+        case 2: {                       // packet (obsolete)
+            if(bodylen < 20)
+                break;
+            uint32_t ifid = rd16(body);
+            size_t caplen = rd32(body + 12);
+            if(ifid < nif && caplen <= bodylen - 20)
+                r = pcap_packet(linktypes[ifid], body + 20, caplen);
+            break; }
+        }
+
+        off += blen;
+    }
+
+    free(linktypes);
+    free(snaplens);
+    return r;
+}
+
+int main_pcap(void)
+{
+    int fd = open(pcap_file, O_RDONLY);
+    struct stat st;
+    int r;
+
+    if(fd < 0 || fstat(fd, &st) < 0) {
+        perror(pcap_file);
+        return 1;
+    }
+    if(st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    const uint8_t *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    posix_madvise((void *)p, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    if(njobs > 1 && !jobs_start()) {
+        fprintf(stderr, "failed to start threads\n");
+        jobs_finish();
+        munmap((void *)p, st.st_size);
+        return 1;
+    }
+
+    size_t n = st.st_size;
+    uint32_t magic = n < 4 ? 0 : be32(p);
+    switch(magic) {
+    case 0xA1B2C3D4:                    // microsecond timestamps
+    case 0xA1B23C4D:                    // nanosecond timestamps
+        swapped = true;
+        r = pcap_classic(p, n);
+        break;
+    case 0xD4C3B2A1:
+    case 0x4D3CB2A1:
+        swapped = false;
+        r = pcap_classic(p, n);
+        break;
+    case 0x0A0D0D0A:
+        r = pcapng(p, n);
+        break;
+    default:
+        fprintf(stderr, "%s: not a pcap or pcapng file\n", pcap_file);
+        r = -1;
+    }
+
+    // NB: the dissectors may hold pointers into the mapping until finished.
+    if(njobs > 1) {
+        jobs_finish();
+        if(par.failed)
+            r = -1;
+    }
+    flows_finish();
+    munmap((void *)p, n);
+    return r < 0 ? 1 : 0;
+}
+
+/// live traffic (-l) ///
+
+// listen on all addresses, with a dissector per TCP connection or UDP peer,
+// until SIGINT or SIGTERM. opened and closed flows are marked in print mode.
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    stop = 1;
+}
+
+static void print_peer(const DNP3_IngestFlow *flow, const char *what)
+{
+    char host[64], serv[8];     // NB: NI_MAXHOST is not POSIX
+
+    if(!print_flows)
+        return;
+    if(getnameinfo(flow->peer, flow->peerlen, host, sizeof host,
+                   serv, sizeof serv, NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        strcpy(host, "?");
+        strcpy(serv, "?");
+    }
+    print(&out, "F> %s port %s (%s) %s\n", host, serv,
+          flow->udp ? "udp" : "tcp", what);
+}
+
+static StreamProcessor *live_open(void *env, const DNP3_IngestFlow *flow)
+{
+    print_peer(flow, "open");
+    return dnp3_dissector(callbacks, &out);
+}
+
+static void live_close(void *env, const DNP3_IngestFlow *flow)
+{
+    print_peer(flow, "closed");
+}
+
+int main_live(void)
+{
+    DNP3_IngestConfig cfg = {0};
+    char port[8];
+    int r = 0;
+
+    cfg.open = live_open;
+    cfg.close = live_close;
+    DNP3_Ingest *ing = dnp3_ingest_new(&cfg, NULL);
+    if(!ing) {
+        perror("dnp3_ingest_new");
+        return 1;
+    }
+    snprintf(port, sizeof port, "%u", (unsigned)dnp3_port);
+    if(dnp3_ingest_listen(ing, NULL, port) < 0) {
+        perror(port);
+        dnp3_ingest_free(ing);
+        return 1;
+    }
+
+    struct sigaction sa = {.sa_handler = on_signal};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while(!stop && !out.err) {
+        if(dnp3_ingest_run(ing, 1000) < 0) {
+            perror("dnp3_ingest_run");
+            r = 1;
+            break;
+        }
+        out_flush(&out);
+    }
+
+    DNP3_IngestStats st;
+    dnp3_ingest_stats(ing, &st);
+    dnp3_ingest_free(ing);
+    fprintf(stderr, "%" PRIu64 " datagrams, %" PRIu64 " bytes, %" PRIu64
+            " flows (%" PRIu64 " refused), %" PRIu64 " dropped by the"
+            " kernel\n", st.datagrams, st.bytes, st.flows, st.flows_refused,
+            st.kernel_drops);
+    return r;
+}
 
 int main(int argc, char *argv[])
 {
@@ -142,7 +1085,7 @@ int main(int argc, char *argv[])
 
     // command line
     int ch;
-    while((ch = getopt(argc, argv, "TAfh")) != -1) {
+    while((ch = getopt(argc, argv, "TAfjblr:p:P:h")) != -1) {
         switch(ch) {
         case 'f': // filter mode
             callbacks.link_frame = output_ctrl_frame;
@@ -153,12 +1096,39 @@ int main(int argc, char *argv[])
             callbacks.app_invalid = NULL;
             callbacks.app_fragment = output_fragment;
             break;
+        case 'j': // export modes
+        case 'b':
+            export_format = (ch == 'j') ? DNP3_EXPORT_JSON : DNP3_EXPORT_CBOR;
+            callbacks.link_frame = NULL;
+            callbacks.link_invalid = NULL;
+            callbacks.transport_segment = NULL;
+            callbacks.transport_discard = NULL;
+            callbacks.transport_payload = NULL;
+            callbacks.app_invalid = NULL;
+            callbacks.app_fragment = export_fragment;
+            break;
         case 'A': // app-layer only
             main_ = main_app;
             break;
         case 'T': // transport-layer
             main_ = main_transport;
             break;
+        case 'r': // capture file
+            main_ = main_pcap;
+            pcap_file = optarg;
+            break;
+        case 'l': // live
+            main_ = main_live;
+            break;
+        case 'p':
+            dnp3_port = atoi(optarg);
+            break;
+        case 'P':
+            if(atoi(optarg) > 0) {
+                njobs = atoi(optarg);
+                break;
+            }
+            // fall through
         default:
             fputs(usage, stderr);
             return 1;
@@ -167,15 +1137,24 @@ int main(int argc, char *argv[])
     argc -= optind;
     argv += optind;
 
+    if(njobs > 1 && main_ != main_pcap) {
+        fputs("dissect: -P requires -r\n", stderr);
+        return 1;
+    }
+
+    print_flows = (callbacks.link_frame == print_frame);
+
     dnp3_init();
-    return main_();
+    int r = main_();
+    out_flush(&out);
+    return (r == 0 && out.err) ? 1 : r;
 }
 
 int main_full(void)
 {
     StreamProcessor *p;
 
-    p = dnp3_dissector(callbacks, stdout);
+    p = dnp3_dissector(callbacks, &out);
     if(p == NULL) {
         fprintf(stderr, "protocol init failed\n");
         return 1;
@@ -209,7 +1188,7 @@ int main_full(void)
 
 #define BUFLEN 4096
 #define CALLBACK(NAME, ...) \
-    do {if(callbacks.NAME) callbacks.NAME(stdout, __VA_ARGS__);} while(0)
+    do {if(callbacks.NAME) callbacks.NAME(&out, __VA_ARGS__);} while(0)
 
 int app_layer(const uint8_t *buf, size_t n, const uint8_t *raw, size_t rawn)
 {
@@ -57,8 +57,12 @@ typedef struct {
         //   parser?)
 } DNP3_Frame;
 
+#define DNP3_LINK_MAXPAYLOAD 250    // max. no. of bytes in a frame payload
+
 // transport function...
 
+#define DNP3_TRANSPORT_MAXPAYLOAD (DNP3_LINK_MAXPAYLOAD - 1)   // less header
+
 typedef struct {
     uint8_t fir:1;  // first segment in series?
     uint8_t fin:1;  // final segment in series?
@@ -341,6 +345,7 @@ typedef enum {
 
     DNP3_VARIATION_APPL_ID = 1,
 
+    DNP3_VARIATION_AUTH_CHALLENGE = 1,
     DNP3_VARIATION_AUTH_AGGR = 3,
     DNP3_VARIATION_AUTH_MAC = 9,
 } DNP3_Variation;
@@ -482,6 +487,18 @@ typedef union {
         size_t len;
     } applid;
 
+    // g120v3 (aggressive mode request)
+    struct {
+        uint32_t csq;           // challenge sequence number
+        uint16_t usr;           // user number
+    } aggr;
+
+    // g120v9 (message authentication code)
+    struct {
+        uint8_t *bytes;
+        size_t len;
+    } mac;
+
     // objects with timestamps (not group 50!)
     struct {
         union {
@@ -490,14 +507,36 @@ typedef union {
             DNP3_Counter ctr;
             DNP3_Analog ana;
         };
-        union {
-            DNP3_Time abstime;  // ms since 1970-01-01
-            uint16_t  reltime;  // ms since "common time-of-occurance" (CTO)
-        };
+        DNP3_Time abstime;      // ms since 1970-01-01
+        uint16_t  reltime;      // ms since "common time-of-occurance" (CTO)
+        uint8_t   cto;          // with reltime: variation of the CTO object
+                                // (DNP3_VARIATION_CTO_*), 0 if none.
+                                // abstime is then CTO + reltime (or 0).
     } timed;
 
 } DNP3_Object;
 
+// value types used in DNP3_Columns
+typedef enum {
+    DNP3_COL_NONE = 0,
+    DNP3_COL_INT32,     // int32_t: integer analogs
+    DNP3_COL_UINT32,    // uint32_t: counters
+    DNP3_COL_FLOAT,     // float: single-precision analogs
+    DNP3_COL_DOUBLE     // double: double-precision analogs
+} DNP3_ColumnType;
+
+// columnar representation of objects of a single fixed-size type
+// (see DNP3_ParserConfig). every column is NULL if the type lacks the
+// field, otherwise it holds one element per object.
+typedef struct {
+    uint8_t         *bits;      // packed states, bitwidth bits each, LSB first
+    uint8_t         bitwidth;   // 1 (g1v1, g10v1), 2 (g3v1), or 0
+    uint8_t         *flags;     // flags octets as on the wire
+    DNP3_ColumnType valuetype;
+    void            *values;    // array of valuetype
+    DNP3_Time       *times;     // abstime, or reltime (g2v3, g4v3)
+} DNP3_Columns;
+
 typedef struct {
     DNP3_Group      group;
     DNP3_Variation  variation;
@@ -505,15 +544,37 @@ typedef struct {
     size_t      count;          // number of objects
     uint32_t    range_base;     // 0 if unused; only used with rangespecs 0-5
     uint32_t    *indexes;       // NULL if unused
-    DNP3_Object *objects;
+    DNP3_Object *objects;       // NULL if unused or stored in columns
+    DNP3_Columns *columns;      // NULL unless stored in columns
 
     // low-level packet info
     uint8_t     prefixcode:4;
     uint8_t     rangespec:4;
+
+    // the CTO (g51) preceding a block of relative-time objects (g2v3, g4v3)
+    DNP3_Time   cto;            // its time, 0 if none
+    uint8_t     ctovar;         // its variation, 0 if none
+
+    void        *lazy;          // internal: objects not decoded yet, see
+                                // dnp3_app_decode_headers()
 } DNP3_ObjectBlock;
 
+// result of verifying an aggressive-mode MAC, see DNP3_DissectorConfig.keys
+typedef enum {
+    DNP3_AUTH_UNCHECKED = 0,    // no session key or challenge known
+    DNP3_AUTH_OK,
+    DNP3_AUTH_FAILED            // MAC mismatch
+} DNP3_AuthStatus;
+
+// aggressive-mode authentication: a g120v3 object first, g120v9 last
 typedef struct {
-} DNP3_AuthData; // XXX
+    uint32_t        csq;        // challenge sequence number (g120v3)
+    uint16_t        usr;        // user number
+    uint8_t         *mac;       // MAC value (g120v9)
+    size_t          maclen;
+    uint8_t         machdr;     // size of the g120v9 object header
+    DNP3_AuthStatus status;     // set by a dissector with keys
+} DNP3_AuthData;
 
 // requests are messages from master to outstation.
 // responses (solicited or unsolicited) are messages from outstation to master.
@@ -524,6 +585,8 @@ typedef struct {
     DNP3_IntIndications iin;    // internal indications (response only)
 
     DNP3_AuthData       *auth;  // aggressive-mode authentication (optional)
+    bool                shed;   // objects left undecoded by a dissector under
+                                // overload, see DNP3_ShedPolicy
 
     size_t              nblocks;    // number of elements in odata array
     DNP3_ObjectBlock    **odata;
@@ -543,7 +606,9 @@ enum DNP3_TokenType {
 
     TT_DNP3_Segment,
 
-    TT_DNP3_Frame
+    TT_DNP3_Frame,
+
+    TT_DNP3_Columns
 };
 
 extern HParser *dnp3_p_app_request;
@@ -554,9 +619,131 @@ extern HParser *dnp3_p_transport_segment;
 
 extern HParser *dnp3_p_link_frame;
 
+// NB: All global parsers are built by dnp3_init() and not modified
+//     afterwards, except for internal tables (by function code, payload
+//     size, etc.) that are filled in on first use, under a lock.
+//     They may be used from any number of threads at once, with
+//     h_parse__m() and a thread-safe (or per-thread) allocator.
+//     dnp3_init() itself must complete before any other thread uses them.
+//     dnp3_free() releases them; no thread may use them after that.
+
 
 /// HIGH-LEVEL PROTOCOL ///
 
+struct iovec;
+
+// dissector statistics, see dnp3_dissector_stats()
+#define DNP3_STATS_NBINS 32     // histogram bin i counts times in [2^i,2^i+1)
+typedef struct {
+    uint64_t frames;            // link frames decoded
+    uint64_t bytes_skipped;     // input bytes skipped to find a frame start
+    uint64_t crc_errors;        // frames with a bad data block CRC
+    uint64_t link_invalid;      // frames failing dnp3_link_validate_frame
+    uint64_t context_evictions;
+    uint64_t transport_discards;    // transport_discard callbacks
+    uint64_t app_fragments;
+    uint64_t app_errors[4];     // [0] = unparseable, else by DNP3_ParseError
+                                // ([e - TT_ERR])
+    uint64_t filtered;          // frames and fragments dropped by the filter
+    uint64_t cache_hits;        // requests found in the request cache
+    uint64_t cache_misses;      // cacheable requests that had to be parsed
+    uint64_t auth_ok;           // aggressive-mode MACs verified
+    uint64_t auth_failed;       // ... and found wrong
+    uint64_t link_duplicates;   // frames dropped by the dedup window
+    uint64_t transport_duplicates;  // ditto, reassembled fragments
+    uint64_t overloads;         // times the shed policy engaged
+    uint64_t shed_fragments;    // fragments delivered with shed set
+    uint64_t memory_evictions;  // contexts and series given up to stay
+                                // within DNP3_DissectorConfig.memory
+    uint64_t auth_challenges_dropped;   // too long to keep, MACs over them
+                                        // go unchecked
+
+    // per-stage processing time in CPU cycles (or ns without a cycle
+    // counter); only collected with DNP3_DissectorConfig.stats_timing
+    uint64_t link_time[DNP3_STATS_NBINS];
+    uint64_t transport_time[DNP3_STATS_NBINS];  // excl. app layer
+    uint64_t app_time[DNP3_STATS_NBINS];
+} DNP3_Stats;
+
+// allocation profiling, see h_profiler(). the dissector marks the stage it
+// is in for the calling thread; allocations are counted by that stage.
+typedef enum {
+    DNP3_STAGE_OTHER = 0,       // outside the dissector, setup, callbacks
+    DNP3_STAGE_LINK,            // frames, connection contexts
+    DNP3_STAGE_TRANSPORT,       // reassembly of segment series
+    DNP3_STAGE_APP,             // parsing fragments (incl. the grammar's
+                                // object data)
+    DNP3_STAGE_OBJECTS,         // directly decoded object data, see
+                                // dnp3_app_decode_fragment()
+    DNP3_STAGE_RESULTS,         // copies of results (dnp3_fragment_copy)
+    DNP3_NSTAGES
+} DNP3_Stage;
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t reallocs;
+    uint64_t frees;
+    uint64_t bytes;             // requested by alloc and realloc
+    uint64_t sizes[DNP3_STATS_NBINS];   // by requested size, bin i counts
+                                        // sizes in [2^i,2^i+1)
+} DNP3_AllocCounts;
+
+typedef struct {
+    DNP3_AllocCounts stage[DNP3_NSTAGES];
+    uint64_t group_bytes[256];  // DNP3_STAGE_OBJECTS by object group
+    uint64_t live;              // bytes allocated and not yet freed
+    uint64_t peak;              // max. of live
+    uint64_t failed;            // allocations that returned NULL
+} DNP3_AllocProfile;
+
+// a point reported by the point database (see dnp3_pointdb_apply)
+typedef struct {
+    uint16_t        outstation; // link address
+    DNP3_Group      group;      // as received, static or event
+    DNP3_Variation  variation;
+    uint32_t        index;
+    DNP3_Object     object;
+    bool            event;      // event object, reported regardless of change
+} DNP3_PointChange;
+
+typedef struct DNP3_PointDB_ DNP3_PointDB;
+
+// MAC algorithms of secure authentication (SAv5) that can be verified
+typedef enum {
+    DNP3_MAC_NONE = 0,
+    DNP3_MAC_HMAC_SHA256        // any key length, 16 or 32 octets in SAv5
+} DNP3_MacAlgorithm;
+
+typedef struct DNP3_KeyCache_ DNP3_KeyCache;
+
+// measurement archive, see dnp3_archive_create
+typedef struct DNP3_ArchiveWriter_ DNP3_ArchiveWriter;
+typedef struct DNP3_Archive_ DNP3_Archive;
+
+// a sample read back from an archive (see dnp3_archive_query)
+typedef struct {
+    uint16_t        outstation;
+    DNP3_Group      group;
+    DNP3_Variation  variation;
+    uint32_t        index;
+    DNP3_Time       time;       // the object's timestamp, else time received
+    DNP3_Object     object;     // timed.abstime = time for types with a
+                                // timestamp; relative times come resolved
+} DNP3_ArchiveRecord;
+
+// returned by the feed functions if the dissector's memory budget (see
+// DNP3_DissectorConfig.memory) refused an allocation during the call. the
+// input was consumed, but what could not be allocated (contexts, series,
+// parse results) was dropped. the caller should slow down, e.g. stop reading
+// the source for a while. near the limit, the dissector makes room first:
+// above 7/8 it frees idle series buffers, then the least recently used idle
+// contexts, then series in flight (transport_discard). all of these count
+// as memory_evictions.
+// NB: the budget may be shared, so the allocation refused may have been
+//     another dissector's. feed_budget only returns it when no input is
+//     left; otherwise the call that finishes the input does.
+#define DNP3_BACKPRESSURE (-2)
+
 typedef struct StreamProcessor_ StreamProcessor;
 struct StreamProcessor_ {
     // input buffer, pre-allocated, may be altered by feed()
@@ -566,12 +753,36 @@ struct StreamProcessor_ {
     // return 0 on success, < 0 on error
     int (*feed)(StreamProcessor *self, size_t n); // eats either 0 or n bytes
     int (*finish)(StreamProcessor *self);         // invalidates (frees) self
+
+    // alternatives to feed() that parse directly from caller memory;
+    // only an incomplete trailing frame is copied to buf.
+    // NB: raw frame pointers passed to callbacks may point into data.
+    int (*feed_external)(StreamProcessor *self, const uint8_t *data, size_t n);
+    int (*feedv)(StreamProcessor *self, const struct iovec *iov, int iovcnt);
+
+    // like feed() but stop after max_frames link frames or max_ns
+    // nanoseconds, whichever comes first (0 = no limit). at least one frame
+    // is processed per call. returns the number of bytes left to process;
+    // call again with n = 0 to resume before writing more input to buf.
+    // returns 0 when only an incomplete frame is left, < 0 on error.
+    // NULL if not supported.
+    int (*feed_budget)(StreamProcessor *self, size_t n,
+                       size_t max_frames, uint64_t max_ns);
+
+    // NULL if not supported, see dnp3_dissector_stats()
+    int (*stats)(StreamProcessor *self, DNP3_Stats *out);
+
+    // NULL if not supported, see dnp3_dissector_checkpoint()
+    int (*checkpoint)(StreamProcessor *self, uint8_t *buf, size_t cap);
+    int (*restore)(StreamProcessor *self, const uint8_t *buf, size_t len);
 };
 
 typedef struct {
     void (*link_invalid)(void *env, const DNP3_Frame *frame);
     int  (*link_frame)(void *env, const DNP3_Frame *frame,
                        const uint8_t *buf, size_t len); // raw input
+    void (*link_skip)(void *env, size_t n);     // n = bytes of garbage skipped
+                                                // looking for a frame start
     void (*transport_segment)(void *env, const DNP3_Segment *segment);
     void (*transport_discard)(void *env, size_t n);     // n = number of bytes
     void (*transport_payload)(void *env, const uint8_t *s, size_t n);
@@ -579,28 +790,374 @@ typedef struct {
     void (*app_fragment)(void *env, const DNP3_Fragment *fragment,
                          const uint8_t *buf, size_t len);       // raw frames
         // XXX Passing raw frames to app_fragment() is a temporary measure.
-        //     Those arguments should be removed when we can generate DNP3
-        //     output ourselves.
+        //     Those arguments should be removed now that we can generate
+        //     DNP3 output ourselves (dnp3_encode_*).
+    void (*app_object_block)(void *env, const DNP3_Fragment *fragment,
+                             const DNP3_ObjectBlock *ob);
+        // optional: if set, the object blocks of every fragment are passed
+        // here, in order, and app_fragment() follows with odata = NULL to
+        // mark the end of the fragment. ob is only valid during the call.
+        // responses handled by dnp3_app_decode_blocks() are streamed block
+        // by block; others are parsed in full first.
+    void (*point_change)(void *env, const DNP3_PointChange *change);
+        // with DNP3_DissectorConfig.point_db: the points of every response
+        // that are new or have changed, and all event objects. called
+        // before app_fragment, always on the feeding thread.
+    void (*context_evict)(void *env, uint16_t src, uint16_t dst, size_t n);
+        // the least recently used connection context was recycled;
+        // n = number of bytes of an unfinished segment series dropped
+    void (*link_duplicate)(void *env, const uint8_t *buf, size_t len);
+    void (*transport_duplicate)(void *env, const uint8_t *s, size_t n);
+        // with DNP3_DissectorConfig.dedup_window: a raw frame (before CRC
+        // checks), or a reassembled fragment (before transport_payload),
+        // was dropped as a copy of a recent one of its connection context
 
     void (*log_error)(void *env, const char *fmt, ...);
 } DNP3_Callbacks;
 
+// early-drop filter, see DNP3_DissectorConfig.filter. traffic that does not
+// pass is dropped without callbacks at the first layer that can tell: link
+// frames by address, fragments by function code (before they are parsed),
+// and object blocks by group. fragments with object data only pass if a
+// block does. start with dnp3_filter_init() which lets everything pass.
+typedef struct {
+    uint64_t addr[65536/64];    // link addresses, see addr_deny
+    bool     addr_deny;         // drop frames from or to a marked address;
+                                // otherwise pass only those
+    uint64_t fc[256/64];        // function codes to pass
+    uint64_t group[256/64];     // object groups to pass
+} DNP3_Filter;
+
+void dnp3_filter_init(DNP3_Filter *f);
+
+// set or test bit i of one of the above
+static inline
+void dnp3_filter_set(uint64_t *map, unsigned i, bool on)
+{
+    if(on)
+        map[i/64] |= (uint64_t)1 << (i%64);
+    else
+        map[i/64] &= ~((uint64_t)1 << (i%64));
+}
+
+static inline
+bool dnp3_filter_test(const uint64_t *map, unsigned i)
+{
+    return (map[i/64] >> (i%64)) & 1;
+}
+
+// load shedding, see DNP3_DissectorConfig.shed. the dissector is overloaded
+// when a feed call takes longer than max_feed_ns, or more than max_queue
+// results wait in the async queue, and stays so until hold_ms pass without
+// either. meanwhile, the objects of selected response fragments are not
+// decoded, except for every sample'th one per connection context. the
+// blocks of such fragments have headers only, as with lazy_objects (the
+// objects can still be decoded on demand, see dnp3_oblock_objects), and
+// shed is set on the fragment. link and transport processing is unchanged.
+// start with dnp3_shed_init() which selects all fragments.
+typedef struct {
+    uint64_t max_feed_ns;   // [0 = not watched]
+    size_t max_queue;       // [0 = not watched]
+    unsigned hold_ms;       // [1000]
+    unsigned sample;        // decode 1 in n selected fragments in full
+                            // [0 = none]
+    DNP3_Filter select;     // fragments subject to shedding, by link address
+                            // (of either end) and function code; the group
+                            // maps are not used
+} DNP3_ShedPolicy;
+
+void dnp3_shed_init(DNP3_ShedPolicy *p);
+
+// optional dissector settings; fields left 0 select the defaults
+typedef struct {
+    size_t max_contexts;    // max. number of (src,dst) pairs tracked [1024]
+    bool skip_raw_frames;   // don't retain raw frames for app_fragment;
+                            // it is then called with buf=NULL, len=0
+    bool stats_timing;      // collect the timing histograms in DNP3_Stats
+    bool ignore_dir;        // parse fragments as requests or responses
+                            // regardless of the DIR bit of their frames
+    size_t async_queue;     // deliver app-layer results asynchronously
+                            // through a queue of this many entries [0 = off]
+    size_t input_buffer;    // size of the input buffer in bytes [4619];
+                            // larger buffers take more input per feed()
+    size_t max_series;      // max. size of a reassembled segment series,
+                            // i.e. an app-layer fragment, in bytes [4096]
+    bool lazy_objects;      // decode objects only on first use where
+                            // possible, see dnp3_app_decode_headers()
+    const DNP3_Filter *filter;  // drop uninteresting traffic early (copied)
+    size_t request_cache;   // entries in a cache of parsed small requests
+                            // (e.g. polls), keyed on their bytes minus the
+                            // sequence number [0 = off]
+    bool point_db;          // track the points of every outstation and
+                            // report changes through point_change
+    DNP3_KeyCache *keys;    // verify aggressive-mode MACs with these session
+                            // keys, see dnp3_keycache_new (not copied; may
+                            // be shared between dissectors)
+    size_t dedup_window;    // drop user data frames and fragments identical
+                            // to one of the last n of their context, e.g.
+                            // from redundant paths [0 = off, max. 15]
+    const DNP3_ShedPolicy *shed;    // reduce app-layer work under overload
+                                    // (copied) [NULL = off]
+    HAllocator *memory;     // a budget from h_membudget() (may be shared)
+                            // that the allocator roles left NULL and the
+                            // parse region draw from. when it runs low,
+                            // state is given up, see DNP3_BACKPRESSURE
+                            // [NULL = off]
+} DNP3_DissectorConfig;
+
+// asynchronous mode (async_queue > 0): app_fragment and app_invalid are
+// called, in order, from a thread owned by the dissector, so a slow consumer
+// does not hold up parsing. every fragment is a copy in mm_results owned by
+// the callback, which must pass it to dnp3_fragment_release() eventually
+// (on any thread). app_fragment is called with buf=NULL, len=0, and
+// app_object_block is not used. the other callbacks stay on the feeding
+// thread. when the queue is full, feeding waits. finish() delivers all
+// queued results before it returns.
+
+// live ingest (dnp3_ingest_new): receives DNP3 over TCP and UDP from any
+// number of sockets, with one StreamProcessor per flow, i.e. per TCP
+// connection or per UDP peer (remote address) on a socket.
+typedef struct DNP3_Ingest_ DNP3_Ingest;
+
+struct sockaddr;
+
+typedef struct {
+    int fd;                         // the socket (TCP: the connection)
+    bool udp;
+    const struct sockaddr *peer;    // remote address
+    size_t peerlen;
+} DNP3_IngestFlow;
+
+typedef struct {
+    // a dissector for a new flow, or NULL to ignore the flow. it is
+    // finished when the connection is closed (or fails to feed), or the
+    // UDP peer has been idle; then close, if not NULL, is called.
+    StreamProcessor *(*open)(void *env, const DNP3_IngestFlow *flow);
+    void (*close)(void *env, const DNP3_IngestFlow *flow);
+
+    size_t batch;           // datagrams per recvmmsg call [64]
+    size_t max_flows;       // further flows are refused [4096]
+    unsigned idle_timeout;  // seconds until a silent UDP peer is closed [60]
+    int rcvbuf;             // SO_RCVBUF of the UDP sockets opened by
+                            // dnp3_ingest_listen [0 = system default]
+} DNP3_IngestConfig;
+
+typedef struct {
+    uint64_t syscalls;      // receive calls (epoll_wait, recvmmsg, read,
+                            // accept)
+    uint64_t datagrams;
+    uint64_t bytes;         // TCP and UDP payload received
+    uint64_t flows;         // opened
+    uint64_t flows_refused; // max_flows reached or open returned NULL
+    uint64_t feed_errors;   // flows closed because feeding failed
+    uint64_t backpressure;  // feeds that returned DNP3_BACKPRESSURE; TCP
+                            // flows are not read further in that round
+    uint64_t kernel_drops;  // datagrams the kernel dropped for want of
+                            // socket buffer space (SO_RXQ_OVFL, Linux)
+    uint64_t recv_errors;   // receive calls that failed (not EAGAIN or
+                            // EINTR); TCP connections are closed, other
+                            // sockets retried in the next round
+} DNP3_IngestStats;
+
 
 /// EXPORTED FUNCTIONS ///
 
+// options for the parsers, fixed at init time
+typedef struct {
+    bool columnar;      // keep objects in DNP3_Columns where possible
+} DNP3_ParserConfig;
+
 // global one-time init
 void dnp3_init(void);
+void dnp3_init_with(const DNP3_ParserConfig *config);   // NULL = defaults
 void dnp3_p_init(void);     // initialize just the parsers  XXX needed?
-// XXX void dnp3_free(void);
+
+// release the global parsers, including those of any earlier dnp3_init().
+// the library can be initialized again afterwards.
+void dnp3_free(void);
+
+// bytes currently held by the global parsers
+size_t dnp3_table_size(void);
 
 // create a protocol dissector bound to the given callbacks
+// NULL mm_parse selects a region allocator (see h_region) owned by the
+// dissector and reset after every frame; other NULL allocators select the
+// system allocator, a NULL config the defaults.
 StreamProcessor *dnp3_dissector(DNP3_Callbacks cb, void *env);
 StreamProcessor *dnp3_dissector__m(HAllocator *mm_input,
                                    HAllocator *mm_parse,
                                    HAllocator *mm_context,
                                    HAllocator *mm_results,
+                                   const DNP3_DissectorConfig *config,
                                    DNP3_Callbacks cb, void *env);
 
+// create a group of nthreads dissectors, each running on its own thread.
+// the feeding thread only splits the input into frames and distributes them
+// by (source,destination), so each connection is processed in order by the
+// same worker. callbacks are called from the worker threads, concurrently
+// and with the same env, so they must be thread-safe.
+// finish() processes all queued frames before it returns.
+// a single StreamProcessor (including a group) must only be fed from one
+// thread at a time.
+StreamProcessor *dnp3_dissector_group_new(unsigned nthreads,
+                                          DNP3_Callbacks cb, void *env);
+
+// get a snapshot of the statistics of a dissector (or group, summed over
+// all workers). the counters are only compiled in with DNP3_STATS.
+// returns 0 on success, -1 if not available.
+int dnp3_dissector_stats(StreamProcessor *p, DNP3_Stats *out);
+
+// save the connection state of a dissector to buf: every context with its
+// partial segment series, duplicate detection (see dedup_window) and place
+// in the LRU order. like snprintf, writes at most cap bytes and returns the
+// full size, which was truncated if that exceeds cap. a standby dissector
+// with the same configuration can take over with dnp3_dissector_restore().
+// not included: input not yet processed, the request cache, point database
+// and load shedding state. must be called between feeds, from the feeding
+// thread. returns -1 if not supported (e.g. dissector groups).
+int dnp3_dissector_checkpoint(StreamProcessor *p, uint8_t *buf, size_t cap);
+
+// replace the contexts of p by those saved in a checkpoint. if p holds
+// fewer contexts (max_contexts), the least recently used are left out.
+// returns 0 on success, -1 if not supported or if the checkpoint is
+// corrupt (checksummed) or does not fit p (max_series, skip_raw_frames);
+// p is left without contexts then.
+int dnp3_dissector_restore(StreamProcessor *p, const uint8_t *buf, size_t len);
+
+// live ingest, see DNP3_IngestConfig. a NULL config selects the defaults
+// (open is required). the ingest is not thread-safe; all calls, and so all
+// callbacks, happen on the thread calling dnp3_ingest_run(). Linux only,
+// elsewhere dnp3_ingest_new() fails with ENOSYS.
+DNP3_Ingest *dnp3_ingest_new(const DNP3_IngestConfig *config, void *env);
+
+// add a bound UDP socket, a listening TCP socket, or a connected TCP socket
+// (a flow of its own). the ingest takes over fd and closes it when freed.
+// returns 0 on success, -1 on error (errno set; fd is closed).
+int dnp3_ingest_add(DNP3_Ingest *ing, int fd);
+
+// listen on TCP and UDP on every address of host (NULL = any) and the given
+// port (e.g. "20000"). returns the number of sockets added, -1 if none.
+int dnp3_ingest_listen(DNP3_Ingest *ing, const char *host, const char *port);
+
+// wait up to timeout_ms milliseconds (-1 = forever) for input and feed all
+// that is ready. returns the number of bytes received, -1 on error.
+int dnp3_ingest_run(DNP3_Ingest *ing, int timeout_ms);
+
+void dnp3_ingest_stats(const DNP3_Ingest *ing, DNP3_IngestStats *out);
+
+// finish all flows and close all sockets
+void dnp3_ingest_free(DNP3_Ingest *ing);
+
+// result ownership: fragments passed to app_fragment() are only valid
+// during the call. to keep one, call dnp3_fragment_retain() on it; this
+// copies it into the dissector's mm_results, or in the case of a copy just
+// counts a reference. every retain (and copy) must be matched by a release,
+// which frees the copy with the last reference. retain and release are
+// thread-safe for copies.
+// NB: retain only works on fragments from app_fragment() and on copies.
+DNP3_Fragment *dnp3_fragment_retain(const DNP3_Fragment *frag);
+void dnp3_fragment_release(DNP3_Fragment *frag);
+
+// copy a fragment with everything it points to into a single allocation
+// from mm (NULL = system allocator), with one reference. returns NULL if
+// out of memory.
+DNP3_Fragment *dnp3_fragment_copy(HAllocator *mm, const DNP3_Fragment *frag);
+
+
+// point database: the last known flags and value of every point by
+// (outstation, point type, index). the point types are binary inputs,
+// double-bit inputs, binary outputs, counters, frozen counters, analog
+// inputs, frozen analog inputs and analog output status; each includes its
+// event group. indexes up to 65535 are tracked.
+// NULL mm selects the system allocator.
+DNP3_PointDB *dnp3_pointdb_new(HAllocator *mm);
+void dnp3_pointdb_free(DNP3_PointDB *db);
+
+// apply the objects of a response fragment from the given outstation and call
+// f (if not NULL) for every point that is new or differs in one of the
+// fields it carries, and for every event object. returns the number of
+// such points. other fragments are ignored.
+size_t dnp3_pointdb_apply(DNP3_PointDB *db, uint16_t outstation,
+                          const DNP3_Fragment *frag,
+                          void (*f)(void *env, const DNP3_PointChange *c),
+                          void *env);
+
+// session key cache: the keys to verify aggressive-mode MACs (g120v9) with,
+// by association and direction (src,dst), along with the last challenge
+// (g120v1) seen the other way. a dissector given the cache
+// (DNP3_DissectorConfig.keys) sets DNP3_AuthData.status on every
+// aggressive-mode fragment before it is delivered. the cache can be shared
+// by any number of dissectors and updated at any time, from any thread.
+// NULL mm selects the system allocator.
+DNP3_KeyCache *dnp3_keycache_new(HAllocator *mm);
+void dnp3_keycache_free(DNP3_KeyCache *kc);
+
+// set the session key for messages from src to dst (the control direction
+// key for master to outstation, the monitoring direction key for the
+// reverse); NULL key removes it. returns false if the key does not suit the
+// algorithm or out of memory.
+bool dnp3_keycache_set(DNP3_KeyCache *kc, uint16_t src, uint16_t dst,
+                       DNP3_MacAlgorithm alg, const uint8_t *key, size_t len);
+
+// what a dissector does per fragment (t, len) from src to dst: remember a
+// challenge, verify an aggressive-mode MAC. verify returns
+// DNP3_AUTH_UNCHECKED without a key, or without a challenge for the
+// association. challenge returns false if t is a challenge for a keyed
+// association but too long (over 256 octets) to keep, or asks for a MAC
+// algorithm other than HMAC-SHA-256 (e.g. AES-GMAC); until the next one,
+// verify returns DNP3_AUTH_UNCHECKED.
+bool dnp3_keycache_challenge(DNP3_KeyCache *kc, uint16_t src, uint16_t dst,
+                             const uint8_t *t, size_t len);
+DNP3_AuthStatus dnp3_keycache_verify(DNP3_KeyCache *kc,
+                                     uint16_t src, uint16_t dst,
+                                     const DNP3_AuthData *auth,
+                                     const uint8_t *t, size_t len);
+
+// measurement archive: a file of decoded objects, stored column-wise per
+// (outstation, group, variation) in compressed chunks (see archive.c).
+// only types that can be stored in DNP3_Columns are archived, i.e. binary,
+// counter and analog inputs and their events, and binary output status.
+// NULL mm selects the system allocator. functions returning int or
+// pointers return -1 or NULL on error, with errno set.
+DNP3_ArchiveWriter *dnp3_archive_create(const char *path, HAllocator *mm);
+
+// add the objects of a block from the given outstation, received at time t
+// (used for objects without a timestamp of their own). returns the number
+// of objects archived, 0 for blocks of other types. after an error, the
+// writer only accepts dnp3_archive_finish().
+int dnp3_archive_add(DNP3_ArchiveWriter *w, uint16_t outstation,
+                     DNP3_Time t, const DNP3_ObjectBlock *ob);
+
+// write all buffered objects out, e.g. periodically. an archive that is not
+// finished can still be read up to the last flush.
+int dnp3_archive_flush(DNP3_ArchiveWriter *w);
+
+// flush, write the index, close the file and free w
+int dnp3_archive_finish(DNP3_ArchiveWriter *w);
+
+// open an archive for reading; the file is mapped into memory
+DNP3_Archive *dnp3_archive_open(const char *path, HAllocator *mm);
+void dnp3_archive_free(DNP3_Archive *a);
+
+size_t dnp3_archive_size(const DNP3_Archive *a);    // number of samples
+
+// pass every sample with a time in [from,to] to cb, in file order (by
+// series, in chunks of up to 4096, each in the order added). f (NULL =
+// all) selects by outstation (as DNP3_Filter.addr) and group; function
+// codes are not used. chunks outside the time range or selection are
+// skipped without reading them. returns the number of samples, -1 if the
+// archive is corrupt.
+int64_t dnp3_archive_query(const DNP3_Archive *a, DNP3_Time from, DNP3_Time to,
+                           const DNP3_Filter *f,
+                           void (*cb)(void *env, const DNP3_ArchiveRecord *r),
+                           void *env);
+
+// look up a point by static or event group. flags is the flags octet as on
+// the wire; value is 0 for binaries. returns false if the point is unknown.
+bool dnp3_pointdb_get(const DNP3_PointDB *db, uint16_t outstation,
+                      DNP3_Group g, uint32_t index,
+                      uint8_t *flags, double *value);
+
 
 // check a raw link-layer frame as parsed by dnp3_p_link_frame for validity
 // any frame for which this function is false should be ignored!
@@ -613,7 +1170,87 @@ bool dnp3_link_prm(const DNP3_Frame *frame) { return (frame->func>>4); }
 // return the correct value for the FCV flag in a (primary) frame
 bool dnp3_link_fcv(const DNP3_Frame *frame);
 
-uint16_t dnp3_crc(uint8_t *bytes, size_t len);
+// decode a raw link-layer frame without going through the Hammer grammar.
+// yields the same DNP3_Frame as dnp3_p_link_frame. the payload is written to
+// payload_out which must hold at least DNP3_LINK_MAXPAYLOAD bytes;
+// frame->payload points there or is NULL (see above).
+// returns the number of bytes consumed, 0 if more input is needed, or -1 if
+// buf does not start with a valid frame header (skip a byte and retry).
+int dnp3_link_decode_frame(const uint8_t *buf, size_t len,
+                           DNP3_Frame *frame, uint8_t *payload_out);
+
+// split a transport segment (frame payload) into header and data without
+// going through dnp3_p_transport_segment. seg->payload points into buf.
+// returns false if len is 0.
+bool dnp3_transport_decode_segment(const uint8_t *buf, size_t len,
+                                   DNP3_Segment *seg);
+
+// decode an application-layer fragment without going through the Hammer
+// grammar. only handles responses made up entirely of blocks of common
+// fixed-size objects (binary inputs, counters, analog inputs and their
+// events, packed binary in- and outputs). yields the same result as
+// h_parse__m(mm, dnp3_p_app_fragment, ...) or NULL if the fragment is not of
+// that kind. use the grammar then.
+// NULL mm selects the system allocator. like h_parse__m, the process aborts
+// if mm refuses an allocation; pass a region with a spare (h_region_spare)
+// to run from a budget.
+HParseResult *dnp3_app_decode_fragment(HAllocator *mm, const uint8_t *input,
+                                       size_t len);
+
+// like dnp3_app_decode_fragment, but only check the object data and leave
+// the objects (and indexes) of every block undecoded until they are first
+// used. this is done by dnp3_oblock_objects() and implicitly by all other
+// functions taking a block, so the result is the same, but the input must
+// remain valid and unchanged until then. NB: the first use writes to the
+// block and is not thread-safe.
+HParseResult *dnp3_app_decode_headers(HAllocator *mm, const uint8_t *input,
+                                      size_t len);
+
+// like dnp3_app_decode_fragment, but hand the object blocks to f one at a
+// time instead of collecting them. every block is allocated from mm and
+// freed again when f returns. frag receives the application header; its
+// odata stays NULL. returns false without calling f if the fragment is not
+// of the kind handled by dnp3_app_decode_fragment.
+bool dnp3_app_decode_blocks(HAllocator *mm, const uint8_t *input, size_t len,
+                            DNP3_Fragment *frag,
+                            void (*f)(void *env, const DNP3_Fragment *frag,
+                                      const DNP3_ObjectBlock *ob),
+                            void *env);
+
+// generate DNP3 output. like snprintf, these write at most cap bytes to buf
+// and return the full size of the result, which was truncated if that
+// exceeds cap. they return -1 for input that cannot be encoded (e.g.
+// authentication data or object types unknown to the encoder).
+int dnp3_encode_fragment(uint8_t *buf, size_t cap, const DNP3_Fragment *frag);
+int dnp3_encode_segment(uint8_t *buf, size_t cap, const DNP3_Segment *seg);
+int dnp3_encode_frame(uint8_t *buf, size_t cap, const DNP3_Frame *frame);
+
+// split payload (usually an encoded fragment) into transport segments and
+// wrap each in a link frame with the header fields of link. the first segment
+// gets sequence number *seq, which is advanced past the last one.
+int dnp3_encode_frames(uint8_t *buf, size_t cap, const DNP3_Frame *link,
+                       uint8_t *seq, const uint8_t *payload, size_t len);
+
+uint16_t dnp3_crc(const uint8_t *bytes, size_t len);
+
+// check the CRCs on the n bytes of user data in a frame, i.e. on the data
+// blocks following the header (16 bytes + CRC each, the last one shorter)
+bool dnp3_crc_blocks_valid(const uint8_t *blocks, size_t n);
+
+// decode the objects of a block from dnp3_app_decode_headers() if that has
+// not happened yet. returns ob->objects (NULL if kept in columns).
+DNP3_Object *dnp3_oblock_objects(DNP3_ObjectBlock *ob);
+
+// access the objects of a block independent of their representation.
+// the result for a field that the object type does not have is undefined.
+DNP3_Object dnp3_oblock_object(const DNP3_ObjectBlock *ob, size_t i);
+unsigned    dnp3_oblock_state(const DNP3_ObjectBlock *ob, size_t i);
+    // bit of packed binaries, DNP3_DblBit of packed double-bits, flags.state
+DNP3_Flags  dnp3_oblock_flags(const DNP3_ObjectBlock *ob, size_t i);
+int32_t     dnp3_oblock_int(const DNP3_ObjectBlock *ob, size_t i);
+uint32_t    dnp3_oblock_uint(const DNP3_ObjectBlock *ob, size_t i);
+double      dnp3_oblock_float(const DNP3_ObjectBlock *ob, size_t i);
+DNP3_Time   dnp3_oblock_time(const DNP3_ObjectBlock *ob, size_t i);
 
 // formatting for human-readable output
 // caller must free result on all of the following!
@@ -630,10 +1267,122 @@ char *dnp3_format_fragment_header(const DNP3_Fragment *frag);
 char *dnp3_format_segment_header(const DNP3_Segment *seg);
 char *dnp3_format_frame_header(const DNP3_Frame *frame);
 
+// allocation-free variants of the above.
+// _into writes at most cap bytes (including the terminating null) to buf and
+// returns the length of the full result, like snprintf; the output was
+// truncated if that is >= cap.
+// _to passes the result in pieces to the given writer, which may return a
+// negative value to signal an error, and returns the total length.
+// both return -1 on error.
+typedef int (*DNP3_FormatWriter)(void *env, const char *s, size_t len);
+
+int dnp3_format_object_into(char *buf, size_t cap,
+                            DNP3_Group g, DNP3_Variation v, const DNP3_Object o);
+int dnp3_format_oblock_into(char *buf, size_t cap, const DNP3_ObjectBlock *ob);
+int dnp3_format_fragment_into(char *buf, size_t cap, const DNP3_Fragment *frag);
+int dnp3_format_segment_into(char *buf, size_t cap, const DNP3_Segment *seg);
+int dnp3_format_frame_into(char *buf, size_t cap, const DNP3_Frame *frame);
+int dnp3_format_fragment_ohdrs_into(char *buf, size_t cap,
+                                    const DNP3_Fragment *frag);
+int dnp3_format_fragment_header_into(char *buf, size_t cap,
+                                     const DNP3_Fragment *frag);
+int dnp3_format_segment_header_into(char *buf, size_t cap,
+                                    const DNP3_Segment *seg);
+int dnp3_format_frame_header_into(char *buf, size_t cap,
+                                  const DNP3_Frame *frame);
+
+int dnp3_format_object_to(DNP3_FormatWriter write, void *env,
+                          DNP3_Group g, DNP3_Variation v, const DNP3_Object o);
+int dnp3_format_oblock_to(DNP3_FormatWriter write, void *env,
+                          const DNP3_ObjectBlock *ob);
+int dnp3_format_fragment_to(DNP3_FormatWriter write, void *env,
+                            const DNP3_Fragment *frag);
+int dnp3_format_segment_to(DNP3_FormatWriter write, void *env,
+                           const DNP3_Segment *seg);
+int dnp3_format_frame_to(DNP3_FormatWriter write, void *env,
+                         const DNP3_Frame *frame);
+int dnp3_format_fragment_ohdrs_to(DNP3_FormatWriter write, void *env,
+                                  const DNP3_Fragment *frag);
+int dnp3_format_fragment_header_to(DNP3_FormatWriter write, void *env,
+                                   const DNP3_Fragment *frag);
+int dnp3_format_segment_header_to(DNP3_FormatWriter write, void *env,
+                                  const DNP3_Segment *seg);
+int dnp3_format_frame_header_to(DNP3_FormatWriter write, void *env,
+                                const DNP3_Frame *frame);
+
+// structured export for machine consumption, as JSON or CBOR (RFC 8949).
+// fragments map to {"seq", "fir", "fin", "con", "uns", "fc", "iin"
+// (responses only, first octet in the low byte), "blocks", "auth" (if
+// present)}; blocks to {"group", "variation", "qc", "start" (ranges only),
+// "count", "objects"}; objects to {"index", "state", "flags" (as on the
+// wire), "value", "time", ...} as far as the type has those fields.
+// output goes to the given writer; returns the total length or -1 on error.
+typedef enum {
+    DNP3_EXPORT_JSON,
+    DNP3_EXPORT_CBOR
+} DNP3_ExportFormat;
+
+int dnp3_export_object(DNP3_ExportFormat fmt, DNP3_FormatWriter write,
+                       void *env, DNP3_Group g, DNP3_Variation v,
+                       const DNP3_Object o);
+int dnp3_export_oblock(DNP3_ExportFormat fmt, DNP3_FormatWriter write,
+                       void *env, const DNP3_ObjectBlock *ob);
+int dnp3_export_fragment(DNP3_ExportFormat fmt, DNP3_FormatWriter write,
+                         void *env, const DNP3_Fragment *frag);
+
 
 // make an allocator that draws from the given memory area  XXX move to hammer
 HAllocator *h_sloballoc(void *mem, size_t size);
 
+// make a region allocator that carves allocations out of chunks of (at
+// least) chunksize bytes taken from mm. free() only returns the most recent
+// allocation; h_region_reset() releases everything at once and keeps the
+// chunks for reuse. NULL mm selects the system allocator, 0 chunksize 64 KB.
+// XXX move to hammer
+HAllocator *h_region(HAllocator *mm, size_t chunksize);
+void h_region_reset(HAllocator *region);    // invalidates all allocations
+void h_region_free(HAllocator *region);     // returns all chunks to mm
+
+// take the chunks that mm refuses from spare instead (NULL = off). they are
+// returned to it on the next reset, so a parse can go on while mm is a full
+// budget (see h_membudget) rather than run hammer out of memory, which
+// aborts.
+void h_region_spare(HAllocator *region, HAllocator *spare);
+
+// make a thread-safe allocator where every thread allocates from its own
+// slabs of slabsize bytes, taken from mm. blocks may be freed on any thread;
+// frees from other threads are passed back to the owner through a
+// lock-free list, so it is suitable as mm_results for a dissector group.
+// heaps of exited threads are adopted by new ones. mm must be thread-safe;
+// NULL selects the system allocator, 0 slabsize 256 KB.
+// XXX move to hammer
+HAllocator *h_tlalloc(HAllocator *mm, size_t slabsize);
+void h_tlalloc_free(HAllocator *tlalloc);   // no other thread may use it
+
+// make a profiling allocator that passes all calls on to mm and counts them
+// by the dissector stage active on the calling thread (see DNP3_Stage). it
+// is thread-safe if mm is. give one to each role of dnp3_dissector__m (or
+// the same to all) to see where the allocations come from. NULL selects
+// the system allocator.
+HAllocator *h_profiler(HAllocator *mm);
+void h_profiler_get(HAllocator *prof, DNP3_AllocProfile *out);
+void h_profiler_reset(HAllocator *prof);    // zero all counts but live
+void h_profiler_free(HAllocator *prof);     // all blocks must be freed
+
+// write a profile as a table, one line per stage
+int h_profiler_report(DNP3_FormatWriter write, void *env,
+                      const DNP3_AllocProfile *p);
+
+// make an allocator that passes all calls on to mm but refuses (returns
+// NULL for) any that would take the memory it has handed out beyond limit
+// bytes, counting a 16-byte header per block. it is thread-safe if mm is,
+// so one budget can serve all roles of many dissectors; give it to them as
+// DNP3_DissectorConfig.memory. NULL selects the system allocator.
+HAllocator *h_membudget(HAllocator *mm, size_t limit);
+size_t h_membudget_used(HAllocator *budget);        // bytes, incl. headers
+uint64_t h_membudget_refused(HAllocator *budget);   // allocations refused
+void h_membudget_free(HAllocator *budget);  // all blocks must be freed
+
 #ifdef __cplusplus
 }
 #endif
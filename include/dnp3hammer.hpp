@@ -0,0 +1,499 @@
+// C++ interface (header-only, C++11)
+//
+// Dissector<H> owns a StreamProcessor whose callbacks go straight to the
+// member functions of a handler H, so the handler code is inlined into the
+// trampolines instead of sitting behind another pointer. only the callbacks
+// that H actually has are set, see Dissector below.
+//
+// Fragment, Block and Span are views over the C results: no copies, valid
+// only as long as the result is (i.e. during the callback). Owned keeps a
+// fragment around by reference counting (dnp3_fragment_retain).
+
+#ifndef DNP3_HPP_SEEN
+#define DNP3_HPP_SEEN
+
+#include <dnp3hammer.h>
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace dnp3 {
+
+
+/// VIEWS ///
+
+// n contiguous elements (before std::span)
+template<class T>
+class Span {
+public:
+    typedef T value_type;
+    typedef T *iterator;
+
+    Span() : p_(nullptr), n_(0) {}
+    Span(T *p, size_t n) : p_(p), n_(p ? n : 0) {}
+
+    T *begin() const { return p_; }
+    T *end() const { return p_ + n_; }
+    T *data() const { return p_; }
+    size_t size() const { return n_; }
+    bool empty() const { return n_ == 0; }
+    T &operator[](size_t i) const { return p_[i]; }
+
+private:
+    T *p_;
+    size_t n_;
+};
+
+// C type of each DNP3_Columns value type
+template<class T> struct ColType;
+template<> struct ColType<int32_t>  { static const DNP3_ColumnType value = DNP3_COL_INT32; };
+template<> struct ColType<uint32_t> { static const DNP3_ColumnType value = DNP3_COL_UINT32; };
+template<> struct ColType<float>    { static const DNP3_ColumnType value = DNP3_COL_FLOAT; };
+template<> struct ColType<double>   { static const DNP3_ColumnType value = DNP3_COL_DOUBLE; };
+
+class Block;
+
+namespace detail {
+
+// ob with its objects decoded if it is lazy (DNP3_DissectorConfig.
+// lazy_objects); indexes and columns are not filled in before that
+inline const DNP3_ObjectBlock *decoded(const DNP3_ObjectBlock *ob)
+{
+    if(ob->lazy)
+        dnp3_oblock_objects(const_cast<DNP3_ObjectBlock *>(ob));
+    return ob;
+}
+
+} // namespace detail
+
+// the object at position i of a block, in either representation
+class ObjectRef {
+public:
+    ObjectRef(const DNP3_ObjectBlock *ob, size_t i) : ob_(ob), i_(i) {}
+
+    size_t position() const { return i_; }
+    uint32_t index() const {
+        const DNP3_ObjectBlock *ob = detail::decoded(ob_);
+        return ob->indexes ? ob->indexes[i_] : ob->range_base + i_;
+    }
+
+    DNP3_Object object() const { return dnp3_oblock_object(ob_, i_); }
+    unsigned    state() const { return dnp3_oblock_state(ob_, i_); }
+    DNP3_Flags  flags() const { return dnp3_oblock_flags(ob_, i_); }
+    DNP3_Time   time() const { return dnp3_oblock_time(ob_, i_); }
+
+    // the value field, read from the columns directly if they hold a T
+    template<class T> T value() const;
+
+private:
+    const DNP3_ObjectBlock *ob_;
+    size_t i_;
+};
+
+template<class T> inline T ObjectRef::value() const
+{
+    const DNP3_Columns *c = detail::decoded(ob_)->columns;
+
+    if(c && c->values && c->valuetype == ColType<T>::value)
+        return static_cast<const T *>(c->values)[i_];
+    if(std::is_floating_point<T>::value)
+        return static_cast<T>(dnp3_oblock_float(ob_, i_));
+    if(std::is_signed<T>::value)
+        return static_cast<T>(dnp3_oblock_int(ob_, i_));
+    return static_cast<T>(dnp3_oblock_uint(ob_, i_));
+}
+
+// iterator over the objects of a block; yields ObjectRef
+class ObjectIterator {
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef ObjectRef value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const ObjectRef *pointer;
+    typedef ObjectRef reference;
+
+    ObjectIterator(const DNP3_ObjectBlock *ob, size_t i) : ob_(ob), i_(i) {}
+
+    ObjectRef operator*() const { return ObjectRef(ob_, i_); }
+    ObjectRef operator[](difference_type k) const
+        { return ObjectRef(ob_, i_ + k); }
+    ObjectIterator &operator++() { i_++; return *this; }
+    ObjectIterator operator++(int) { ObjectIterator t = *this; i_++; return t; }
+    ObjectIterator &operator--() { i_--; return *this; }
+    ObjectIterator &operator+=(difference_type k) { i_ += k; return *this; }
+    ObjectIterator operator+(difference_type k) const
+        { return ObjectIterator(ob_, i_ + k); }
+    difference_type operator-(const ObjectIterator &o) const
+        { return (difference_type)i_ - (difference_type)o.i_; }
+    bool operator==(const ObjectIterator &o) const { return i_ == o.i_; }
+    bool operator!=(const ObjectIterator &o) const { return i_ != o.i_; }
+    bool operator<(const ObjectIterator &o) const { return i_ < o.i_; }
+
+private:
+    const DNP3_ObjectBlock *ob_;
+    size_t i_;
+};
+
+// (index, value) of every object of a block, see Block::values()
+template<class T>
+class Values {
+public:
+    struct Point {
+        uint32_t index;
+        T value;
+    };
+
+    class iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Point value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Point *pointer;
+        typedef Point reference;
+
+        iterator(const DNP3_ObjectBlock *ob, const T *col, size_t i)
+            : ob_(ob), col_(col), i_(i) {}
+
+        Point operator*() const {
+            ObjectRef o(ob_, i_);
+            Point pt = {o.index(), col_ ? col_[i_] : o.value<T>()};
+            return pt;
+        }
+        iterator &operator++() { i_++; return *this; }
+        iterator operator++(int) { iterator t = *this; i_++; return t; }
+        bool operator==(const iterator &o) const { return i_ == o.i_; }
+        bool operator!=(const iterator &o) const { return i_ != o.i_; }
+
+    private:
+        const DNP3_ObjectBlock *ob_;
+        const T *col_;          // the value column if it holds T
+        size_t i_;
+    };
+
+    explicit Values(const DNP3_ObjectBlock *ob) : ob_(ob), col_(nullptr) {
+        const DNP3_Columns *c = detail::decoded(ob)->columns;
+        if(c && c->values && c->valuetype == ColType<T>::value)
+            col_ = static_cast<const T *>(c->values);
+    }
+
+    iterator begin() const { return iterator(ob_, col_, 0); }
+    iterator end() const { return iterator(ob_, col_, ob_->count); }
+    size_t size() const { return ob_->count; }
+
+private:
+    const DNP3_ObjectBlock *ob_;
+    const T *col_;
+};
+
+// an object block
+class Block {
+public:
+    explicit Block(const DNP3_ObjectBlock *ob) : ob_(ob) {}
+
+    const DNP3_ObjectBlock *get() const { return ob_; }
+    const DNP3_ObjectBlock *operator->() const { return ob_; }
+
+    DNP3_Group group() const { return ob_->group; }
+    DNP3_Variation variation() const { return ob_->variation; }
+    bool is(DNP3_Group g, DNP3_Variation v) const
+        { return ob_->group == g && ob_->variation == v; }
+
+    size_t size() const { return ob_->count; }
+    bool empty() const { return ob_->count == 0; }
+
+    // NULL-safe views of the arrays; objects() is empty if the block is
+    // kept in columns. all of these decode a lazy block first.
+    Span<const uint32_t> indexes() const {
+        const uint32_t *x = detail::decoded(ob_)->indexes;
+        return Span<const uint32_t>(x, ob_->count);
+    }
+    Span<const DNP3_Object> objects() const {
+        DNP3_Object *o = dnp3_oblock_objects(const_cast<DNP3_ObjectBlock *>(ob_));
+        return Span<const DNP3_Object>(o, ob_->count);
+    }
+    const DNP3_Columns *columns() const
+        { return detail::decoded(ob_)->columns; }
+
+    ObjectRef operator[](size_t i) const { return ObjectRef(ob_, i); }
+    ObjectIterator begin() const { return ObjectIterator(ob_, 0); }
+    ObjectIterator end() const { return ObjectIterator(ob_, ob_->count); }
+
+    // the value fields as T, straight from the columns where they match
+    template<class T> Values<T> values() const { return Values<T>(ob_); }
+
+private:
+    const DNP3_ObjectBlock *ob_;
+};
+
+// iterator over the blocks of a fragment; yields Block
+class BlockIterator {
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef Block value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Block *pointer;
+    typedef Block reference;
+
+    explicit BlockIterator(DNP3_ObjectBlock *const *p) : p_(p) {}
+
+    Block operator*() const { return Block(*p_); }
+    Block operator[](difference_type k) const { return Block(p_[k]); }
+    BlockIterator &operator++() { p_++; return *this; }
+    BlockIterator operator++(int) { BlockIterator t = *this; p_++; return t; }
+    BlockIterator &operator--() { p_--; return *this; }
+    BlockIterator &operator+=(difference_type k) { p_ += k; return *this; }
+    BlockIterator operator+(difference_type k) const
+        { return BlockIterator(p_ + k); }
+    difference_type operator-(const BlockIterator &o) const
+        { return p_ - o.p_; }
+    bool operator==(const BlockIterator &o) const { return p_ == o.p_; }
+    bool operator!=(const BlockIterator &o) const { return p_ != o.p_; }
+    bool operator<(const BlockIterator &o) const { return p_ < o.p_; }
+
+private:
+    DNP3_ObjectBlock *const *p_;
+};
+
+// an application-layer fragment
+class Fragment {
+public:
+    explicit Fragment(const DNP3_Fragment *f) : f_(f) {}
+
+    const DNP3_Fragment *get() const { return f_; }
+    const DNP3_Fragment *operator->() const { return f_; }
+
+    DNP3_FunctionCode fc() const { return f_->fc; }
+    const DNP3_AppControl &ac() const { return f_->ac; }
+    const DNP3_IntIndications &iin() const { return f_->iin; }
+    bool shed() const { return f_->shed; }
+
+    size_t size() const { return f_->odata ? f_->nblocks : 0; }
+    bool empty() const { return size() == 0; }
+    Block operator[](size_t i) const { return Block(f_->odata[i]); }
+    BlockIterator begin() const { return BlockIterator(f_->odata); }
+    BlockIterator end() const { return BlockIterator(f_->odata + size()); }
+
+private:
+    const DNP3_Fragment *f_;
+};
+
+// a fragment kept beyond its callback; move-only
+class Owned {
+public:
+    Owned() : f_(nullptr) {}
+    explicit Owned(Fragment f)
+        : f_(f.get() ? dnp3_fragment_retain(f.get()) : nullptr) {}
+    Owned(Owned &&o) noexcept : f_(o.f_) { o.f_ = nullptr; }
+    Owned &operator=(Owned &&o) noexcept {
+        std::swap(f_, o.f_);
+        return *this;
+    }
+    Owned(const Owned &) = delete;
+    Owned &operator=(const Owned &) = delete;
+    ~Owned() { dnp3_fragment_release(f_); }
+
+    explicit operator bool() const { return f_ != nullptr; }
+    Fragment operator*() const { return Fragment(f_); }
+    Fragment view() const { return Fragment(f_); }
+
+    // an extra reference (to the same copy)
+    Owned share() const {
+        Owned o;
+        o.f_ = f_ ? dnp3_fragment_retain(f_) : nullptr;
+        return o;
+    }
+
+private:
+    DNP3_Fragment *f_;
+};
+
+
+/// DISSECTOR ///
+
+// the handler H may have any of these members; the others stay unset:
+//
+//     void link_invalid(const DNP3_Frame &);
+//     int  link_frame(const DNP3_Frame &, Span<const uint8_t> raw);
+//     void link_skip(size_t n);
+//     void transport_segment(const DNP3_Segment &);
+//     void transport_discard(size_t n);
+//     void transport_payload(Span<const uint8_t>);
+//     void app_invalid(DNP3_ParseError);
+//     void app_fragment(Fragment, Span<const uint8_t> raw);
+//     void app_object_block(Fragment, Block);
+//     void point_change(const DNP3_PointChange &);
+//     void context_evict(uint16_t src, uint16_t dst, size_t n);
+//     void link_duplicate(Span<const uint8_t> raw);
+//     void transport_duplicate(Span<const uint8_t>);
+//     void log_error(const char *msg);
+//
+// cf. DNP3_Callbacks for their meaning.
+
+namespace detail {
+
+template<class H>
+struct Trampolines {
+    static H &h(void *env) { return *static_cast<H *>(env); }
+
+    static void link_invalid(void *env, const DNP3_Frame *f)
+        { h(env).link_invalid(*f); }
+    static int link_frame(void *env, const DNP3_Frame *f,
+                          const uint8_t *buf, size_t len)
+        { return h(env).link_frame(*f, Span<const uint8_t>(buf, len)); }
+    static void link_skip(void *env, size_t n)
+        { h(env).link_skip(n); }
+    static void transport_segment(void *env, const DNP3_Segment *s)
+        { h(env).transport_segment(*s); }
+    static void transport_discard(void *env, size_t n)
+        { h(env).transport_discard(n); }
+    static void transport_payload(void *env, const uint8_t *s, size_t n)
+        { h(env).transport_payload(Span<const uint8_t>(s, n)); }
+    static void app_invalid(void *env, DNP3_ParseError e)
+        { h(env).app_invalid(e); }
+    static void app_fragment(void *env, const DNP3_Fragment *f,
+                             const uint8_t *buf, size_t len)
+        { h(env).app_fragment(Fragment(f), Span<const uint8_t>(buf, len)); }
+    static void app_object_block(void *env, const DNP3_Fragment *f,
+                                 const DNP3_ObjectBlock *ob)
+        { h(env).app_object_block(Fragment(f), Block(ob)); }
+    static void point_change(void *env, const DNP3_PointChange *c)
+        { h(env).point_change(*c); }
+    static void context_evict(void *env, uint16_t src, uint16_t dst, size_t n)
+        { h(env).context_evict(src, dst, n); }
+    static void link_duplicate(void *env, const uint8_t *buf, size_t len)
+        { h(env).link_duplicate(Span<const uint8_t>(buf, len)); }
+    static void transport_duplicate(void *env, const uint8_t *s, size_t n)
+        { h(env).transport_duplicate(Span<const uint8_t>(s, n)); }
+    static void log_error(void *env, const char *fmt, ...) {
+        char msg[256];
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(msg, sizeof msg, fmt, args);
+        va_end(args);
+        h(env).log_error(static_cast<const char *>(msg));
+    }
+};
+
+// has_NAME<H>(0) is true_type if H has a member NAME taking these
+// arguments; set_NAME then installs the trampoline
+#define DNP3_HPP_CALLBACK(NAME, ...)                                        \
+    template<class H> auto has_##NAME(int)                                  \
+        -> decltype(std::declval<H &>().NAME(__VA_ARGS__), std::true_type()); \
+    template<class H> std::false_type has_##NAME(...);                      \
+    template<class H> void set_##NAME(DNP3_Callbacks &cb, std::true_type)   \
+        { cb.NAME = &Trampolines<H>::NAME; }                                \
+    template<class H> void set_##NAME(DNP3_Callbacks &, std::false_type) {}
+
+DNP3_HPP_CALLBACK(link_invalid, std::declval<const DNP3_Frame &>())
+DNP3_HPP_CALLBACK(link_frame, std::declval<const DNP3_Frame &>(),
+                  Span<const uint8_t>())
+DNP3_HPP_CALLBACK(link_skip, size_t())
+DNP3_HPP_CALLBACK(transport_segment, std::declval<const DNP3_Segment &>())
+DNP3_HPP_CALLBACK(transport_discard, size_t())
+DNP3_HPP_CALLBACK(transport_payload, Span<const uint8_t>())
+DNP3_HPP_CALLBACK(app_invalid, DNP3_ParseError())
+DNP3_HPP_CALLBACK(app_fragment, std::declval<Fragment>(), Span<const uint8_t>())
+DNP3_HPP_CALLBACK(app_object_block, std::declval<Fragment>(),
+                  std::declval<Block>())
+DNP3_HPP_CALLBACK(point_change, std::declval<const DNP3_PointChange &>())
+DNP3_HPP_CALLBACK(context_evict, uint16_t(), uint16_t(), size_t())
+DNP3_HPP_CALLBACK(link_duplicate, Span<const uint8_t>())
+DNP3_HPP_CALLBACK(transport_duplicate, Span<const uint8_t>())
+DNP3_HPP_CALLBACK(log_error, static_cast<const char *>(nullptr))
+
+#undef DNP3_HPP_CALLBACK
+
+#define DNP3_HPP_SET(NAME) set_##NAME<H>(cb, decltype(has_##NAME<H>(0))())
+
+template<class H>
+DNP3_Callbacks callbacks()
+{
+    DNP3_Callbacks cb = {};
+
+    DNP3_HPP_SET(link_invalid);
+    DNP3_HPP_SET(link_frame);
+    DNP3_HPP_SET(link_skip);
+    DNP3_HPP_SET(transport_segment);
+    DNP3_HPP_SET(transport_discard);
+    DNP3_HPP_SET(transport_payload);
+    DNP3_HPP_SET(app_invalid);
+    DNP3_HPP_SET(app_fragment);
+    DNP3_HPP_SET(app_object_block);
+    DNP3_HPP_SET(point_change);
+    DNP3_HPP_SET(context_evict);
+    DNP3_HPP_SET(link_duplicate);
+    DNP3_HPP_SET(transport_duplicate);
+    DNP3_HPP_SET(log_error);
+    return cb;
+}
+
+#undef DNP3_HPP_SET
+
+} // namespace detail
+
+// a dissector bound to a handler; move-only. the handler must outlive it.
+// check valid() after construction (out of memory).
+template<class H>
+class Dissector {
+public:
+    explicit Dissector(H &h, const DNP3_DissectorConfig *config = nullptr,
+                       HAllocator *mm_input = nullptr,
+                       HAllocator *mm_parse = nullptr,
+                       HAllocator *mm_context = nullptr,
+                       HAllocator *mm_results = nullptr)
+        : p_(dnp3_dissector__m(mm_input, mm_parse, mm_context, mm_results,
+                               config, detail::callbacks<H>(), &h)) {}
+    Dissector(Dissector &&o) noexcept : p_(o.p_) { o.p_ = nullptr; }
+    Dissector &operator=(Dissector &&o) noexcept {
+        std::swap(p_, o.p_);
+        return *this;
+    }
+    Dissector(const Dissector &) = delete;
+    Dissector &operator=(const Dissector &) = delete;
+    ~Dissector() { finish(); }
+
+    bool valid() const { return p_ != nullptr; }
+    StreamProcessor *get() const { return p_; }
+
+    // parse caller memory (feed_external); returns 0 or < 0 on error
+    int feed(const uint8_t *data, size_t n) {
+        return p_->feed_external(p_, data, n);
+    }
+    int feed(Span<const uint8_t> data) { return feed(data.data(), data.size()); }
+
+    // the input buffer, for feeding in place with commit()
+    Span<uint8_t> buffer() const { return Span<uint8_t>(p_->buf, p_->bufsize); }
+    int commit(size_t n) { return p_->feed(p_, n); }
+
+    int stats(DNP3_Stats *out) { return dnp3_dissector_stats(p_, out); }
+
+    // see dnp3_dissector_checkpoint() and dnp3_dissector_restore()
+    int checkpoint(uint8_t *buf, size_t cap) {
+        return dnp3_dissector_checkpoint(p_, buf, cap);
+    }
+    int restore(Span<const uint8_t> data) {
+        return dnp3_dissector_restore(p_, data.data(), data.size());
+    }
+
+    // process what is left and release the dissector
+    int finish() {
+        int r = 0;
+        if(p_) {
+            r = p_->finish(p_);
+            p_ = nullptr;
+        }
+        return r;
+    }
+
+private:
+    StreamProcessor *p_;
+};
+
+} // namespace dnp3
+
+#endif // DNP3_HPP_SEEN
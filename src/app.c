@@ -14,9 +14,13 @@
 #include "obj/application.h"
 #include "g120_auth.h"
 #include "util.h"
+#include "tables.h"
 
 #include "app.h"
 
+#include <assert.h>
+#include <string.h>
+
 
 HParser *dnp3_p_app_request;
 HParser *dnp3_p_app_response;
@@ -25,23 +29,50 @@ HParser *dnp3_p_app_fragment;
 
 /// AGGRESSIVE-MODE AUTHENTICATION ///
 
-static HParsedToken *act_with_ama(const HParseResult *p, void *env)
+// an error is propagated, otherwise the MAC must follow
+static bool validate_with_ama(HParseResult *p, void *env)
 {
-    DNP3_Fragment *frag = H_ALLOC(DNP3_Fragment);
-    DNP3_AuthData *a = H_ALLOC(DNP3_AuthData);
+    // p->ast = (auth_aggr, [base], auth_mac | [none])
+    size_t n = h_seq_len(p->ast);
 
-    // XXX this is wrong; the incoming objects are raw, not yet a DNP3_Fragment
-    //     leave all this to act_fragment!?
+    for(size_t i=0; i<n; i++) {
+        if(H_ISERR(H_INDEX_TOKEN(p->ast, i)->token_type))
+            return true;
+    }
+    return (H_INDEX_TOKEN(p->ast, n-1)->token_type != TT_NONE);
+}
 
-    // input is a sequence: (auth_aggr, fragment, auth_mac)
-    *frag = *H_FIELD(DNP3_Fragment, 1);
+static HParsedToken *act_with_ama(const HParseResult *p, void *env)
+{
+    // p->ast = (auth_aggr, [base], auth_mac), cf. validate_with_ama.
+    // NB: base yields nothing on an empty request (h_epsilon_p).
+    size_t n = h_seq_len(p->ast);
+
+    // propagate TT_ERR on any element
+    for(size_t i=0; i<n; i++) {
+        HParsedToken *tok = H_INDEX_TOKEN(p->ast, i);
+        if(H_ISERR(tok->token_type))
+            return tok;
+    }
 
-    // XXX fill AuthData from H_FIELD(..., 0) and H_FIELD(..., 2)
-    // a->xxx = H_FIELD(..., 1)->xxx;
-    // a->mac = H_FIELD(..., 2);
-    frag->auth = a;
+    const DNP3_ObjectBlock *aggr = H_FIELD(DNP3_ObjectBlock, 0);
+    const DNP3_ObjectBlock *mac = H_FIELD(DNP3_ObjectBlock, n-1);
+    DNP3_AuthData *a = H_ALLOC(DNP3_AuthData);
 
-    return H_MAKE(DNP3_Fragment, frag);
+    assert(aggr->count == 1 && mac->count == 1);
+    a->csq = aggr->objects[0].aggr.csq;
+    a->usr = aggr->objects[0].aggr.usr;
+    a->mac = mac->objects[0].mac.bytes;
+    a->maclen = mac->objects[0].mac.len;
+    a->machdr = 4 + (1 << (mac->prefixcode - 4));   // grp,var,qc,count,size
+    a->status = DNP3_AUTH_UNCHECKED;
+
+    // (authdata, base) or (authdata), see act_fragment
+    HParsedToken *res = h_make_seqn(p->arena, 2);
+    h_seq_snoc(res, H_MAKE(DNP3_AuthData, a));
+    if(n == 3)
+        h_seq_snoc(res, H_INDEX_TOKEN(p->ast, 1));
+    return res;
 }
 
 // combinator: allow aggresive-mode auth objects around base parser
@@ -50,13 +81,14 @@ static HParser *ama(HParser *base)
     // aggressive mode objects are optional, but if used:
     // g120v3 (aggressive mode request) must be the first object.
     // g120v9 (message authentication code) must be the last object.
+    // NB: dnp3_p_many stops before the MAC, see dnp3_p_trailer.
 
-    H_ARULE(with_ama, h_sequence(dnp3_p_g120v3_auth_aggr_block,
-                                 base,
-                                 dnp3_p_g120v9_auth_mac_block, NULL));
+    H_RULE (mac,      h_optional(dnp3_p_g120v9_auth_mac_block));
+    H_AVRULE(with_ama, h_sequence(dnp3_p_g120v3_auth_aggr_block,
+                                  base, mac, NULL));
         // XXX parse/validate mac before rest of odata?!
 
-    return base; // XXX h_choice(with_ama, base, NULL);
+    return h_choice(with_ama, base, NULL);
 }
 
 
@@ -397,6 +429,41 @@ static void init_odata(void)
 
 /// APPLICATION LAYER FRAGMENTS ///
 
+// resolve relative timestamps against the last CTO before them, if any
+static void resolve_cto(DNP3_Fragment *frag)
+{
+    DNP3_Time cto = 0;
+    uint8_t var = 0;
+
+    for(size_t i=0; i<frag->nblocks; i++) {
+        DNP3_ObjectBlock *ob = frag->odata[i];
+
+        switch(ob->group << 8 | ob->variation) {
+        case GV(CTO, SYNC):
+        case GV(CTO, UNSYNC):
+            if(ob->count > 0 && ob->objects) {
+                cto = ob->objects[0].time.abstime;
+                var = ob->variation;
+            }
+            continue;
+        case GV(BININEV, RELTIME):
+        case GV(DBLBITINEV, RELTIME):
+            break;
+        default:
+            continue;
+        }
+
+        ob->cto = cto;
+        ob->ctovar = var;
+        for(size_t j=0; j<ob->count && ob->objects; j++) {
+            DNP3_Object *o = &ob->objects[j];
+            o->timed.abstime = var ? cto + o->timed.reltime : 0;
+            o->timed.cto = var;
+        }
+        // NB: columnar blocks are resolved by dnp3_oblock_object()
+    }
+}
+
 // combine header, auth, and object data into final DNP3_Fragment
 static HParsedToken *act_fragment(const HParseResult *p, void *user)
 {
@@ -435,7 +502,7 @@ static HParsedToken *act_fragment(const HParseResult *p, void *user)
           && od->seq->elements[0]->token_type == TT_DNP3_AuthData)
     {
         frag->auth = H_INDEX(DNP3_AuthData, od, 0);
-        od = H_INDEX_TOKEN(od, 1);
+        od = (od->seq->used > 1) ? H_INDEX_TOKEN(od, 1) : NULL;
     }
 
     if(od == NULL) {
@@ -456,49 +523,67 @@ static HParsedToken *act_fragment(const HParseResult *p, void *user)
         frag->odata[0] = H_CAST(DNP3_ObjectBlock, od);
     }
 
+    resolve_cto(frag);
     return H_MAKE(DNP3_Fragment, frag);
 }
 
 static HParsedToken *act_fragment_errfc(const HParseResult *p, void *user)
 {
-    HParsedToken *ac = user;
+    const HParsedToken *hdr = user;
+    HParsedToken *ac = H_INDEX_TOKEN(hdr, 0);
+    HParsedToken *fc = H_INDEX_TOKEN(hdr, 1);
 
     // return a DNP3_Fragment containing the parsed application control octet
     DNP3_Fragment *frag = H_ALLOC(DNP3_Fragment);
     frag->ac = *H_CAST(DNP3_AppControl, ac);
-    frag->fc = p->ast->uint;
+    frag->fc = fc->uint;
 
     return h_make_err(p->arena, ERR_FUNC_NOT_SUPP, frag);
 }
 
+// parsers for the rest of a fragment, by function code; built on first use
+// (build_body). NULL for unsupported functions, i.e. where odata is NULL.
+static HParser *body[256] = {NULL};
+static HParser *nobody;     // consumes nothing, for the error case
+
+static HParser *build_body(void *env, size_t fc)
+{
+    HAllocator *mm__ = dnp3_p_mm;
+
+    // odata must always parse the entire rest of the fragment
+    HParser *p = dnp3_p_packet__m(mm__, odata[fc]);
+
+    // any unspecific parse failure on odata should yield PARAM_ERROR
+    return h_choice__m(mm__, p, dnp3_p_err_param_error, NULL);
+}
+
+static void init_body(void)
+{
+    memset(body, 0, sizeof body);   // from an earlier dnp3_init
+    nobody = h_epsilon_p();
+}
+
 // parse the rest of a fragment, after the application header
+//
+// NB: the body parsers are built once per function code (build_body). what
+//     remains per fragment is the action that attaches the header; h_bind
+//     does not pass the header token on, so that one has to carry it as its
+//     env.
 static HParser *k_fragment(HAllocator *mm__, const HParsedToken *hdr, void *env)
 {
     // propagate TT_ERR on function code
     HParsedToken *fc_ = H_INDEX_TOKEN(hdr, 1);
-    if(H_ISERR(fc_->token_type))
-        goto err;
+    HParser *p = NULL;
 
-    int fc = H_CAST_UINT(fc_);
+    if(!H_ISERR(fc_->token_type)) {
+        uint8_t fc = H_CAST_UINT(fc_);
+        if(odata[fc])
+            p = dnp3_p_lazy(&body[fc], build_body, NULL, fc);
+    }
 
-    // basic object data parser
-    HParser *p = odata[fc];
     if(p == NULL)
-        goto err;
-
-    // odata must always parse the entire rest of the fragment
-    p = dnp3_p_packet__m(mm__, p);
-
-    // any unspecific parse failure on odata should yield PARAM_ERROR
-    p = h_choice__m(mm__, p, dnp3_p_err_param_error, NULL);
-
+        return h_action__m(mm__, nobody, act_fragment_errfc, (void *)hdr);
     return h_action__m(mm__, p, act_fragment, (void *)hdr);
-
-    err: {
-        HParsedToken *ac = H_INDEX_TOKEN(hdr, 0);
-        return h_action__m(mm__, h_unit__m(mm__, fc_),
-                                 act_fragment_errfc, (void *)ac);
-    }
 }
 
 static HParsedToken *act_iin(const HParseResult *p, void *user)
@@ -563,6 +648,7 @@ void dnp3_p_init_app(void)
     init_oblock();
 
     // initialize object parsers
+    dnp3_p_init_g120_auth();    // NB: first, sets dnp3_p_trailer
     dnp3_p_init_binary();
     dnp3_p_init_binoutcmd();
     dnp3_p_init_counter();
@@ -574,6 +660,7 @@ void dnp3_p_init_app(void)
 
     // initialize request-specific "object data" parsers
     init_odata();
+    init_body();
 
     H_RULE (bit,    h_bits(1, false));
     H_RULE (zro,    dnp3_p_int_exact(bit, 0));
@@ -622,9 +709,16 @@ void dnp3_p_init_app(void)
     H_RULE (request,    h_bind(req_header, k_fragment, NULL));
     H_RULE (response,   h_bind(rsp_header, k_fragment, NULL));
 
+    // dispatch on the function code (second octet) so that requests never
+    // go through a failed response parse. fragments with a response code
+    // still fall back to request to produce the same errors as before.
+    H_RULE (rspstart,   h_sequence(fc, anyrspfc, NULL));
     H_VRULE(tryresponse, response);
-    H_RULE (fragment,   h_choice(tryresponse, request, NULL));
+    H_RULE (rspfrag,    h_right(h_and(rspstart),
+                                h_choice(tryresponse, request, NULL)));
         // NB: try response first because it may also fail on missing IIN
+    H_RULE (reqfrag,    h_right(h_not(rspstart), request));
+    H_RULE (fragment,   h_choice(rspfrag, reqfrag, NULL));
 
     dnp3_p_app_request  = little_endian(request);
     dnp3_p_app_response = little_endian(response);
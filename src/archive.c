@@ -0,0 +1,879 @@
+// columnar archive of measurements (see dnp3_archive_create)
+//
+// the objects of every (outstation, group, variation) form a series. the
+// writer buffers each series and writes it out in chunks of up to CHUNKN
+// samples, column by column, each column with its own encoding:
+//
+//   index  zigzag varint of the difference to the previous index
+//   time   zigzag varint delta-of-delta
+//   flags  runs of (octet, varint length); the flags octet as on the wire,
+//          or the state of packed binaries
+//   value  integers: zigzag varint delta; floats: XOR with the previous
+//          value, Gorilla style
+//
+// every column starts over with each chunk, so chunks decode on their own.
+//
+// file layout, all integers little-endian:
+//   "DNP3ARC1"
+//   chunk*         header (HDRLEN) followed by its columns
+//   index          a copy of every chunk header, in file order
+//   trailer        u64 offset of index, u64 number of chunks, "DNP3AEND"
+//
+// a reader maps the file and only consults the index, so chunks outside a
+// queried time range or selection are never touched. without a valid
+// trailer (e.g. the writer did not finish), the chunks are found by
+// walking them from the start.
+
+#include <dnp3hammer.h>
+#include "hammer.h"     // h_system_allocator
+#include "columns.h"    // dnp3_column_spec, dnp3_flags_encode
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define MAGIC   "DNP3ARC1"
+#define TRAILER "DNP3AEND"
+#define TAG     0x304B4843      // "CHK0"
+#define HDRLEN  52
+#define TRLEN   24
+#define CHUNKN  4096            // max. samples per chunk
+#define NBUCKETS 256
+#define NCOLS   4               // index, time, flags, value
+
+typedef struct {
+    uint16_t outstation;
+    uint8_t group, variation;
+    uint32_t count;
+    DNP3_Time tmin, tmax;
+    uint64_t offset;            // of the first column
+    uint32_t len[NCOLS];        // bytes per column
+} Chunk;
+
+static void put_le(uint8_t *p, uint64_t x, int n)
+{
+    for(int i=0; i<n; i++)
+        p[i] = x >> (8*i);
+}
+
+static uint64_t get_le(const uint8_t *p, int n)
+{
+    uint64_t x = 0;
+
+    for(int i=n-1; i>=0; i--)
+        x = x << 8 | p[i];
+    return x;
+}
+
+static void chunk_pack(uint8_t *b, const Chunk *c)
+{
+    put_le(b, TAG, 4);
+    put_le(b+4, c->outstation, 2);
+    b[6] = c->group;
+    b[7] = c->variation;
+    put_le(b+8, c->count, 4);
+    put_le(b+12, c->tmin, 8);
+    put_le(b+20, c->tmax, 8);
+    put_le(b+28, c->offset, 8);
+    for(int i=0; i<NCOLS; i++)
+        put_le(b+36+4*i, c->len[i], 4);
+}
+
+// false if b does not hold a chunk header
+static bool chunk_unpack(const uint8_t *b, Chunk *c)
+{
+    if(get_le(b, 4) != TAG)
+        return false;
+    c->outstation = get_le(b+4, 2);
+    c->group = b[6];
+    c->variation = b[7];
+    c->count = get_le(b+8, 4);
+    c->tmin = get_le(b+12, 8);
+    c->tmax = get_le(b+20, 8);
+    c->offset = get_le(b+28, 8);
+    for(int i=0; i<NCOLS; i++)
+        c->len[i] = get_le(b+36+4*i, 4);
+    return true;
+}
+
+static uint64_t chunk_size(const Chunk *c)
+{
+    uint64_t n = 0;
+
+    for(int i=0; i<NCOLS; i++)
+        n += c->len[i];
+    return n;
+}
+
+static inline uint64_t zigzag(int64_t x)
+{
+    return (uint64_t)x << 1 ^ (x < 0 ? ~(uint64_t)0 : 0);
+}
+
+static inline int64_t unzigzag(uint64_t u)
+{
+    return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+}
+
+
+/// ENCODING ///
+
+typedef struct {
+    HAllocator *mm;
+    uint8_t *p;
+    size_t len, cap;
+    bool err;                   // out of memory
+} Bytes;
+
+static void bytes_put(Bytes *b, const void *p, size_t n)
+{
+    if(b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while(cap < b->len + n)
+            cap *= 2;
+        uint8_t *q = b->mm->realloc(b->mm, b->p, cap);
+        if(!q) {
+            b->err = true;
+            return;
+        }
+        b->p = q;
+        b->cap = cap;
+    }
+    memcpy(b->p + b->len, p, n);
+    b->len += n;
+}
+
+static void put_varint(Bytes *b, uint64_t x)
+{
+    uint8_t buf[10];
+    size_t n = 0;
+
+    while(x >= 0x80) {
+        buf[n++] = x | 0x80;
+        x >>= 7;
+    }
+    buf[n++] = x;
+    bytes_put(b, buf, n);
+}
+
+// bit stream, most significant bit first
+typedef struct {
+    Bytes *b;
+    uint8_t cur;
+    int nbit;                   // bits used in cur
+} BitWriter;
+
+static void bits_put(BitWriter *w, uint64_t x, int n)
+{
+    while(n > 0) {
+        int k = 8 - w->nbit;
+        if(k > n)
+            k = n;
+        w->cur |= ((x >> (n-k)) & ((1u << k) - 1)) << (8 - w->nbit - k);
+        w->nbit += k;
+        n -= k;
+        if(w->nbit == 8) {
+            bytes_put(w->b, &w->cur, 1);
+            w->cur = 0;
+            w->nbit = 0;
+        }
+    }
+}
+
+static void bits_flush(BitWriter *w)
+{
+    if(w->nbit > 0)
+        bytes_put(w->b, &w->cur, 1);
+}
+
+// XOR encoding of w-bit floats (32 or 64): a 0 bit for a repeated value;
+// else 1, then 0 and the meaningful bits if they fit the window of the
+// last value written out in full, or 1, 6 bits of leading zeros, 6 bits of
+// length - 1, and the meaningful bits.
+typedef struct {
+    uint64_t prev;
+    int lead, trail;            // window, lead < 0 if none yet
+    bool first;
+} Xor;
+
+static void xor_put(BitWriter *bw, Xor *s, uint64_t v, int w)
+{
+    if(s->first) {
+        bits_put(bw, v, w);
+        s->first = false;
+        s->prev = v;
+        return;
+    }
+
+    uint64_t x = v ^ s->prev;
+    s->prev = v;
+    if(x == 0) {
+        bits_put(bw, 0, 1);
+        return;
+    }
+
+    int lead = __builtin_clzll(x) - (64 - w);
+    int trail = __builtin_ctzll(x);
+    if(s->lead >= 0 && lead >= s->lead && trail >= s->trail) {
+        bits_put(bw, 2, 2);                         // 10
+        bits_put(bw, x >> s->trail, w - s->lead - s->trail);
+    } else {
+        int n = w - lead - trail;
+        bits_put(bw, 3, 2);                         // 11
+        bits_put(bw, lead, 6);
+        bits_put(bw, n - 1, 6);
+        bits_put(bw, x >> trail, n);
+        s->lead = lead;
+        s->trail = trail;
+    }
+}
+
+
+/// DECODING ///
+
+typedef struct {
+    const uint8_t *p, *end;
+    int nbit;                   // bits used of *p
+    bool err;                   // ran past the end
+} Reader;
+
+static uint64_t get_varint(Reader *r)
+{
+    uint64_t x = 0;
+
+    for(int s=0; s<64; s+=7) {
+        if(r->p >= r->end)
+            break;
+        uint8_t b = *r->p++;
+        x |= (uint64_t)(b & 0x7F) << s;
+        if(!(b & 0x80))
+            return x;
+    }
+    r->err = true;
+    return 0;
+}
+
+static uint64_t bits_get(Reader *r, int n)
+{
+    uint64_t x = 0;
+
+    while(n > 0) {
+        if(r->p >= r->end) {
+            r->err = true;
+            return 0;
+        }
+        int k = 8 - r->nbit;
+        if(k > n)
+            k = n;
+        x = x << k | ((*r->p >> (8 - r->nbit - k)) & ((1u << k) - 1));
+        r->nbit += k;
+        n -= k;
+        if(r->nbit == 8) {
+            r->p++;
+            r->nbit = 0;
+        }
+    }
+    return x;
+}
+
+static uint64_t xor_get(Reader *r, Xor *s, int w)
+{
+    if(s->first) {
+        s->first = false;
+        return s->prev = bits_get(r, w);
+    }
+
+    if(bits_get(r, 1) == 0)
+        return s->prev;
+    if(bits_get(r, 1) == 1) {
+        int lead = bits_get(r, 6);
+        int n = bits_get(r, 6) + 1;
+        if(lead + n > w) {
+            r->err = true;
+            return 0;
+        }
+        s->lead = lead;
+        s->trail = w - lead - n;
+    } else if(s->lead < 0) {
+        r->err = true;
+        return 0;
+    }
+    int n = w - s->lead - s->trail;
+    return s->prev ^= bits_get(r, n) << s->trail;
+}
+
+
+/// WRITER ///
+
+struct Sample {
+    DNP3_Time time;
+    uint64_t value;             // raw bits: int32, uint32, float or double
+    uint32_t index;
+    uint8_t flags;
+};
+
+struct Series {
+    struct Series *next;        // hash chain
+    uint16_t outstation;
+    DNP3_Group group;
+    DNP3_Variation variation;
+    const DNP3_ColumnSpec *spec;
+    struct Sample *s;
+    size_t n, cap;
+};
+
+struct DNP3_ArchiveWriter_ {
+    HAllocator *mm;
+    FILE *f;
+    uint64_t pos;               // bytes written
+    struct Series *tab[NBUCKETS];
+    Chunk *chunks;              // for the index
+    size_t nchunks, capchunks;
+    Bytes col[NCOLS];
+    bool err;                   // after an I/O error or out of memory
+};
+
+static int value_width(DNP3_ColumnType t)
+{
+    return (t == DNP3_COL_DOUBLE) ? 64 : 32;
+}
+
+DNP3_ArchiveWriter *dnp3_archive_create(const char *path, HAllocator *mm)
+{
+    if(!mm)
+        mm = h_system_allocator;
+
+    DNP3_ArchiveWriter *w = mm->alloc(mm, sizeof(DNP3_ArchiveWriter));
+    if(!w) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(w, 0, sizeof *w);
+    w->mm = mm;
+    for(int i=0; i<NCOLS; i++)
+        w->col[i].mm = mm;
+
+    if(!(w->f = fopen(path, "wb"))) {
+        mm->free(mm, w);
+        return NULL;
+    }
+    if(fwrite(MAGIC, 8, 1, w->f) != 1) {
+        int e = errno;
+        fclose(w->f);
+        mm->free(mm, w);
+        errno = e;
+        return NULL;
+    }
+    w->pos = 8;
+
+    return w;
+}
+
+static struct Series *series(DNP3_ArchiveWriter *w, uint16_t outstation,
+                             const DNP3_ColumnSpec *spec)
+{
+    size_t h = (outstation * 31u + (spec->group << 8 | spec->variation))
+               % NBUCKETS;
+    struct Series *s;
+
+    for(s = w->tab[h]; s; s = s->next) {
+        if(s->outstation == outstation && s->spec == spec)
+            return s;
+    }
+
+    if(!(s = w->mm->alloc(w->mm, sizeof(struct Series))))
+        return NULL;
+    memset(s, 0, sizeof *s);
+    s->outstation = outstation;
+    s->group = spec->group;
+    s->variation = spec->variation;
+    s->spec = spec;
+    s->next = w->tab[h];
+    w->tab[h] = s;
+    return s;
+}
+
+// encode the buffered samples of s into w->col
+static void encode(DNP3_ArchiveWriter *w, const struct Series *s)
+{
+    Bytes *col = w->col;
+    int64_t prevt = 0, prevd = 0, previ = 0;
+
+    for(int i=0; i<NCOLS; i++)
+        col[i].len = 0;
+
+    for(size_t i=0; i<s->n; i++) {
+        const struct Sample *x = &s->s[i];
+        int64_t d = (int64_t)(x->time - (uint64_t)prevt);
+
+        put_varint(&col[0], zigzag((int64_t)x->index - previ));
+        put_varint(&col[1], zigzag(d - prevd));
+        previ = x->index;
+        prevt = x->time;
+        prevd = d;
+    }
+
+    for(size_t i=0; i<s->n; ) {
+        size_t k = i+1;
+        while(k < s->n && s->s[k].flags == s->s[i].flags)
+            k++;
+        bytes_put(&col[2], &s->s[i].flags, 1);
+        put_varint(&col[2], k - i);
+        i = k;
+    }
+
+    DNP3_ColumnType vt = s->spec->valuetype;
+    if(vt == DNP3_COL_INT32 || vt == DNP3_COL_UINT32) {
+        uint32_t prev = 0;
+        for(size_t i=0; i<s->n; i++) {
+            uint32_t v = s->s[i].value;
+            if(vt == DNP3_COL_INT32)
+                put_varint(&col[3], zigzag((int64_t)(int32_t)v
+                                           - (int32_t)prev));
+            else
+                put_varint(&col[3], zigzag((int32_t)(v - prev)));
+            prev = v;
+        }
+    } else if(vt == DNP3_COL_FLOAT || vt == DNP3_COL_DOUBLE) {
+        BitWriter bw = {&col[3], 0, 0};
+        Xor st = {0, -1, 0, true};
+        for(size_t i=0; i<s->n; i++)
+            xor_put(&bw, &st, s->s[i].value, value_width(vt));
+        bits_flush(&bw);
+    }
+}
+
+// write the buffered samples of s as a chunk
+static int flush_series(DNP3_ArchiveWriter *w, struct Series *s)
+{
+    Chunk c = {s->outstation, s->group, s->variation, s->n};
+    uint8_t hdr[HDRLEN];
+
+    if(s->n == 0)
+        return 0;
+
+    encode(w, s);
+    c.tmin = c.tmax = s->s[0].time;
+    for(size_t i=1; i<s->n; i++) {
+        if(s->s[i].time < c.tmin)
+            c.tmin = s->s[i].time;
+        if(s->s[i].time > c.tmax)
+            c.tmax = s->s[i].time;
+    }
+    c.offset = w->pos + HDRLEN;
+    for(int i=0; i<NCOLS; i++) {
+        if(w->col[i].err) {
+            errno = ENOMEM;
+            return -1;
+        }
+        c.len[i] = w->col[i].len;
+    }
+
+    if(w->nchunks == w->capchunks) {
+        size_t cap = w->capchunks ? 2 * w->capchunks : 64;
+        Chunk *p = w->mm->realloc(w->mm, w->chunks, cap * sizeof(Chunk));
+        if(!p) {
+            errno = ENOMEM;
+            return -1;
+        }
+        w->chunks = p;
+        w->capchunks = cap;
+    }
+
+    chunk_pack(hdr, &c);
+    if(fwrite(hdr, HDRLEN, 1, w->f) != 1)
+        return -1;
+    for(int i=0; i<NCOLS; i++) {
+        if(c.len[i] && fwrite(w->col[i].p, c.len[i], 1, w->f) != 1)
+            return -1;
+    }
+    w->pos = c.offset + chunk_size(&c);
+    w->chunks[w->nchunks++] = c;
+    s->n = 0;
+
+    return 0;
+}
+
+int dnp3_archive_add(DNP3_ArchiveWriter *w, uint16_t outstation,
+                     DNP3_Time t, const DNP3_ObjectBlock *ob)
+{
+    const DNP3_ColumnSpec *spec = dnp3_column_spec(ob->group, ob->variation);
+
+    if(w->err)
+        return -1;
+    if(!spec || ob->count == 0)
+        return 0;
+
+    struct Series *s = series(w, outstation, spec);
+    if(!s)
+        goto nomem;
+
+    for(size_t i=0; i<ob->count; i++) {
+        if(s->n == s->cap) {
+            size_t cap = s->cap ? 2 * s->cap : 64;
+            struct Sample *p = w->mm->realloc(w->mm, s->s,
+                                              cap * sizeof(struct Sample));
+            if(!p)
+                goto nomem;
+            s->s = p;
+            s->cap = cap;
+        }
+
+        DNP3_Object o = dnp3_oblock_object(ob, i);
+        struct Sample *x = &s->s[s->n];
+        x->index = ob->indexes ? ob->indexes[i] : ob->range_base + i;
+        x->time = (spec->time && o.timed.abstime) ? o.timed.abstime : t;
+        if(spec->bitwidth)
+            x->flags = dnp3_oblock_state(ob, i);
+        else if(spec->flags)
+            x->flags = dnp3_flags_encode(ob->group, o.flags);
+        else
+            x->flags = 0;
+        switch(spec->valuetype) {
+        case DNP3_COL_INT32:  x->value = (uint32_t)o.ana.sint; break;
+        case DNP3_COL_UINT32: x->value = o.ctr.value; break;
+        case DNP3_COL_FLOAT: {
+            float f = o.ana.flt;
+            uint32_t u;
+            memcpy(&u, &f, 4);
+            x->value = u;
+            break; }
+        case DNP3_COL_DOUBLE:
+            memcpy(&x->value, &o.ana.flt, 8);
+            break;
+        default:
+            x->value = 0;
+        }
+        s->n++;
+
+        if(s->n == CHUNKN && flush_series(w, s) < 0) {
+            w->err = true;
+            return -1;
+        }
+    }
+
+    return ob->count;
+
+nomem:
+    w->err = true;
+    errno = ENOMEM;
+    return -1;
+}
+
+int dnp3_archive_flush(DNP3_ArchiveWriter *w)
+{
+    if(w->err)
+        return -1;
+    for(size_t h=0; h<NBUCKETS; h++) {
+        for(struct Series *s = w->tab[h]; s; s = s->next) {
+            if(flush_series(w, s) < 0) {
+                w->err = true;
+                return -1;
+            }
+        }
+    }
+    if(fflush(w->f) != 0) {
+        w->err = true;
+        return -1;
+    }
+    return 0;
+}
+
+int dnp3_archive_finish(DNP3_ArchiveWriter *w)
+{
+    HAllocator *mm = w->mm;
+    int r = dnp3_archive_flush(w);
+
+    // index and trailer
+    if(r == 0) {
+        uint8_t b[HDRLEN];
+        for(size_t i=0; i<w->nchunks && r == 0; i++) {
+            chunk_pack(b, &w->chunks[i]);
+            if(fwrite(b, HDRLEN, 1, w->f) != 1)
+                r = -1;
+        }
+        put_le(b, w->pos, 8);
+        put_le(b+8, w->nchunks, 8);
+        memcpy(b+16, TRAILER, 8);
+        if(r == 0 && fwrite(b, TRLEN, 1, w->f) != 1)
+            r = -1;
+    }
+    if(fclose(w->f) != 0)
+        r = -1;
+
+    for(size_t h=0; h<NBUCKETS; h++) {
+        struct Series *s;
+        while((s = w->tab[h])) {
+            w->tab[h] = s->next;
+            mm->free(mm, s->s);
+            mm->free(mm, s);
+        }
+    }
+    for(int i=0; i<NCOLS; i++)
+        mm->free(mm, w->col[i].p);
+    mm->free(mm, w->chunks);
+    mm->free(mm, w);
+
+    return r;
+}
+
+
+/// READER ///
+
+struct DNP3_Archive_ {
+    HAllocator *mm;
+    const uint8_t *map;
+    size_t size;
+    Chunk *chunks;
+    size_t nchunks;
+};
+
+static bool chunk_valid(const DNP3_Archive *a, const Chunk *c)
+{
+    return c->offset >= 8 + HDRLEN && c->offset <= a->size
+           && chunk_size(c) <= a->size - c->offset
+           && dnp3_column_spec(c->group, c->variation) != NULL;
+}
+
+// read the index, or walk the chunks if there is none
+static bool load_index(DNP3_Archive *a)
+{
+    const uint8_t *t = a->map + a->size - TRLEN;
+    size_t n = 0, pos = 8;
+    Chunk c;
+
+    if(a->size >= 8 + TRLEN && memcmp(t+16, TRAILER, 8) == 0) {
+        uint64_t off = get_le(t, 8);
+        n = get_le(t+8, 8);
+        if(off > a->size - TRLEN || n > (a->size - TRLEN - off) / HDRLEN)
+            return false;
+        if(!(a->chunks = a->mm->alloc(a->mm, (n ? n : 1) * sizeof(Chunk))))
+            return false;
+        for(size_t i=0; i<n; i++) {
+            if(!chunk_unpack(a->map + off + i*HDRLEN, &a->chunks[i])
+               || !chunk_valid(a, &a->chunks[i]))
+                return false;
+        }
+        a->nchunks = n;
+        return true;
+    }
+
+    for(int pass=0; pass<2; pass++) {
+        for(pos=8, n=0; pos + HDRLEN <= a->size; n++) {
+            if(!chunk_unpack(a->map + pos, &c) || c.offset != pos + HDRLEN
+               || !chunk_valid(a, &c))
+                break;
+            if(pass == 1)
+                a->chunks[n] = c;
+            pos = c.offset + chunk_size(&c);
+        }
+        if(pass == 0
+           && !(a->chunks = a->mm->alloc(a->mm, (n ? n : 1) * sizeof(Chunk))))
+            return false;
+    }
+    a->nchunks = n;
+    return true;
+}
+
+DNP3_Archive *dnp3_archive_open(const char *path, HAllocator *mm)
+{
+    struct stat st;
+    int fd, e;
+
+    if(!mm)
+        mm = h_system_allocator;
+
+    DNP3_Archive *a = mm->alloc(mm, sizeof(DNP3_Archive));
+    if(!a) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(a, 0, sizeof *a);
+    a->mm = mm;
+
+    if((fd = open(path, O_RDONLY)) < 0)
+        goto fail;
+    if(fstat(fd, &st) < 0) {
+        e = errno;
+        close(fd);
+        errno = e;
+        goto fail;
+    }
+    if(st.st_size < 8) {
+        close(fd);
+        errno = EINVAL;
+        goto fail;
+    }
+    a->size = st.st_size;
+    void *map = mmap(NULL, a->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    e = errno;
+    close(fd);
+    if(map == MAP_FAILED) {
+        errno = e;
+        goto fail;
+    }
+    a->map = map;
+
+    if(memcmp(a->map, MAGIC, 8) != 0 || !load_index(a)) {
+        dnp3_archive_free(a);
+        errno = EINVAL;
+        return NULL;
+    }
+    return a;
+
+fail:
+    mm->free(mm, a);
+    return NULL;
+}
+
+void dnp3_archive_free(DNP3_Archive *a)
+{
+    if(a->map)
+        munmap((void *)a->map, a->size);
+    if(a->chunks)
+        a->mm->free(a->mm, a->chunks);
+    a->mm->free(a->mm, a);
+}
+
+size_t dnp3_archive_size(const DNP3_Archive *a)
+{
+    size_t n = 0;
+
+    for(size_t i=0; i<a->nchunks; i++)
+        n += a->chunks[i].count;
+    return n;
+}
+
+static bool selected(const DNP3_Filter *f, const Chunk *c)
+{
+    if(!f)
+        return true;
+
+    bool marked = dnp3_filter_test(f->addr, c->outstation);
+    if(f->addr_deny ? marked : !marked)
+        return false;
+    return dnp3_filter_test(f->group, c->group);
+}
+
+// decode chunk c and pass the samples in [from,to] to cb; returns their
+// number or -1 if the chunk is corrupt
+static int64_t query_chunk(const DNP3_Archive *a, const Chunk *c,
+                           DNP3_Time from, DNP3_Time to,
+                           void (*cb)(void *env, const DNP3_ArchiveRecord *r),
+                           void *env)
+{
+    const DNP3_ColumnSpec *spec = dnp3_column_spec(c->group, c->variation);
+    DNP3_ColumnType vt = spec->valuetype;
+    Reader rd[NCOLS];
+    const uint8_t *p = a->map + c->offset;
+    int64_t prevt = 0, prevd = 0, previ = 0;
+    uint32_t prevv = 0;
+    uint8_t flags = 0;
+    uint64_t run = 0;
+    Xor xs = {0, -1, 0, true};
+    int64_t n = 0;
+
+    for(int i=0; i<NCOLS; i++) {
+        rd[i].p = p;
+        rd[i].end = p + c->len[i];
+        rd[i].nbit = 0;
+        rd[i].err = false;
+        p += c->len[i];
+    }
+
+    for(uint32_t i=0; i<c->count; i++) {
+        DNP3_ArchiveRecord r;
+
+        previ += unzigzag(get_varint(&rd[0]));
+        prevd += unzigzag(get_varint(&rd[1]));
+        prevt += prevd;
+        if(run == 0) {
+            if(rd[2].p >= rd[2].end)
+                return -1;
+            flags = *rd[2].p++;
+            run = get_varint(&rd[2]);
+            if(run == 0)
+                return -1;
+        }
+        run--;
+
+        uint64_t v = 0;
+        if(vt == DNP3_COL_INT32 || vt == DNP3_COL_UINT32) {
+            int64_t d = unzigzag(get_varint(&rd[3]));
+            v = prevv = (uint32_t)(prevv + (uint32_t)d);
+        } else if(vt == DNP3_COL_FLOAT || vt == DNP3_COL_DOUBLE) {
+            v = xor_get(&rd[3], &xs, value_width(vt));
+        }
+
+        for(int k=0; k<NCOLS; k++) {
+            if(rd[k].err)
+                return -1;
+        }
+        if((DNP3_Time)prevt < from || (DNP3_Time)prevt > to)
+            continue;
+
+        memset(&r, 0, sizeof r);
+        r.outstation = c->outstation;
+        r.group = c->group;
+        r.variation = c->variation;
+        r.index = previ;
+        r.time = prevt;
+
+        // NB: flags are at the same place in all object types concerned
+        if(spec->bitwidth == 2)
+            r.object.dblbit = flags;
+        else if(spec->bitwidth)
+            r.object.bit = flags;
+        else if(spec->flags)
+            r.object.flags = dnp3_flags_decode(c->group, flags);
+        switch(vt) {
+        case DNP3_COL_INT32:  r.object.ana.sint = (int32_t)v; break;
+        case DNP3_COL_UINT32: r.object.ctr.value = v; break;
+        case DNP3_COL_FLOAT: {
+            uint32_t u = v;
+            float f;
+            memcpy(&f, &u, 4);
+            r.object.ana.flt = f;
+            break; }
+        case DNP3_COL_DOUBLE:
+            memcpy(&r.object.ana.flt, &v, 8);
+            break;
+        default:
+            break;
+        }
+        if(spec->time)
+            r.object.timed.abstime = r.time;
+
+        cb(env, &r);
+        n++;
+    }
+
+    return n;
+}
+
+int64_t dnp3_archive_query(const DNP3_Archive *a, DNP3_Time from, DNP3_Time to,
+                           const DNP3_Filter *f,
+                           void (*cb)(void *env, const DNP3_ArchiveRecord *r),
+                           void *env)
+{
+    int64_t n = 0;
+
+    for(size_t i=0; i<a->nchunks; i++) {
+        const Chunk *c = &a->chunks[i];
+
+        if(c->tmax < from || c->tmin > to || !selected(f, c))
+            continue;
+
+        int64_t k = query_chunk(a, c, from, to, cb, env);
+        if(k < 0)
+            return -1;
+        n += k;
+    }
+
+    return n;
+}
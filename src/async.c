@@ -0,0 +1,217 @@
+// asynchronous delivery of app-layer results to a consumer thread
+//
+// the dissector pushes owned copies of its fragments (and app_invalid
+// events) into a single-producer single-consumer ring; a thread of our own
+// pops them and calls the user's callbacks. cf. the worker rings in group.c.
+
+#include <dnp3hammer.h>
+#include "async.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+
+#define SPIN 100        // polls of an empty/full queue before sleeping
+#define CACHELINE 64
+
+struct Item {
+    DNP3_Fragment *fragment;    // owned copy, NULL for app_invalid
+    DNP3_ParseError error;
+};
+
+struct AsyncQueue {
+    size_t head __attribute__((aligned(CACHELINE)));    // producer
+    int sleeping;               // consumer waits on 'wake'
+    size_t tail __attribute__((aligned(CACHELINE)));    // consumer
+    int waiting;                // producer waits on 'space'
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t space;
+    bool done;                  // protected by lock
+    pthread_t thread;
+
+    HAllocator *mm;             // for the copies
+    DNP3_Callbacks cb;
+    void *env;
+
+    size_t len;                 // power of 2
+    struct Item ring[];
+};
+
+
+// wait for input on an empty queue
+// returns: true when the queue is finished and drained
+static bool wait_input(AsyncQueue *q, size_t tail)
+{
+    for(int i=0; i<SPIN; i++) {
+        if(__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) != tail)
+            return false;
+        sched_yield();
+    }
+
+    // NB: see the analogous code in group.c
+    pthread_mutex_lock(&q->lock);
+    __atomic_store_n(&q->sleeping, 1, __ATOMIC_SEQ_CST);
+    while(__atomic_load_n(&q->head, __ATOMIC_SEQ_CST) == tail && !q->done)
+        pthread_cond_wait(&q->wake, &q->lock);
+    __atomic_store_n(&q->sleeping, 0, __ATOMIC_RELAXED);
+    bool done = (__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == tail);
+    done = done && q->done;
+    pthread_mutex_unlock(&q->lock);
+
+    return done;
+}
+
+static void *consumer_main(void *arg)
+{
+    AsyncQueue *q = arg;
+    size_t tail = q->tail;
+
+    for(;;) {
+        size_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        if(head == tail) {
+            if(wait_input(q, tail))
+                break;
+            continue;
+        }
+
+        for(; tail != head; tail++) {
+            struct Item it = q->ring[tail & (q->len-1)];
+            __atomic_store_n(&q->tail, tail+1, __ATOMIC_SEQ_CST);
+            if(__atomic_load_n(&q->waiting, __ATOMIC_SEQ_CST)) {
+                pthread_mutex_lock(&q->lock);
+                pthread_cond_signal(&q->space);
+                pthread_mutex_unlock(&q->lock);
+            }
+
+            // NB: the callback takes ownership of the fragment
+            if(!it.fragment) {
+                if(q->cb.app_invalid)
+                    q->cb.app_invalid(q->env, it.error);
+            } else if(q->cb.app_fragment) {
+                q->cb.app_fragment(q->env, it.fragment, NULL, 0);
+            } else {
+                dnp3_fragment_release(it.fragment);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// wait for a free slot, at head
+static void wait_space(AsyncQueue *q, size_t head)
+{
+    for(int i=0; i<SPIN; i++) {
+        if(head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) < q->len)
+            return;
+        sched_yield();
+    }
+
+    pthread_mutex_lock(&q->lock);
+    __atomic_store_n(&q->waiting, 1, __ATOMIC_SEQ_CST);
+    while(head - __atomic_load_n(&q->tail, __ATOMIC_SEQ_CST) == q->len)
+        pthread_cond_wait(&q->space, &q->lock);
+    __atomic_store_n(&q->waiting, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void push(AsyncQueue *q, DNP3_Fragment *fragment, DNP3_ParseError e)
+{
+    size_t head = q->head;
+
+    wait_space(q, head);
+
+    struct Item *it = &q->ring[head & (q->len-1)];
+    it->fragment = fragment;
+    it->error = e;
+    __atomic_store_n(&q->head, head+1, __ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&q->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&q->lock);
+        pthread_cond_signal(&q->wake);
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+bool dnp3_async_push_fragment(AsyncQueue *q, const DNP3_Fragment *fragment)
+{
+    DNP3_Fragment *copy = dnp3_fragment_copy(q->mm, fragment);
+
+    if(!copy)
+        return false;
+    push(q, copy, 0);
+    return true;
+}
+
+void dnp3_async_push_invalid(AsyncQueue *q, DNP3_ParseError e)
+{
+    push(q, NULL, e);
+}
+
+size_t dnp3_async_depth(const AsyncQueue *q)
+{
+    return q->head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+}
+
+AsyncQueue *dnp3_async_new(HAllocator *mm, size_t len,
+                           DNP3_Callbacks cb, void *env)
+{
+    size_t n = 1;
+    while(n < len)
+        n *= 2;
+
+    AsyncQueue *q = malloc(sizeof(AsyncQueue) + n * sizeof(struct Item));
+    if(!q)
+        return NULL;
+
+    q->head = 0;
+    q->tail = 0;
+    q->sleeping = 0;
+    q->waiting = 0;
+    q->done = false;
+    q->mm = mm;
+    q->cb = cb;
+    q->env = env;
+    q->len = n;
+
+    if(pthread_mutex_init(&q->lock, NULL) != 0)
+        goto err;
+    if(pthread_cond_init(&q->wake, NULL) != 0)
+        goto err_lock;
+    if(pthread_cond_init(&q->space, NULL) != 0)
+        goto err_wake;
+    if(pthread_create(&q->thread, NULL, consumer_main, q) != 0)
+        goto err_space;
+
+    return q;
+
+err_space:
+    pthread_cond_destroy(&q->space);
+err_wake:
+    pthread_cond_destroy(&q->wake);
+err_lock:
+    pthread_mutex_destroy(&q->lock);
+err:
+    free(q);
+    return NULL;
+}
+
+void dnp3_async_free(AsyncQueue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->done = true;
+    pthread_cond_signal(&q->wake);
+    pthread_mutex_unlock(&q->lock);
+
+    pthread_join(q->thread, NULL);
+    assert(q->head == q->tail);
+
+    pthread_cond_destroy(&q->space);
+    pthread_cond_destroy(&q->wake);
+    pthread_mutex_destroy(&q->lock);
+    free(q);
+}
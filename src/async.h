@@ -0,0 +1,29 @@
+// asynchronous delivery of app-layer results (see async.c)
+
+#ifndef DNP3_ASYNC_H_SEEN
+#define DNP3_ASYNC_H_SEEN
+
+#include <dnp3hammer.h>
+
+
+typedef struct AsyncQueue AsyncQueue;
+
+// start a consumer thread that calls cb.app_fragment and cb.app_invalid
+// (with env) for every item pushed, in order. fragments are copied into mm
+// and the callback takes ownership of them (see dnp3_fragment_release).
+// len is the capacity of the queue, rounded up to a power of 2.
+AsyncQueue *dnp3_async_new(HAllocator *mm, size_t len,
+                           DNP3_Callbacks cb, void *env);
+
+// queue a result; waits while the queue is full.
+// returns false if the fragment could not be copied.
+bool dnp3_async_push_fragment(AsyncQueue *q, const DNP3_Fragment *fragment);
+void dnp3_async_push_invalid(AsyncQueue *q, DNP3_ParseError e);
+
+// number of items waiting; only meaningful on the producing thread
+size_t dnp3_async_depth(const AsyncQueue *q);
+
+// deliver everything queued, stop the thread, and free q
+void dnp3_async_free(AsyncQueue *q);
+
+#endif // DNP3_ASYNC_H_SEEN
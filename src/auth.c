@@ -0,0 +1,231 @@
+// secure authentication: session key cache and aggressive-mode MACs
+//
+// an aggressive-mode message (IEEE 1815-2012 7.5.2.3.3) carries a g120v3
+// object first and a g120v9 MAC last. the MAC is computed with the session
+// key of the sender's direction over the last challenge message (g120v1)
+// the sender received from the other station, followed by the message
+// itself up to the MAC object. so the cache keeps, per (src,dst), the
+// prepared key (see mac.c) and the last challenge seen from dst to src.
+// the fragment is covered in place, as reassembled by the dissector.
+//
+// readers (verify) share a lock with each other; updates (set, challenge)
+// take it exclusively. challenges are only kept for associations that have
+// a key, so traffic cannot grow the cache.
+//
+// only HMAC-SHA-256 is verified. a challenge that asks for anything else
+// (SHA-1, AES-GMAC) supersedes the last one but is not kept, so replies to
+// it go unchecked rather than failed.
+
+#include <dnp3hammer.h>
+#include "hammer.h"     // h_system_allocator
+#include "mac.h"
+
+#include <pthread.h>
+#include <string.h>
+
+
+#define NBUCKETS 256
+#define CHALLENGEMAX 256    // longer challenge messages are not kept, see
+                            // dnp3_keycache_challenge
+#define MACMIN 8            // shortest MAC accepted (SAv5: 8, 10, 12, 16)
+
+// MAC algorithm codes (mal) in g120v1 challenges
+#define MAL_SHA256_8    3   // HMAC-SHA-256 truncated to 8 octets (serial)
+#define MAL_SHA256_16   4   // ditto, 16 octets (networked)
+
+struct Assoc {
+    struct Assoc *next;         // hash chain
+    uint16_t src, dst;
+    DNP3_MacKey key;
+
+    // the last challenge message from dst to src, nchallenge = 0 if none
+    uint8_t challenge[CHALLENGEMAX];
+    size_t nchallenge;
+    size_t cdoff;               // offset of the challenge data in it
+};
+
+struct DNP3_KeyCache_ {
+    HAllocator *mm;
+    pthread_rwlock_t lock;
+    struct Assoc *tab[NBUCKETS];
+};
+
+
+static inline size_t hash(uint16_t src, uint16_t dst)
+{
+    return (src * 31u + dst) % NBUCKETS;
+}
+
+static struct Assoc **find(DNP3_KeyCache *kc, uint16_t src, uint16_t dst)
+{
+    struct Assoc **pa = &kc->tab[hash(src, dst)];
+
+    for(; *pa; pa = &(*pa)->next) {
+        if((*pa)->src == src && (*pa)->dst == dst)
+            break;
+    }
+    return pa;
+}
+
+DNP3_KeyCache *dnp3_keycache_new(HAllocator *mm)
+{
+    if(!mm)
+        mm = h_system_allocator;
+
+    DNP3_KeyCache *kc = mm->alloc(mm, sizeof(DNP3_KeyCache));
+    if(!kc)
+        return NULL;
+    memset(kc, 0, sizeof *kc);
+    kc->mm = mm;
+    if(pthread_rwlock_init(&kc->lock, NULL) != 0) {
+        mm->free(mm, kc);
+        return NULL;
+    }
+    return kc;
+}
+
+void dnp3_keycache_free(DNP3_KeyCache *kc)
+{
+    for(size_t i=0; i<NBUCKETS; i++) {
+        struct Assoc *a;
+        while((a = kc->tab[i])) {
+            kc->tab[i] = a->next;
+            memset(&a->key, 0, sizeof a->key);
+            kc->mm->free(kc->mm, a);
+        }
+    }
+    pthread_rwlock_destroy(&kc->lock);
+    kc->mm->free(kc->mm, kc);
+}
+
+bool dnp3_keycache_set(DNP3_KeyCache *kc, uint16_t src, uint16_t dst,
+                       DNP3_MacAlgorithm alg, const uint8_t *key, size_t len)
+{
+    DNP3_MacKey k;
+
+    if(key && alg != DNP3_MAC_HMAC_SHA256)
+        return false;
+
+    // NB: prepare the key outside the lock
+    if(key && !dnp3_mac_key(&k, alg, key, len))
+        return false;
+
+    bool ok = true;
+    pthread_rwlock_wrlock(&kc->lock);
+    struct Assoc **pa = find(kc, src, dst);
+    struct Assoc *a = *pa;
+    if(!key) {
+        if(a) {
+            *pa = a->next;
+            memset(&a->key, 0, sizeof a->key);
+            kc->mm->free(kc->mm, a);
+        }
+    } else if(a) {
+        a->key = k;
+    } else if((a = kc->mm->alloc(kc->mm, sizeof(struct Assoc)))) {
+        a->next = NULL;
+        a->src = src;
+        a->dst = dst;
+        a->key = k;
+        a->nchallenge = 0;
+        *pa = a;
+    } else {
+        ok = false;
+    }
+    pthread_rwlock_unlock(&kc->lock);
+
+    memset(&k, 0, sizeof k);
+    return ok;
+}
+
+// is t a challenge message? if so, where is the challenge data?
+// a challenge is a single g120v1 object (qualifier 5B) in an
+// AUTHENTICATE_REQ (from a master) or AUTHENTICATE_RESP (outstation).
+static bool is_challenge(const uint8_t *t, size_t len, size_t *cdoff,
+                         uint8_t *mal)
+{
+    size_t h;
+
+    if(len < 2)
+        return false;
+    if(t[1] == DNP3_AUTHENTICATE_REQ)
+        h = 2;                          // ac, fc
+    else if(t[1] == DNP3_AUTHENTICATE_RESP)
+        h = 4;                          // ac, fc, iin
+    else
+        return false;
+
+    if(len < h + 6 || t[h] != DNP3_GROUP_AUTH
+       || t[h+1] != DNP3_VARIATION_AUTH_CHALLENGE
+       || t[h+2] != 0x5B || t[h+3] != 1)
+        return false;
+
+    // csq (4), usr (2), mal (1), reason (1), challenge data (at least 4)
+    size_t n = t[h+4] | t[h+5] << 8;
+    if(n < 12 || h + 6 + n > len)
+        return false;
+
+    *cdoff = h + 6 + 8;
+    *mal = t[h + 6 + 6];
+    return true;
+}
+
+bool dnp3_keycache_challenge(DNP3_KeyCache *kc, uint16_t src, uint16_t dst,
+                             const uint8_t *t, size_t len)
+{
+    size_t cdoff;
+    uint8_t mal;
+    bool kept = true;
+
+    if(!is_challenge(t, len, &cdoff, &mal))
+        return true;
+
+    // for the association of the challenged station: from dst to src
+    pthread_rwlock_wrlock(&kc->lock);
+    struct Assoc *a = *find(kc, dst, src);
+    if(a) {
+        if(len <= CHALLENGEMAX
+           && (mal == MAL_SHA256_8 || mal == MAL_SHA256_16)) {
+            memcpy(a->challenge, t, len);
+            a->nchallenge = len;
+            a->cdoff = cdoff;
+        } else {
+            // the old challenge is superseded all the same; MACs over the
+            // new one go unchecked
+            a->nchallenge = 0;
+            kept = false;
+        }
+    }
+    pthread_rwlock_unlock(&kc->lock);
+
+    return kept;
+}
+
+DNP3_AuthStatus dnp3_keycache_verify(DNP3_KeyCache *kc,
+                                     uint16_t src, uint16_t dst,
+                                     const DNP3_AuthData *auth,
+                                     const uint8_t *t, size_t len)
+{
+    size_t tail = auth->machdr + auth->maclen;
+
+    if(tail > len || auth->maclen < MACMIN)
+        return DNP3_AUTH_FAILED;
+
+    DNP3_AuthStatus st = DNP3_AUTH_UNCHECKED;
+    pthread_rwlock_rdlock(&kc->lock);
+    const struct Assoc *a = *find(kc, src, dst);
+    if(a && a->nchallenge > 0) {
+        uint8_t mac[DNP3_MAC_MAXLEN];
+        size_t n = dnp3_mac(&a->key, NULL, a->challenge, a->nchallenge,
+                            t, len - tail, mac);
+
+        // NB: compare in constant time
+        uint8_t d = (auth->maclen > n);
+        for(size_t i=0; i<auth->maclen && i<n; i++)
+            d |= mac[i] ^ auth->mac[i];
+        st = d ? DNP3_AUTH_FAILED : DNP3_AUTH_OK;
+    }
+    pthread_rwlock_unlock(&kc->lock);
+
+    return st;
+}
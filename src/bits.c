@@ -0,0 +1,109 @@
+// unpacking of packed binary objects
+//
+// the vector versions replicate each input byte over 8 (or 4) lanes and test
+// one bit per lane against a mask, yielding 16 values per step. SSE2 and NEON
+// are part of the baseline on x86-64 and aarch64, so no runtime dispatch is
+// needed.
+
+#include "bits.h"
+
+#if defined(__SSE2__)
+#define UNPACK_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define UNPACK_NEON
+#include <arm_neon.h>
+#endif
+
+
+void dnp3_unpack_bits_scalar(const uint8_t *in, size_t n, unsigned w,
+                             uint8_t *out)
+{
+    unsigned mask = (1 << w) - 1;
+
+    for(size_t i=0; i<n; i++)
+        out[i] = (in[i*w / 8] >> (i*w % 8)) & mask;
+}
+
+#if defined(UNPACK_SSE2)
+// 16 values from 2 bytes (w=1) or 4 bytes (w=2)
+static inline void unpack16(const uint8_t *in, unsigned w, uint8_t *out)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i v, r;
+
+    if(w == 1) {
+        const __m128i m = _mm_set_epi8(-128,64,32,16,8,4,2,1,
+                                       -128,64,32,16,8,4,2,1);
+        v = _mm_cvtsi32_si128(in[0] | in[1] << 8);
+        v = _mm_unpacklo_epi8(v, v);            // b0 b0 b1 b1
+        v = _mm_unpacklo_epi16(v, v);           // b0 x4, b1 x4
+        v = _mm_unpacklo_epi32(v, v);           // b0 x8, b1 x8
+        r = _mm_cmpeq_epi8(_mm_and_si128(v, m), m);
+        r = _mm_and_si128(r, one);
+    } else {
+        const __m128i lo = _mm_set_epi8(64,16,4,1, 64,16,4,1,
+                                        64,16,4,1, 64,16,4,1);
+        const __m128i hi = _mm_add_epi8(lo, lo);
+        v = _mm_cvtsi32_si128(in[0] | in[1] << 8 | in[2] << 16 |
+                              (uint32_t)in[3] << 24);
+        v = _mm_unpacklo_epi8(v, v);            // b0 b0 b1 b1 b2 b2 b3 b3
+        v = _mm_unpacklo_epi16(v, v);           // b0 x4 ... b3 x4
+        r = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(v, lo), lo), one);
+        r = _mm_or_si128(r, _mm_and_si128(_mm_cmpeq_epi8(
+                                _mm_and_si128(v, hi), hi), _mm_add_epi8(one, one)));
+    }
+    _mm_storeu_si128((__m128i *)out, r);
+}
+#elif defined(UNPACK_NEON)
+static inline void unpack16(const uint8_t *in, unsigned w, uint8_t *out)
+{
+    const uint8x16_t one = vdupq_n_u8(1);
+    uint8x16_t v, r;
+
+    if(w == 1) {
+        static const uint8_t m_[16] = {1,2,4,8,16,32,64,128,
+                                       1,2,4,8,16,32,64,128};
+        v = vcombine_u8(vdup_n_u8(in[0]), vdup_n_u8(in[1]));
+        r = vandq_u8(vtstq_u8(v, vld1q_u8(m_)), one);
+    } else {
+        static const uint8_t lo_[16] = {1,4,16,64, 1,4,16,64,
+                                        1,4,16,64, 1,4,16,64};
+        static const uint8_t i_[16] = {0,0,0,0, 1,1,1,1, 2,2,2,2, 3,3,3,3};
+        uint8x16_t lo = vld1q_u8(lo_);
+        uint8x16_t hi = vaddq_u8(lo, lo);
+        uint8x8_t b = vreinterpret_u8_u32(vdup_n_u32(in[0] | in[1] << 8 |
+                                                     in[2] << 16 |
+                                                     (uint32_t)in[3] << 24));
+        v = vcombine_u8(vtbl1_u8(b, vld1_u8(i_)), vtbl1_u8(b, vld1_u8(i_+8)));
+        r = vandq_u8(vtstq_u8(v, lo), one);
+        r = vorrq_u8(r, vandq_u8(vtstq_u8(v, hi), vaddq_u8(one, one)));
+    }
+    vst1q_u8(out, r);
+}
+#endif
+
+void dnp3_unpack_bits(const uint8_t *in, size_t n, unsigned w, uint8_t *out)
+{
+#if defined(UNPACK_SSE2) || defined(UNPACK_NEON)
+    size_t i;
+
+    for(i=0; i+16 <= n; i+=16)
+        unpack16(in + i*w/8, w, out + i);
+    in += i*w/8;
+    out += i;
+    n -= i;
+#endif
+    dnp3_unpack_bits_scalar(in, n, w, out);
+}
+
+const char *dnp3_unpack_impl(void)
+{
+#if defined(UNPACK_SSE2)
+    return "sse2";
+#elif defined(UNPACK_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,18 @@
+#ifndef DNP3_BITS_H_SEEN
+#define DNP3_BITS_H_SEEN
+
+#include <stdint.h>
+#include <stddef.h>
+
+// expand n packed values of w bits each (w = 1 or 2, LSB first as in g1v1,
+// g3v1, g10v1) into one byte per value. in must hold (n*w+7)/8 bytes.
+void dnp3_unpack_bits(const uint8_t *in, size_t n, unsigned w, uint8_t *out);
+
+// the plain C version behind dnp3_unpack_bits() for reference
+void dnp3_unpack_bits_scalar(const uint8_t *in, size_t n, unsigned w,
+                             uint8_t *out);
+
+// the name of the implementation used by dnp3_unpack_bits()
+const char *dnp3_unpack_impl(void);
+
+#endif // DNP3_BITS_H_SEEN
@@ -0,0 +1,317 @@
+#include <dnp3hammer.h>
+
+#include <string.h>
+#include <assert.h>
+#include "app.h"        // GV()
+#include "columns.h"
+#include "objects.h"
+
+
+// compact columnar object storage
+
+// column types by registry value field
+#define COLTYPE_NONE    DNP3_COL_NONE
+#define COLTYPE_U16     DNP3_COL_UINT32
+#define COLTYPE_U32     DNP3_COL_UINT32
+#define COLTYPE_S16     DNP3_COL_INT32
+#define COLTYPE_S32     DNP3_COL_INT32
+#define COLTYPE_F32     DNP3_COL_FLOAT
+#define COLTYPE_F64     DNP3_COL_DOUBLE
+
+// one spec per registry entry; only those marked "col" are handed out
+static const DNP3_ColumnSpec specs[DNP3_NOBJECTS] = {
+#define X(g,v, size,bits,fl,res, val,time, fmt, col,dec,ev) \
+    {G_V(g,v), bits, fl, COLTYPE_##val, OBJ_TIME_##time != OBJ_TIME_NONE},
+    DNP3_OBJECTS(X)
+#undef X
+};
+
+const DNP3_ColumnSpec *dnp3_column_spec(DNP3_Group g, DNP3_Variation v)
+{
+    const DNP3_ObjectInfo *info = dnp3_object_info(g, v);
+
+    if(!info || !info->columnar)
+        return NULL;
+    return &specs[info - dnp3_objects];
+}
+
+static size_t value_size(DNP3_ColumnType t)
+{
+    switch(t) {
+    case DNP3_COL_INT32:    return sizeof(int32_t);
+    case DNP3_COL_UINT32:   return sizeof(uint32_t);
+    case DNP3_COL_FLOAT:    return sizeof(float);
+    case DNP3_COL_DOUBLE:   return sizeof(double);
+    default:                return 0;
+    }
+}
+
+DNP3_Columns *dnp3_columns_new(HArena *arena, const DNP3_ColumnSpec *spec,
+                               size_t n)
+{
+    DNP3_Columns *cols = h_arena_malloc(arena, sizeof(DNP3_Columns));
+
+    memset(cols, 0, sizeof(DNP3_Columns));
+    cols->bitwidth = spec->bitwidth;
+    cols->valuetype = spec->valuetype;
+    if(n == 0)
+        return cols;
+
+    if(spec->bitwidth) {
+        size_t len = (n * spec->bitwidth + 7) / 8;
+        cols->bits = h_arena_malloc(arena, len);
+        memset(cols->bits, 0, len);
+    }
+    if(spec->flags)
+        cols->flags = h_arena_malloc(arena, n);
+    if(spec->valuetype)
+        cols->values = h_arena_malloc(arena, n * value_size(spec->valuetype));
+    if(spec->time)
+        cols->times = h_arena_malloc(arena, n * sizeof(DNP3_Time));
+
+    return cols;
+}
+
+// is the timestamp of objects of this type relative to a CTO?
+static bool reltime(DNP3_Group g, DNP3_Variation v)
+{
+    return (g << 8 | v) == GV(BININEV, RELTIME) ||
+           (g << 8 | v) == GV(DBLBITINEV, RELTIME);
+}
+
+void dnp3_columns_set(DNP3_Columns *cols, const DNP3_ColumnSpec *spec,
+                      size_t i, const DNP3_Object *o)
+{
+    // NB: flags are at the same place in all object types concerned
+    if(cols->bits) {
+        unsigned w = cols->bitwidth;
+        unsigned x = (w == 2) ? o->dblbit : o->bit;
+        cols->bits[i*w / 8] |= x << (i*w % 8);
+    }
+    if(cols->flags)
+        cols->flags[i] = dnp3_flags_encode(spec->group, o->flags);
+    switch(spec->valuetype) {
+    case DNP3_COL_INT32:  ((int32_t *)cols->values)[i] = o->ana.sint; break;
+    case DNP3_COL_UINT32: ((uint32_t *)cols->values)[i] = o->ctr.value; break;
+    case DNP3_COL_FLOAT:  ((float *)cols->values)[i] = o->ana.flt; break;
+    case DNP3_COL_DOUBLE: ((double *)cols->values)[i] = o->ana.flt; break;
+    default: break;
+    }
+    if(cols->times) {
+        if(reltime(spec->group, spec->variation))
+            cols->times[i] = o->timed.reltime;
+        else
+            cols->times[i] = o->timed.abstime;
+    }
+}
+
+
+// flags octets
+//
+// bits 0-4 are common to all types (online, restart, comm_lost,
+// remote_forced, local_forced). the rest depends on the group.
+
+enum {
+    F_BIN,  // 5 chatter_filter, 7 state
+    F_DBL,  // 5 chatter_filter, 6-7 state
+    F_OUT,  // 7 state
+    F_CTR,  // 5 (rollover, ignored), 6 discontinuity
+    F_ANA   // 5 over_range, 6 reference_err
+};
+
+static int flags_kind(DNP3_Group g)
+{
+    switch(g) {
+    case DNP3_GROUP_BININ:
+    case DNP3_GROUP_BININEV:        return F_BIN;
+    case DNP3_GROUP_DBLBITIN:
+    case DNP3_GROUP_DBLBITINEV:     return F_DBL;
+    case DNP3_GROUP_BINOUT:
+    case DNP3_GROUP_BINOUTEV:       return F_OUT;
+    case DNP3_GROUP_CTR:
+    case DNP3_GROUP_FROZENCTR:
+    case DNP3_GROUP_CTREV:
+    case DNP3_GROUP_FROZENCTREV:    return F_CTR;
+    default:                        return F_ANA;
+    }
+}
+
+uint8_t dnp3_flags_encode(DNP3_Group g, DNP3_Flags f)
+{
+    uint8_t x = f.online | f.restart << 1 | f.comm_lost << 2
+              | f.remote_forced << 3 | f.local_forced << 4;
+
+    switch(flags_kind(g)) {
+    case F_BIN: x |= f.chatter_filter << 5 | (f.state & 1) << 7; break;
+    case F_DBL: x |= f.chatter_filter << 5 | f.state << 6; break;
+    case F_OUT: x |= (f.state & 1) << 7; break;
+    case F_CTR: x |= f.discontinuity << 6; break;
+    case F_ANA: x |= f.over_range << 5 | f.reference_err << 6; break;
+    }
+    return x;
+}
+
+DNP3_Flags dnp3_flags_decode(DNP3_Group g, uint8_t x)
+{
+    DNP3_Flags f = {0};
+
+    f.online        = x;
+    f.restart       = x >> 1;
+    f.comm_lost     = x >> 2;
+    f.remote_forced = x >> 3;
+    f.local_forced  = x >> 4;
+    switch(flags_kind(g)) {
+    case F_BIN: f.chatter_filter = x >> 5; f.state = x >> 7; break;
+    case F_DBL: f.chatter_filter = x >> 5; f.state = x >> 6; break;
+    case F_OUT: f.state = x >> 7; break;
+    case F_CTR: f.discontinuity = x >> 6; break;
+    case F_ANA: f.over_range = x >> 5; f.reference_err = x >> 6; break;
+    }
+    return f;
+}
+
+
+// accessors
+
+DNP3_Object dnp3_oblock_object(const DNP3_ObjectBlock *ob, size_t i)
+{
+    dnp3_oblock_force(ob);
+
+    const DNP3_Columns *cols = ob->columns;
+    DNP3_Object o;
+
+    assert(i < ob->count);
+    if(ob->objects)
+        return ob->objects[i];
+
+    memset(&o, 0, sizeof(o));
+    if(!cols)
+        return o;
+
+    // NB: flags are at the same place in all object types concerned
+    if(cols->bits) {
+        if(cols->bitwidth == 2)
+            o.dblbit = dnp3_oblock_state(ob, i);
+        else
+            o.bit = dnp3_oblock_state(ob, i);
+    }
+    if(cols->flags)
+        o.flags = dnp3_flags_decode(ob->group, cols->flags[i]);
+    switch(cols->valuetype) {
+    case DNP3_COL_INT32:  o.ana.sint = dnp3_oblock_int(ob, i); break;
+    case DNP3_COL_UINT32: o.ctr.value = dnp3_oblock_uint(ob, i); break;
+    case DNP3_COL_FLOAT:
+    case DNP3_COL_DOUBLE: o.ana.flt = dnp3_oblock_float(ob, i); break;
+    default: break;
+    }
+    if(cols->times) {
+        if(reltime(ob->group, ob->variation)) {
+            o.timed.reltime = cols->times[i];
+            o.timed.abstime = ob->ctovar ? ob->cto + o.timed.reltime : 0;
+            o.timed.cto = ob->ctovar;
+        } else {
+            o.timed.abstime = cols->times[i];
+        }
+    }
+
+    return o;
+}
+
+unsigned dnp3_oblock_state(const DNP3_ObjectBlock *ob, size_t i)
+{
+    dnp3_oblock_force(ob);
+
+    const DNP3_Columns *cols = ob->columns;
+
+    assert(i < ob->count);
+    if(cols && cols->bits) {
+        unsigned w = cols->bitwidth;
+        return (cols->bits[i*w / 8] >> (i*w % 8)) & ((1 << w) - 1);
+    }
+    if(ob->objects) {
+        DNP3_Object o = ob->objects[i];
+        switch(ob->group << 8 | ob->variation) {
+        case GV(BININ, PACKED):
+        case GV(BINOUT, PACKED):    return o.bit;
+        case GV(DBLBITIN, PACKED):  return o.dblbit;
+        default:                    return o.flags.state;
+        }
+    }
+    return dnp3_oblock_flags(ob, i).state;
+}
+
+DNP3_Flags dnp3_oblock_flags(const DNP3_ObjectBlock *ob, size_t i)
+{
+    dnp3_oblock_force(ob);
+
+    const DNP3_Columns *cols = ob->columns;
+    DNP3_Flags f = {0};
+
+    assert(i < ob->count);
+    if(ob->objects)
+        return ob->objects[i].flags;
+    if(cols && cols->flags)
+        return dnp3_flags_decode(ob->group, cols->flags[i]);
+    return f;
+}
+
+int32_t dnp3_oblock_int(const DNP3_ObjectBlock *ob, size_t i)
+{
+    dnp3_oblock_force(ob);
+
+    const DNP3_Columns *cols = ob->columns;
+
+    assert(i < ob->count);
+    if(ob->objects)
+        return ob->objects[i].ana.sint;
+    if(cols && cols->valuetype == DNP3_COL_INT32)
+        return ((const int32_t *)cols->values)[i];
+    return 0;
+}
+
+uint32_t dnp3_oblock_uint(const DNP3_ObjectBlock *ob, size_t i)
+{
+    dnp3_oblock_force(ob);
+
+    const DNP3_Columns *cols = ob->columns;
+
+    assert(i < ob->count);
+    if(ob->objects)
+        return ob->objects[i].ctr.value;
+    if(cols && cols->valuetype == DNP3_COL_UINT32)
+        return ((const uint32_t *)cols->values)[i];
+    return 0;
+}
+
+double dnp3_oblock_float(const DNP3_ObjectBlock *ob, size_t i)
+{
+    dnp3_oblock_force(ob);
+
+    const DNP3_Columns *cols = ob->columns;
+
+    assert(i < ob->count);
+    if(ob->objects)
+        return ob->objects[i].ana.flt;
+    if(cols && cols->valuetype == DNP3_COL_FLOAT)
+        return ((const float *)cols->values)[i];
+    if(cols && cols->valuetype == DNP3_COL_DOUBLE)
+        return ((const double *)cols->values)[i];
+    return 0;
+}
+
+DNP3_Time dnp3_oblock_time(const DNP3_ObjectBlock *ob, size_t i)
+{
+    dnp3_oblock_force(ob);
+
+    const DNP3_Columns *cols = ob->columns;
+
+    assert(i < ob->count);
+    if(ob->objects) {
+        if(reltime(ob->group, ob->variation))
+            return ob->objects[i].timed.reltime;
+        return ob->objects[i].timed.abstime;
+    }
+    if(cols && cols->times)
+        return cols->times[i];
+    return 0;
+}
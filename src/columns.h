@@ -0,0 +1,45 @@
+// columnar object storage (DNP3_Columns)
+//
+// blocks of objects of a single, fixed-size type can be kept in typed
+// columns instead of an array of DNP3_Object. the layout of each type is
+// given by a column spec.
+
+#ifndef DNP3_COLUMNS_H_SEEN
+#define DNP3_COLUMNS_H_SEEN
+
+#include <dnp3hammer.h>
+
+
+typedef struct {
+    DNP3_Group      group;
+    DNP3_Variation  variation;
+    uint8_t         bitwidth;   // packed states
+    bool            flags;      // flags octet
+    DNP3_ColumnType valuetype;
+    bool            time;       // timestamp (abstime or reltime)
+} DNP3_ColumnSpec;
+
+// the column spec for the given group and variation, NULL if none applies
+const DNP3_ColumnSpec *dnp3_column_spec(DNP3_Group g, DNP3_Variation v);
+
+// allocate columns for n objects
+DNP3_Columns *dnp3_columns_new(HArena *arena, const DNP3_ColumnSpec *spec,
+                               size_t n);
+
+// store object o at position i
+void dnp3_columns_set(DNP3_Columns *cols, const DNP3_ColumnSpec *spec,
+                      size_t i, const DNP3_Object *o);
+
+// decode the objects of a lazily parsed block before use
+static inline void dnp3_oblock_force(const DNP3_ObjectBlock *ob)
+{
+    if(ob->lazy)
+        dnp3_oblock_objects((DNP3_ObjectBlock *)ob);
+}
+
+// convert between flag octets and DNP3_Flags for objects of group g
+uint8_t dnp3_flags_encode(DNP3_Group g, DNP3_Flags flags);
+DNP3_Flags dnp3_flags_decode(DNP3_Group g, uint8_t x);
+
+
+#endif // DNP3_COLUMNS_H_SEEN
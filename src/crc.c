@@ -0,0 +1,275 @@
+// DNP3 CRC-16 (reflected polynomial 0xA6BC, final inversion)
+//
+// There are three implementations:
+//
+//   bytewise   the textbook table lookup, one byte at a time
+//   slice8     "slicing-by-8", eight table lookups per 8 bytes of input
+//   clmul      carry-less multiplication, 2 multiplies per 8 bytes of input
+//
+// The latter uses a Montgomery-style reduction: With V the next 8 input bytes
+// (little-endian) xor'ed with the running CRC and P the (reflected) generator
+// polynomial of degree 16, let Q = V * P^-1 mod x^64. Then (Q * P) >> 64 is
+// the CRC over V. Since DNP3 data blocks are only 16 bytes, this beats the
+// usual folding approaches which only pay off for long inputs.
+//
+// dnp3_crc() picks one at runtime, preferring clmul where the CPU has it.
+
+#include <dnp3hammer.h>
+#include <pthread.h>
+#include "crc.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CLMUL_X86
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+#define CLMUL_ARM
+#include <arm_neon.h>
+#endif
+
+
+// from IEEE Std 1815-2012 Annex E
+static const uint16_t crctable[256] = {
+    0x0000, 0x365E, 0x6CBC, 0x5AE2, 0xD978, 0xEF26, 0xB5C4, 0x839A,
+    0xFF89, 0xC9D7, 0x9335, 0xA56B, 0x26F1, 0x10AF, 0x4A4D, 0x7C13,
+    0xB26B, 0x8435, 0xDED7, 0xE889, 0x6B13, 0x5D4D, 0x07AF, 0x31F1,
+    0x4DE2, 0x7BBC, 0x215E, 0x1700, 0x949A, 0xA2C4, 0xF826, 0xCE78,
+    0x29AF, 0x1FF1, 0x4513, 0x734D, 0xF0D7, 0xC689, 0x9C6B, 0xAA35,
+    0xD626, 0xE078, 0xBA9A, 0x8CC4, 0x0F5E, 0x3900, 0x63E2, 0x55BC,
+    0x9BC4, 0xAD9A, 0xF778, 0xC126, 0x42BC, 0x74E2, 0x2E00, 0x185E,
+    0x644D, 0x5213, 0x08F1, 0x3EAF, 0xBD35, 0x8B6B, 0xD189, 0xE7D7,
+    0x535E, 0x6500, 0x3FE2, 0x09BC, 0x8A26, 0xBC78, 0xE69A, 0xD0C4,
+    0xACD7, 0x9A89, 0xC06B, 0xF635, 0x75AF, 0x43F1, 0x1913, 0x2F4D,
+    0xE135, 0xD76B, 0x8D89, 0xBBD7, 0x384D, 0x0E13, 0x54F1, 0x62AF,
+    0x1EBC, 0x28E2, 0x7200, 0x445E, 0xC7C4, 0xF19A, 0xAB78, 0x9D26,
+    0x7AF1, 0x4CAF, 0x164D, 0x2013, 0xA389, 0x95D7, 0xCF35, 0xF96B,
+    0x8578, 0xB326, 0xE9C4, 0xDF9A, 0x5C00, 0x6A5E, 0x30BC, 0x06E2,
+    0xC89A, 0xFEC4, 0xA426, 0x9278, 0x11E2, 0x27BC, 0x7D5E, 0x4B00,
+    0x3713, 0x014D, 0x5BAF, 0x6DF1, 0xEE6B, 0xD835, 0x82D7, 0xB489,
+    0xA6BC, 0x90E2, 0xCA00, 0xFC5E, 0x7FC4, 0x499A, 0x1378, 0x2526,
+    0x5935, 0x6F6B, 0x3589, 0x03D7, 0x804D, 0xB613, 0xECF1, 0xDAAF,
+    0x14D7, 0x2289, 0x786B, 0x4E35, 0xCDAF, 0xFBF1, 0xA113, 0x974D,
+    0xEB5E, 0xDD00, 0x87E2, 0xB1BC, 0x3226, 0x0478, 0x5E9A, 0x68C4,
+    0x8F13, 0xB94D, 0xE3AF, 0xD5F1, 0x566B, 0x6035, 0x3AD7, 0x0C89,
+    0x709A, 0x46C4, 0x1C26, 0x2A78, 0xA9E2, 0x9FBC, 0xC55E, 0xF300,
+    0x3D78, 0x0B26, 0x51C4, 0x679A, 0xE400, 0xD25E, 0x88BC, 0xBEE2,
+    0xC2F1, 0xF4AF, 0xAE4D, 0x9813, 0x1B89, 0x2DD7, 0x7735, 0x416B,
+    0xF5E2, 0xC3BC, 0x995E, 0xAF00, 0x2C9A, 0x1AC4, 0x4026, 0x7678,
+    0x0A6B, 0x3C35, 0x66D7, 0x5089, 0xD313, 0xE54D, 0xBFAF, 0x89F1,
+    0x4789, 0x71D7, 0x2B35, 0x1D6B, 0x9EF1, 0xA8AF, 0xF24D, 0xC413,
+    0xB800, 0x8E5E, 0xD4BC, 0xE2E2, 0x6178, 0x5726, 0x0DC4, 0x3B9A,
+    0xDC4D, 0xEA13, 0xB0F1, 0x86AF, 0x0535, 0x336B, 0x6989, 0x5FD7,
+    0x23C4, 0x159A, 0x4F78, 0x7926, 0xFABC, 0xCCE2, 0x9600, 0xA05E,
+    0x6E26, 0x5878, 0x029A, 0x34C4, 0xB75E, 0x8100, 0xDBE2, 0xEDBC,
+    0x91AF, 0xA7F1, 0xFD13, 0xCB4D, 0x48D7, 0x7E89, 0x246B, 0x1235
+};
+
+// slicetab[k][b] = CRC register after byte b followed by k zero bytes
+static uint16_t slicetab[8][256];
+
+// reflected generator polynomial incl. the x^16 term, and its inverse mod x^64
+#define CRC_P    0x14D79ULL
+#define CRC_PINV 0x124F9628F81E8E39ULL
+
+
+static inline uint16_t le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint64_t le64(const uint8_t *p)
+{
+    return (uint64_t)p[0]       | (uint64_t)p[1] << 8  |
+           (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+           (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+           (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static inline uint16_t crc_tail(uint16_t crc, const uint8_t *p, size_t len)
+{
+    while(len--)
+        crc = (crc>>8) ^ crctable[(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+static inline uint16_t crc_slice8(uint16_t crc, const uint8_t *p, size_t len)
+{
+    for(; len >= 8; p += 8, len -= 8) {
+        uint64_t x = le64(p) ^ crc;
+        crc = slicetab[7][x & 0xFF]       ^ slicetab[6][(x>>8) & 0xFF]  ^
+              slicetab[5][(x>>16) & 0xFF] ^ slicetab[4][(x>>24) & 0xFF] ^
+              slicetab[3][(x>>32) & 0xFF] ^ slicetab[2][(x>>40) & 0xFF] ^
+              slicetab[1][(x>>48) & 0xFF] ^ slicetab[0][x>>56];
+    }
+    return crc_tail(crc, p, len);
+}
+
+#if defined(CLMUL_X86)
+#define CLMUL_TARGET __attribute__((target("sse2,pclmul")))
+
+CLMUL_TARGET
+static inline uint16_t crc_clmul(uint16_t crc, const uint8_t *p, size_t len)
+{
+    const __m128i k = _mm_set_epi64x(CRC_P, CRC_PINV);
+
+    for(; len >= 8; p += 8, len -= 8) {
+        __m128i v = _mm_set_epi64x(0, le64(p) ^ crc);
+        v = _mm_clmulepi64_si128(v, k, 0x00);       // Q = V * P^-1 mod x^64
+        v = _mm_clmulepi64_si128(v, k, 0x10);       // Q * P
+        crc = _mm_extract_epi16(v, 4);              // bits 64-79
+    }
+    return crc_tail(crc, p, len);
+}
+#elif defined(CLMUL_ARM)
+#define CLMUL_TARGET
+
+static inline uint16_t crc_clmul(uint16_t crc, const uint8_t *p, size_t len)
+{
+    for(; len >= 8; p += 8, len -= 8) {
+        poly128_t q = vmull_p64(le64(p) ^ crc, CRC_PINV);
+        uint64_t ql = vgetq_lane_u64(vreinterpretq_u64_p128(q), 0);
+        poly128_t r = vmull_p64(ql, CRC_P);
+        crc = vgetq_lane_u64(vreinterpretq_u64_p128(r), 1);
+    }
+    return crc_tail(crc, p, len);
+}
+#endif
+
+
+uint16_t dnp3_crc_bytewise(const uint8_t *bytes, size_t len)
+{
+    return ~crc_tail(0, bytes, len);
+}
+
+uint16_t dnp3_crc_slice8(const uint8_t *bytes, size_t len)
+{
+    return ~crc_slice8(0, bytes, len);
+}
+
+#ifdef CLMUL_TARGET
+CLMUL_TARGET
+uint16_t dnp3_crc_clmul(const uint8_t *bytes, size_t len)
+{
+    return ~crc_clmul(0, bytes, len);
+}
+#else
+uint16_t dnp3_crc_clmul(const uint8_t *bytes, size_t len)
+{
+    return dnp3_crc_slice8(bytes, len);     // not available
+}
+#endif
+
+bool dnp3_crc_have_clmul(void)
+{
+#if defined(CLMUL_X86)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul");
+#elif defined(CLMUL_ARM)
+    return true;    // enabled at compile time
+#else
+    return false;
+#endif
+}
+
+
+// verify the CRCs on a sequence of data blocks (cf. dnp3hammer.h)
+// NB: no early exit; independent blocks can be computed in parallel.
+#define BLOCKS_VALID(CRC) do {                          \
+        bool valid = true;                              \
+        while(n > 0) {                                  \
+            size_t k = n<16 ? n : 16;                   \
+            valid &= (le16(p+k) == (uint16_t)~CRC(0, p, k)); \
+            p += k+2;                                   \
+            n -= k;                                     \
+        }                                               \
+        return valid;                                   \
+    } while(0)
+
+static bool blocks_slice8(const uint8_t *p, size_t n)
+{
+    BLOCKS_VALID(crc_slice8);
+}
+
+#ifdef CLMUL_TARGET
+CLMUL_TARGET
+static bool blocks_clmul(const uint8_t *p, size_t n)
+{
+    BLOCKS_VALID(crc_clmul);
+}
+#endif
+
+
+// runtime dispatch
+//
+// NB: the pointers are published with release stores after the tables
+//     are filled, and read with acquire loads, so a thread that sees the
+//     final implementation also sees its tables. setup runs only once
+//     (pthread_once) even if several threads hit crc_first at a time.
+static uint16_t crc_first(const uint8_t *bytes, size_t len);
+static bool blocks_first(const uint8_t *p, size_t n);
+
+static uint16_t (*crcfun)(const uint8_t *, size_t) = crc_first;
+static bool (*blocksfun)(const uint8_t *, size_t) = blocks_first;
+static const char *crcname = "none";
+static pthread_once_t crconce = PTHREAD_ONCE_INIT;
+
+#define PUBLISH(VAR, X) __atomic_store_n(&(VAR), (X), __ATOMIC_RELEASE)
+#define FETCH(VAR)      __atomic_load_n(&(VAR), __ATOMIC_ACQUIRE)
+
+static void crc_setup(void)
+{
+    // slicing tables, derived from the byte-wise one
+    for(int b=0; b<256; b++) {
+        uint16_t crc = crctable[b];
+        slicetab[0][b] = crc;
+        for(int k=1; k<8; k++) {
+            crc = (crc>>8) ^ crctable[crc & 0xFF];
+            slicetab[k][b] = crc;
+        }
+    }
+
+#ifdef CLMUL_TARGET
+    if(dnp3_crc_have_clmul()) {
+        PUBLISH(crcname, "clmul");
+        PUBLISH(blocksfun, blocks_clmul);
+        PUBLISH(crcfun, dnp3_crc_clmul);
+        return;
+    }
+#endif
+    PUBLISH(crcname, "slice8");
+    PUBLISH(blocksfun, blocks_slice8);
+    PUBLISH(crcfun, dnp3_crc_slice8);
+}
+
+void dnp3_crc_init(void)
+{
+    pthread_once(&crconce, crc_setup);
+}
+
+// initialize on first use, in case dnp3_init() has not been called
+static uint16_t crc_first(const uint8_t *bytes, size_t len)
+{
+    dnp3_crc_init();
+    return FETCH(crcfun)(bytes, len);
+}
+
+static bool blocks_first(const uint8_t *p, size_t n)
+{
+    dnp3_crc_init();
+    return FETCH(blocksfun)(p, n);
+}
+
+const char *dnp3_crc_impl(void)
+{
+    return FETCH(crcname);
+}
+
+uint16_t dnp3_crc(const uint8_t *bytes, size_t len)
+{
+    return FETCH(crcfun)(bytes, len);
+}
+
+bool dnp3_crc_blocks_valid(const uint8_t *blocks, size_t n)
+{
+    return FETCH(blocksfun)(blocks, n);
+}
@@ -0,0 +1,23 @@
+#ifndef DNP3_CRC_H_SEEN
+#define DNP3_CRC_H_SEEN
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// the individual CRC implementations behind dnp3_crc()
+// all of them yield the complete DNP3 CRC (including the final inversion)
+uint16_t dnp3_crc_bytewise(const uint8_t *bytes, size_t len);
+uint16_t dnp3_crc_slice8(const uint8_t *bytes, size_t len);
+uint16_t dnp3_crc_clmul(const uint8_t *bytes, size_t len);
+    // carry-less multiply (PCLMULQDQ or PMULL); only if dnp3_crc_have_clmul()
+
+bool dnp3_crc_have_clmul(void);
+
+// the name of the implementation selected by dnp3_crc()
+const char *dnp3_crc_impl(void);
+
+// fill tables and select an implementation based on CPU features
+void dnp3_crc_init(void);
+
+#endif // DNP3_CRC_H_SEEN
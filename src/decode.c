@@ -0,0 +1,482 @@
+// direct decoding of common response fragments
+//
+// most of the time spent on large responses (e.g. integrity polls of many
+// analogs) goes into running the grammar once per object. for blocks of
+// fixed-size objects, however, the size of the object data is known from the
+// object header, so after checking the header we can loop over the raw bytes.
+//
+// dnp3_app_decode_fragment only handles fragments that consist entirely of
+// such blocks (including packed binaries, see bits.c) and that the grammar
+// would accept without error. anything else is left to the grammar
+// (dnp3_p_app_fragment) by returning NULL.
+//
+// dnp3_app_decode_headers does all the checks but stops short of decoding
+// the objects; each block keeps a pointer into the input and decodes them
+// on first use (dnp3_oblock_objects).
+
+#include <dnp3hammer.h>
+
+#include <hammer/hammer.h>
+#include <hammer/glue.h>
+#include <string.h>
+#include "hammer.h"
+#include "app.h"
+#include "columns.h"
+#include "bits.h"
+#include "objects.h"
+#include "profile.h"
+
+
+// object layouts
+//
+// every object is an optional flags octet, followed by an optional value and
+// an optional timestamp, all little-endian. packed objects are instead bits
+// fields of 1 or 2 bits, padded with zeros to the next octet. the layouts
+// are the registry entries (objects.h) marked "dec".
+
+typedef DNP3_ObjectInfo Layout;
+
+static const Layout *find_layout(DNP3_Group g, DNP3_Variation v)
+{
+    const Layout *l = dnp3_object_info(g, v);
+
+    return (l && l->decode) ? l : NULL;
+}
+
+// little-endian integers of 1, 2, 4, 6, or 8 bytes
+static inline uint64_t le(const uint8_t *p, size_t n)
+{
+    uint64_t x = 0;
+
+    for(size_t i=n; i>0; i--)
+        x = x << 8 | p[i-1];
+    return x;
+}
+
+// decode one object, see block_valid() for the checks
+static void decode_object(const Layout *l, const uint8_t *p, DNP3_Object *o)
+{
+    memset(o, 0, sizeof(DNP3_Object));
+
+    // NB: flags, counter and analog are at the same place in o->timed.
+    if(l->flags) {
+        o->flags = dnp3_flags_decode(l->group, *p);
+        p++;
+    }
+
+    switch(l->value) {
+    case OBJ_VAL_U16: o->ctr.value = le(p, 2); p += 2; break;
+    case OBJ_VAL_U32: o->ctr.value = le(p, 4); p += 4; break;
+    case OBJ_VAL_S16: o->ana.sint = (int16_t)le(p, 2); p += 2; break;
+    case OBJ_VAL_S32: o->ana.sint = (int32_t)le(p, 4); p += 4; break;
+    case OBJ_VAL_F32: {
+        uint32_t x = le(p, 4);
+        float f;
+        memcpy(&f, &x, sizeof(f));
+        o->ana.flt = f;
+        p += 4;
+        break; }
+    case OBJ_VAL_F64: {
+        uint64_t x = le(p, 8);
+        double d;
+        memcpy(&d, &x, sizeof(d));
+        o->ana.flt = d;
+        p += 8;
+        break; }
+    default: break;
+    }
+
+    switch(l->time) {
+    case OBJ_TIME_ABS: o->timed.abstime = le(p, 6); break;
+    case OBJ_TIME_REL: o->timed.reltime = le(p, 2); break;
+    default: break;
+    }
+}
+
+// unpack n packed objects of w bits into ob
+static void decode_packed(unsigned w, const uint8_t *p, size_t n,
+                          DNP3_ObjectBlock *ob)
+{
+    // the compact representation is the same as on the wire
+    if(ob->columns) {
+        memcpy(ob->columns->bits, p, (n * w + 7) / 8);
+        return;
+    }
+
+    for(size_t i=0; i<n; ) {
+        uint8_t v[256];
+        size_t k = n-i < sizeof(v) ? n-i : sizeof(v);
+
+        dnp3_unpack_bits(p + i*w/8, k, w, v);   // NB: i*w is a multiple of 8
+        for(size_t j=0; j<k; j++, i++) {
+            DNP3_Object *o = &ob->objects[i];
+            memset(o, 0, sizeof(DNP3_Object));
+            if(w == 2)
+                o->dblbit = v[j];
+            else
+                o->bit = v[j];
+        }
+    }
+}
+
+// an object header and where its objects are
+typedef struct {
+    const Layout *l;
+    unsigned pc, rsc;
+    uint32_t base;
+    size_t count;
+    size_t iw;                  // width of an index prefix
+    size_t pos;                 // start of the objects
+    size_t end;                 // end of the block
+} BlockHeader;
+
+// read the object header of a block starting at p, false if the block is to
+// be left to the grammar.
+static bool block_header(const uint8_t *p, size_t len, bool unsolicited,
+                         BlockHeader *h)
+{
+    const Layout *l;
+    size_t count, pos = 3;
+    size_t iw = 0;
+    uint32_t base = 0;
+
+    if(len < 3)
+        return false;
+    if(!(l = find_layout(p[0], p[1])))
+        return false;
+    if(unsolicited && !l->event)
+        return false;
+
+    // object header: group, variation, qualifier code
+    uint8_t qc = p[2];
+    unsigned pc = (qc >> 4) & 7, rsc = qc & 0xF;
+    if(qc & 0x80)
+        return false;
+
+    if(pc == 0 && rsc <= 0x5) {
+        // index or address range: start, stop
+        size_t w = (size_t)1 << (rsc % 3);
+        if(len < pos + 2*w)
+            return false;
+        uint64_t start = le(p+pos, w);
+        uint64_t stop  = le(p+pos+w, w);
+        if(start > stop)
+            return false;
+        count = stop - start + 1;
+        base = start;
+        pos += 2*w;
+    } else if(pc >= 1 && pc <= 3 && rsc >= 0x7 && rsc <= 0x9) {
+        // count, followed by prefixed objects
+        size_t w = (size_t)1 << (rsc - 7);
+        if(len < pos + w)
+            return false;
+        count = le(p+pos, w);
+        if(count == 0)
+            return false;
+        iw = (size_t)1 << (pc - 1);
+        pos += w;
+    } else {
+        return false;
+    }
+
+    if(l->bits) {
+        // packed objects only come with ranges
+        if(iw || count > (len - pos) * 8 / l->bits)
+            return false;
+        h->end = pos + (count * l->bits + 7) / 8;
+    } else {
+        if(count > (len - pos) / (iw + l->size))
+            return false;
+        h->end = pos + count * (iw + l->size);
+    }
+
+    h->l = l;
+    h->pc = pc;
+    h->rsc = rsc;
+    h->base = base;
+    h->count = count;
+    h->iw = iw;
+    h->pos = pos;
+    return true;
+}
+
+// check the objects of a block for what the grammar would reject
+static bool block_valid(const BlockHeader *h, const uint8_t *p)
+{
+    const Layout *l = h->l;
+
+    if(l->bits) {
+        // padding must be zero
+        unsigned r = h->count * l->bits % 8;
+        return !(r && (p[h->end - 1] >> r));
+    }
+
+    if(l->flags) {
+        size_t size = h->iw + l->size;
+        for(size_t pos = h->pos + h->iw; pos < h->end; pos += size)
+            if(p[pos] & l->reserved)
+                return false;
+    }
+    return true;
+}
+
+// fill in the object header fields of ob
+static void block_init(DNP3_ObjectBlock *ob, const BlockHeader *h)
+{
+    memset(ob, 0, sizeof(DNP3_ObjectBlock));
+    ob->group = h->l->group;
+    ob->variation = h->l->variation;
+    ob->prefixcode = h->pc;
+    ob->rangespec = h->rsc;
+    ob->range_base = h->base;
+    ob->count = h->count;
+}
+
+// decode the objects (and indexes) of a valid block into ob
+static void decode_objects(HArena *arena, const BlockHeader *h,
+                           const uint8_t *p, DNP3_ObjectBlock *ob)
+{
+    const Layout *l = h->l;
+    size_t count = h->count;
+
+    const DNP3_ColumnSpec *spec = NULL;
+    if(dnp3_p_columnar)
+        spec = dnp3_column_spec(l->group, l->variation);
+    if(spec)
+        ob->columns = dnp3_columns_new(arena, spec, count);
+    else
+        ob->objects = h_arena_malloc(arena, count * sizeof(DNP3_Object));
+
+    if(l->bits) {
+        decode_packed(l->bits, p + h->pos, count, ob);
+        return;
+    }
+
+    size_t iw = h->iw, size = iw + l->size, pos = h->pos;
+    if(iw)
+        ob->indexes = h_arena_malloc(arena, count * sizeof(uint32_t));
+
+    for(size_t i=0; i<count; i++, pos+=size) {
+        DNP3_Object o;
+
+        if(iw)
+            ob->indexes[i] = le(p+pos, iw);
+        decode_object(l, p+pos+iw, &o);
+        if(spec)
+            dnp3_columns_set(ob->columns, spec, i, &o);
+        else
+            ob->objects[i] = o;
+    }
+}
+
+static void block_objects(HArena *arena, const BlockHeader *h,
+                          const uint8_t *p, DNP3_ObjectBlock *ob)
+{
+    unsigned st = dnp3_stage_enter(DNP3_STAGE_OBJECTS, h->l->group);
+    decode_objects(arena, h, p, ob);
+    dnp3_stage_leave(st);
+}
+
+// build the DNP3_ObjectBlock for a valid block
+static DNP3_ObjectBlock *block_decode(HArena *arena, const BlockHeader *h,
+                                      const uint8_t *p)
+{
+    DNP3_ObjectBlock *ob = h_arena_malloc(arena, sizeof(DNP3_ObjectBlock));
+
+    block_init(ob, h);
+    block_objects(arena, h, p, ob);
+    return ob;
+}
+
+// what a lazily parsed block still needs to decode its objects
+struct Lazy {
+    HArena *arena;
+    BlockHeader h;
+    const uint8_t *p;           // the block in the caller's input
+};
+
+// like block_decode but leave the objects for dnp3_oblock_objects()
+static DNP3_ObjectBlock *block_lazy(HArena *arena, const BlockHeader *h,
+                                    const uint8_t *p)
+{
+    DNP3_ObjectBlock *ob = h_arena_malloc(arena, sizeof(DNP3_ObjectBlock));
+    struct Lazy *z = h_arena_malloc(arena, sizeof(struct Lazy));
+
+    block_init(ob, h);
+    z->arena = arena;
+    z->h = *h;
+    z->p = p;
+    ob->lazy = z;
+    return ob;
+}
+
+DNP3_Object *dnp3_oblock_objects(DNP3_ObjectBlock *ob)
+{
+    struct Lazy *z = ob->lazy;
+
+    if(z) {
+        block_objects(z->arena, &z->h, z->p, ob);
+        ob->lazy = NULL;
+    }
+    return ob->objects;
+}
+
+// read the application header: ac, fc, iin
+static bool fragment_header(const uint8_t *p, size_t len, DNP3_Fragment *frag)
+{
+    if(len < 4)
+        return false;
+
+    uint8_t ac = p[0];
+    frag->ac.seq = ac & 0xF;
+    frag->ac.uns = (ac >> 4) & 1;
+    frag->ac.con = (ac >> 5) & 1;
+    frag->ac.fin = (ac >> 6) & 1;
+    frag->ac.fir = (ac >> 7) & 1;
+    frag->fc = p[1];
+    if(frag->fc == DNP3_RESPONSE) {
+        if(frag->ac.uns)
+            return false;
+    } else if(frag->fc == DNP3_UNSOLICITED_RESPONSE) {
+        if(!frag->ac.uns || !frag->ac.con)
+            return false;
+    } else {
+        return false;
+    }
+
+    uint16_t iin = le(p+2, 2);
+    if(iin & 0xC000)        // reserved
+        return false;
+    frag->iin.broadcast         = iin >> DNP3_IIN_BROADCAST;
+    frag->iin.class1            = iin >> DNP3_IIN_CLASS1;
+    frag->iin.class2            = iin >> DNP3_IIN_CLASS2;
+    frag->iin.class3            = iin >> DNP3_IIN_CLASS3;
+    frag->iin.need_time         = iin >> DNP3_IIN_NEED_TIME;
+    frag->iin.local_ctrl        = iin >> DNP3_IIN_LOCAL_CTRL;
+    frag->iin.device_trouble    = iin >> DNP3_IIN_DEVICE_TROUBLE;
+    frag->iin.device_restart    = iin >> DNP3_IIN_DEVICE_RESTART;
+    frag->iin.func_not_supp     = iin >> DNP3_IIN_FUNC_NOT_SUPP;
+    frag->iin.obj_unknown       = iin >> DNP3_IIN_OBJ_UNKNOWN;
+    frag->iin.param_error       = iin >> DNP3_IIN_PARAM_ERROR;
+    frag->iin.eventbuf_overflow = iin >> DNP3_IIN_EVENTBUF_OVERFLOW;
+    frag->iin.already_executing = iin >> DNP3_IIN_ALREADY_EXECUTING;
+    frag->iin.config_corrupt    = iin >> DNP3_IIN_CONFIG_CORRUPT;
+
+    return true;
+}
+
+// check that every block after the header can be decoded
+static bool fragment_valid(const uint8_t *p, size_t len,
+                           const DNP3_Fragment *frag)
+{
+    bool unsolicited = (frag->fc == DNP3_UNSOLICITED_RESPONSE);
+    BlockHeader h;
+
+    for(size_t pos = 4; pos < len; pos += h.end) {
+        if(!block_header(p+pos, len-pos, unsolicited, &h))
+            return false;
+        if(!block_valid(&h, p+pos))
+            return false;
+    }
+    return true;
+}
+
+static bool decode_fragment(HArena *arena, const uint8_t *p, size_t len,
+                            bool lazy, DNP3_Fragment *frag)
+{
+    if(!fragment_header(p, len, frag))
+        return false;
+
+    // object blocks, until the end of input
+    bool unsolicited = (frag->fc == DNP3_UNSOLICITED_RESPONSE);
+    size_t pos = 4, cap = 0;
+    while(pos < len) {
+        BlockHeader h;
+        if(!block_header(p+pos, len-pos, unsolicited, &h))
+            return false;
+        if(!block_valid(&h, p+pos))
+            return false;
+        DNP3_ObjectBlock *ob = lazy ? block_lazy(arena, &h, p+pos)
+                                    : block_decode(arena, &h, p+pos);
+        pos += h.end;
+
+        if(frag->nblocks == cap) {
+            DNP3_ObjectBlock **old = frag->odata;
+            cap = cap ? 2*cap : 8;
+            frag->odata = h_arena_malloc(arena, cap * sizeof(*old));
+            if(old)
+                memcpy(frag->odata, old, frag->nblocks * sizeof(*old));
+        }
+        frag->odata[frag->nblocks++] = ob;
+    }
+
+    return true;
+}
+
+static HParseResult *decode(HAllocator *mm, const uint8_t *input, size_t len,
+                           bool lazy)
+{
+    if(!mm)
+        mm = h_system_allocator;
+
+    // NB: like h_parse__m, this aborts if mm refuses an allocation
+    HArena *arena = h_new_arena(mm, 0);
+
+    DNP3_Fragment *frag = h_arena_malloc(arena, sizeof(DNP3_Fragment));
+    memset(frag, 0, sizeof(DNP3_Fragment));
+    if(!decode_fragment(arena, input, len, lazy, frag)) {
+        h_delete_arena(arena);
+        return NULL;
+    }
+
+    HParseResult *res = h_arena_malloc(arena, sizeof(HParseResult));
+    res->ast = h_make(arena, TT_DNP3_Fragment, frag);
+    res->bit_length = len * 8;
+    res->arena = arena;
+    return res;
+}
+
+// hand-written equivalent of dnp3_p_app_fragment, see dnp3hammer.h
+HParseResult *dnp3_app_decode_fragment(HAllocator *mm, const uint8_t *input,
+                                       size_t len)
+{
+    return decode(mm, input, len, false);
+}
+
+// header-only variant of dnp3_app_decode_fragment, see dnp3hammer.h
+HParseResult *dnp3_app_decode_headers(HAllocator *mm, const uint8_t *input,
+                                      size_t len)
+{
+    return decode(mm, input, len, true);
+}
+
+// streaming variant of dnp3_app_decode_fragment, see dnp3hammer.h
+bool dnp3_app_decode_blocks(HAllocator *mm, const uint8_t *input, size_t len,
+                            DNP3_Fragment *frag,
+                            void (*f)(void *env, const DNP3_Fragment *frag,
+                                      const DNP3_ObjectBlock *ob),
+                            void *env)
+{
+    if(!mm)
+        mm = h_system_allocator;
+
+    memset(frag, 0, sizeof(DNP3_Fragment));
+    if(!fragment_header(input, len, frag))
+        return false;
+
+    // check everything first; f must not see blocks of a fragment that is
+    // then left to the grammar
+    if(!fragment_valid(input, len, frag))
+        return false;
+
+    bool unsolicited = (frag->fc == DNP3_UNSOLICITED_RESPONSE);
+    BlockHeader h;
+    for(size_t pos = 4; pos < len; pos += h.end) {
+        HArena *arena = h_new_arena(mm, 0);
+        block_header(input+pos, len-pos, unsolicited, &h);
+        f(env, frag, block_decode(arena, &h, input+pos));
+        h_delete_arena(arena);
+    }
+
+    return true;
+}
@@ -2,41 +2,136 @@
 #include <hammer/hammer.h>
 #include <hammer/glue.h>
 #include "hammer.h"
+#include "link.h"     // dnp3_link_resync
+#include "async.h"
+#include "result.h"
+#include "points.h"   // dnp3_pointdb_apply_block
+#include "profile.h"  // dnp3_stage_enter
+#include "membudget.h"
+#include "trace.h"
+#include "tables.h"   // dnp3_p_lazy
 
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>     // INT_MAX
+#include <sys/uio.h>    // struct iovec
+#include <time.h>       // clock_gettime
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>  // __rdtsc
+#endif
 
+
+// defaults, see DNP3_DissectorConfig
 #define BUFLEN 4619 // enough for 4096B over 1 frame or 355 empty segments
-#define CTXMAX 1024 // maximum number of connection contexts
-#define TBUFLEN (BUFLEN/13*2)   // 13 = min. size of a frame
-                                // 2  = max. number of tokens per frame
+#define CTXMAX 1024 // default maximum number of connection contexts
+#define SERIESMAX 4096  // max. size of a reassembled segment series
+
+#define FRAMEMAX 292    // max. size of a link frame: 10 + 250 + 16*2
+#define SEGMAX 249      // max. payload of a transport segment
+#define POOLMAX 16  // number of idle series buffers kept for reuse
+#define DEDUPMAX 15 // max. dedup window: frames repeat after 64 transport
+                    // sequence numbers, fragments after 16 app ones
+#define SHEDHOLD 1000   // default ms to stay overloaded, see DNP3_ShedPolicy
+#define BATCH 16    // frames decoded ahead of processing, see process_frames
 
 
 // internal data structures
 
+// per-series storage, only attached to a context while a series is in flight
+struct SeriesBuf {
+    struct SeriesBuf *next;             // free list
+    uint8_t last_segment_payload[SEGMAX];
+    uint8_t *frames;                    // raw valid frames, framesmax or NULL
+    uint8_t payload[];                  // reassembled series, seriesmax
+};
+
+// NB: the fields used on every frame come first, so they share the first
+//     cache line; everything needed for series in flight is in the sbuf.
 struct Context {
-    struct Context *next;
+    struct Context *prev, *next;    // LRU list, most recently used first
 
     uint16_t src;
     uint16_t dst;
+    uint8_t dir;                // DIR bit of the last frame
 
     // transport function
-    DNP3_Segment last_segment;
-    uint8_t last_segment_payload[249];  // max size
-    HSuspendedParser *tfun;
-    size_t tfun_pos;        // number of bytes consumed so far
-
-    // raw valid frames
-    uint8_t buf[BUFLEN];
-    size_t n;
+    uint8_t tstate;             // T_IDLE, T_FIRST, T_SERIES
+    bool toverflow;             // series exceeded seriesmax
+    size_t tlen;                // bytes of payload reassembled so far
+
+    struct SeriesBuf *sbuf; // NULL while idle
+    size_t n;               // bytes of raw frames in the current series
+
+    unsigned nshed;             // fragments shed since the last one decoded
+                                // in full, see shed_select()
+
+    DNP3_Segment last_segment;  // only valid when not idle
+
+    // hashes of the last frames and fragments (0 = empty), see dedup_seen()
+    uint32_t dup_frames[DEDUPMAX];
+    uint32_t dup_payloads[DEDUPMAX];
+    uint8_t dup_fnext, dup_pnext;   // next slot to fill
+};
+
+// a link frame decoded ahead of processing, see process_frames()
+struct Pending {
+    DNP3_Frame frame;
+    size_t off, len;            // raw frame in the input
+    size_t skipped;             // bytes of garbage before it
+};
+
+// max. size of a fragment in the request cache
+#define CACHEKEY 32
+
+struct CacheEntry {
+    const HParser *p;           // parser used, NULL = empty
+    size_t len;
+    uint8_t key[CACHEKEY];      // fragment with the sequence number masked
+    DNP3_Fragment *fragment;    // owned copy, NULL on error
+    HTokenType error;           // if !fragment; 0 = unparseable
 };
 
 typedef struct {
     StreamProcessor base;
     uint8_t *buf;               // input buffer
     size_t bufsize;
-    struct Context *contexts;   // linked list
+    size_t need;                // size of the incomplete frame at buf[0]
+                                // once its header has been checked, else 0
+    size_t seriesmax;           // max. size of a reassembled series
+    size_t framesmax;           // space for the raw frames of a series
+
+    // connection contexts, hashed by (src,dst) with linear probing
+    struct Context **ctxtab;
+    int ctxbits;                // log2 of table size
+    size_t nctx;                // number of contexts allocated
+    size_t maxctx;
+    struct Context *lru_head;   // most recently used
+    struct Context *lru_tail;   // least recently used
+    struct SeriesBuf *pool;     // idle series buffers
+    size_t npool;
+    bool retain_frames;         // keep raw frames for app_fragment?
+    bool use_dir;               // parse by direction (DIR bit)?
+    bool lazy;                  // dnp3_app_decode_headers instead of _fragment
+    bool filtering;             // apply filter?
+    DNP3_Filter filter;
+    size_t dedup;               // dedup window, 0 = off
+    uint32_t frame_hash;        // of the current frame if not a duplicate,
+                                // see frame_duplicate(); 0 = none
+    bool shedding;              // apply shed policy?
+    DNP3_ShedPolicy shed;
+    bool overloaded;            // see shed_update()
+    uint64_t shed_until;        // clock_ns() until which to stay overloaded
+
+    // frames decoded ahead and their payloads, see process_frames()
+    struct Pending pending[BATCH];
+    uint8_t payloads[BATCH][DNP3_LINK_MAXPAYLOAD];
+
+#ifdef DNP3_STATS
+    DNP3_Stats stats;           // only written by the feeding thread
+    bool timing;                // collect timing histograms?
+    uint64_t nested;            // time spent in app layer during transport
+#endif
 
     // callbacks
     DNP3_Callbacks cb;
@@ -47,12 +142,28 @@ typedef struct {
     HAllocator *mm_parse;
     HAllocator *mm_context;
     HAllocator *mm_results;
+    HAllocator *region;         // own mm_parse, reset after every frame
+
+    AsyncQueue *async;          // asynchronous app-layer delivery or NULL
+
+    struct CacheEntry *cache;   // parsed requests or NULL, see cache_slot()
+    size_t cachemask;           // number of entries - 1
+
+    DNP3_PointDB *points;       // see DNP3_DissectorConfig.point_db
+    DNP3_KeyCache *keys;        // see DNP3_DissectorConfig.keys, not owned
+
+    HAllocator *memory;         // budget (see DNP3_DissectorConfig.memory)
+                                // or NULL, not owned
+    uint64_t refused;           // its refusals last reported, see
+                                // backpressure()
 } Dissector;
 
 
 // high-level parsers  XXX should these be exported?!
 HParser *dnp3_p_synced_frame;       // skips bytes until valid frame header
-HParser *dnp3_p_transport_function; // the transport-layer state machine
+static HParser *tfun;               // the transport function as a grammar
+                                    // (reference for testing, not used)
+static HParser *tfun_lalr;          // tfun once compiled
 
 
 // shorthand to be used in a function foo(Dissector *self, ...)
@@ -62,16 +173,72 @@ HParser *dnp3_p_transport_function; // the transport-layer state machine
 #define error(...) CALLBACK(log_error, __VA_ARGS__)
 #define debug(...) //fprintf(stderr, __VA_ARGS__)
 
+// statistics, also in a function foo(Dissector *self, ...)
+// NB: counters are stored atomically so another thread (dissector group)
+//     can take a snapshot; there is only ever one writer.
+#ifdef DNP3_STATS
+#define STAT_ADD(FIELD, N) \
+    __atomic_store_n(&self->stats.FIELD, self->stats.FIELD + (N), \
+                     __ATOMIC_RELAXED)
+#define STAT_START() (self->timing ? timestamp() : 0)
+#define STAT_TIME(HIST, T0) \
+    do {if(self->timing) stat_time(self->stats.HIST, timestamp() - (T0));} \
+    while(0)
+#define STAT_NESTED(HIST, T0) \
+    do {if(self->timing) {uint64_t dt_ = timestamp() - (T0); \
+                          stat_time(self->stats.HIST, dt_); \
+                          self->nested += dt_;}} \
+    while(0)    // also counts the time as nested in the transport layer
+#else
+#define STAT_ADD(FIELD, N) ((void)0)
+#define STAT_START() 0
+#define STAT_TIME(HIST, T0) ((void)(T0))
+#define STAT_NESTED(HIST, T0) ((void)0)
+#endif
+#define STAT_INC(FIELD) STAT_ADD(FIELD, 1)
+
+// index into DNP3_Stats.app_errors
+static inline int error_index(HTokenType tt)
+{
+    int e = tt - TT_ERR;
+    return (e > 0 && e < 4) ? e : 0;
+}
+
+#ifdef DNP3_STATS
+// CPU cycles where cheaply available, nanoseconds otherwise
+static inline uint64_t timestamp(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline void stat_time(uint64_t *hist, uint64_t t)
+{
+    int i = 0;
+    while(t > 1 && i < DNP3_STATS_NBINS-1) {
+        t >>= 1;
+        i++;
+    }
+    __atomic_store_n(&hist[i], hist[i] + 1, __ATOMIC_RELAXED);
+}
+#endif
+
 
 static bool segment_equal(const DNP3_Segment *a, const DNP3_Segment *b)
 {
     // a and b must be byte-by-byte identical
+    // NB: b is the last segment whose payload we may not have kept
     return (a->fir == b->fir &&
             a->fin == b->fin &&
             a->seq == b->seq &&
             a->len == b->len &&
             (a->payload == b->payload ||    // catches NULL case
-             memcmp(a->payload, b->payload, a->len) == 0));
+             (b->payload && memcmp(a->payload, b->payload, a->len) == 0)));
 }
 
 // Define an alphabet of input events related to the transport function:
@@ -89,58 +256,31 @@ static bool segment_equal(const DNP3_Segment *a, const DNP3_Segment *b)
 //
 // with greedy matching.
 //
-// NB: Convert to a finite state machine and compare with IEEE 1815-2012
-//     Figure 8-4 "Reception state diagram" (page 273)!
-//
-// We will use an unambiguous variant:
+// We use an unambiguous variant:
 //
 //      (A+[+=]*(Z|[^AZ+=]|$)|[^A])*
 //
+// which is implemented by the following state machine (process_transport_
+// segment below). Each segment yields one of A,=,+,!,_ followed by Z if FIN:
+//
+//  state   input   action                          next state
+//  IDLE    A       start series                    FIRST
+//  IDLE    =+!_    discard segment                 IDLE
+//  FIRST   A       restart series                  FIRST
+//  SERIES  A       discard series, start new one   FIRST
+//  FIRST,  +       append to series                SERIES
+//  SERIES  =       ignore duplicate                SERIES
+//          !_      discard series                  IDLE
+//  any     Z       if not IDLE: series complete    IDLE
+//
+// NB: The grammar has no match for A after [+=]; this corresponds to IEEE
+//     1815-2012 Figure 8-4 "Reception state diagram" (page 273) which
+//     discards the partial series and starts a new one.
+//
+// dnp3_p_transport_function below is the same expression as a Hammer (LALR)
+// grammar over a token stream. It is kept as an oracle for the unit tests.
 
-static uint8_t *store_ptr(uint8_t *p, uintptr_t ptr)
-{
-    // NB: hammer is big-endian by default
-    int n = 8 * sizeof(DNP3_Segment *);
-    while(n>0) {
-        n -= 8;
-        *p++ = (ptr >> n) & 0xFF;
-    }
-    return p;
-}
-
-// convert an incoming transport segment into appropriate input tokens
-// precondition: p points to a buffer of size >= 2 * (1+sizeof(void *))
-// returns: number of bytes written
-static
-size_t transport_tokens(const DNP3_Segment *seg, const DNP3_Segment *last,
-                        uint8_t *buf)
-{
-    uint8_t *p = buf;
-
-    // first token
-    if(seg->fir) {
-        *p++ = 'A';
-    } else if(last) {
-        if(segment_equal(seg, last))
-            *p++ = '=';
-        else if(seg->seq == (last->seq + 1)%64)
-            *p++ = '+';
-        else
-            *p++ = '!';
-    } else {
-        *p++ = '_';
-    }
-    p = store_ptr(p, (uintptr_t)seg);
-
-    // second token
-    if(seg->fin) {
-        *p++ = 'Z';
-        p = store_ptr(p, 0);
-    }
-
-    return (p-buf);
-}
-
+enum {T_IDLE, T_FIRST, T_SERIES};
 
 // helper: create a copy of segment in the given arena
 static DNP3_Segment *copy_segment(HArena *arena, const DNP3_Segment *segment)
@@ -236,198 +376,847 @@ void dnp3_dissector_init(void)
     H_RULE (A1,         h_indirect());
     h_bind_indirect(A1, h_choice(h_right(A, A1), A, NULL));
     H_ARULE(series,  h_sequence(A1, pe, end, NULL));
-    H_RULE (tfun,    h_choice(series, h_ignore(notA), NULL));
+    H_RULE (tfun_,   h_choice(series, h_ignore(notA), NULL));
 
-    int tfun_compile = !h_compile(tfun, PB_LALR, NULL);
+    dnp3_p_synced_frame = sync;
+    tfun = tfun_;
+    tfun_lalr = NULL;   // compiled on first use
+}
+
+static HParser *compile_tfun(void *env, size_t i)
+{
+    int tfun_compile = !h_compile__m(dnp3_p_mm, tfun, PB_LALR, NULL);
     assert(tfun_compile);
+    return tfun;
+}
 
-    dnp3_p_synced_frame = sync;
-    dnp3_p_transport_function = tfun;
+// the transport function grammar, compiled for LALR
+HParser *dnp3_p_transport_function(void)
+{
+    return dnp3_p_lazy(&tfun_lalr, compile_tfun, NULL, 0);
 }
 
 
-static void reset_tfun(struct Context *ctx)
+// attach a series buffer to ctx, from the pool if possible
+static void acquire_sbuf(Dissector *self, struct Context *ctx)
 {
-    debug("tfun reset\n");
-    if(ctx->tfun) {
-        HParseResult *r = h_parse_finish(ctx->tfun);
-        assert(r != NULL);
-        assert(r->ast == NULL); // no stuck results
-        h_parse_result_free(r);
-        ctx->tfun = NULL;
+    if(ctx->sbuf)
+        return;
+
+    struct SeriesBuf *sb = self->pool;
+    if(sb) {
+        self->pool = sb->next;
+        self->npool--;
+    } else {
+        size_t size = sizeof(struct SeriesBuf) + self->seriesmax;
+        if(self->retain_frames)
+            size += self->framesmax;
+        sb = self->mm_context->alloc(self->mm_context, size);
+        if(!sb) {
+            error("series buffer failed to allocate\n");
+            return;
+        }
+        sb->frames = self->retain_frames ? sb->payload + self->seriesmax
+                                         : NULL;
     }
+    ctx->sbuf = sb;
 }
 
-static void init_tfun(Dissector *self, struct Context *ctx)
+// is the memory budget (if any) above its high-water mark?
+static inline bool memory_low(const Dissector *self)
 {
-    debug("tfun init\n");
-    assert(ctx->tfun == NULL);
-    ctx->tfun = h_parse_start__m(self->mm_parse, dnp3_p_transport_function);
-    assert(ctx->tfun != NULL);
-    ctx->tfun_pos = 0;
+    return self->memory && dnp3_membudget_excess(self->memory) > 0;
 }
 
-static
-HParseResult *feed_tfun(Dissector *self,
-                        struct Context *ctx, const uint8_t *buf, size_t n)
+static void release_sbuf(Dissector *self, struct Context *ctx)
 {
-    HParseResult *r = NULL;
+    struct SeriesBuf *sb = ctx->sbuf;
+    if(!sb)
+        return;
+
+    if(self->npool < POOLMAX && !memory_low(self)) {
+        sb->next = self->pool;
+        self->pool = sb;
+        self->npool++;
+    } else {
+        self->mm_context->free(self->mm_context, sb);
+    }
+    ctx->sbuf = NULL;
+    ctx->last_segment.payload = NULL;
+}
 
-    if(!ctx->tfun)
-        init_tfun(self, ctx);
+static inline size_t ctx_hash(const Dissector *self, uint16_t src, uint16_t dst)
+{
+    uint32_t key = ((uint32_t)src << 16) | dst;
+    return (uint32_t)(key * 0x9E3779B1u) >> (32 - self->ctxbits);
+}
 
-    bool done = h_parse_chunk(ctx->tfun, buf, n);
+static void lru_unlink(Dissector *self, struct Context *ctx)
+{
+    if(ctx->prev)
+        ctx->prev->next = ctx->next;
+    else
+        self->lru_head = ctx->next;
+    if(ctx->next)
+        ctx->next->prev = ctx->prev;
+    else
+        self->lru_tail = ctx->prev;
+}
+
+static void lru_push(Dissector *self, struct Context *ctx)
+{
+    ctx->prev = NULL;
+    ctx->next = self->lru_head;
+    if(self->lru_head)
+        self->lru_head->prev = ctx;
+    else
+        self->lru_tail = ctx;
+    self->lru_head = ctx;
+}
 
-    if(done) {
-        r = h_parse_finish(ctx->tfun);
-        assert(r != NULL);  // tfun always accepts
-        ctx->tfun = NULL;
+// remove the given context from the hash table
+static void ctxtab_remove(Dissector *self, struct Context *ctx)
+{
+    size_t mask = ((size_t)1 << self->ctxbits) - 1;
+    size_t i = ctx_hash(self, ctx->src, ctx->dst);
+
+    while(self->ctxtab[i] != ctx)
+        i = (i+1) & mask;
+
+    // close the gap by shifting back entries further down the probe chain
+    for(size_t j=(i+1)&mask; self->ctxtab[j]; j=(j+1)&mask) {
+        struct Context *c = self->ctxtab[j];
+        size_t h = ctx_hash(self, c->src, c->dst);
+        if(((j-h) & mask) >= ((j-i) & mask)) {
+            self->ctxtab[i] = c;
+            i = j;
+        }
     }
+    self->ctxtab[i] = NULL;
+}
+
+// the context for (src,dst) if there is one; leaves the LRU list alone
+static
+struct Context *find_context(const Dissector *self, uint16_t src, uint16_t dst)
+{
+    size_t mask = ((size_t)1 << self->ctxbits) - 1;
+    struct Context *ctx;
 
-    return r;
+    for(size_t i=ctx_hash(self, src, dst); (ctx = self->ctxtab[i]);
+        i=(i+1)&mask) {
+        if(ctx->src == src && ctx->dst == dst)
+            return ctx;
+    }
+    return NULL;
 }
 
-// allocates up to CTXMAX contexts, or recycles the least recently used
+// allocates up to maxctx contexts, or recycles the least recently used
 static
 struct Context *lookup_context(Dissector *self, uint16_t src, uint16_t dst)
 {
-    struct Context **pnext;
+    size_t mask = ((size_t)1 << self->ctxbits) - 1;
+    size_t i = ctx_hash(self, src, dst);
     struct Context *ctx;
-    int n=0; // number of context entries
 
-    for(pnext=&self->contexts; (ctx = *pnext); pnext=&ctx->next) {
+    for(; (ctx = self->ctxtab[i]); i=(i+1)&mask) {
         if(ctx->src == src && ctx->dst == dst) {
-            *pnext = ctx->next;         // unlink
-            ctx->next = self->contexts; // move to front of list
-            self->contexts = ctx;
-
+            if(ctx != self->lru_head) {
+                lru_unlink(self, ctx);  // move to front of list
+                lru_push(self, ctx);
+            }
+            TRACE3(context__lookup, src, dst, 0);
             return ctx;
         }
-
-        n++;
-        if(n >= CTXMAX) {
-            debug("reuse context %d\n", n);
-            break;  // don't advance pnext or ctx
-        }
     }
-    // ctx points to the last context in list, or NULL
-    // *pnext is the next pointer pointing to ctx
+    // i is the free slot at the end of the probe chain
 
-    if(!ctx) {
+    if(self->nctx < self->maxctx) {
         // allocate a new context
-        debug("alloc context %d\n", n+1);
+        debug("alloc context %zu\n", self->nctx+1);
         ctx = self->mm_context->alloc(self->mm_context, sizeof(struct Context));
-        if(ctx)
-            memset(ctx, 0, sizeof(struct Context));
+        if(!ctx)
+            return NULL;
+        memset(ctx, 0, sizeof(struct Context));
+        self->nctx++;
     } else {
-        *pnext = ctx->next; // unlink
-    }
-
-    // fill context and place it in front of list
-    if(ctx) {
+        // recycle the least recently used context
+        ctx = self->lru_tail;
+        debug("reuse context %u to %u\n", (unsigned)ctx->src, (unsigned)ctx->dst);
         if(ctx->n > 0) {
             error("context overflow, %u to %u dropped with %zu bytes!\n",
                   (unsigned)ctx->src, (unsigned)ctx->dst, ctx->n);
         }
+        TRACE3(context__evict, ctx->src, ctx->dst, ctx->n);
+        CALLBACK(context_evict, ctx->src, ctx->dst, ctx->n);
+        STAT_INC(context_evictions);
 
-        ctx->n = 0;
-        reset_tfun(ctx);
+        lru_unlink(self, ctx);
+        ctxtab_remove(self, ctx);
 
-        ctx->next = self->contexts;
-        ctx->src = src;
-        ctx->dst = dst;
-        self->contexts = ctx;
+        ctx->n = 0;
+        ctx->tstate = T_IDLE;
+        release_sbuf(self, ctx);
+        memset(ctx->dup_frames, 0, sizeof ctx->dup_frames);
+        memset(ctx->dup_payloads, 0, sizeof ctx->dup_payloads);
+        ctx->dup_fnext = ctx->dup_pnext = 0;
+        ctx->nshed = 0;
+
+        // the removal may have moved entries into our chain
+        for(i=ctx_hash(self, src, dst); self->ctxtab[i]; i=(i+1)&mask);
     }
 
+    // fill context and place it in front of list
+    ctx->src = src;
+    ctx->dst = dst;
+    self->ctxtab[i] = ctx;
+    lru_push(self, ctx);
+
+    TRACE3(context__lookup, src, dst, 1);
     return ctx;
 }
 
+// duplicate suppression, see DNP3_DissectorConfig.dedup_window
+//
+// every context remembers 32-bit hashes (XXH32) of its last user data
+// frames and reassembled fragments. frames are checked on their raw bytes,
+// before the CRCs, so a copy costs one pass over it. but only frames that
+// got as far as the transport function are remembered; so a corrupted
+// first copy does not suppress an intact second one.
+
+#define XXH_P1 2654435761u
+#define XXH_P2 2246822519u
+#define XXH_P3 3266489917u
+#define XXH_P4 668265263u
+#define XXH_P5 374761393u
+
+static inline uint32_t rotl32(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t rd32le(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint32_t xxh_round(uint32_t acc, uint32_t x)
+{
+    return rotl32(acc + x * XXH_P2, 13) * XXH_P1;
+}
+
+static uint32_t xxh32(const uint8_t *p, size_t len, uint32_t seed)
+{
+    const uint8_t *end = p + len;
+    uint32_t h;
+
+    if(len >= 16) {
+        uint32_t v1 = seed + XXH_P1 + XXH_P2, v2 = seed + XXH_P2;
+        uint32_t v3 = seed, v4 = seed - XXH_P1;
+        for(; end - p >= 16; p += 16) {
+            v1 = xxh_round(v1, rd32le(p));
+            v2 = xxh_round(v2, rd32le(p+4));
+            v3 = xxh_round(v3, rd32le(p+8));
+            v4 = xxh_round(v4, rd32le(p+12));
+        }
+        h = rotl32(v1, 1) + rotl32(v2, 7) + rotl32(v3, 12) + rotl32(v4, 18);
+    } else {
+        h = seed + XXH_P5;
+    }
+    h += (uint32_t)len;
+
+    for(; end - p >= 4; p += 4)
+        h = rotl32(h + rd32le(p) * XXH_P3, 17) * XXH_P4;
+    for(; p < end; p++)
+        h = rotl32(h + *p * XXH_P5, 11) * XXH_P1;
+
+    h ^= h >> 15;
+    h *= XXH_P2;
+    h ^= h >> 13;
+    h *= XXH_P3;
+    h ^= h >> 16;
+    return h ? h : 1;                   // NB: 0 marks an empty slot
+}
+
+// is h among the n (<= DEDUPMAX) entries of ring w? if not and add is set,
+// put it in the place of the oldest.
+static bool dedup_seen(uint32_t *w, uint8_t *next, size_t n, uint32_t h,
+                       bool add)
+{
+    for(size_t i=0; i<n; i++) {
+        if(w[i] == h)
+            return true;
+    }
+    if(add) {
+        w[*next] = h;
+        *next = (*next + 1) % n;
+    }
+    return false;
+}
+
+// is the (complete) frame at p of size k a copy of a recent user data
+// frame? if not, note its hash for process_link_frame.
+static bool frame_duplicate(Dissector *self, const uint8_t *p, size_t k)
+{
+    // NB: the header has been checked; cf. dnp3_link_decode_frame
+    uint8_t ctrl = p[3];
+    uint8_t func = ((ctrl >> 6) & 1) << 4 | (ctrl & 0x0F);
+    uint16_t dst = p[4] | p[5] << 8;
+    uint16_t src = p[6] | p[7] << 8;
+
+    self->frame_hash = 0;
+    if(func != DNP3_UNCONFIRMED_USER_DATA)
+        return false;
+
+    uint32_t h = xxh32(p, k, 0);
+    struct Context *ctx = find_context(self, src, dst);
+    if(ctx && dedup_seen(ctx->dup_frames, &ctx->dup_fnext, self->dedup, h,
+                         false)) {
+        STAT_INC(link_duplicates);
+        CALLBACK(link_duplicate, p, k);
+        return true;
+    }
+    self->frame_hash = h;
+    return false;
+}
+
+// hand app-layer results to the user, directly or through the async queue
+static void deliver_fragment(Dissector *self, const DNP3_Fragment *fragment,
+                             const uint8_t *buf, size_t n)
+{
+    if(self->async) {
+        if(!dnp3_async_push_fragment(self->async, fragment))
+            error("fragment failed to copy for delivery\n");
+        return;
+    }
+
+    // transient, dnp3_fragment_retain copies to mm_results
+    struct Result r = {self->mm_results, 0, *fragment};
+    CALLBACK(app_fragment, &r.frag, buf, n);
+}
+
+static void deliver_invalid(Dissector *self, DNP3_ParseError e)
+{
+    if(!self->async)
+        CALLBACK(app_invalid, e);
+    else
+        dnp3_async_push_invalid(self->async, e);
+}
+
+// early-drop filter, see DNP3_Filter
+
+void dnp3_filter_init(DNP3_Filter *f)
+{
+    memset(f->addr, 0, sizeof(f->addr));
+    f->addr_deny = true;
+    memset(f->fc, 0xFF, sizeof(f->fc));
+    memset(f->group, 0xFF, sizeof(f->group));
+}
+
+static bool filter_frame(const DNP3_Filter *f, const DNP3_Frame *frame)
+{
+    bool marked = dnp3_filter_test(f->addr, frame->source)
+               || dnp3_filter_test(f->addr, frame->destination);
+
+    return f->addr_deny ? !marked : marked;
+}
+
+// load shedding, see DNP3_ShedPolicy
+
+void dnp3_shed_init(DNP3_ShedPolicy *p)
+{
+    p->max_feed_ns = 0;
+    p->max_queue = 0;
+    p->hold_ms = 0;
+    p->sample = 0;
+    dnp3_filter_init(&p->select);
+}
+
+// skip decoding the objects of fragment t from ctx?
+static bool shed_select(Dissector *self, struct Context *ctx,
+                        const uint8_t *t, size_t len)
+{
+    const DNP3_Filter *f = &self->shed.select;
+
+    if(!self->overloaded || len < 2 || !dnp3_filter_test(f->fc, t[1]))
+        return false;
+
+    bool marked = dnp3_filter_test(f->addr, ctx->src)
+               || dnp3_filter_test(f->addr, ctx->dst);
+    if(f->addr_deny ? marked : !marked)
+        return false;
+
+    if(self->shed.sample > 0 && ++ctx->nshed >= self->shed.sample) {
+        ctx->nshed = 0;
+        return false;
+    }
+    return true;
+}
+
+// drop the object blocks of filtered groups from frag; the rest are placed
+// in out (which may be frag->odata) and frag is pointed there.
+// returns: false if the fragment should be dropped altogether
+static bool filter_blocks(const DNP3_Filter *f, DNP3_Fragment *frag,
+                          DNP3_ObjectBlock **out)
+{
+    size_t n = 0;
+
+    if(frag->nblocks == 0)
+        return true;
+    for(size_t i=0; i<frag->nblocks; i++) {
+        if(dnp3_filter_test(f->group, frag->odata[i]->group))
+            out[n++] = frag->odata[i];
+    }
+    frag->odata = out;
+    frag->nblocks = n;
+    return (n > 0);
+}
+
+// wrapper around the app_object_block callback for dnp3_app_decode_blocks,
+// applying the filter and the point database
+struct BlockSink {
+    Dissector *self;
+    uint16_t src;
+    size_t n;                   // blocks seen
+    size_t passed;
+};
+
+static void sink_object_block(void *env, const DNP3_Fragment *frag,
+                              const DNP3_ObjectBlock *ob)
+{
+    struct BlockSink *bs = env;
+    Dissector *self = bs->self;
+
+    bs->n++;
+    if(self->filtering && !dnp3_filter_test(self->filter.group, ob->group))
+        return;
+    bs->passed++;
+    if(self->points) {
+        // NB: the decoder only handles responses
+        dnp3_pointdb_apply_block(self->points, bs->src, ob,
+                                 self->cb.point_change, self->env);
+    }
+    CALLBACK(app_object_block, frag, ob);
+}
+
+// pass a parsed fragment from ctx->src on through the filter, point
+// database, and app_object_block
+// odata: room for the blocks passing the filter, may be fragment->odata
+static void deliver_parsed(Dissector *self, const struct Context *ctx,
+                           DNP3_Fragment *fragment, DNP3_ObjectBlock **odata,
+                           const uint8_t *buf, size_t n)
+{
+    TRACE4(fragment, ctx->src, ctx->dst, fragment->fc, fragment->nblocks);
+    STAT_INC(app_fragments);
+    if(self->filtering && !filter_blocks(&self->filter, fragment, odata)) {
+        STAT_INC(filtered);
+        return;
+    }
+
+    if(self->points) {
+        dnp3_pointdb_apply(self->points, ctx->src, fragment,
+                           self->cb.point_change, self->env);
+    }
+    if(self->cb.app_object_block) {
+        DNP3_Fragment hdr = *fragment;
+        hdr.odata = NULL;
+        hdr.nblocks = 0;
+        for(size_t i=0; i<fragment->nblocks; i++)
+            CALLBACK(app_object_block, &hdr, fragment->odata[i]);
+        deliver_fragment(self, &hdr, buf, n);
+    } else {
+        deliver_fragment(self, fragment, buf, n);
+    }
+}
+
+// check the aggressive-mode MAC of fragment t from ctx->src, if any
+static void check_auth(Dissector *self, const struct Context *ctx,
+                       DNP3_AuthData *auth, const uint8_t *t, size_t len)
+{
+    auth->status = dnp3_keycache_verify(self->keys, ctx->src, ctx->dst, auth,
+                                        t, len);
+    if(auth->status == DNP3_AUTH_OK)
+        STAT_INC(auth_ok);
+    else if(auth->status == DNP3_AUTH_FAILED)
+        STAT_INC(auth_failed);
+}
+
+// e = 0: unparseable
+static void deliver_error(Dissector *self, const struct Context *ctx,
+                          HTokenType e)
+{
+    TRACE3(app__error, ctx->src, ctx->dst, e);
+    STAT_INC(app_errors[error_index(e)]);
+    deliver_invalid(self, e);
+}
+
+
+// cache of parsed requests, see DNP3_DissectorConfig.request_cache
+//
+// masters repeat the same few requests (class polls) over and over. small
+// request fragments are looked up by their bytes with the sequence number
+// masked out. the cache is direct-mapped, so a colliding request simply
+// replaces the entry.
+
+static uint32_t cache_hash(const HParser *p, const uint8_t *key, size_t len)
+{
+    uint32_t h = 2166136261u ^ (uint32_t)(uintptr_t)p;   // FNV-1a
+
+    for(size_t i=0; i<len; i++)
+        h = (h ^ key[i]) * 16777619u;
+    return h;
+}
+
+// the entry for fragment t as parsed by p; writes the masked bytes to key
+static struct CacheEntry *cache_slot(Dissector *self, const HParser *p,
+                                     const uint8_t *t, size_t len,
+                                     uint8_t *key)
+{
+    assert(len > 0 && len <= CACHEKEY);
+    memcpy(key, t, len);
+    key[0] &= 0xF0;                     // AC sequence number
+
+    return &self->cache[cache_hash(p, key, len) & self->cachemask];
+}
+
+static bool cache_match(const struct CacheEntry *e, const HParser *p,
+                        const uint8_t *key, size_t len)
+{
+    return (e->p == p && e->len == len && memcmp(e->key, key, len) == 0);
+}
+
+static void cache_clear(struct CacheEntry *e)
+{
+    dnp3_fragment_release(e->fragment);
+    e->p = NULL;
+    e->fragment = NULL;
+}
+
+// fill e with the result of parsing key with p
+static void cache_store(Dissector *self, struct CacheEntry *e,
+                        const HParser *p, const uint8_t *key, size_t len,
+                        const HParseResult *r)
+{
+    cache_clear(e);
+    if(r && !H_ISERR(r->ast->token_type)) {
+        e->fragment = dnp3_fragment_copy(self->mm_results,
+                                         H_CAST(DNP3_Fragment, r->ast));
+        if(!e->fragment)
+            return;                     // out of memory, leave empty
+        e->error = 0;
+    } else {
+        e->error = r ? r->ast->token_type : 0;
+    }
+
+    e->p = p;
+    e->len = len;
+    memcpy(e->key, key, len);
+}
+
+// deliver the cached result for fragment t (of length len) from ctx->src
+static void cache_deliver(Dissector *self, const struct Context *ctx,
+                          const struct CacheEntry *e,
+                          const uint8_t *t, size_t len,
+                          const uint8_t *buf, size_t n)
+{
+    if(!e->fragment) {
+        deliver_error(self, ctx, e->error);
+        return;
+    }
+
+    // NB: the entry is shared, only touch our copy of the DNP3_Fragment
+    DNP3_ObjectBlock *odata[CACHEKEY / 3];  // NB: each block takes >= 3 bytes
+    DNP3_Fragment fragment = *e->fragment;
+    assert(fragment.nblocks <= sizeof(odata) / sizeof(*odata));
+    fragment.ac.seq = t[0] & 0x0F;
+    DNP3_AuthData auth;
+    if(fragment.auth && self->keys) {
+        auth = *fragment.auth;
+        fragment.auth = &auth;
+        check_auth(self, ctx, &auth, t, len);
+    }
+    deliver_parsed(self, ctx, &fragment, odata, buf, n);
+}
+
+
+// buf and n are the raw frames that carried the payload, if available
 static
-void process_transport_payload(Dissector *self, struct Context *ctx,
-                               const uint8_t *t, size_t len)
+void process_app_fragment(Dissector *self, struct Context *ctx,
+                          const uint8_t *t, size_t len,
+                          const uint8_t *buf, size_t n)
 {
+    if(self->dedup) {
+        uint32_t h = xxh32(t, len, 1);
+        if(dedup_seen(ctx->dup_payloads, &ctx->dup_pnext, self->dedup, h,
+                      true)) {
+            STAT_INC(transport_duplicates);
+            CALLBACK(transport_duplicate, t, len);
+            return;
+        }
+    }
+
     CALLBACK(transport_payload, t, len);
 
+    // NB: challenges count even if they are filtered out below
+    if(self->keys
+       && !dnp3_keycache_challenge(self->keys, ctx->src, ctx->dst, t, len))
+        STAT_INC(auth_challenges_dropped);
+
+    // function code (second octet): drop without parsing
+    if(self->filtering && len >= 2
+       && !dnp3_filter_test(self->filter.fc, t[1])) {
+        STAT_INC(filtered);
+        return;
+    }
+
     // try to parse a message fragment
-    HParseResult *r = h_parse__m(self->mm_parse, dnp3_p_app_fragment, t, len);
+#ifdef DNP3_STATS
+    uint64_t t0 = STAT_START();
+#endif
+    // master to outstation is requests only, the other way responses
+    HParser *p = dnp3_p_app_fragment;
+    if(self->use_dir)
+        p = ctx->dir ? dnp3_p_app_request : dnp3_p_app_response;
+
+    // repeated requests: take the result from the cache
+    struct CacheEntry *ce = NULL;
+    uint8_t key[CACHEKEY];
+    if(self->cache && len >= 2 && len <= CACHEKEY && t[1] < DNP3_RESPONSE) {
+        ce = cache_slot(self, p, t, len, key);
+        if(cache_match(ce, p, key, len)) {
+            STAT_INC(cache_hits);
+            STAT_NESTED(app_time, t0);
+            cache_deliver(self, ctx, ce, t, len, buf, n);
+            return;
+        }
+        STAT_INC(cache_misses);
+    }
+
+    // under overload, maybe decode the headers only
+    bool shed = self->shedding && p != dnp3_p_app_request
+                && shed_select(self, ctx, t, len);
+
+    // streaming: pass object blocks on as they are decoded
+    if(self->cb.app_object_block && p != dnp3_p_app_request && !shed) {
+        // NB: our region is only reset per frame, blocks would pile up there
+        HAllocator *mm = self->region ? h_system_allocator : self->mm_parse;
+        DNP3_Fragment hdr;
+        struct BlockSink bs = {self, ctx->src, 0, 0};
+        bool ok;
+        if(self->filtering || self->points)
+            ok = dnp3_app_decode_blocks(mm, t, len, &hdr, sink_object_block,
+                                        &bs);
+        else
+            ok = dnp3_app_decode_blocks(mm, t, len, &hdr,
+                                        self->cb.app_object_block, self->env);
+        if(ok) {
+            STAT_NESTED(app_time, t0);
+            TRACE4(fragment, ctx->src, ctx->dst, hdr.fc, bs.n);
+            STAT_INC(app_fragments);
+            if(bs.n > 0 && bs.passed == 0)
+                STAT_INC(filtered);
+            else
+                deliver_fragment(self, &hdr, buf, n);
+            return;
+        }
+    }
+
+    // NB: with a filter, the objects of dropped blocks are never decoded
+    HParseResult *r = NULL;
+    if(p != dnp3_p_app_request && (self->lazy || self->filtering || shed))
+        r = dnp3_app_decode_headers(self->mm_parse, t, len);
+    else if(p != dnp3_p_app_request)
+        r = dnp3_app_decode_fragment(self->mm_parse, t, len);
+    if(!r) {
+        shed = false;   // NB: the grammar decodes everything
+        r = h_parse__m(self->mm_parse, p, t, len);
+    }
+    STAT_NESTED(app_time, t0);
+    if(ce)
+        cache_store(self, ce, p, key, len, r);
     if(r) {
         assert(r->ast != NULL);
         if(H_ISERR(r->ast->token_type)) {
-            CALLBACK(app_invalid, r->ast->token_type);
+            deliver_error(self, ctx, r->ast->token_type);
         } else {
-            DNP3_Fragment *fragment = H_CAST(DNP3_Fragment, r->ast);    // XXX copy to result mem
-            CALLBACK(app_fragment, fragment, ctx->buf, ctx->n);
+            DNP3_Fragment *fragment = H_CAST(DNP3_Fragment, r->ast);
+            if(shed) {
+                fragment->shed = true;
+                STAT_INC(shed_fragments);
+            }
+            if(fragment->auth && self->keys)
+                check_auth(self, ctx, fragment->auth, t, len);
+            deliver_parsed(self, ctx, fragment, fragment->odata, buf, n);
         }
         h_parse_result_free(r);
     } else {
-        CALLBACK(app_invalid, 0);
+        deliver_error(self, ctx, 0);
     }
 }
 
+static
+void process_transport_payload(Dissector *self, struct Context *ctx,
+                               const uint8_t *t, size_t len,
+                               const uint8_t *buf, size_t n)
+{
+    TRACE3(series__done, ctx->src, ctx->dst, len);
+    unsigned st = dnp3_stage_enter(DNP3_STAGE_APP, 0);
+    process_app_fragment(self, ctx, t, len, buf, n);
+    dnp3_stage_leave(st);
+}
+
 // helper
 static void save_last_segment(struct Context *ctx, const DNP3_Segment *segment)
 {
-    assert(segment->len <= sizeof(ctx->last_segment_payload));
-    memcpy(ctx->last_segment_payload, segment->payload, segment->len);
     ctx->last_segment = *segment;
-    ctx->last_segment.payload = ctx->last_segment_payload;
+    ctx->last_segment.payload = NULL;
+    if(ctx->sbuf) {
+        uint8_t *p = ctx->sbuf->last_segment_payload;
+        assert(segment->len <= sizeof(ctx->sbuf->last_segment_payload));
+        memcpy(p, segment->payload, segment->len);
+        ctx->last_segment.payload = p;
+    }
 }
 
-static
-void process_transport_segment(Dissector *self,
-                               struct Context *ctx, const DNP3_Segment *segment)
+static void discard_series(Dissector *self, struct Context *ctx, size_t extra)
 {
-    uint8_t buf[2 * (1 + sizeof(DNP3_Segment *))];
-    size_t n;
-    HParseResult *r;
+    TRACE3(series__discard, ctx->src, ctx->dst, ctx->n + extra);
+    CALLBACK(transport_discard, ctx->n + extra);
+    STAT_INC(transport_discards);
+    ctx->n = 0;
+    ctx->tstate = T_IDLE;
+    release_sbuf(self, ctx);
+}
 
-    CALLBACK(transport_segment, segment);
+static void series_complete(Dissector *self, struct Context *ctx)
+{
+    if(ctx->toverflow) {
+        error("segment series exceeds %zu bytes, discarded\n",
+              self->seriesmax);
+        discard_series(self, ctx, 0);
+        return;
+    }
 
-    // convert to input tokens for transport function
-    n = transport_tokens(segment, &ctx->last_segment, buf);
-    save_last_segment(ctx, segment);
-    debug("tfun input:");
-    for(size_t i=0; i<n; i++) {
-        debug("  %c 0x", buf[i]);
-        for(int j=0; j<sizeof(DNP3_Segment *); j++)
-            debug("%.2x", buf[++i]);
+    if(self->retain_frames)
+        process_transport_payload(self, ctx, ctx->sbuf->payload, ctx->tlen,
+                                  ctx->sbuf->frames, ctx->n);
+    else
+        process_transport_payload(self, ctx, ctx->sbuf->payload, ctx->tlen,
+                                  NULL, 0);
+
+    ctx->n = 0;
+    ctx->tstate = T_IDLE;
+    release_sbuf(self, ctx);
+}
+
+// helper: write segment payload to the reassembly buffer
+static void append_payload(Dissector *self, struct Context *ctx,
+                           const DNP3_Segment *segment)
+{
+    if(ctx->tlen + segment->len > self->seriesmax) {
+        ctx->toverflow = true;
+        return;
     }
-    debug("\n");
+    memcpy(ctx->sbuf->payload + ctx->tlen, segment->payload, segment->len);
+    ctx->tlen += segment->len;
+}
 
-    // run transport function
-    size_t m=0;
-    while(m<n && (r = feed_tfun(self, ctx, buf+m, n-m))) {
-        assert(r->bit_length%8 == 0);
-        size_t consumed = r->bit_length/8 - ctx->tfun_pos;
-        assert(consumed > 0);
+// helper: append a raw frame to the series buffer
+static void append_frame(Dissector *self, struct Context *ctx,
+                         const uint8_t *buf, size_t len)
+{
+    if(!self->retain_frames) {
+        ctx->n += len;
+    } else if(ctx->n + len <= self->framesmax) {
+        memcpy(ctx->sbuf->frames + ctx->n, buf, len);
+        ctx->n += len;
+    } else {
+        error("overflow at %zu bytes, dropping %zu byte frame\n",
+              ctx->n, len);
+    }
+}
 
-        // process reassembled segment series if any
-        if(r->ast) {
-            HBytes b = H_CAST_BYTES(r->ast);
-            process_transport_payload(self, ctx, b.token, b.len);
-        } else {
-            CALLBACK(transport_discard, ctx->n);
+// run the transport function on a segment, cf. the state table above
+// buf and len are the raw frame that carried the segment
+static
+void process_transport_segment(Dissector *self, struct Context *ctx,
+                               const DNP3_Segment *segment,
+                               const uint8_t *buf, size_t len)
+{
+    TRACE4(segment, ctx->src, ctx->dst,
+           segment->fin << 7 | segment->fir << 6 | segment->seq, segment->len);
+    CALLBACK(transport_segment, segment);
+
+    if(segment->fir) {                                  // A
+        if(ctx->tstate == T_SERIES)
+            discard_series(self, ctx, 0);
+
+        if(segment->fin) {                              // AZ
+            // single-segment series, pass on without copying
+            ctx->n = 0;
+            ctx->tstate = T_IDLE;
+            release_sbuf(self, ctx);
+            process_transport_payload(self, ctx, segment->payload, segment->len,
+                                      self->retain_frames ? buf : NULL,
+                                      self->retain_frames ? len : 0);
+            return;
         }
-        ctx->n = 0; // flush frames
 
-        h_parse_result_free(r);
-        m += consumed;
+        acquire_sbuf(self, ctx);
+        if(!ctx->sbuf) {
+            discard_series(self, ctx, len);
+            return;
+        }
+        ctx->tstate = T_FIRST;
+        ctx->toverflow = false;
+        ctx->tlen = 0;
+        ctx->n = 0;
+        append_payload(self, ctx, segment);
+    } else if(ctx->tstate == T_IDLE) {                  // =+!_
+        TRACE3(series__discard, ctx->src, ctx->dst, len);
+        CALLBACK(transport_discard, len);
+        STAT_INC(transport_discards);
+        return;
+    } else if(segment_equal(segment, &ctx->last_segment)) {    // =
+        ctx->tstate = T_SERIES;
+    } else if(segment->seq == (ctx->last_segment.seq + 1)%64) { // +
+        ctx->tstate = T_SERIES;
+        append_payload(self, ctx, segment);
+    } else {                                            // !
+        discard_series(self, ctx, len);
+        return;
     }
 
-    ctx->tfun_pos += n;
+    append_frame(self, ctx, buf, len);
+    save_last_segment(ctx, segment);
+
+    if(segment->fin)                                    // Z
+        series_complete(self, ctx);
 }
 
 static
 void process_link_frame(Dissector *self,
-                        const DNP3_Frame *frame, uint8_t *buf, size_t len)
+                        const DNP3_Frame *frame, const uint8_t *buf, size_t len)
 {
     struct Context *ctx;
-    HParseResult *r;
+    DNP3_Segment segment;
+
+    STAT_INC(frames);
+    if(frame->len > 0 && !frame->payload)
+        STAT_INC(crc_errors);
 
     if(!dnp3_link_validate_frame(frame)) {
+        TRACE4(frame__invalid, frame->source, frame->destination,
+               frame->func, len);
+        STAT_INC(link_invalid);
         CALLBACK(link_invalid, frame);
         return;
     }
+    TRACE4(frame, frame->source, frame->destination, frame->func, len);
+
+    if(self->filtering && !filter_frame(&self->filter, frame)) {
+        STAT_INC(filtered);
+        return;
+    }
 
     if(CALLBACK(link_frame, frame, buf, len) != 0)
         return;
@@ -444,28 +1233,35 @@ void process_link_frame(Dissector *self,
             error("connection context failed to allocate\n");
             break;
         }
+        ctx->dir = frame->dir;
+        if(self->frame_hash) {
+            dedup_seen(ctx->dup_frames, &ctx->dup_fnext, self->dedup,
+                       self->frame_hash, true);
+            self->frame_hash = 0;
+        }
 
-        // parse and process payload as transport segment
-        r = h_parse__m(self->mm_parse, dnp3_p_transport_segment,
-                       frame->payload, frame->len);
-        if(!r) {
+        // process payload as transport segment, in place
+        if(!dnp3_transport_decode_segment(frame->payload, frame->len,
+                                          &segment)) {
             // NB: this should only happen when frame->len = 0, which is
             //     not valid with USER_DATA as per AN2013-004b
             break;
         }
 
-        // append the raw frame to context buf
-        if(ctx->n + len <= BUFLEN) {
-            memcpy(ctx->buf + ctx->n, buf, len);
-            ctx->n += len;
-        } else {
-            error("overflow at %zu bytes, dropping %zu byte frame\n",
-                  ctx->n, len);
+        unsigned st = dnp3_stage_enter(DNP3_STAGE_TRANSPORT, 0);
+#ifdef DNP3_STATS
+        if(self->timing) {
+            uint64_t t0 = timestamp();
+            self->nested = 0;
+            process_transport_segment(self, ctx, &segment, buf, len);
+            stat_time(self->stats.transport_time,
+                      timestamp() - t0 - self->nested);
+            dnp3_stage_leave(st);
+            break;
         }
-
-        assert(r->ast);
-        process_transport_segment(self, ctx, H_CAST(DNP3_Segment, r->ast)); // XXX copy to result mem
-        h_parse_result_free(r);
+#endif
+        process_transport_segment(self, ctx, &segment, buf, len);
+        dnp3_stage_leave(st);
         break;
     case DNP3_CONFIRMED_USER_DATA:
         if(!frame->payload) // CRC error
@@ -476,50 +1272,700 @@ void process_link_frame(Dissector *self,
     }
 }
 
-static int dissector_feed(StreamProcessor *base, size_t n)
+// limits on the work done by a call to process_frames
+struct Budget {
+    size_t frames;              // frames left, 0 = unlimited
+    uint64_t deadline;          // clock_ns() value, 0 = none
+    bool spent;                 // set when the budget ran out
+};
+
+static inline uint64_t clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// account for one frame; returns true if the budget is spent
+static bool budget_spend(struct Budget *b)
+{
+    if(!b)
+        return false;
+    if(b->frames > 0 && --b->frames == 0)
+        b->spent = true;
+    if(b->deadline && clock_ns() >= b->deadline)
+        b->spent = true;
+    return b->spent;
+}
+
+// watch for overload after a call to process_frames that began at t0
+static void shed_update(Dissector *self, uint64_t t0)
+{
+    uint64_t now = clock_ns();
+    const DNP3_ShedPolicy *pol = &self->shed;
+
+    if((pol->max_feed_ns && now - t0 > pol->max_feed_ns)
+       || (pol->max_queue && self->async
+           && dnp3_async_depth(self->async) > pol->max_queue)) {
+        if(!self->overloaded)
+            STAT_INC(overloads);
+        self->shed_until = now + (uint64_t)pol->hold_ms * 1000000;
+    }
+    self->overloaded = (now < self->shed_until);
+}
+
+// give up state until the memory budget is below its high-water mark, the
+// cheapest first: idle series buffers, idle contexts, then series in flight.
+// the latter two from the least recently used, see DNP3_BACKPRESSURE.
+static void make_room(Dissector *self)
+{
+    struct SeriesBuf *sb;
+    while((sb = self->pool) && memory_low(self)) {
+        self->pool = sb->next;
+        self->npool--;
+        self->mm_context->free(self->mm_context, sb);
+    }
+
+    struct Context *ctx, *prev;
+    for(ctx = self->lru_tail; ctx && memory_low(self); ctx = prev) {
+        prev = ctx->prev;
+        if(ctx->tstate != T_IDLE)
+            continue;
+        TRACE3(context__evict, ctx->src, ctx->dst, 0);
+        CALLBACK(context_evict, ctx->src, ctx->dst, 0);
+        STAT_INC(memory_evictions);
+        lru_unlink(self, ctx);
+        ctxtab_remove(self, ctx);
+        release_sbuf(self, ctx);
+        self->mm_context->free(self->mm_context, ctx);
+        self->nctx--;
+    }
+
+    for(ctx = self->lru_tail; ctx && memory_low(self); ctx = ctx->prev) {
+        if(ctx->tstate == T_IDLE)
+            continue;
+        STAT_INC(memory_evictions);
+        discard_series(self, ctx, 0);   // NB: frees, not pooled
+    }
+}
+
+// parse and process link layer frames in buf, within budget b (or NULL)
+// returns: number of bytes consumed; the rest is an incomplete frame, or
+//          unprocessed input if b->spent
+static size_t process_frames(Dissector *self, const uint8_t *buf, size_t n,
+                             struct Budget *b)
 {
-    Dissector *self = (Dissector *)base;
-    HParseResult *r;
     size_t m=0;
 
-    // parse and process link layer frames
+    // an incomplete frame kept at the start of the input buffer has had its
+    // header checked already. wait until all of it is there.
+    size_t need = (buf == self->buf) ? self->need : 0;
+    if(n < need)
+        return 0;
+    self->need = 0;
+    unsigned st = dnp3_stage_enter(DNP3_STAGE_LINK, 0);
+    uint64_t tfeed = self->shedding ? clock_ns() : 0;
+
+#ifdef DNP3_HAMMER_LINK
+    // reference mode: use the Hammer grammar
+    HParseResult *r;
     HAllocator *mm = self->mm_parse;
-    while((r = h_parse__m(mm, dnp3_p_synced_frame, base->buf+m, n-m))) {
+    for(;;) {
+        // find the next frame start before invoking the grammar, which
+        // would otherwise retry itself at every offset
+        size_t s = dnp3_link_resync(buf+m, n-m);
+        if(s > 0) {
+            STAT_ADD(bytes_skipped, s);
+            CALLBACK(link_skip, s);
+            m += s;
+        }
+        if(memory_low(self))
+            make_room(self);
+        int size = dnp3_link_frame_size(buf+m, n-m);
+        if(self->dedup && size > 0 && (size_t)size <= n-m
+           && frame_duplicate(self, buf+m, size)) {
+            m += size;
+            continue;
+        }
+        if(!(r = h_parse__m(mm, dnp3_p_synced_frame, buf+m, n-m)))
+            break;
+
         size_t consumed = r->bit_length/8;
         assert(r->bit_length%8 == 0);
         assert(consumed > 0);
         assert(r->ast);
 
         process_link_frame(self, H_CAST(DNP3_Frame, r->ast),    // XXX copy to result mem
-                           base->buf+m, consumed);
+                           buf+m, consumed);
         h_parse_result_free(r);
+        if(self->region)
+            h_region_reset(self->region);
 
         m += consumed;
+        if(budget_spend(b))
+            break;
+    }
+    // XXX no link timing statistics in this mode
+#else
+    // in batches of up to BATCH frames: first decode them all and prefetch
+    // the first probe of their contexts in the hash table, then the
+    // contexts, then process the frames in order. so the lookups of many
+    // connections overlap instead of stalling one by one.
+    // NB: callbacks and the budget still go frame by frame in input order;
+    //     frames decoded beyond a spent budget are decoded again next time.
+    struct Pending *q = self->pending;
+    size_t skipped = 0;
+    while(m < n) {
+        size_t np = 0, pos = m, s = 0;
+        uint64_t t0 = STAT_START();
+        int k;
+
+        while(np < BATCH && pos < n) {
+            DNP3_Frame *f = &q[np].frame;
+            if(need > 0) {
+                k = dnp3_link_decode_checked(buf, f, self->payloads[np]);
+                assert(k == need);
+                need = 0;
+            } else {
+                size_t r = dnp3_link_resync(buf+pos, n-pos);
+                if(r > 0) {
+                    s += r;
+                    pos += r;
+                    continue;
+                }
+                k = dnp3_link_decode_frame(buf+pos, n-pos, f,
+                                           self->payloads[np]);
+                if(k == 0)
+                    break;
+                assert(k > 0);  // header checked by dnp3_link_resync
+            }
+            STAT_TIME(link_time, t0);
+            __builtin_prefetch(&self->ctxtab[ctx_hash(self, f->source,
+                                                      f->destination)]);
+            q[np].off = pos;
+            q[np].len = k;
+            q[np].skipped = s;
+            s = 0;
+            pos += k;
+            np++;
+            t0 = STAT_START();
+        }
+
+        for(size_t j=0; j<np; j++) {
+            const DNP3_Frame *f = &q[j].frame;
+            const struct Context *c =
+                self->ctxtab[ctx_hash(self, f->source, f->destination)];
+            if(c)
+                __builtin_prefetch(c);
+        }
+
+        for(size_t j=0; j<np; j++) {
+            if(q[j].skipped > 0) {
+                CALLBACK(link_skip, q[j].skipped);
+                skipped += q[j].skipped;
+            }
+            m = q[j].off + q[j].len;
+            if(memory_low(self))
+                make_room(self);
+            if(self->dedup && frame_duplicate(self, buf + q[j].off, q[j].len))
+                continue;
+
+            process_link_frame(self, &q[j].frame, buf + q[j].off, q[j].len);
+            if(self->region)
+                h_region_reset(self->region);   // nothing from mm_parse survives
+            if(budget_spend(b))
+                break;
+        }
+        if(b && b->spent)
+            break;
+
+        // garbage after the last frame
+        if(s > 0) {
+            CALLBACK(link_skip, s);
+            skipped += s;
+        }
+        m = pos;
+        if(np < BATCH)
+            break;              // incomplete frame or end of input
+    }
+    STAT_ADD(bytes_skipped, skipped);
+    (void)skipped;
+#endif
+
+    // remember the size of an incomplete frame with a valid header
+    if(m < n) {
+        int size = dnp3_link_frame_size(buf+m, n-m);
+        if(size > 0 && (size_t)size > n-m)
+            self->need = size;
+    }
+
+    if(self->shedding)
+        shed_update(self, tfeed);
+    dnp3_stage_leave(st);
+    return m;
+}
+
+// helper: keep the n bytes at p as the start of the input buffer
+static void keep_input(Dissector *self, const uint8_t *p, size_t n)
+{
+    assert(n <= self->bufsize);
+    if(p != self->buf)
+        memmove(self->buf, p, n);
+    self->base.buf = self->buf + n;
+    self->base.bufsize = self->bufsize - n;
+}
+
+// DNP3_BACKPRESSURE if the memory budget refused an allocation since the
+// last time this was reported, else 0
+static int backpressure(Dissector *self)
+{
+    if(!self->memory)
+        return 0;
+
+    uint64_t r = h_membudget_refused(self->memory);
+    if(r == self->refused)
+        return 0;
+    self->refused = r;
+    return DNP3_BACKPRESSURE;
+}
+
+static int dissector_feed(StreamProcessor *base, size_t n)
+{
+    Dissector *self = (Dissector *)base;
+
+    // include any incomplete frame left over from the last call
+    n += base->buf - self->buf;
+
+    size_t m = process_frames(self, self->buf, n, NULL);
+    keep_input(self, self->buf+m, n-m);
+
+    return backpressure(self);
+}
+
+static int dissector_feed_budget(StreamProcessor *base, size_t n,
+                                 size_t max_frames, uint64_t max_ns)
+{
+    Dissector *self = (Dissector *)base;
+    struct Budget b = {max_frames, max_ns ? clock_ns() + max_ns : 0, false};
+
+    // NB: unprocessed input is kept at the start of buf, like an
+    //     incomplete frame, so the next call picks it up.
+    n += base->buf - self->buf;
+
+    size_t m = process_frames(self, self->buf, n, &b);
+
+    // NB: if all that is left is an incomplete frame, there is nothing to
+    //     resume; report 0 as without a budget
+    if(b.spent) {
+        int size = dnp3_link_frame_size(self->buf+m, n-m);
+        if(size == 0 || (size > 0 && (size_t)size > n-m))
+            b.spent = false;
+    }
+    keep_input(self, self->buf+m, n-m);
+
+    return b.spent ? (int)(n-m) : backpressure(self);
+}
+
+static int dissector_feed_external(StreamProcessor *base,
+                                   const uint8_t *data, size_t n)
+{
+    Dissector *self = (Dissector *)base;
+    size_t have = base->buf - self->buf;    // incomplete frame in buf
+    size_t pos = 0;
+
+    // complete the buffered frame, if any, by copying just enough input
+    while(have > 0 && pos < n) {
+        size_t k = n - pos;
+        if(self->need > have && k > self->need - have)
+            k = self->need - have;      // exactly the rest of the frame
+        if(k > FRAMEMAX)
+            k = FRAMEMAX;
+        if(k > self->bufsize - have)
+            k = self->bufsize - have;
+        memcpy(self->buf + have, data + pos, k);
+
+        size_t m = process_frames(self, self->buf, have + k, NULL);
+        if(m >= have) {
+            // left the buffer, continue in data
+            pos += m - have;
+            have = 0;
+        } else {
+            pos += k;
+            have += k;
+            memmove(self->buf, self->buf + m, have - m);
+            have -= m;
+        }
+    }
+    keep_input(self, self->buf, have);
+
+    // parse the rest in place
+    if(pos < n) {
+        size_t m = process_frames(self, data + pos, n - pos, NULL);
+        keep_input(self, data + pos + m, n - pos - m);
     }
 
-    // flush consumed input
-    n -= m;
-    memmove(self->buf, base->buf+m, n);
-    base->buf = self->buf + n;
-    base->bufsize = BUFLEN - n;
+    return backpressure(self);
+}
+
+static int dissector_feedv(StreamProcessor *base,
+                           const struct iovec *iov, int iovcnt)
+{
+    int bp = 0;
+
+    for(int i=0; i<iovcnt; i++) {
+        int r = dissector_feed_external(base, iov[i].iov_base, iov[i].iov_len);
+        if(r == DNP3_BACKPRESSURE)
+            bp = r;             // NB: keep going, the input is consumed
+        else if(r < 0)
+            return r;
+    }
+    return bp;
+}
+
+static int dissector_stats(StreamProcessor *base, DNP3_Stats *out)
+{
+#ifdef DNP3_STATS
+    Dissector *self = (Dissector *)base;
+    const uint64_t *p = (const uint64_t *)&self->stats;
+    uint64_t *q = (uint64_t *)out;
+
+    for(size_t i=0; i<sizeof(DNP3_Stats)/sizeof(uint64_t); i++)
+        q[i] = __atomic_load_n(&p[i], __ATOMIC_RELAXED);
 
     return 0;
+#else
+    return -1;
+#endif
 }
 
-static int dissector_finish(StreamProcessor *base)
+int dnp3_dissector_stats(StreamProcessor *p, DNP3_Stats *out)
+{
+    if(!p->stats)
+        return -1;
+    return p->stats(p, out);
+}
+
+// checkpoint and restore, see dnp3_dissector_checkpoint()
+//
+// format (little-endian):
+//
+//  "DNP3CKP1", u32 number of contexts, u8 flags (CKP_FRAMES),
+//  per context, least recently used first:
+//      u16 src, u16 dst, u8 dir, u8 tstate, u8 toverflow, u32 nshed,
+//      u8 window n, u32 dup_frames[n], u32 dup_payloads[n], u8 fnext, pnext
+//      if not idle:
+//          u8 last segment (fin<<7 | fir<<6 | seq), u8 len, payload,
+//          u32 tlen, payload so far, u32 n, raw frames (with CKP_FRAMES)
+//  u32 xxh32 of all of the above
+
+#define CKP_MAGIC "DNP3CKP1"
+#define CKP_FRAMES 0x01     // raw frames of series in flight included
+
+struct CkpOut {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;             // NB: counts on past cap
+};
+
+static void ckp_put(struct CkpOut *o, const void *p, size_t n)
+{
+    if(o->len + n <= o->cap)
+        memcpy(o->buf + o->len, p, n);
+    o->len += n;
+}
+
+static void ckp_put8(struct CkpOut *o, uint8_t x)
+{
+    ckp_put(o, &x, 1);
+}
+
+static void ckp_put16(struct CkpOut *o, uint16_t x)
+{
+    uint8_t b[2] = {x, x >> 8};
+    ckp_put(o, b, 2);
+}
+
+static void ckp_put32(struct CkpOut *o, uint32_t x)
+{
+    uint8_t b[4] = {x, x >> 8, x >> 16, x >> 24};
+    ckp_put(o, b, 4);
+}
+
+static int dissector_checkpoint(StreamProcessor *base, uint8_t *buf, size_t cap)
 {
     Dissector *self = (Dissector *)base;
+    struct CkpOut o_ = {buf, cap, 0}, *o = &o_;
+
+    ckp_put(o, CKP_MAGIC, 8);
+    ckp_put32(o, self->nctx);
+    ckp_put8(o, self->retain_frames ? CKP_FRAMES : 0);
+
+    for(struct Context *c = self->lru_tail; c; c = c->prev) {
+        ckp_put16(o, c->src);
+        ckp_put16(o, c->dst);
+        ckp_put8(o, c->dir);
+        ckp_put8(o, c->tstate);
+        ckp_put8(o, c->toverflow);
+        ckp_put32(o, c->nshed);
+
+        ckp_put8(o, self->dedup);
+        for(size_t i=0; i<self->dedup; i++)
+            ckp_put32(o, c->dup_frames[i]);
+        for(size_t i=0; i<self->dedup; i++)
+            ckp_put32(o, c->dup_payloads[i]);
+        ckp_put8(o, c->dup_fnext);
+        ckp_put8(o, c->dup_pnext);
+
+        if(c->tstate == T_IDLE)
+            continue;
+        const DNP3_Segment *s = &c->last_segment;
+        ckp_put8(o, s->fin << 7 | s->fir << 6 | s->seq);
+        ckp_put8(o, s->len);
+        ckp_put(o, s->payload, s->len);
+        ckp_put32(o, c->tlen);
+        ckp_put(o, c->sbuf->payload, c->tlen);
+        ckp_put32(o, c->n);
+        if(self->retain_frames)
+            ckp_put(o, c->sbuf->frames, c->n);
+    }
+
+    if(o->len + 4 > INT_MAX)
+        return -1;
+    if(o->len + 4 <= cap)
+        ckp_put32(o, xxh32(buf, o->len, 0));
+    else
+        o->len += 4;
+    return o->len;
+}
+
+struct CkpIn {
+    const uint8_t *p, *end;
+    bool err;               // ran past the end
+};
+
+static const uint8_t *ckp_get(struct CkpIn *r, size_t n)
+{
+    const uint8_t *p = r->p;
+
+    if((size_t)(r->end - r->p) < n) {
+        r->err = true;
+        return NULL;
+    }
+    r->p += n;
+    return p;
+}
+
+static uint8_t ckp_get8(struct CkpIn *r)
+{
+    const uint8_t *p = ckp_get(r, 1);
+    return p ? p[0] : 0;
+}
+
+static uint16_t ckp_get16(struct CkpIn *r)
+{
+    const uint8_t *p = ckp_get(r, 2);
+    return p ? p[0] | p[1] << 8 : 0;
+}
+
+static uint32_t ckp_get32(struct CkpIn *r)
+{
+    const uint8_t *p = ckp_get(r, 4);
+    return p ? rd32le(p) : 0;
+}
 
-    // free contexts
+// free all contexts, cf. dissector_finish
+static void drop_contexts(Dissector *self)
+{
     struct Context *p;
-    while((p = self->contexts)) {
-        self->contexts = p->next;
+
+    while((p = self->lru_head)) {
+        self->lru_head = p->next;
+        release_sbuf(self, p);
         self->mm_context->free(self->mm_context, p);
     }
+    self->lru_tail = NULL;
+    self->nctx = 0;
+    memset(self->ctxtab, 0, ((size_t)1 << self->ctxbits) * sizeof *self->ctxtab);
+}
+
+// read one context from r. if ctx is NULL, it is only skipped.
+static bool restore_context(Dissector *self, struct CkpIn *r, bool frames,
+                            struct Context *ctx)
+{
+    struct Context c = {0};
+    const uint8_t *lastpl = NULL, *payload = NULL, *raw = NULL;
+
+    c.src = ckp_get16(r);
+    c.dst = ckp_get16(r);
+    c.dir = ckp_get8(r);
+    c.tstate = ckp_get8(r);
+    uint8_t overflow = ckp_get8(r);
+    c.toverflow = overflow;
+    c.nshed = ckp_get32(r);
+
+    // NB: a window of another size still holds recent hashes
+    size_t n = ckp_get8(r);
+    if(n > DEDUPMAX)
+        return false;
+    for(size_t i=0; i<n; i++)
+        c.dup_frames[i] = ckp_get32(r);
+    for(size_t i=0; i<n; i++)
+        c.dup_payloads[i] = ckp_get32(r);
+    c.dup_fnext = ckp_get8(r);
+    c.dup_pnext = ckp_get8(r);
+    if(c.dup_fnext >= self->dedup)
+        c.dup_fnext = 0;
+    if(c.dup_pnext >= self->dedup)
+        c.dup_pnext = 0;
+
+    if(c.tstate > T_SERIES || c.dir > 1 || overflow > 1)
+        return false;
+    if(c.tstate != T_IDLE) {
+        uint8_t h = ckp_get8(r);
+        c.last_segment.fin = h >> 7;
+        c.last_segment.fir = (h >> 6) & 1;
+        c.last_segment.seq = h & 0x3F;
+        c.last_segment.len = ckp_get8(r);
+        lastpl = ckp_get(r, c.last_segment.len);
+        c.tlen = ckp_get32(r);
+        payload = ckp_get(r, c.tlen);
+        c.n = ckp_get32(r);
+        if(frames)
+            raw = ckp_get(r, c.n);
+
+        // the series must fit this dissector
+        if(c.last_segment.len > SEGMAX || c.tlen > self->seriesmax)
+            return false;
+        if(self->retain_frames && (!frames || c.n > self->framesmax))
+            return false;
+    }
+    if(r->err)
+        return false;
+    if(!ctx)
+        return true;
+
+    // NB: the caller initialized the list and table links
+    ctx->src = c.src;
+    ctx->dst = c.dst;
+    ctx->dir = c.dir;
+    ctx->tstate = c.tstate;
+    ctx->toverflow = c.toverflow;
+    ctx->nshed = c.nshed;
+    memcpy(ctx->dup_frames, c.dup_frames, sizeof c.dup_frames);
+    memcpy(ctx->dup_payloads, c.dup_payloads, sizeof c.dup_payloads);
+    ctx->dup_fnext = c.dup_fnext;
+    ctx->dup_pnext = c.dup_pnext;
+    if(c.tstate == T_IDLE)
+        return true;
+
+    acquire_sbuf(self, ctx);
+    if(!ctx->sbuf)
+        return false;
+    ctx->tlen = c.tlen;
+    memcpy(ctx->sbuf->payload, payload, c.tlen);
+    ctx->n = c.n;
+    if(self->retain_frames)
+        memcpy(ctx->sbuf->frames, raw, c.n);
+    c.last_segment.payload = (uint8_t *)lastpl;
+    save_last_segment(ctx, &c.last_segment);
+    return true;
+}
+
+static int dissector_restore(StreamProcessor *base,
+                             const uint8_t *buf, size_t len)
+{
+    Dissector *self = (Dissector *)base;
+    size_t mask = ((size_t)1 << self->ctxbits) - 1;
+
+    if(len < 8 + 4 + 1 + 4 || memcmp(buf, CKP_MAGIC, 8) != 0)
+        return -1;
+    if(rd32le(buf + len - 4) != xxh32(buf, len - 4, 0))
+        return -1;
+
+    struct CkpIn r = {buf + 8, buf + len - 4, false};
+    uint32_t nctx = ckp_get32(&r);
+    bool frames = ckp_get8(&r) & CKP_FRAMES;
+
+    drop_contexts(self);
+
+    // the oldest do not fit if maxctx is smaller
+    for(uint32_t k=0; k<nctx; k++) {
+        if(nctx - k > self->maxctx) {
+            if(!restore_context(self, &r, frames, NULL))
+                goto err;
+            continue;
+        }
+
+        struct Context *ctx =
+            self->mm_context->alloc(self->mm_context, sizeof(struct Context));
+        if(!ctx)
+            goto err;
+        memset(ctx, 0, sizeof(struct Context));
+        lru_push(self, ctx);    // NB: freed with the rest on error
+        self->nctx++;
+        if(!restore_context(self, &r, frames, ctx))
+            goto err;
+
+        size_t i = ctx_hash(self, ctx->src, ctx->dst);
+        for(; self->ctxtab[i]; i=(i+1)&mask) {
+            if(self->ctxtab[i]->src == ctx->src &&
+               self->ctxtab[i]->dst == ctx->dst)
+                goto err;       // duplicate
+        }
+        self->ctxtab[i] = ctx;
+    }
+    if(r.p != r.end)
+        goto err;
+    return 0;
+
+err:
+    drop_contexts(self);
+    return -1;
+}
+
+int dnp3_dissector_checkpoint(StreamProcessor *p, uint8_t *buf, size_t cap)
+{
+    if(!p->checkpoint)
+        return -1;
+    return p->checkpoint(p, buf, cap);
+}
+
+int dnp3_dissector_restore(StreamProcessor *p, const uint8_t *buf, size_t len)
+{
+    if(!p->restore)
+        return -1;
+    return p->restore(p, buf, len);
+}
+
+static int dissector_finish(StreamProcessor *base)
+{
+    Dissector *self = (Dissector *)base;
+
+    if(self->async)
+        dnp3_async_free(self->async);   // drains the queue
+
+    if(self->cache) {
+        for(size_t i=0; i<=self->cachemask; i++)
+            cache_clear(&self->cache[i]);
+        self->mm_context->free(self->mm_context, self->cache);
+    }
+    if(self->points)
+        dnp3_pointdb_free(self->points);
+
+    drop_contexts(self);
+    struct SeriesBuf *sb;
+    while((sb = self->pool)) {
+        self->pool = sb->next;
+        self->mm_context->free(self->mm_context, sb);
+    }
+    self->mm_context->free(self->mm_context, self->ctxtab);
 
     // free input buffer
     self->mm_input->free(self->mm_input, self->buf);
 
+    if(self->region)
+        h_region_free(self->region);
+
     free(self);
     return 0;
 }
@@ -528,27 +1974,158 @@ StreamProcessor *dnp3_dissector__m(HAllocator *mm_input,
                                    HAllocator *mm_parse,
                                    HAllocator *mm_context,
                                    HAllocator *mm_results,
+                                   const DNP3_DissectorConfig *config,
                                    DNP3_Callbacks cb, void *env)
 {
+    DNP3_DissectorConfig cfg = {0};
+    if(config)
+        cfg = *config;
+    if(cfg.max_contexts == 0)
+        cfg.max_contexts = CTXMAX;
+    if(cfg.input_buffer == 0)
+        cfg.input_buffer = BUFLEN;
+    if(cfg.input_buffer < FRAMEMAX)
+        cfg.input_buffer = FRAMEMAX;    // must hold any single frame
+    if(cfg.max_series == 0)
+        cfg.max_series = SERIESMAX;
+
+    HAllocator *mm = cfg.memory ? cfg.memory : h_system_allocator;
+    if(!mm_input)   mm_input = mm;
+    if(!mm_context) mm_context = mm;
+    if(!mm_results) mm_results = mm;
+
+    // hash table size: next power of two at least twice max_contexts
+    int ctxbits = 1;
+    while(ctxbits < 31 && ((size_t)1 << ctxbits) < 2 * cfg.max_contexts)
+        ctxbits++;
+    size_t ctxtabsize = (size_t)1 << ctxbits;
+    if(cfg.max_contexts > ctxtabsize / 2)
+        cfg.max_contexts = ctxtabsize / 2;
+
     Dissector *p = malloc(sizeof(Dissector));
     if(!p) return NULL;
 
-    uint8_t *buf = mm_input->alloc(mm_input, BUFLEN);
-    if(!buf) return NULL;
+    uint8_t *buf = mm_input->alloc(mm_input, cfg.input_buffer);
+    if(!buf) {
+        free(p);
+        return NULL;
+    }
+
+    struct Context **ctxtab =
+        mm_context->alloc(mm_context, ctxtabsize * sizeof(struct Context *));
+    if(!ctxtab) {
+        mm_input->free(mm_input, buf);
+        free(p);
+        return NULL;
+    }
+    memset(ctxtab, 0, ctxtabsize * sizeof(struct Context *));
+
+    HAllocator *region = NULL;
+    if(!mm_parse) {
+        region = mm_parse = h_region(mm, 0);
+        if(!region) {
+            mm_context->free(mm_context, ctxtab);
+            mm_input->free(mm_input, buf);
+            free(p);
+            return NULL;
+        }
+        // NB: hammer aborts when its allocator fails. under a full budget,
+        //     finish the frame on borrowed chunks; the refusal is reported
+        //     as DNP3_BACKPRESSURE.
+        if(cfg.memory)
+            h_region_spare(region, h_system_allocator);
+    }
 
     p->base.buf     = buf;
-    p->base.bufsize = BUFLEN;
+    p->base.bufsize = cfg.input_buffer;
     p->base.feed    = dissector_feed;
+    p->base.feed_external = dissector_feed_external;
+    p->base.feedv   = dissector_feedv;
+    p->base.feed_budget = dissector_feed_budget;
+    p->base.stats   = dissector_stats;
+    p->base.checkpoint = dissector_checkpoint;
+    p->base.restore = dissector_restore;
     p->base.finish  = dissector_finish;
     p->buf          = buf;
-    p->bufsize      = BUFLEN;
-    p->contexts     = NULL;
+    p->bufsize      = cfg.input_buffer;
+    p->need         = 0;
+    p->seriesmax    = cfg.max_series;
+    // raw frames: enough for a full series in maximum-size segments
+    p->framesmax    = (cfg.max_series + SEGMAX-1) / SEGMAX * FRAMEMAX;
+    p->ctxtab       = ctxtab;
+    p->ctxbits      = ctxbits;
+    p->nctx         = 0;
+    p->maxctx       = cfg.max_contexts;
+    p->lru_head     = NULL;
+    p->lru_tail     = NULL;
+    p->pool         = NULL;
+    p->npool        = 0;
+    p->retain_frames = !cfg.skip_raw_frames;
+    p->use_dir      = !cfg.ignore_dir;
+    p->lazy         = cfg.lazy_objects;
+    p->filtering    = (cfg.filter != NULL);
+    p->dedup        = (cfg.dedup_window > DEDUPMAX) ? DEDUPMAX
+                                                    : cfg.dedup_window;
+    p->frame_hash   = 0;
+    if(cfg.filter)
+        p->filter   = *cfg.filter;
+    p->shedding     = (cfg.shed != NULL);
+    if(cfg.shed) {
+        p->shed     = *cfg.shed;
+        if(p->shed.hold_ms == 0)
+            p->shed.hold_ms = SHEDHOLD;
+    }
+    p->overloaded   = false;
+    p->shed_until   = 0;
+#ifdef DNP3_STATS
+    memset(&p->stats, 0, sizeof(p->stats));
+    p->timing       = cfg.stats_timing;
+    p->nested       = 0;
+#endif
     p->cb           = cb;
     p->env          = env;
     p->mm_input     = mm_input;
     p->mm_parse     = mm_parse;
     p->mm_context   = mm_context;
     p->mm_results   = mm_results;
+    p->region       = region;
+    p->async        = NULL;
+    p->cache        = NULL;
+    p->cachemask    = 0;
+    p->points       = NULL;
+    p->keys         = cfg.keys;
+    p->memory       = cfg.memory;
+    p->refused      = cfg.memory ? h_membudget_refused(cfg.memory) : 0;
+
+    if(cfg.point_db) {
+        p->points = dnp3_pointdb_new(mm_context);
+        if(!p->points) {
+            dissector_finish(&p->base);
+            return NULL;
+        }
+    }
+
+    if(cfg.request_cache > 0) {
+        size_t k = 1;
+        while(k < cfg.request_cache)
+            k *= 2;
+        p->cache = mm_context->alloc(mm_context, k * sizeof(struct CacheEntry));
+        if(!p->cache) {
+            dissector_finish(&p->base);
+            return NULL;
+        }
+        memset(p->cache, 0, k * sizeof(struct CacheEntry));
+        p->cachemask = k - 1;
+    }
+
+    if(cfg.async_queue > 0) {
+        p->async = dnp3_async_new(mm_results, cfg.async_queue, cb, env);
+        if(!p->async) {
+            dissector_finish(&p->base);
+            return NULL;
+        }
+        p->cb.app_object_block = NULL;  // whole fragments only
+    }
 
     assert((StreamProcessor *)p == &p->base);
     return &p->base;
@@ -557,8 +2134,8 @@ StreamProcessor *dnp3_dissector__m(HAllocator *mm_input,
 StreamProcessor *dnp3_dissector(DNP3_Callbacks cb, void *env)
 {
     return dnp3_dissector__m(h_system_allocator,
+                             NULL,  // region allocator
                              h_system_allocator,
                              h_system_allocator,
-                             h_system_allocator,
-                             cb, env);
+                             NULL, cb, env);
 }
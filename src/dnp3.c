@@ -5,8 +5,10 @@
 #include "app.h"
 #include "transport.h"
 #include "link.h"
+#include "tables.h"
 
 void dnp3_dissector_init(void); // from dissector.c
+HParser *dnp3_p_transport_function(void);   // ditto
 
 void dnp3_p_init(void)
 {
@@ -22,14 +24,30 @@ void h_pprint_lrtable(FILE *f, void *, void *, int);
 
 void dnp3_init(void)
 {
+    dnp3_init_with(NULL);
+}
+
+void dnp3_init_with(const DNP3_ParserConfig *config)
+{
+    DNP3_ParserConfig cfg = {0};
+    if(config)
+        cfg = *config;
+
+    dnp3_p_columnar = cfg.columnar;
     dnp3_p_init();
     dnp3_dissector_init();
 
     // XXX debug
 #if 0
-    void *g = h_pprint_lr_info(stdout, dnp3_p_transport_function);
+    HParser *tfun = dnp3_p_transport_function();
+    void *g = h_pprint_lr_info(stdout, tfun);
     assert(g != NULL);
     fprintf(stdout, "\n==== L A L R  T A B L E ====\n");
-    h_pprint_lrtable(stdout, g, dnp3_p_transport_function->backend_data, 0);
+    h_pprint_lrtable(stdout, g, tfun->backend_data, 0);
 #endif
 }
+
+void dnp3_free(void)
+{
+    dnp3_tables_free();
+}
@@ -0,0 +1,346 @@
+// generating DNP3 output
+//
+// the encoders write the wire format of application fragments, transport
+// segments and link frames (with their CRCs) into a caller's buffer. like
+// snprintf, they write at most cap bytes and return the full size of the
+// output, which is complete only if that is <= cap. they never allocate.
+//
+// object data is laid out as given by the object registry (objects.h), the
+// same tables the direct decoder uses, plus the few types with fields of
+// their own (commands, analog output status, intervals, application ids).
+
+#include <dnp3hammer.h>
+
+#include <string.h>
+#include <limits.h>     // INT_MAX
+#include "app.h"        // GV()
+#include "columns.h"    // dnp3_flags_encode
+#include "objects.h"
+
+
+// output cursor; len counts everything, also what did not fit
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool err;       // something that cannot be encoded
+} Enc;
+
+static inline void put8(Enc *e, uint8_t x)
+{
+    if(e->len < e->cap)
+        e->buf[e->len] = x;
+    e->len++;
+}
+
+// little-endian integers of 1, 2, 4, 6, or 8 bytes
+static inline void le(Enc *e, uint64_t x, size_t n)
+{
+    for(size_t i=0; i<n; i++)
+        put8(e, x >> (8*i));
+}
+
+static void put(Enc *e, const uint8_t *p, size_t n)
+{
+    if(e->len < e->cap) {
+        size_t k = e->cap - e->len;
+        memcpy(e->buf + e->len, p, k < n ? k : n);
+    }
+    e->len += n;
+}
+
+static int finish(const Enc *e)
+{
+    return (e->err || e->len > INT_MAX) ? -1 : (int)e->len;
+}
+
+
+/// application layer ///
+
+static void encode_value(Enc *e, const DNP3_ObjectInfo *x, const DNP3_Object *o)
+{
+    uint64_t u;
+
+    switch(x->value) {
+    case OBJ_VAL_U16:
+    case OBJ_VAL_U32:
+        if(x->group == DNP3_GROUP_DELAY)
+            u = (x->variation == DNP3_VARIATION_DELAY_S) ? o->delay / 1000
+                                                         : o->delay;
+        else if(x->group == DNP3_GROUP_ANAINDEADBAND)
+            u = o->ana.uint;
+        else
+            u = o->ctr.value;
+        le(e, u, x->value == OBJ_VAL_U16 ? 2 : 4);
+        break;
+    case OBJ_VAL_S16:   le(e, (uint16_t)o->ana.sint, 2); break;
+    case OBJ_VAL_S32:   le(e, (uint32_t)o->ana.sint, 4); break;
+    case OBJ_VAL_F32: {
+        float f = o->ana.flt;
+        uint32_t bits;
+        memcpy(&bits, &f, 4);
+        le(e, bits, 4);
+        break; }
+    case OBJ_VAL_F64: {
+        uint64_t bits;
+        memcpy(&bits, &o->ana.flt, 8);
+        le(e, bits, 8);
+        break; }
+    }
+}
+
+// one fixed-size object; the counterpart of the parsers in obj/*.c
+static void encode_object(Enc *e, const DNP3_ObjectInfo *x, const DNP3_Object *o)
+{
+    DNP3_Group g = x->group;
+
+    switch(g << 8 | x->variation) {
+    case GV(BINOUTCMD, CROB):
+    case GV(BINOUTCMD, PCB):
+        put8(e, o->cmd.optype | o->cmd.queue << 4 | o->cmd.clear << 5
+                | o->cmd.tcc << 6);
+        put8(e, o->cmd.count);
+        le(e, o->cmd.on, 4);
+        le(e, o->cmd.off, 4);
+        put8(e, o->cmd.status & 0x7F);
+        return;
+    case GV(BINOUTCMDEV, NOTIME):
+    case GV(BINOUTCMDEV, ABSTIME):
+        put8(e, (o->cmdev.status & 0x7F) | o->cmdev.cs << 7);
+        if(x->time)
+            le(e, o->timed.abstime, 6);
+        return;
+    case GV(TIME, TIME_INTERVAL):
+    case GV(TIME, INDEXED_TIME):
+        le(e, o->time.abstime, 6);
+        le(e, o->time.interval, 4);
+        if(x->variation == DNP3_VARIATION_TIME_INDEXED_TIME)
+            put8(e, o->time.unit);
+        return;
+    }
+
+    // analog output command events: status, value, time
+    if(g == DNP3_GROUP_ANAOUTCMDEV)
+        put8(e, o->ana.status & 0x7F);
+
+    // NB: flags, counter and analog are at the same place in o->timed.
+    if(x->flags)
+        put8(e, dnp3_flags_encode(g, o->flags));
+    encode_value(e, x, o);
+
+    // analog output blocks: value, status
+    if(g == DNP3_GROUP_ANAOUT)
+        put8(e, o->ana.status);
+
+    if(x->time == OBJ_TIME_ABS) {
+        if(g == DNP3_GROUP_TIME || g == DNP3_GROUP_CTO)
+            le(e, o->time.abstime, 6);
+        else
+            le(e, o->timed.abstime, 6);
+    } else if(x->time == OBJ_TIME_REL) {
+        le(e, o->timed.reltime, 2);
+    }
+}
+
+// state of the i-th packed object
+static unsigned packed_state(const DNP3_ObjectBlock *ob, unsigned w, size_t i)
+{
+    if(ob->columns)
+        return dnp3_oblock_state(ob, i);
+    return (w == 2) ? ob->objects[i].dblbit : ob->objects[i].bit;
+}
+
+static void encode_oblock(Enc *e, const DNP3_ObjectBlock *ob)
+{
+    dnp3_oblock_force(ob);
+
+    static const size_t fieldsize[] = {1, 2, 4};
+    bool objects = (ob->objects || ob->columns);
+    const DNP3_ObjectInfo *x = dnp3_object_info(ob->group, ob->variation);
+    unsigned pc = ob->prefixcode;
+    unsigned rsc = ob->rangespec;
+
+    // object header
+    put8(e, ob->group);
+    put8(e, ob->variation);
+    put8(e, pc << 4 | rsc);
+    if(rsc <= 5) {
+        size_t n = fieldsize[rsc % 3];
+        le(e, ob->range_base, n);
+        le(e, ob->range_base + ob->count - 1, n);
+    } else if(rsc >= 7 && rsc <= 9) {
+        le(e, ob->count, fieldsize[rsc - 7]);
+    } else if(rsc == 0xB) {
+        le(e, ob->count, 1);
+    } else if(rsc != 6) {
+        e->err = true;
+    }
+
+    if(!objects && !ob->indexes)
+        return;                         // header only (requests)
+    if(pc > 6 || (objects && !x) || (pc >= 4 && rsc != 0xB)
+       || (pc >= 1 && pc <= 3 && (rsc < 7 || rsc > 9))) {
+        e->err = true;
+        return;
+    }
+
+    // packed objects
+    if(objects && x->bits) {
+        unsigned w = x->bits;
+        unsigned acc = 0, nbits = 0;
+
+        if(pc != 0) {
+            e->err = true;
+            return;
+        }
+        for(size_t i=0; i<ob->count; i++) {
+            acc |= packed_state(ob, w, i) << nbits;
+            nbits += w;
+            if(nbits == 8) {
+                put8(e, acc);
+                acc = nbits = 0;
+            }
+        }
+        if(nbits > 0)
+            put8(e, acc);               // padding
+        return;
+    }
+
+    for(size_t i=0; i<ob->count && !e->err; i++) {
+        if(pc >= 1 && pc <= 3)
+            le(e, ob->indexes ? ob->indexes[i] : 0, fieldsize[pc - 1]);
+        if(!objects)
+            continue;
+
+        DNP3_Object o = dnp3_oblock_object(ob, i);
+        if(pc >= 4) {
+            // size-prefixed (variable-format) object
+            if(x->group != DNP3_GROUP_APPL) {
+                e->err = true;
+                return;
+            }
+            le(e, o.applid.len, fieldsize[pc - 4]);
+            put(e, (const uint8_t *)o.applid.str, o.applid.len);
+        } else if(x->size == 0) {
+            e->err = true;              // variable size needs a prefix
+        } else {
+            encode_object(e, x, &o);
+        }
+    }
+}
+
+int dnp3_encode_fragment(uint8_t *buf, size_t cap, const DNP3_Fragment *frag)
+{
+    Enc e_ = {buf, cap}, *e = &e_;
+    const DNP3_AppControl *ac = &frag->ac;
+    const DNP3_IntIndications *iin = &frag->iin;
+
+    if(frag->auth)
+        return -1;                      // XXX not supported
+
+    put8(e, ac->fir << 7 | ac->fin << 6 | ac->con << 5 | ac->uns << 4
+            | ac->seq);
+    put8(e, frag->fc);
+    if(frag->fc >= DNP3_RESPONSE) {
+        put8(e, iin->broadcast          | iin->class1 << 1
+              | iin->class2 << 2        | iin->class3 << 3
+              | iin->need_time << 4     | iin->local_ctrl << 5
+              | iin->device_trouble << 6 | iin->device_restart << 7);
+        put8(e, iin->func_not_supp      | iin->obj_unknown << 1
+              | iin->param_error << 2   | iin->eventbuf_overflow << 3
+              | iin->already_executing << 4 | iin->config_corrupt << 5);
+    }
+
+    for(size_t i=0; i<frag->nblocks && !e->err; i++)
+        encode_oblock(e, frag->odata[i]);
+
+    return finish(e);
+}
+
+
+/// transport and link layers ///
+
+int dnp3_encode_segment(uint8_t *buf, size_t cap, const DNP3_Segment *seg)
+{
+    Enc e_ = {buf, cap}, *e = &e_;
+
+    if(seg->len > DNP3_TRANSPORT_MAXPAYLOAD)
+        return -1;
+    put8(e, seg->fin << 7 | seg->fir << 6 | seg->seq);
+    put(e, seg->payload, seg->len);
+
+    return finish(e);
+}
+
+static void encode_frame(Enc *e, const DNP3_Frame *frame,
+                         const uint8_t *hdr, const uint8_t *data, size_t len)
+{
+    bool prm = dnp3_link_prm(frame);
+    uint8_t h[10];
+    size_t n = (hdr ? 1 : 0) + len;
+
+    h[0] = 0x05;
+    h[1] = 0x64;
+    h[2] = 5 + n;
+    h[3] = frame->dir << 7 | prm << 6 | frame->fcb << 5
+         | (prm ? frame->fcv : frame->dfc) << 4 | (frame->func & 0x0F);
+    h[4] = frame->destination;
+    h[5] = frame->destination >> 8;
+    h[6] = frame->source;
+    h[7] = frame->source >> 8;
+    uint16_t crc = dnp3_crc(h, 8);
+    h[8] = crc;
+    h[9] = crc >> 8;
+    put(e, h, 10);
+
+    // user data (an optional header octet plus data) in blocks of 16 bytes,
+    // each followed by its CRC. assemble into a local block first so the
+    // CRC routine sees contiguous input.
+    uint8_t blk[18];
+    size_t k = 0;
+    for(size_t i=0; i<n; i++) {
+        blk[k++] = (hdr && i == 0) ? *hdr : data[i - (hdr ? 1 : 0)];
+        if(k == 16 || i == n-1) {
+            crc = dnp3_crc(blk, k);
+            blk[k++] = crc;
+            blk[k++] = crc >> 8;
+            put(e, blk, k);
+            k = 0;
+        }
+    }
+}
+
+int dnp3_encode_frame(uint8_t *buf, size_t cap, const DNP3_Frame *frame)
+{
+    Enc e_ = {buf, cap}, *e = &e_;
+
+    if(frame->len < 0 || frame->len > DNP3_LINK_MAXPAYLOAD
+       || (frame->len > 0 && !frame->payload))
+        return -1;
+    encode_frame(e, frame, NULL, frame->payload, frame->len);
+
+    return finish(e);
+}
+
+int dnp3_encode_frames(uint8_t *buf, size_t cap, const DNP3_Frame *link,
+                       uint8_t *seq, const uint8_t *payload, size_t len)
+{
+    Enc e_ = {buf, cap}, *e = &e_;
+    size_t off = 0;
+
+    do {
+        size_t n = len - off;
+        if(n > DNP3_TRANSPORT_MAXPAYLOAD)
+            n = DNP3_TRANSPORT_MAXPAYLOAD;
+
+        bool fir = (off == 0);
+        bool fin = (off + n == len);
+        uint8_t th = fin << 7 | fir << 6 | (*seq & 0x3F);
+
+        encode_frame(e, link, &th, payload + off, n);
+        *seq = (*seq + 1) & 0x3F;
+        off += n;
+    } while(off < len);
+
+    return finish(e);
+}
@@ -0,0 +1,394 @@
+#include <dnp3hammer.h>
+
+#include <string.h>     // strlen
+#include <inttypes.h>   // PRIu64 etc.
+#include <math.h>       // isfinite
+#include "app.h"        // GV()
+#include "columns.h"    // dnp3_flags_encode
+#include "objects.h"
+#include "out.h"
+
+
+// structured output for machine consumption (JSON, CBOR)
+//
+// both encodings carry the same tree of maps, arrays and scalars. CBOR
+// containers are of indefinite length so nothing needs to be counted or
+// buffered ahead.
+
+#define MAXDEPTH 8
+
+typedef struct {
+    Out out;
+    DNP3_ExportFormat fmt;
+    int depth;
+    char close[MAXDEPTH];   // JSON: closing bracket per level
+    bool comma;             // JSON: a value precedes at this level
+} Enc;
+
+// CBOR major types
+enum { CB_UINT=0, CB_NINT=1, CB_TEXT=3, CB_ARRAY=4, CB_MAP=5, CB_SIMPLE=7 };
+
+static void cbor_head(Enc *e, unsigned major, uint64_t x)
+{
+    uint8_t b[9];
+    size_t n;
+
+    major <<= 5;
+    if(x < 24) {
+        b[0] = major | x; n = 1;
+    } else if(x <= 0xFF) {
+        b[0] = major | 24; n = 2;
+    } else if(x <= 0xFFFF) {
+        b[0] = major | 25; n = 3;
+    } else if(x <= 0xFFFFFFFF) {
+        b[0] = major | 26; n = 5;
+    } else {
+        b[0] = major | 27; n = 9;
+    }
+    for(size_t i=1; i<n; i++)
+        b[i] = x >> (8 * (n-1-i));
+
+    put(&e->out, (char *)b, n);
+}
+
+// JSON separator before a value
+static void json_sep(Enc *e)
+{
+    if(e->comma)
+        put(&e->out, ",", 1);
+    e->comma = true;
+}
+
+static void put_uint(Out *out, uint64_t x)
+{
+    char b[20];
+    char *p = b + sizeof(b);
+
+    do { *--p = '0' + x % 10; x /= 10; } while(x);
+    put(out, p, b + sizeof(b) - p);
+}
+
+static void enc_open(Enc *e, bool map)
+{
+    assert(e->depth < MAXDEPTH);
+    if(e->fmt == DNP3_EXPORT_CBOR) {
+        put(&e->out, map ? "\xBF" : "\x9F", 1);     // indefinite length
+    } else {
+        json_sep(e);
+        put(&e->out, map ? "{" : "[", 1);
+        e->close[e->depth] = map ? '}' : ']';
+        e->comma = false;
+    }
+    e->depth++;
+}
+
+#define enc_map(e)   enc_open(e, true)
+#define enc_array(e) enc_open(e, false)
+
+static void enc_end(Enc *e)
+{
+    assert(e->depth > 0);
+    e->depth--;
+    if(e->fmt == DNP3_EXPORT_CBOR) {
+        put(&e->out, "\xFF", 1);                     // break
+    } else {
+        put(&e->out, &e->close[e->depth], 1);
+        e->comma = true;
+    }
+}
+
+static void enc_uint(Enc *e, uint64_t x)
+{
+    if(e->fmt == DNP3_EXPORT_CBOR) {
+        cbor_head(e, CB_UINT, x);
+    } else {
+        json_sep(e);
+        put_uint(&e->out, x);
+    }
+}
+
+static void enc_int(Enc *e, int64_t x)
+{
+    if(x >= 0) {
+        enc_uint(e, x);
+    } else if(e->fmt == DNP3_EXPORT_CBOR) {
+        cbor_head(e, CB_NINT, -1 - x);
+    } else {
+        json_sep(e);
+        put(&e->out, "-", 1);
+        put_uint(&e->out, -(uint64_t)x);
+    }
+}
+
+static void enc_bool(Enc *e, bool x)
+{
+    if(e->fmt == DNP3_EXPORT_CBOR) {
+        put(&e->out, x ? "\xF5" : "\xF4", 1);
+    } else {
+        json_sep(e);
+        putstr(&e->out, x ? "true" : "false");
+    }
+}
+
+// single selects the 32-bit representation
+static void enc_float(Enc *e, double x, bool single)
+{
+    if(e->fmt == DNP3_EXPORT_CBOR) {
+        uint8_t b[9];
+        uint64_t bits;
+        size_t n;
+
+        if(single) {
+            float f = x;
+            uint32_t u;
+            memcpy(&u, &f, 4);
+            bits = u;
+            b[0] = CB_SIMPLE << 5 | 26;
+            n = 4;
+        } else {
+            memcpy(&bits, &x, 8);
+            b[0] = CB_SIMPLE << 5 | 27;
+            n = 8;
+        }
+        for(size_t i=0; i<n; i++)
+            b[1+i] = bits >> (8 * (n-1-i));
+        put(&e->out, (char *)b, 1+n);
+    } else {
+        json_sep(e);
+        if(single)
+            x = (float)x;
+        if(isfinite(x))
+            appendf(&e->out, single ? "%.9g" : "%.17g", x);
+        else
+            putstr(&e->out, "null");    // not representable in JSON
+    }
+}
+
+static void enc_str(Enc *e, const char *s, size_t n)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    if(e->fmt == DNP3_EXPORT_CBOR) {
+        cbor_head(e, CB_TEXT, n);
+        put(&e->out, s, n);
+        return;
+    }
+
+    json_sep(e);
+    put(&e->out, "\"", 1);
+    for(size_t i=0; i<n; i++) {
+        unsigned char c = s[i];
+        if(c == '"' || c == '\\') {
+            char t[2] = {'\\', c};
+            put(&e->out, t, 2);
+        } else if(c < 0x20 || c >= 0x7F) {
+            // NB: not necessarily UTF-8, so escape everything non-ASCII
+            char t[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+            put(&e->out, t, 6);
+        } else {
+            put(&e->out, (char *)&c, 1);
+        }
+    }
+    put(&e->out, "\"", 1);
+}
+
+static void enc_key(Enc *e, const char *k)
+{
+    enc_str(e, k, strlen(k));
+    if(e->fmt == DNP3_EXPORT_JSON) {
+        put(&e->out, ":", 1);
+        e->comma = false;
+    }
+}
+
+#define KEY_UINT(e, k, x)  do { enc_key(e, k); enc_uint(e, x); } while(0)
+#define KEY_INT(e, k, x)   do { enc_key(e, k); enc_int(e, x); } while(0)
+#define KEY_BOOL(e, k, x)  do { enc_key(e, k); enc_bool(e, x); } while(0)
+
+
+// object fields, the members of the map for one object:
+//
+//   state      packed binaries and double-bits, command event states
+//   flags      flags octet as on the wire (includes the state bit/s)
+//   value      counter, analog, delay [ms], deadband
+//   time       ms since 1970-01-01, or relative to the CTO (g2v3, g4v3)
+//   status     control status of commands and analog outputs
+//   ...        command fields (g12), intervals (g50), application id (g90)
+
+static void export_fields(Enc *e, DNP3_Group g, DNP3_Variation v,
+                          const DNP3_Object o)
+{
+    const DNP3_ObjectInfo *x = dnp3_object_info(g, v);
+
+    if(!x)
+        return;
+
+    if(x->bits == 1)
+        KEY_UINT(e, "state", o.bit);
+    else if(x->bits == 2)
+        KEY_UINT(e, "state", o.dblbit);
+
+    if(x->flags)
+        KEY_UINT(e, "flags", dnp3_flags_encode(g, o.flags));
+
+    if(x->value != OBJ_VAL_NONE)
+        enc_key(e, "value");
+    switch(x->value) {
+    case OBJ_VAL_U16:
+    case OBJ_VAL_U32:
+        if(g == DNP3_GROUP_DELAY)
+            enc_uint(e, o.delay);
+        else if(g == DNP3_GROUP_ANAINDEADBAND)
+            enc_uint(e, o.ana.uint);
+        else
+            enc_uint(e, o.ctr.value);
+        break;
+    case OBJ_VAL_S16:
+    case OBJ_VAL_S32:   enc_int(e, o.ana.sint); break;
+    case OBJ_VAL_F32:   enc_float(e, o.ana.flt, true); break;
+    case OBJ_VAL_F64:   enc_float(e, o.ana.flt, false); break;
+    }
+
+    if(x->time == OBJ_TIME_ABS) {
+        if(g == DNP3_GROUP_TIME || g == DNP3_GROUP_CTO)
+            KEY_UINT(e, "time", o.time.abstime);
+        else
+            KEY_UINT(e, "time", o.timed.abstime);
+    } else if(x->time == OBJ_TIME_REL) {
+        KEY_UINT(e, "time", o.timed.reltime);
+        KEY_BOOL(e, "relative", true);
+    }
+
+    // type-specific extras
+    switch(g << 8 | v) {
+    case GV(BINOUTCMD, CROB):
+    case GV(BINOUTCMD, PCB):
+        KEY_UINT(e, "tcc", o.cmd.tcc);
+        KEY_UINT(e, "optype", o.cmd.optype);
+        KEY_BOOL(e, "queue", o.cmd.queue);
+        KEY_BOOL(e, "clear", o.cmd.clear);
+        KEY_UINT(e, "count", o.cmd.count);
+        KEY_UINT(e, "on", o.cmd.on);
+        KEY_UINT(e, "off", o.cmd.off);
+        KEY_UINT(e, "status", o.cmd.status);
+        break;
+    case GV(BINOUTCMDEV, NOTIME):
+    case GV(BINOUTCMDEV, ABSTIME):
+        KEY_UINT(e, "state", o.cmdev.cs);
+        KEY_UINT(e, "status", o.cmdev.status);
+        break;
+    case GV(TIME, TIME_INTERVAL):
+        KEY_UINT(e, "interval", o.time.interval);
+        break;
+    case GV(TIME, INDEXED_TIME):
+        KEY_UINT(e, "interval", o.time.interval);
+        KEY_UINT(e, "unit", o.time.unit);
+        break;
+    case GV(CTO, UNSYNC):
+        KEY_BOOL(e, "unsynchronized", true);
+        break;
+    case GV(APPL, ID):
+        enc_key(e, "applid");
+        enc_str(e, o.applid.str, o.applid.len);
+        break;
+    default:
+        if(g == DNP3_GROUP_ANAOUT || g == DNP3_GROUP_ANAOUTCMDEV)
+            KEY_UINT(e, "status", o.ana.status);
+    }
+}
+
+static void export_object(Enc *e, DNP3_Group g, DNP3_Variation v,
+                          const DNP3_Object o)
+{
+    enc_map(e);
+    export_fields(e, g, v, o);
+    enc_end(e);
+}
+
+static void export_oblock(Enc *e, const DNP3_ObjectBlock *ob)
+{
+    dnp3_oblock_force(ob);
+
+    bool objects = (ob->objects || ob->columns);
+
+    enc_map(e);
+    KEY_UINT(e, "group", ob->group);
+    KEY_UINT(e, "variation", ob->variation);
+    KEY_UINT(e, "qc", ob->prefixcode << 4 | ob->rangespec);
+    if(ob->rangespec < 6)
+        KEY_UINT(e, "start", ob->range_base);
+    KEY_UINT(e, "count", ob->count);
+
+    if(objects || ob->indexes) {
+        enc_key(e, "objects");
+        enc_array(e);
+        for(size_t i=0; i<ob->count && !e->out.err; i++) {
+            enc_map(e);
+            if(ob->indexes)
+                KEY_UINT(e, "index", ob->indexes[i]);
+            else if(ob->rangespec < 6)
+                KEY_UINT(e, "index", ob->range_base + i);
+            if(objects) {
+                DNP3_Object o = dnp3_oblock_object(ob, i);
+                export_fields(e, ob->group, ob->variation, o);
+            }
+            enc_end(e);
+        }
+        enc_end(e);
+    }
+
+    enc_end(e);
+}
+
+static void export_fragment(Enc *e, const DNP3_Fragment *frag)
+{
+    enc_map(e);
+    KEY_UINT(e, "seq", frag->ac.seq);
+    KEY_BOOL(e, "fir", frag->ac.fir);
+    KEY_BOOL(e, "fin", frag->ac.fin);
+    KEY_BOOL(e, "con", frag->ac.con);
+    KEY_BOOL(e, "uns", frag->ac.uns);
+    KEY_UINT(e, "fc", frag->fc);
+
+    // internal indications as on the wire, first octet in the low byte
+    if(frag->fc >= DNP3_RESPONSE) {
+        const DNP3_IntIndications *iin = &frag->iin;
+        uint16_t x =
+            iin->broadcast          | iin->class1 << 1
+          | iin->class2 << 2        | iin->class3 << 3
+          | iin->need_time << 4     | iin->local_ctrl << 5
+          | iin->device_trouble << 6 | iin->device_restart << 7
+          | iin->func_not_supp << 8 | iin->obj_unknown << 9
+          | iin->param_error << 10  | iin->eventbuf_overflow << 11
+          | iin->already_executing << 12 | iin->config_corrupt << 13;
+        KEY_UINT(e, "iin", x);
+    }
+
+    enc_key(e, "blocks");
+    enc_array(e);
+    for(size_t i=0; i<frag->nblocks && !e->out.err; i++)
+        export_oblock(e, frag->odata[i]);
+    enc_end(e);
+
+    if(frag->auth)
+        KEY_BOOL(e, "auth", true);
+    enc_end(e);
+}
+
+#define EXPORT_API(name, call, ...)                                         \
+    int dnp3_export_##name(DNP3_ExportFormat fmt,                           \
+                           DNP3_FormatWriter write, void *env, __VA_ARGS__) \
+    {                                                                       \
+        char chunk[CHUNK];                                                  \
+        Enc e_ = {{chunk, CHUNK, .write=write, .env=env}, fmt}, *e = &e_;   \
+        call;                                                               \
+        assert(e->depth == 0);                                              \
+        return finish(&e->out);                                             \
+    }
+
+EXPORT_API(object, (export_object(e, g, v, o)),
+           DNP3_Group g, DNP3_Variation v, const DNP3_Object o)
+EXPORT_API(oblock, (export_oblock(e, ob)), const DNP3_ObjectBlock *ob)
+EXPORT_API(fragment, (export_fragment(e, frag)), const DNP3_Fragment *frag)
+
+#undef EXPORT_API
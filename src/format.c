@@ -6,6 +6,9 @@
 #include <ctype.h>
 #include <assert.h>
 #include "app.h"        // GV()
+#include "columns.h"    // dnp3_oblock_force
+#include "objects.h"
+#include "out.h"
 
 
 // human-readable output formatting
@@ -39,93 +42,42 @@ static char *funcnames[] = {
     "RESPONSE", "UNSOLICITED_RESPONSE", "AUTHENTICATE_RESP"
     };
 
-static int appendf(char **s, size_t *size, const char *fmt, ...)
-{
-    va_list args;
-    size_t len;
-    int n;
-    char *p;
-
-    assert(s != NULL);
-    if(*s == NULL) {
-        *s = malloc(n = 10);
-        if(!*s) return -1;
-        *s[0] = '\0';
-        *size = n;
-    }
-
-    len = strlen(*s);
-    while(1) {
-        size_t left = *size - len;
-        va_start(args, fmt);
-        n = vsnprintf(*s + len, left, fmt, args);
-        va_end(args);
-        if(n < 0)
-            return -1;
-        if(n < left)
-            break;
-
-        // need more space
-        n = len + n + 1;
-        p = realloc(*s, n);
-        if(!p)
-            return -1;
-        *size = n;
-        *s = p;
-    }
-
-    return 0;
-}
-
 static const char dblbit_sym[] = "~01-";
 
-static char *format_flags(DNP3_Flags flags)
+static void append_flags(Out *out, DNP3_Flags flags)
 {
-    char *res = NULL;
-    size_t n;
-
-    if(flags.online)            appendf(&res, &n, ",online");
-    if(flags.restart)           appendf(&res, &n, ",restart");
-    if(flags.comm_lost)         appendf(&res, &n, ",comm_lost");
-    if(flags.remote_forced)     appendf(&res, &n, ",remote_forced");
-    if(flags.local_forced)      appendf(&res, &n, ",local_forced");
-    if(flags.chatter_filter)    appendf(&res, &n, ",chatter_filter");
-    //if(flags.rollover)          appendf(&res, &n, ",rollover");
-    if(flags.discontinuity)     appendf(&res, &n, ",discontinuity");
-    if(flags.over_range)        appendf(&res, &n, ",over_range");
-    if(flags.reference_err)     appendf(&res, &n, ",reference_err");
-
-    return res;
+    const char *sep = "(";
+
+    #define FLAG(x) if(flags.x) { putstr(out, sep); putstr(out, #x); sep = ","; }
+    FLAG(online);
+    FLAG(restart);
+    FLAG(comm_lost);
+    FLAG(remote_forced);
+    FLAG(local_forced);
+    FLAG(chatter_filter);
+    //FLAG(rollover);
+    FLAG(discontinuity);
+    FLAG(over_range);
+    FLAG(reference_err);
+    #undef FLAG
+
+    if(*sep == ',')
+        put(out, ")", 1);
 }
 
-static int append_flags(char **res, size_t *size, DNP3_Flags flags)
+static void append_bin_flags(Out *out, DNP3_Flags flags)
 {
-    char *s = format_flags(flags);
-    int x;
-
-    if(s) {
-        x = appendf(res, size, "(%s)", s+1);
-        free(s);
-    } else {
-        x = 0;
-    }
-
-    return x;
-}
-
-static int append_bin_flags(char **res, size_t *size, DNP3_Flags flags)
-{
-    if(append_flags(res, size, flags) < 0) return -1;
-    return appendf(res, size, "%d", (int)flags.state);
+    append_flags(out, flags);
+    appendf(out, "%d", (int)flags.state);
 }
 
-static int append_dblbit_flags(char **res, size_t *size, DNP3_Flags flags)
+static void append_dblbit_flags(Out *out, DNP3_Flags flags)
 {
-    if(append_flags(res, size, flags) < 0) return -1;
-    return appendf(res, size, "%c", (int)dblbit_sym[flags.state]);
+    append_flags(out, flags);
+    put(out, &dblbit_sym[flags.state], 1);
 }
 
-static int append_time(char **res, size_t *size, const char *pre, uint64_t time, bool relative)
+static void append_time(Out *out, const char *pre, uint64_t time, bool relative)
 {
     uint64_t s  = time / 1000;
     uint64_t ms = time % 1000;
@@ -135,19 +87,19 @@ static int append_time(char **res, size_t *size, const char *pre, uint64_t time,
         fmt = ms ? "%s%"PRIu64".%.3"PRIu64"s" : "%s%"PRIu64"s";
     else
         fmt = ms ? "%s%"PRIu64".%.3"PRIu64"s" : "%s%"PRIu64"s";
-    return appendf(res, size, fmt, pre, s, ms);
+    appendf(out, fmt, pre, s, ms);
 }
 
-#define append_abstime(res, size, time) append_time(res, size, "@", time, false)
-#define append_reltime(res, size, time) append_time(res, size, "@+", time, true)
-#define append_interval_ms(res, size, time) append_time(res, size, "+", time, true)
+#define append_abstime(out, time) append_time(out, "@", time, false)
+#define append_reltime(out, time) append_time(out, "@+", time, true)
+#define append_interval_ms(out, time) append_time(out, "+", time, true)
 
-static int append_interval(char **res, size_t *size, uint32_t val, DNP3_IntervalUnit unit)
+static void append_interval(Out *out, uint32_t val, DNP3_IntervalUnit unit)
 {
     const char *u = NULL;
 
     switch(unit) {
-    case DNP3_INTERVAL_NONE:                return 0;
+    case DNP3_INTERVAL_NONE:                return;
     case DNP3_INTERVAL_MILLISECONDS:        u = "ms"; break;
     case DNP3_INTERVAL_SECONDS:             u = "s"; break;
     case DNP3_INTERVAL_MINUTES:             u = "min"; break;
@@ -161,10 +113,10 @@ static int append_interval(char **res, size_t *size, uint32_t val, DNP3_Interval
     default:                                u = "[?]";
     }
 
-    return appendf(res, size, "+%"PRIu32"%s", val, u);
+    appendf(out, "+%"PRIu32"%s", val, u);
 }
 
-static int append_crob(char **res, size_t *size, DNP3_Command crob)
+static void append_crob(Out *out, DNP3_Command crob)
 {
     static const char *tcc_s[] = {"", "CLOSE ", "TRIP ", "XXX "};
     static const char *optype_s[] = {
@@ -181,246 +133,176 @@ static int append_crob(char **res, size_t *size, DNP3_Command crob)
     if(crob.status)
         snprintf(status, sizeof(status), " status=%d", crob.status);
 
-    return appendf(res, size, "(%s%s%s%s%dx on=%dms off=%dms%s)", tcc, optype,
-                   queue, clear, crob.count, crob.on, crob.off, status);
+    appendf(out, "(%s%s%s%s%dx on=%dms off=%dms%s)", tcc, optype,
+            queue, clear, crob.count, crob.on, crob.off, status);
 }
 
-static int append_string(char **res, size_t *size, const char *s, size_t n)
+static void append_string(Out *out, const char *s, size_t n)
 {
-    char *t = malloc(n+1);
-    if(!t) return -1;
-
+    put(out, "'", 1);
     for(size_t i=0; i<n; i++) {
-        t[i] = isalnum(s[i]) ? s[i] : '.'; // XXX escape properly
+        char c = isalnum(s[i]) ? s[i] : '.'; // XXX escape properly
+        put(out, &c, 1);
     }
-    t[n] = '\0';
+    put(out, "'", 1);
+}
+
+// object formatters, one per "fmt" column of the registry (objects.h)
+
+#define FMT(name) \
+    static void fmt_##name(Out *out, const DNP3_Object o)
 
-    int x = appendf(res, size, "'%s'", t);
-    free(t);
-    return x;
+FMT(bit)            { appendf(out, "%d", (int)o.bit); }
+FMT(bin_flags)      { append_bin_flags(out, o.flags); }
+FMT(bin_abstime)
+{
+    append_bin_flags(out, o.timed.flags);
+    append_abstime(out, o.timed.abstime);
+}
+FMT(bin_reltime)
+{
+    append_bin_flags(out, o.timed.flags);
+    append_reltime(out, o.timed.reltime);
+}
+FMT(dblbit)         { put(out, &dblbit_sym[o.dblbit], 1); }
+FMT(dblbit_flags)   { append_dblbit_flags(out, o.flags); }
+FMT(dblbit_abstime)
+{
+    append_dblbit_flags(out, o.timed.flags);
+    append_abstime(out, o.timed.abstime);
+}
+FMT(dblbit_reltime)
+{
+    append_dblbit_flags(out, o.timed.flags);
+    append_reltime(out, o.timed.reltime);
+}
+FMT(crob)           { append_crob(out, o.cmd); }
+FMT(cmdev)
+{
+    if(o.cmdev.status)
+        appendf(out, "(status=%d)", (int)o.cmdev.status);
+    appendf(out, "%d", (int)o.cmdev.cs);
+}
+FMT(cmdev_abstime)
+{
+    if(o.timed.cmdev.status)
+        appendf(out, "(status=%d)", (int)o.timed.cmdev.status);
+    appendf(out, "%d", (int)o.timed.cmdev.cs);
+    append_abstime(out, o.timed.abstime);
+}
+FMT(ctr)            { appendf(out, "%"PRIu32, o.ctr.value); }
+FMT(ctr_flags)
+{
+    append_flags(out, o.ctr.flags);
+    appendf(out, "%"PRIu32, o.ctr.value);
+}
+FMT(ctr_abstime)
+{
+    append_flags(out, o.timed.ctr.flags);
+    appendf(out, "%"PRIu32, o.timed.ctr.value);
+    append_abstime(out, o.timed.abstime);
+}
+FMT(ana)            { appendf(out, "%"PRIi32, o.ana.sint); }
+FMT(ana_flags)
+{
+    append_flags(out, o.ana.flags);
+    appendf(out, "%"PRIi32, o.ana.sint);
+}
+FMT(ana_abstime)
+{
+    append_flags(out, o.timed.ana.flags);
+    appendf(out, "%"PRIi32, o.timed.ana.sint);
+    append_abstime(out, o.timed.abstime);
+}
+FMT(flt)            { appendf(out, "%.1f", o.ana.flt); }
+FMT(flt_flags)
+{
+    append_flags(out, o.ana.flags);
+    appendf(out, "%.1f", o.ana.flt);
+}
+FMT(flt_abstime)
+{
+    append_flags(out, o.ana.flags);
+    appendf(out, "%.1f", o.ana.flt);
+    append_abstime(out, o.timed.abstime);
+}
+FMT(anaout)
+{
+    if(o.ana.status)
+        appendf(out, "(status=%d)", (int)o.ana.status);
+    appendf(out, "%"PRIi32, o.ana.sint);
+}
+FMT(anaout_abstime)
+{
+    if(o.ana.status)
+        appendf(out, "(status=%d)", (int)o.timed.ana.status);
+    appendf(out, "%"PRIi32, o.timed.ana.sint);
+    append_abstime(out, o.timed.abstime);
+}
+FMT(anaout_flt)
+{
+    if(o.ana.status)
+        appendf(out, "(status=%d)", (int)o.ana.status);
+    appendf(out, "%.1f", o.ana.flt);
+}
+FMT(anaout_flt_abstime)
+{
+    if(o.timed.ana.status)
+        appendf(out, "(status=%d)", (int)o.timed.ana.status);
+    appendf(out, "%.1f", o.timed.ana.flt);
+    append_abstime(out, o.timed.abstime);
+}
+FMT(abstime)        { append_abstime(out, o.time.abstime); }
+FMT(time_interval)
+{
+    append_abstime(out, o.time.abstime);
+    append_interval_ms(out, o.time.interval);
 }
+FMT(indexed_time)
+{
+    append_abstime(out, o.time.abstime);
+    append_interval(out, o.time.interval, o.time.unit);
+}
+FMT(cto_unsync)
+{
+    putstr(out, "(unsynchronized)");
+    append_abstime(out, o.time.abstime);
+}
+FMT(delay)          { appendf(out, "%"PRIu32"ms", o.delay); }
+FMT(applid)         { append_string(out, o.applid.str, o.applid.len); }
+
+#undef FMT
 
-char *dnp3_format_object(DNP3_Group g, DNP3_Variation v, const DNP3_Object o)
+static void format_object(Out *out, DNP3_Group g, DNP3_Variation v,
+                          const DNP3_Object o)
 {
-    size_t size;
-    char *res = NULL;
+    size_t len = out->len;
 
     switch(g << 8 | v) {
-    case GV(BININ, PACKED):
-    case GV(BINOUT, PACKED):
-    case GV(BINOUTCMD, PCM):
-    case GV(IIN, PACKED):
-        appendf(&res, &size, "%d", (int)o.bit);
-        break;
-    case GV(BININ, FLAGS):
-    case GV(BINOUT, FLAGS):
-    case GV(BININEV, NOTIME):
-    case GV(BINOUTEV, NOTIME):
-        append_bin_flags(&res, &size, o.flags);
-        break;
-    case GV(BININEV, ABSTIME):
-    case GV(BINOUTEV, ABSTIME):
-        append_bin_flags(&res, &size, o.timed.flags);
-        append_abstime(&res, &size, o.timed.abstime);
-        break;
-    case GV(BININEV, RELTIME):
-        append_bin_flags(&res, &size, o.timed.flags);
-        append_reltime(&res, &size, o.timed.reltime);
-        break;
-    case GV(DBLBITIN, PACKED):
-        appendf(&res, &size, "%c", (int)dblbit_sym[o.dblbit]);
-        break;
-    case GV(DBLBITIN, FLAGS):
-    case GV(DBLBITINEV, NOTIME):
-        append_dblbit_flags(&res, &size, o.flags);
-        break;
-    case GV(DBLBITINEV, ABSTIME):
-        append_dblbit_flags(&res, &size, o.timed.flags);
-        append_abstime(&res, &size, o.timed.abstime);
-        break;
-    case GV(DBLBITINEV, RELTIME):
-        append_dblbit_flags(&res, &size, o.timed.flags);
-        append_reltime(&res, &size, o.timed.reltime);
-        break;
-    case GV(BINOUTCMD, CROB):
-    case GV(BINOUTCMD, PCB):
-        append_crob(&res, &size, o.cmd);
-        break;
-    case GV(BINOUTCMDEV, NOTIME):
-        if(o.cmdev.status)
-            appendf(&res, &size, "(status=%d)", (int)o.cmdev.status);
-        appendf(&res, &size, "%d", (int)o.cmdev.cs);
-        break;
-    case GV(BINOUTCMDEV, ABSTIME):
-        if(o.timed.cmdev.status)
-            appendf(&res, &size, "(status=%d)", (int)o.timed.cmdev.status);
-        appendf(&res, &size, "%d", (int)o.timed.cmdev.cs);
-        append_abstime(&res, &size, o.timed.abstime);
-        break;
-    case GV(CTR, 32BIT):
-    case GV(CTR, 16BIT):
-    case GV(CTREV, 16BIT):
-    case GV(CTREV, 32BIT):
-    case GV(FROZENCTR, 32BIT):
-    case GV(FROZENCTR, 16BIT):
-    case GV(FROZENCTREV, 32BIT):
-    case GV(FROZENCTREV, 16BIT):
-        append_flags(&res, &size, o.ctr.flags);
-        // fall through to next case to append counter value
-    case GV(CTR, 32BIT_NOFLAG):
-    case GV(CTR, 16BIT_NOFLAG):
-    case GV(FROZENCTR, 32BIT_NOFLAG):
-    case GV(FROZENCTR, 16BIT_NOFLAG):
-        appendf(&res, &size, "%"PRIu32, o.ctr.value);
-        break;
-    case GV(CTREV, 16BIT_TIME):
-    case GV(CTREV, 32BIT_TIME):
-    case GV(FROZENCTR, 32BIT_TIME):
-    case GV(FROZENCTR, 16BIT_TIME):
-    case GV(FROZENCTREV, 32BIT_TIME):
-    case GV(FROZENCTREV, 16BIT_TIME):
-        append_flags(&res, &size, o.timed.ctr.flags);
-        appendf(&res, &size, "%"PRIu32, o.timed.ctr.value);
-        append_abstime(&res, &size, o.timed.abstime);
-        break;
-    case GV(ANAIN, 32BIT):
-    case GV(ANAIN, 16BIT):
-    case GV(ANAINEV, 32BIT):
-    case GV(ANAINEV, 16BIT):
-    case GV(FROZENANAIN, 32BIT):
-    case GV(FROZENANAIN, 16BIT):
-    case GV(FROZENANAINEV, 32BIT):
-    case GV(FROZENANAINEV, 16BIT):
-    case GV(ANAOUTSTATUS, 32BIT):
-    case GV(ANAOUTSTATUS, 16BIT):
-    case GV(ANAOUTEV, 32BIT):
-    case GV(ANAOUTEV, 16BIT):
-        append_flags(&res, &size, o.ana.flags);
-        // fall through to next case to append value
-    case GV(ANAIN, 32BIT_NOFLAG):
-    case GV(ANAIN, 16BIT_NOFLAG):
-    case GV(FROZENANAIN, 32BIT_NOFLAG):
-    case GV(FROZENANAIN, 16BIT_NOFLAG):
-    case GV(ANAINDEADBAND, 32BIT):
-    case GV(ANAINDEADBAND, 16BIT):
-        appendf(&res, &size, "%"PRIi32, o.ana.sint);
-        break;
-    case GV(ANAIN, FLOAT):
-    case GV(ANAIN, DOUBLE):
-    case GV(ANAINEV, FLOAT):
-    case GV(ANAINEV, DOUBLE):
-    case GV(FROZENANAIN, FLOAT):
-    case GV(FROZENANAIN, DOUBLE):
-    case GV(FROZENANAINEV, FLOAT):
-    case GV(FROZENANAINEV, DOUBLE):
-    case GV(ANAOUTSTATUS, FLOAT):
-    case GV(ANAOUTSTATUS, DOUBLE):
-    case GV(ANAOUTEV, FLOAT):
-    case GV(ANAOUTEV, DOUBLE):
-        append_flags(&res, &size, o.ana.flags);
-        // fall through to append value
-    case GV(ANAINDEADBAND, FLOAT):
-        appendf(&res, &size, "%.1f", o.ana.flt);
-        break;
-    case GV(ANAINEV, 32BIT_TIME):
-    case GV(ANAINEV, 16BIT_TIME):
-    case GV(FROZENANAIN, 32BIT_TIME):
-    case GV(FROZENANAIN, 16BIT_TIME):
-    case GV(FROZENANAINEV, 32BIT_TIME):
-    case GV(FROZENANAINEV, 16BIT_TIME):
-    case GV(ANAOUTEV, 32BIT_TIME):
-    case GV(ANAOUTEV, 16BIT_TIME):
-        append_flags(&res, &size, o.timed.ana.flags);
-        appendf(&res, &size, "%"PRIi32, o.timed.ana.sint);
-        append_abstime(&res, &size, o.timed.abstime);
-        break;
-    case GV(ANAINEV, FLOAT_TIME):
-    case GV(ANAINEV, DOUBLE_TIME):
-    case GV(FROZENANAINEV, FLOAT_TIME):
-    case GV(FROZENANAINEV, DOUBLE_TIME):
-    case GV(ANAOUTEV, FLOAT_TIME):
-    case GV(ANAOUTEV, DOUBLE_TIME):
-        append_flags(&res, &size, o.ana.flags);
-        appendf(&res, &size, "%.1f", o.ana.flt);
-        append_abstime(&res, &size, o.timed.abstime);
-        break;
-    case GV(ANAOUTCMDEV, 32BIT):
-    case GV(ANAOUTCMDEV, 16BIT):
-    case GV(ANAOUT, 32BIT):
-    case GV(ANAOUT, 16BIT):
-        if(o.ana.status)
-            appendf(&res, &size, "(status=%d)", (int)o.ana.status);
-        appendf(&res, &size, "%"PRIi32, o.ana.sint);
-        break;
-    case GV(ANAOUTCMDEV, 32BIT_TIME):
-    case GV(ANAOUTCMDEV, 16BIT_TIME):
-        if(o.ana.status)
-            appendf(&res, &size, "(status=%d)", (int)o.timed.ana.status);
-        appendf(&res, &size, "%"PRIi32, o.timed.ana.sint);
-        append_abstime(&res, &size, o.timed.abstime);
-        break;
-    case GV(ANAOUTCMDEV, FLOAT):
-    case GV(ANAOUTCMDEV, DOUBLE):
-    case GV(ANAOUT, FLOAT):
-    case GV(ANAOUT, DOUBLE):
-        if(o.ana.status)
-            appendf(&res, &size, "(status=%d)", (int)o.ana.status);
-        appendf(&res, &size, "%.1f", o.ana.flt);
-        break;
-    case GV(ANAOUTCMDEV, FLOAT_TIME):
-    case GV(ANAOUTCMDEV, DOUBLE_TIME):
-        if(o.timed.ana.status)
-            appendf(&res, &size, "(status=%d)", (int)o.timed.ana.status);
-        appendf(&res, &size, "%.1f", o.timed.ana.flt);
-        append_abstime(&res, &size, o.timed.abstime);
-        break;
-    case GV(TIME, TIME):
-    case GV(TIME, RECORDED_TIME):
-        append_abstime(&res, &size, o.time.abstime);
-        break;
-    case GV(TIME, TIME_INTERVAL):
-        append_abstime(&res, &size, o.time.abstime);
-        append_interval_ms(&res, &size, o.time.interval);
-        break;
-    case GV(TIME, INDEXED_TIME):
-        append_abstime(&res, &size, o.time.abstime);
-        append_interval(&res, &size, o.time.interval, o.time.unit);
-        break;
-    case GV(CTO, UNSYNC):
-        appendf(&res, &size, "(unsynchronized)");
-        // fall through and append time
-    case GV(CTO, SYNC):
-        append_abstime(&res, &size, o.time.abstime);
-        break;
-    case GV(DELAY, S):
-    case GV(DELAY, MS):
-        appendf(&res, &size, "%"PRIu32"ms", o.delay);
-        break;
-    case GV(APPL, ID):
-        append_string(&res, &size, o.applid.str, o.applid.len);
-        break;
+#define X(g_,v_, size_,bits,fl,rsv, val,time, fmt, col,dec,ev) \
+    case GV(g_,v_): fmt_##fmt(out, o); break;
+    DNP3_OBJECTS(X)
+#undef X
     }
 
-    if(!res)
-        appendf(&res, &size, "?");
-
-    return res;
+    if(out->len == len)
+        put(out, "?", 1);
 }
 
-char *dnp3_format_oblock_(const DNP3_ObjectBlock *ob, bool do_data)
+static void format_oblock(Out *out, const DNP3_ObjectBlock *ob, bool do_data)
 {
-    size_t size;
-    char *res = NULL;
-    const char *sep = ob->objects ? ":" : "";
-    int x;
+    if(do_data)
+        dnp3_oblock_force(ob);      // NB: object headers don't need this
+
+    bool objects = (ob->objects || ob->columns);
+    const char *sep = objects ? ":" : "";
 
     // group, variation, qc
-    x = appendf(&res, &size, "g%dv%d qc=%X%X",
-                (int)ob->group, (int)ob->variation,
-                (unsigned int)ob->prefixcode, (unsigned int)ob->rangespec);
-    if(x<0) goto err;
+    appendf(out, "g%dv%d qc=%X%X",
+            (int)ob->group, (int)ob->variation,
+            (unsigned int)ob->prefixcode, (unsigned int)ob->rangespec);
 
-    if(!do_data) return res;
+    if(!do_data) return;
 
     // range
     if(ob->rangespec < 6) {
@@ -434,49 +316,30 @@ char *dnp3_format_oblock_(const DNP3_ObjectBlock *ob, bool do_data)
             fmt = " @%"PRIx32"..%"PRIx32"%s"; // address range
         }
 
-        x = appendf(&res, &size, fmt, start, stop, sep);
-        if(x<0) goto err;
+        appendf(out, fmt, start, stop, sep);
     }
 
     // objects/indexes
-    if(ob->indexes || ob->objects) {
-        for(size_t i=0; i<ob->count; i++) {
-            if(appendf(&res, &size, " ") < 0) goto err;
-            if(ob->indexes) {
-                x = appendf(&res, &size, "#%"PRIu32"%s", ob->indexes[i], sep);
-                if(x<0) goto err;
-            }
-            if(ob->objects) {
-                DNP3_Object o = ob->objects[i];
-                char *s = dnp3_format_object(ob->group, ob->variation, o);
-                x = appendf(&res, &size, "%s", s);
-                free(s);
-                if(x<0) goto err;
+    if(ob->indexes || objects) {
+        for(size_t i=0; i<ob->count && !out->err; i++) {
+            put(out, " ", 1);
+            if(ob->indexes)
+                appendf(out, "#%"PRIu32"%s", ob->indexes[i], sep);
+            if(objects) {
+                DNP3_Object o = dnp3_oblock_object(ob, i);
+                format_object(out, ob->group, ob->variation, o);
             }
         }
     } else if(ob->prefixcode == 0 && ob->rangespec >= 7 && ob->rangespec <= 9) {
         // count field but no objects or indexes
         // (presumably this is on a request giving a maximum number of objects.)
-        x = appendf(&res, &size, " range=%d", ob->count);
-        if(x<0) goto err;
+        appendf(out, " range=%d", ob->count);
     }
-
-    return res;
-
-err:
-    if(res) free(res);
-    return NULL;
 }
 
-char *dnp3_format_oblock(const DNP3_ObjectBlock *ob)
-{ return dnp3_format_oblock_(ob, true); }
-
-char *dnp3_format_fragment_(const DNP3_Fragment *frag, bool do_objects, bool do_data)
+static void format_fragment(Out *out, const DNP3_Fragment *frag,
+                            bool do_objects, bool do_data)
 {
-    char *res = NULL;
-    size_t size;
-    int x;
-
     // flags string
     char flags[20]; // need 4*3(names)+3(seps)+2(parens)+1(space)+1(null)
     char *p = flags;
@@ -492,23 +355,21 @@ char *dnp3_format_fragment_(const DNP3_Fragment *frag, bool do_objects, bool do_
     *p = '\0';
 
     // begin assembly of result string
-    x = appendf(&res, &size, "([%d], %s,", (int)frag->ac.seq, flags);
-    if(x<0) goto err;
+    appendf(out, "([%d], %s,", (int)frag->ac.seq, flags);
 
     // function name
     char *name = NULL;
     if(frag->fc < sizeof(funcnames) / sizeof(char *))
         name = funcnames[frag->fc];
     if(name)
-        x = appendf(&res, &size, "\"%s\",", name);
+        appendf(out, "\"%s\",", name);
     else
-        x = appendf(&res, &size, "0x%.2X,", (unsigned int)frag->fc);
-    if(x<0) goto err;
+        appendf(out, "0x%.2X,", (unsigned int)frag->fc);
 
     // add internal indications
-    char *iin = NULL;
-    size_t iinsize;
-    #define APPEND_IIN(FLAG) if(frag->iin.FLAG) appendf(&iin, &iinsize, "," #FLAG)
+    const char *sep = "(\"";
+    #define APPEND_IIN(FLAG) \
+        if(frag->iin.FLAG) { putstr(out, sep); putstr(out, #FLAG); sep = ","; }
     APPEND_IIN(broadcast);
     APPEND_IIN(class1);
     APPEND_IIN(class2);
@@ -524,104 +385,53 @@ char *dnp3_format_fragment_(const DNP3_Fragment *frag, bool do_objects, bool do_
     APPEND_IIN(already_executing);
     APPEND_IIN(config_corrupt);
     #undef APPEND_IIN
-    if(iin) {
-        x = appendf(&res, &size, "(\"%s\"),", iin+1); // +1 to skip the leading ','
-        free(iin);
-        if(x<0) goto err;
-    }
+    if(*sep == ',')
+        putstr(out, "\"),");
 
     // add object data
     if(do_objects) {
-        for(size_t i=0; i<frag->nblocks; i++) {
-            char *blk = dnp3_format_oblock_(frag->odata[i], do_data);
-            if(!blk) goto err;
-
-            x = appendf(&res, &size, " {%s},", blk);
-            free(blk);
-            if(x<0) goto err;
+        for(size_t i=0; i<frag->nblocks && !out->err; i++) {
+            put(out, " {", 2);
+            format_oblock(out, frag->odata[i], do_data);
+            put(out, "},", 2);
         }
     }
 
     // add authdata
-    if(frag->auth) {
-        x = appendf(&res, &size, "[\"auth\"])");    // XXX
-        if(x<0) goto err;
-    }
+    if(frag->auth)
+        putstr(out, "[\"auth\"])");     // XXX
     else
-    {
-        x = appendf(&res, &size, ")");    // XXX
-        if(x<0) goto err;
-    }
-        
-
-    return res;
-
-err:
-    if(res) free(res);
-    return NULL;
+        put(out, ")", 1);               // XXX
 }
 
-char *dnp3_format_fragment(const DNP3_Fragment *frag)
-{ return dnp3_format_fragment_(frag, true, true); }
-
-char *dnp3_format_fragment_ohdrs(const DNP3_Fragment *frag)
-{ return dnp3_format_fragment_(frag, false, true); }
-
-char *dnp3_format_fragment_header(const DNP3_Fragment *frag)
-{ return dnp3_format_fragment_(frag, false, false); }
-
-int append_payload(char **res, size_t *size, uint8_t *bytes, size_t len)
+static void append_payload(Out *out, const uint8_t *bytes, size_t len)
 {
-    if(bytes) {
-        char *s = malloc(len * 3 + 1);
-        if(!s) return -1;
-
-        char *p = s;
-        *p = '\0';
-        for(size_t i=0; i<len; i++)
-            p += sprintf(p, " %.2X", bytes[i]);
+    static const char hex[] = "0123456789ABCDEF";
 
-        int x = appendf(res, size, ":%s", s);
-        free(s);
-        return x;
+    if(bytes) {
+        put(out, ":", 1);
+        for(size_t i=0; i<len; i++) {
+            char t[3] = {' ', hex[bytes[i] >> 4], hex[bytes[i] & 0xF]};
+            put(out, t, 3);
+        }
     } else {
-        int x = appendf(res, size, ": (null)");
-        return x;
+        putstr(out, ": (null)");
     }
 }
 
-char *dnp3_format_segment_(const DNP3_Segment *seg, bool do_payload)
+static void format_segment(Out *out, const DNP3_Segment *seg, bool do_payload)
 {
-    char *res = NULL;
-    size_t size;
-    int x;
-
     const char *flags = "";
     if(seg->fir && seg->fin) flags = "(fir,fin) ";
     else if(seg->fir)        flags = "(fir) ";
     else if(seg->fin)        flags = "(fin) ";
 
-    x = appendf(&res, &size, "%ssegment %"PRIu8, flags, seg->seq);
-    if(x<0) goto err;
-
-    if(do_payload) {
-        x = append_payload(&res, &size, seg->payload, seg->len);
-        if(x<0) goto err;
-    }
-
-    return res;
+    appendf(out, "%ssegment %"PRIu8, flags, seg->seq);
 
-err:
-    if(res) free(res);
-    return NULL;
+    if(do_payload)
+        append_payload(out, seg->payload, seg->len);
 }
 
-char *dnp3_format_segment(const DNP3_Segment *seg)
-{ return dnp3_format_segment_(seg, true); }
-
-char *dnp3_format_segment_header(const DNP3_Segment *seg)
-{ return dnp3_format_segment_(seg, false); }
-
 static const char *linkfuncnames[32] = {
     // secondary (PRM=0)
     "ACK", "NACK", NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
@@ -633,61 +443,86 @@ static const char *linkfuncnames[32] = {
     "REQUEST_LINK_STATUS", NULL, NULL, NULL, NULL, NULL, NULL
 };
 
-char *dnp3_format_frame_(const DNP3_Frame *frame, bool do_payload)
+static void format_frame(Out *out, const DNP3_Frame *frame, bool do_payload)
 {
-    char *res = NULL;
-    size_t size;
-    int x;
-
     // header
-    x = appendf(&res, &size, "%s frame from %s %"PRIu16" to %"PRIu16": ",
-                             dnp3_link_prm(frame)? "primary" : "secondary",
-                             frame->dir? "master" : "outstation",
-                             frame->source, frame->destination);
-    if(x<0) goto err;
+    appendf(out, "%s frame from %s %"PRIu16" to %"PRIu16": ",
+                 dnp3_link_prm(frame)? "primary" : "secondary",
+                 frame->dir? "master" : "outstation",
+                 frame->source, frame->destination);
 
     // frame count / data flow control flags
     if(dnp3_link_prm(frame)) {
-        if(frame->fcv) {
-            x = appendf(&res, &size, "(fcb=%d) ", (int)frame->fcb);
-            if(x<0) goto err;
-        }
+        if(frame->fcv)
+            appendf(out, "(fcb=%d) ", (int)frame->fcb);
     } else {
         if(frame->dfc && frame->fcb)
-            x = appendf(&res, &size, "(fcb=1,dfc) ");
+            putstr(out, "(fcb=1,dfc) ");
         else if(frame->fcb)
-            x = appendf(&res, &size, "(fcb=1) ");
+            putstr(out, "(fcb=1) ");
         else if(frame->dfc)
-            x = appendf(&res, &size, "(dfc) ");
-        if(x<0) goto err;
+            putstr(out, "(dfc) ");
     }
 
     // function name
     const char *name = linkfuncnames[frame->func];
     if(name)
-        x = appendf(&res, &size, "%s", name);
+        putstr(out, name);
     else
-        x = appendf(&res, &size, "function %d (reserved)", (int)(frame->func & 0xF));
-    if(x<0) goto err;
+        appendf(out, "function %d (reserved)", (int)(frame->func & 0xF));
 
     // user data
     if(do_payload && frame->len > 0) {
         if(frame->payload)
-            x = append_payload(&res, &size, frame->payload, frame->len);
+            append_payload(out, frame->payload, frame->len);
         else
-            x = appendf(&res, &size, ": <corrupt>");
-        if(x<0) goto err;
+            putstr(out, ": <corrupt>");
     }
-
-    return res;
-
-err:
-    if(res) free(res);
-    return NULL;
 }
 
-char *dnp3_format_frame(const DNP3_Frame *frame)
-{ return dnp3_format_frame_(frame, true); }
+// public entry points, three per formatter: into a caller's buffer, to a
+// writer, and into a malloc'd string.
+#define FORMAT_API(name, call, ...)                                         \
+    int dnp3_format_##name##_into(char *buf, size_t cap, __VA_ARGS__)       \
+    {                                                                       \
+        Out o_ = {cap ? buf : NULL, cap ? cap-1 : 0}, *out = &o_;           \
+        call;                                                               \
+        return finish(out);                                                 \
+    }                                                                       \
+    int dnp3_format_##name##_to(DNP3_FormatWriter write, void *env,         \
+                                __VA_ARGS__)                                \
+    {                                                                       \
+        char chunk[CHUNK];                                                  \
+        Out o_ = {chunk, CHUNK, .write=write, .env=env}, *out = &o_;        \
+        call;                                                               \
+        return finish(out);                                                 \
+    }                                                                       \
+    char *dnp3_format_##name(__VA_ARGS__)                                   \
+    {                                                                       \
+        char chunk[CHUNK];                                                  \
+        Str str = {NULL};                                                   \
+        Out o_ = {chunk, CHUNK, .write=str_write, .env=&str}, *out = &o_;   \
+        call;                                                               \
+        return finish_str(out, &str);                                       \
+    }
 
-char *dnp3_format_frame_header(const DNP3_Frame *frame)
-{ return dnp3_format_frame_(frame, false); }
+FORMAT_API(object, (format_object(out, g, v, o)),
+           DNP3_Group g, DNP3_Variation v, const DNP3_Object o)
+FORMAT_API(oblock, (format_oblock(out, ob, true)),
+           const DNP3_ObjectBlock *ob)
+FORMAT_API(fragment, (format_fragment(out, frag, true, true)),
+           const DNP3_Fragment *frag)
+FORMAT_API(fragment_ohdrs, (format_fragment(out, frag, false, true)),
+           const DNP3_Fragment *frag)
+FORMAT_API(fragment_header, (format_fragment(out, frag, false, false)),
+           const DNP3_Fragment *frag)
+FORMAT_API(segment, (format_segment(out, seg, true)),
+           const DNP3_Segment *seg)
+FORMAT_API(segment_header, (format_segment(out, seg, false)),
+           const DNP3_Segment *seg)
+FORMAT_API(frame, (format_frame(out, frame, true)),
+           const DNP3_Frame *frame)
+FORMAT_API(frame_header, (format_frame(out, frame, false)),
+           const DNP3_Frame *frame)
+
+#undef FORMAT_API
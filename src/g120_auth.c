@@ -1,25 +1,54 @@
-
 #include <dnp3hammer.h>
 
 #include <hammer/glue.h>
 #include "g120_auth.h"
 #include "app.h"
+#include "util.h"
+#include "tables.h"
 
 HParser *dnp3_p_g120v3_auth_aggr_block;
 HParser *dnp3_p_g120v9_auth_mac_block;
 
+static HParsedToken *act_auth_aggr(const HParseResult *p, void *user)
+{
+    DNP3_Object *o = H_ALLOC(DNP3_Object);
+
+    o->aggr.csq = H_FIELD_UINT(0);
+    o->aggr.usr = H_FIELD_UINT(1);
+
+    return H_MAKE(DNP3_Object, o);
+}
+
+static HParsedToken *act_mac(const HParseResult *p, void *user)
+{
+    DNP3_Object *o = H_ALLOC(DNP3_Object);
+    HCountedArray *a = H_CAST_SEQ(p->ast);
+    size_t n = a->used;
+
+    o->mac.len = n;
+    o->mac.bytes = h_arena_malloc(p->arena, n ? n : 1);
+    for(size_t i=0; i<n; i++)
+        o->mac.bytes[i] = H_CAST_UINT(a->elements[i]);
+
+    return H_MAKE(DNP3_Object, o);
+}
+
 static HParser *auth_mac(HAllocator *mm__, size_t n)  // n = size in object prefix
 {
-    return h_repeat_n__m(mm__, h_uint8__m(mm__), n);
+    return h_action__m(mm__, h_repeat_n__m(mm__, h_uint8__m(mm__), n),
+                             act_mac, NULL);
 }
 
 void dnp3_p_init_g120_auth(void)
 {
     // A45.3
-    H_RULE(seqno,     h_uint32());
-    H_RULE(userno,    h_int_range(h_uint16(), 1, 65535));
-    H_RULE(auth_aggr, h_sequence(seqno, userno, NULL));
+    H_RULE (seqno,      h_uint32());
+    H_RULE (userno,     h_int_range(h_uint16(), 1, 65535));
+    H_ARULE(auth_aggr,  h_sequence(seqno, userno, NULL));
 
     dnp3_p_g120v3_auth_aggr_block = dnp3_p_single(G_V(AUTH, AGGR), auth_aggr);
     dnp3_p_g120v9_auth_mac_block = dnp3_p_single_vf(G_V(AUTH, MAC), auth_mac);
+
+    // the MAC is always the last object; dnp3_p_many must stop before it
+    dnp3_p_trailer = h_sequence(dnp3_p_g120v9_auth_mac_block, h_end_p(), NULL);
 }
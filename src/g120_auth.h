@@ -2,3 +2,5 @@
 
 extern HParser *dnp3_p_g120v3_auth_aggr_block;
 extern HParser *dnp3_p_g120v9_auth_mac_block;
+
+void dnp3_p_init_g120_auth(void);
@@ -0,0 +1,349 @@
+// dissector group: one dissector per worker thread, frames sharded by address
+
+#include <dnp3hammer.h>
+#include "link.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>    // struct iovec
+
+
+#define BUFLEN 4619     // same as a single dissector
+#define FRAMEMAX 292    // max. size of a link frame: 10 + 250 + 16*2
+#define RINGLEN 256     // frames queued per worker, must be a power of 2
+#define SPIN 100        // polls of an empty queue before a worker sleeps
+#define CACHELINE 64
+
+
+// a queued frame, complete but not checked beyond the header
+struct Slot {
+    uint16_t len;
+    uint8_t frame[FRAMEMAX];
+};
+
+// every worker owns a single-producer single-consumer ring of frames.
+// head is only written by the feeding thread, tail only by the worker.
+struct Worker {
+    size_t head __attribute__((aligned(CACHELINE)));
+    int sleeping;   // worker waits on 'wake'
+    size_t tail __attribute__((aligned(CACHELINE)));
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool done;      // protected by lock
+    pthread_t thread;
+    StreamProcessor *dissector;
+
+    struct Slot ring[RINGLEN];
+} __attribute__((aligned(CACHELINE)));
+
+typedef struct {
+    StreamProcessor base;
+
+    uint8_t *buf;   // input buffer, BUFLEN bytes
+    struct Worker *workers;
+    unsigned nworkers;
+} Group;
+
+
+static inline uint16_t le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+// wait for input on an empty ring
+// returns: true when the group is finished and all input is consumed
+static bool wait_input(struct Worker *w, size_t tail)
+{
+    for(int i=0; i<SPIN; i++) {
+        if(__atomic_load_n(&w->head, __ATOMIC_ACQUIRE) != tail)
+            return false;
+        sched_yield();
+    }
+
+    // NB: 'sleeping' and 'head' are accessed seq_cst on both sides, so
+    //     either we see the new head or the producer sees us sleeping.
+    pthread_mutex_lock(&w->lock);
+    __atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+    while(__atomic_load_n(&w->head, __ATOMIC_SEQ_CST) == tail && !w->done)
+        pthread_cond_wait(&w->wake, &w->lock);
+    __atomic_store_n(&w->sleeping, 0, __ATOMIC_RELAXED);
+    bool done = (__atomic_load_n(&w->head, __ATOMIC_ACQUIRE) == tail);
+    done = done && w->done;
+    pthread_mutex_unlock(&w->lock);
+
+    return done;
+}
+
+static void *worker_main(void *arg)
+{
+    struct Worker *w = arg;
+    StreamProcessor *d = w->dissector;
+    size_t tail = w->tail;
+
+    for(;;) {
+        size_t head = __atomic_load_n(&w->head, __ATOMIC_ACQUIRE);
+        if(head == tail) {
+            if(wait_input(w, tail))
+                break;
+            continue;
+        }
+
+        for(; tail != head; tail++) {
+            struct Slot *s = &w->ring[tail & (RINGLEN-1)];
+            d->feed_external(d, s->frame, s->len);
+            __atomic_store_n(&w->tail, tail+1, __ATOMIC_RELEASE);
+        }
+    }
+
+    return NULL;
+}
+
+// choose a worker by (source,destination), like the transport contexts
+static struct Worker *shard(Group *self, const uint8_t *frame)
+{
+    uint32_t key = ((uint32_t)le16(frame+6) << 16) | le16(frame+4);
+    uint32_t h = (key * 0x9E3779B1u) >> 16;
+    return &self->workers[h % self->nworkers];
+}
+
+static void push_frame(Group *self, const uint8_t *frame, size_t len)
+{
+    struct Worker *w = shard(self, frame);
+    size_t head = w->head;
+
+    assert(len <= FRAMEMAX);
+
+    // wait for a free slot
+    while(head - __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE) == RINGLEN)
+        sched_yield();
+
+    struct Slot *s = &w->ring[head & (RINGLEN-1)];
+    memcpy(s->frame, frame, len);
+    s->len = len;
+    __atomic_store_n(&w->head, head+1, __ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&w->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_signal(&w->wake);
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+// split input into frames and queue them to the workers
+// returns: number of bytes consumed; the rest is an incomplete frame
+static size_t queue_frames(Group *self, const uint8_t *buf, size_t n)
+{
+    size_t m=0;
+    int k;
+
+    while(m < n) {
+        m += dnp3_link_resync(buf+m, n-m);
+        if(m == n || (k = dnp3_link_frame_size(buf+m, n-m)) == 0)
+            break;
+        assert(k > 0);
+        if((size_t)k > n-m)
+            break;
+
+        push_frame(self, buf+m, k);
+        m += k;
+    }
+
+    return m;
+}
+
+// helper: keep the n bytes at p as the start of the input buffer
+static void keep_input(Group *self, const uint8_t *p, size_t n)
+{
+    assert(n <= BUFLEN);
+    if(p != self->buf)
+        memmove(self->buf, p, n);
+    self->base.buf = self->buf + n;
+    self->base.bufsize = BUFLEN - n;
+}
+
+static int group_feed(StreamProcessor *base, size_t n)
+{
+    Group *self = (Group *)base;
+
+    n += base->buf - self->buf;
+
+    size_t m = queue_frames(self, self->buf, n);
+    keep_input(self, self->buf+m, n-m);
+
+    return 0;
+}
+
+static int group_feed_external(StreamProcessor *base,
+                               const uint8_t *data, size_t n)
+{
+    Group *self = (Group *)base;
+    size_t have = base->buf - self->buf;
+    size_t pos = 0;
+
+    // complete the buffered frame, if any; cf. dissector_feed_external
+    while(have > 0 && pos < n) {
+        size_t k = n - pos;
+        if(k > FRAMEMAX)
+            k = FRAMEMAX;
+        if(k > BUFLEN - have)
+            k = BUFLEN - have;
+        memcpy(self->buf + have, data + pos, k);
+
+        size_t m = queue_frames(self, self->buf, have + k);
+        if(m >= have) {
+            pos += m - have;
+            have = 0;
+        } else {
+            pos += k;
+            have += k;
+            memmove(self->buf, self->buf + m, have - m);
+            have -= m;
+        }
+    }
+    keep_input(self, self->buf, have);
+
+    if(pos < n) {
+        size_t m = queue_frames(self, data + pos, n - pos);
+        keep_input(self, data + pos + m, n - pos - m);
+    }
+
+    return 0;
+}
+
+static int group_feedv(StreamProcessor *base,
+                       const struct iovec *iov, int iovcnt)
+{
+    for(int i=0; i<iovcnt; i++) {
+        int r = group_feed_external(base, iov[i].iov_base, iov[i].iov_len);
+        if(r < 0)
+            return r;
+    }
+    return 0;
+}
+
+// sum up the statistics of all workers
+static int group_stats(StreamProcessor *base, DNP3_Stats *out)
+{
+    Group *self = (Group *)base;
+    uint64_t *q = (uint64_t *)out;
+
+    memset(out, 0, sizeof(DNP3_Stats));
+    for(unsigned i=0; i<self->nworkers; i++) {
+        DNP3_Stats st;
+        const uint64_t *p = (const uint64_t *)&st;
+
+        if(dnp3_dissector_stats(self->workers[i].dissector, &st) < 0)
+            return -1;
+        for(size_t j=0; j<sizeof(DNP3_Stats)/sizeof(uint64_t); j++)
+            q[j] += p[j];
+    }
+
+    return 0;
+}
+
+// stop and free the first n workers, after they drained their queues
+static void stop_workers(Group *self, unsigned n)
+{
+    for(unsigned i=0; i<n; i++) {
+        struct Worker *w = &self->workers[i];
+
+        pthread_mutex_lock(&w->lock);
+        w->done = true;
+        pthread_cond_signal(&w->wake);
+        pthread_mutex_unlock(&w->lock);
+
+        pthread_join(w->thread, NULL);
+        w->dissector->finish(w->dissector);
+        pthread_cond_destroy(&w->wake);
+        pthread_mutex_destroy(&w->lock);
+    }
+}
+
+static int group_finish(StreamProcessor *base)
+{
+    Group *self = (Group *)base;
+
+    stop_workers(self, self->nworkers);
+    free(self->workers);
+    free(self->buf);
+    free(self);
+
+    return 0;
+}
+
+StreamProcessor *dnp3_dissector_group_new(unsigned nthreads,
+                                          DNP3_Callbacks cb, void *env)
+{
+    Group *self = NULL;
+    struct Worker *workers = NULL;
+    uint8_t *buf = NULL;
+    unsigned i;
+
+    if(nthreads == 0)
+        return NULL;
+
+    self = malloc(sizeof(Group));
+    buf = malloc(BUFLEN);
+    if(posix_memalign((void **)&workers, CACHELINE,
+                      nthreads * sizeof(struct Worker)) != 0)
+        workers = NULL;
+    if(!self || !buf || !workers)
+        goto err;
+
+    self->base.feed          = group_feed;
+    self->base.finish        = group_finish;
+    self->base.feed_external = group_feed_external;
+    self->base.feedv         = group_feedv;
+    self->base.feed_budget   = NULL;
+    self->base.stats         = group_stats;
+    self->base.checkpoint    = NULL;
+    self->base.restore       = NULL;
+    self->base.buf           = buf;
+    self->base.bufsize       = BUFLEN;
+    self->buf                = buf;
+    self->workers            = workers;
+    self->nworkers           = nthreads;
+
+    for(i=0; i<nthreads; i++) {
+        struct Worker *w = &workers[i];
+
+        w->head = 0;
+        w->tail = 0;
+        w->sleeping = 0;
+        w->done = false;
+        w->dissector = dnp3_dissector(cb, env);
+        if(!w->dissector)
+            goto err_workers;
+
+        if(pthread_mutex_init(&w->lock, NULL) != 0) {
+            w->dissector->finish(w->dissector);
+            goto err_workers;
+        }
+        if(pthread_cond_init(&w->wake, NULL) != 0) {
+            pthread_mutex_destroy(&w->lock);
+            w->dissector->finish(w->dissector);
+            goto err_workers;
+        }
+        if(pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            pthread_cond_destroy(&w->wake);
+            pthread_mutex_destroy(&w->lock);
+            w->dissector->finish(w->dissector);
+            goto err_workers;
+        }
+    }
+
+    assert((StreamProcessor *)self == &self->base);
+    return &self->base;
+
+err_workers:
+    stop_workers(self, i);
+err:
+    free(workers);
+    free(buf);
+    free(self);
+    return NULL;
+}
@@ -1,6 +1,7 @@
 #include <hammer/hammer.h>
 #include <hammer/glue.h>
 #include <assert.h>
+#include <string.h>
 #include "hammer.h"
 #include "sloballoc.h"
 
@@ -32,6 +33,12 @@ HParser *h_error(int code)
     // could implement in terms of h_unit, but would need an alloc
     return h_action(h_epsilon_p(), act_error, (void *)(intptr_t)code);
 }
+HParser *h_error__m(HAllocator *mm__, int code)
+{
+    assert(H_ISERR(code));
+    return h_action__m(mm__, h_epsilon_p__m(mm__), act_error,
+                       (void *)(intptr_t)code);
+}
 
 // helper not officially exported by hammer, but I know it is ;)
 HParsedToken *h_make_(HArena *arena, HTokenType type);
@@ -76,11 +83,19 @@ HParser *h_float32(void)
 {
     return h_action(h_uint32(), act_float, NULL);
 }
+HParser *h_float32__m(HAllocator *mm__)
+{
+    return h_action__m(mm__, h_uint32__m(mm__), act_float, NULL);
+}
 
 HParser *h_float64(void)
 {
     return h_action(h_uint64(), act_double, NULL);
 }
+HParser *h_float64__m(HAllocator *mm__)
+{
+    return h_action__m(mm__, h_uint64__m(mm__), act_double, NULL);
+}
 
 static void *h_slob_alloc(HAllocator *mm, size_t size)
 {
@@ -120,5 +135,172 @@ HAllocator *h_sloballoc(void *mem, size_t size)
     return mm;
 }
 
+// region allocator: bump allocation from a chain of chunks, O(1) reset
+
+#define REGION_ALIGN (2 * sizeof(void *))
+#define REGION_ROUND(n) (((n) + REGION_ALIGN-1) & ~(REGION_ALIGN-1))
+
+struct chunk {
+    struct chunk *next;
+    HAllocator *mm;     // taken from this (mm or spare)
+    size_t size;        // usable bytes after the header
+};
+#define CHUNK_HDR REGION_ROUND(sizeof(struct chunk))
+#define CHUNK_MEM(c) ((uint8_t *)(c) + CHUNK_HDR)
+
+typedef struct {
+    HAllocator base;
+    HAllocator *mm;     // source of chunks
+    HAllocator *spare;  // source of chunks that mm refuses, or NULL
+    size_t chunksize;
+    struct chunk *head; // all chunks
+    struct chunk *cur;  // currently allocating from this chunk
+    size_t used;        // bytes used in cur
+    void *last;         // most recent allocation
+} Region;
+
+// every allocation is preceded by its size
+#define BLOCK_HDR REGION_ROUND(sizeof(size_t))
+#define BLOCK_SIZE(p) (*(size_t *)((uint8_t *)(p) - BLOCK_HDR))
+
+static void *h_region_alloc(HAllocator *mm, size_t size)
+{
+    Region *r = (Region *)mm;
+    size_t n = BLOCK_HDR + REGION_ROUND(size);
+
+    // advance to the next chunk that fits, allocate a new one if necessary
+    while(r->cur == NULL || r->used + n > r->cur->size) {
+        struct chunk *c = r->cur ? r->cur->next : r->head;
+
+        if(c == NULL || n > c->size) {
+            size_t csize = n > r->chunksize ? n : r->chunksize;
+            HAllocator *src = r->mm;
+            struct chunk *new = src->alloc(src, CHUNK_HDR + csize);
+            if(!new && r->spare) {
+                src = r->spare;
+                new = src->alloc(src, CHUNK_HDR + csize);
+            }
+            if(!new)
+                return NULL;
+            new->mm = src;
+            new->size = csize;
+            new->next = c;
+            if(r->cur)
+                r->cur->next = new;
+            else
+                r->head = new;
+            c = new;
+        }
+
+        r->cur = c;
+        r->used = 0;
+    }
+
+    uint8_t *p = CHUNK_MEM(r->cur) + r->used + BLOCK_HDR;
+    r->used += n;
+    BLOCK_SIZE(p) = REGION_ROUND(size);
+    r->last = p;
+
+    return p;
+}
+
+static void h_region_free_(HAllocator *mm, void *p)
+{
+    Region *r = (Region *)mm;
+
+    // only the most recent allocation is actually returned
+    if(p && p == r->last) {
+        r->used -= BLOCK_HDR + BLOCK_SIZE(p);
+        r->last = NULL;
+    }
+}
+
+static void *h_region_realloc(HAllocator *mm, void *p, size_t size)
+{
+    Region *r = (Region *)mm;
+
+    if(!p)
+        return h_region_alloc(mm, size);
+
+    size_t old = BLOCK_SIZE(p);
+    size_t new = REGION_ROUND(size);
+    if(new <= old)
+        return p;
+
+    // grow the most recent allocation in place
+    if(p == r->last && r->used - old + new <= r->cur->size) {
+        r->used += new - old;
+        BLOCK_SIZE(p) = new;
+        return p;
+    }
+
+    void *q = h_region_alloc(mm, size);
+    if(q)
+        memcpy(q, p, old);
+    return q;
+}
+
+HAllocator *h_region(HAllocator *mm, size_t chunksize)
+{
+    if(!mm)
+        mm = h_system_allocator;
+
+    Region *r = mm->alloc(mm, sizeof(Region));
+    if(!r)
+        return NULL;
+
+    r->base.alloc = h_region_alloc;
+    r->base.realloc = h_region_realloc;
+    r->base.free = h_region_free_;
+    r->mm = mm;
+    r->spare = NULL;
+    r->chunksize = chunksize ? chunksize : 65536;
+    r->head = NULL;
+    r->cur = NULL;
+    r->used = 0;
+    r->last = NULL;
+
+    return &r->base;
+}
+
+void h_region_spare(HAllocator *mm, HAllocator *spare)
+{
+    Region *r = (Region *)mm;
+
+    r->spare = spare;
+}
+
+void h_region_reset(HAllocator *mm)
+{
+    Region *r = (Region *)mm;
+
+    // give back the chunks borrowed from spare, keep the others
+    for(struct chunk **pc = &r->head; *pc; ) {
+        struct chunk *c = *pc;
+        if(c->mm == r->mm) {
+            pc = &c->next;
+            continue;
+        }
+        *pc = c->next;
+        c->mm->free(c->mm, c);
+    }
+
+    r->cur = r->head;
+    r->used = 0;
+    r->last = NULL;
+}
+
+void h_region_free(HAllocator *mm)
+{
+    Region *r = (Region *)mm;
+    struct chunk *c;
+
+    while((c = r->head)) {
+        r->head = c->next;
+        c->mm->free(c->mm, c);
+    }
+    r->mm->free(r->mm, r);
+}
+
 extern HAllocator system_allocator;
 HAllocator *h_system_allocator = &system_allocator;
@@ -1,5 +1,8 @@
 // XXX placeholder header for possible extensions to hammer
 
+#ifndef DNP3_HAMMER_H_SEEN
+#define DNP3_HAMMER_H_SEEN
+
 
 // parser that always succeeds with the given result token.
 HParser *h_unit(const HParsedToken *tok);
@@ -7,6 +10,7 @@ HParser *h_unit__m(HAllocator *mm__, const HParsedToken *tok);
 
 // parser that always "succeeds" with the given error code (token type).
 HParser *h_error(int code);     // TT_ERR <= code < TT_USER
+HParser *h_error__m(HAllocator *mm__, int code);
 
 // helpers to construct custom error tokens
 // we use (abuse?) the 'user' and other fields to report user-supplied data.
@@ -19,6 +23,8 @@ HParsedToken *h_make_err_uint(HArena *arena, HTokenType type, uint64_t value);
 // parsing IEEE single and double precision floating point numbers
 HParser *h_float32(void);
 HParser *h_float64(void);
+HParser *h_float32__m(HAllocator *mm__);
+HParser *h_float64__m(HAllocator *mm__);
 
 #define TT_FLOAT 9
 
@@ -29,3 +35,5 @@ HParser *h_float64(void);
 
 // the system default allocator (-> malloc)
 extern HAllocator *h_system_allocator;
+
+#endif // DNP3_HAMMER_H_SEEN
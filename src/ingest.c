@@ -0,0 +1,618 @@
+// live ingest: DNP3 over TCP and UDP straight from the network
+//
+// one epoll set watches all sockets. a ready UDP socket is drained with
+// recvmmsg, up to 'batch' datagrams per call; consecutive datagrams from the
+// same peer go to its dissector in one feedv. a TCP connection is read into
+// a single buffer and passed on with feed_external. so neither is copied
+// (except for incomplete trailing frames, by the dissector).
+//
+// to stay fair, every socket gets at most ROUNDS receive calls per
+// dnp3_ingest_run; epoll is level-triggered, so the rest waits for the
+// next round.
+//
+// XXX io_uring would save the epoll_wait as well, at the price of a
+//     dependency (liburing); recvmmsg already takes a batch per call.
+
+#ifdef __linux__
+#define _GNU_SOURCE     // recvmmsg, accept4
+#endif
+
+#include <dnp3hammer.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+
+#define NEVENTS 64          // events per epoll_wait
+#define ROUNDS 8            // receive calls per socket and run
+#define DGRAMMAX 8192       // receive buffer per datagram
+#define READMAX 65536       // receive buffer for TCP
+#define NBUCKETS 1024       // flow table
+
+enum {S_UDP, S_LISTEN, S_TCP};
+
+// anything registered with epoll starts with a Source
+typedef struct {
+    int kind;               // S_*
+    int fd;
+} Source;
+
+// a bound UDP or listening TCP socket
+typedef struct Sock_ {
+    Source src;
+    uint32_t drops;         // last SO_RXQ_OVFL count (UDP)
+    struct Sock_ *next;
+} Sock;
+
+// a TCP connection (kind S_TCP) or UDP peer (kind S_UDP, fd of its socket)
+typedef struct Flow_ {
+    Source src;
+    struct sockaddr_storage peer;
+    socklen_t peerlen;
+    StreamProcessor *p;
+    time_t last;            // last input (UDP), monotonic seconds
+    struct Flow_ *next;     // hash chain
+} Flow;
+
+struct DNP3_Ingest_ {
+    DNP3_IngestConfig cfg;
+    void *env;
+    int epfd;
+
+    Sock *socks;
+    Flow *tab[NBUCKETS];
+    size_t nflows;
+    time_t t;               // time of the current run, monotonic seconds
+    time_t swept;           // last check for idle UDP peers
+
+    DNP3_IngestStats stats;
+
+    // recvmmsg buffers, cfg.batch of each
+    struct mmsghdr *msgs;
+    struct iovec *iov;      // one per datagram, into dgrams
+    struct iovec *feed;     // for feedv
+    struct sockaddr_storage *names;
+    uint8_t *dgrams;
+    uint8_t *ctrl;          // control messages, CTRLLEN per datagram
+    uint8_t *rbuf;          // READMAX
+};
+
+#define CTRLLEN CMSG_SPACE(sizeof(uint32_t))
+
+#define AGAIN(e) ((e) == EAGAIN || (e) == EWOULDBLOCK || (e) == EINTR)
+
+
+static time_t now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static size_t hash(int fd, const struct sockaddr_storage *a, socklen_t len)
+{
+    const uint8_t *p = (const uint8_t *)a;
+    uint32_t h = 2166136261u ^ (uint32_t)fd;    // FNV-1a
+
+    for(socklen_t i=0; i<len; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h % NBUCKETS;
+}
+
+static Flow **flow_find(DNP3_Ingest *ing, int fd,
+                        const struct sockaddr_storage *a, socklen_t len)
+{
+    Flow **pf = &ing->tab[hash(fd, a, len)];
+
+    for(; *pf; pf = &(*pf)->next) {
+        const Flow *f = *pf;
+        if(f->src.fd == fd && f->peerlen == len
+           && memcmp(&f->peer, a, len) == 0)
+            break;
+    }
+    return pf;
+}
+
+static void flow_info(const Flow *f, DNP3_IngestFlow *info)
+{
+    info->fd = f->src.fd;
+    info->udp = (f->src.kind == S_UDP);
+    info->peer = (const struct sockaddr *)&f->peer;
+    info->peerlen = f->peerlen;
+}
+
+// a new flow, or NULL if refused. TCP connections are added to epoll.
+static Flow *flow_open(DNP3_Ingest *ing, int kind, int fd,
+                       const struct sockaddr_storage *a, socklen_t len)
+{
+    if(len > sizeof(struct sockaddr_storage))
+        len = sizeof(struct sockaddr_storage);
+    if(ing->nflows >= ing->cfg.max_flows)
+        goto refuse;
+
+    Flow *f = calloc(1, sizeof(Flow));
+    if(!f)
+        goto refuse;
+    f->src.kind = kind;
+    f->src.fd = fd;
+    memcpy(&f->peer, a, len);
+    f->peerlen = len;
+    f->last = ing->t;
+
+    DNP3_IngestFlow info;
+    flow_info(f, &info);
+    f->p = ing->cfg.open(ing->env, &info);
+    if(!f->p) {
+        free(f);
+        goto refuse;
+    }
+
+    if(kind == S_TCP) {
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = f};
+        if(epoll_ctl(ing->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            f->p->finish(f->p);
+            free(f);
+            goto refuse;
+        }
+    }
+
+    Flow **pf = flow_find(ing, fd, a, len);
+    f->next = *pf;
+    *pf = f;
+    ing->nflows++;
+    ing->stats.flows++;
+    return f;
+
+refuse:
+    ing->stats.flows_refused++;
+    return NULL;
+}
+
+static void flow_close(DNP3_Ingest *ing, Flow *f)
+{
+    Flow **pf = flow_find(ing, f->src.fd, &f->peer, f->peerlen);
+    DNP3_IngestFlow info;
+
+    *pf = f->next;
+    ing->nflows--;
+
+    f->p->finish(f->p);
+    flow_info(f, &info);
+    if(ing->cfg.close)
+        ing->cfg.close(ing->env, &info);
+    if(f->src.kind == S_TCP)
+        close(f->src.fd);       // NB: also removes it from epoll
+    free(f);
+}
+
+static void sweep_idle(DNP3_Ingest *ing)
+{
+    time_t t = ing->t;
+
+    if(t == ing->swept)
+        return;
+    ing->swept = t;
+
+    for(size_t i=0; i<NBUCKETS; i++) {
+        Flow *f, *next;
+        for(f=ing->tab[i]; f; f=next) {
+            next = f->next;
+            if(f->src.kind == S_UDP && t - f->last >= ing->cfg.idle_timeout)
+                flow_close(ing, f);
+        }
+    }
+}
+
+
+/// RECEIVING ///
+
+static void feed(DNP3_Ingest *ing, Flow *f, const struct iovec *iov, int n)
+{
+    int r = (n == 1) ? f->p->feed_external(f->p, iov[0].iov_base,
+                                           iov[0].iov_len)
+                     : f->p->feedv(f->p, iov, n);
+    if(r == DNP3_BACKPRESSURE) {
+        ing->stats.backpressure++;      // XXX nothing to hold back on UDP
+    } else if(r < 0) {
+        ing->stats.feed_errors++;
+        flow_close(ing, f);
+    }
+}
+
+static void count_drops(DNP3_Ingest *ing, Sock *s, struct msghdr *h)
+{
+    for(struct cmsghdr *c = CMSG_FIRSTHDR(h); c; c = CMSG_NXTHDR(h, c)) {
+        if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t n;
+            memcpy(&n, CMSG_DATA(c), sizeof n);
+            ing->stats.kernel_drops += n - s->drops;    // NB: wraps
+            s->drops = n;
+        }
+    }
+}
+
+// returns the number of bytes received
+static size_t recv_udp(DNP3_Ingest *ing, Sock *s)
+{
+    size_t total = 0;
+
+    for(int round=0; round<ROUNDS; round++) {
+        size_t batch = ing->cfg.batch;
+        for(size_t i=0; i<batch; i++) {
+            struct msghdr *h = &ing->msgs[i].msg_hdr;
+            h->msg_name = &ing->names[i];
+            h->msg_namelen = sizeof(struct sockaddr_storage);
+            h->msg_iov = &ing->iov[i];
+            h->msg_iovlen = 1;
+            h->msg_control = ing->ctrl + i * CTRLLEN;
+            h->msg_controllen = CTRLLEN;
+            h->msg_flags = 0;
+        }
+
+        ing->stats.syscalls++;
+        int n = recvmmsg(s->src.fd, ing->msgs, batch, MSG_DONTWAIT, NULL);
+        if(n < 0 && !AGAIN(errno))
+            ing->stats.recv_errors++;   // e.g. ICMP errors, ENOMEM
+        if(n <= 0)
+            break;
+        ing->stats.datagrams += n;
+        count_drops(ing, s, &ing->msgs[n-1].msg_hdr);
+
+        // feed runs of datagrams from the same peer together
+        Flow *f = NULL;
+        int nfeed = 0;
+        for(int i=0; i<n; i++) {
+            struct msghdr *h = &ing->msgs[i].msg_hdr;
+            size_t len = ing->msgs[i].msg_len;
+            total += len;
+
+            Flow *g = *flow_find(ing, s->src.fd, &ing->names[i],
+                                 h->msg_namelen);
+            if(g != f && f && nfeed > 0) {
+                feed(ing, f, ing->feed, nfeed);
+                nfeed = 0;
+            }
+            if(!g)
+                g = flow_open(ing, S_UDP, s->src.fd, &ing->names[i],
+                              h->msg_namelen);
+            f = g;
+            if(!f || len == 0)
+                continue;
+            f->last = ing->t;
+            ing->feed[nfeed].iov_base = ing->iov[i].iov_base;
+            ing->feed[nfeed].iov_len = len;
+            nfeed++;
+        }
+        if(f && nfeed > 0)
+            feed(ing, f, ing->feed, nfeed);
+
+        if((size_t)n < batch)
+            break;
+    }
+
+    ing->stats.bytes += total;
+    return total;
+}
+
+static size_t recv_tcp(DNP3_Ingest *ing, Flow *f)
+{
+    size_t total = 0;
+
+    for(int round=0; round<ROUNDS; round++) {
+        ing->stats.syscalls++;
+        ssize_t n = read(f->src.fd, ing->rbuf, READMAX);
+        if(n < 0 && AGAIN(errno))
+            break;
+        if(n < 0)
+            ing->stats.recv_errors++;
+        if(n <= 0) {
+            flow_close(ing, f);         // end of stream or error
+            break;
+        }
+        total += n;
+
+        struct iovec iov = {ing->rbuf, n};
+        int r = f->p->feed_external(f->p, iov.iov_base, iov.iov_len);
+        if(r == DNP3_BACKPRESSURE) {
+            // leave the rest in the socket for the next round, so TCP flow
+            // control pushes back on the sender
+            ing->stats.backpressure++;
+            break;
+        }
+        if(r < 0) {
+            ing->stats.feed_errors++;
+            flow_close(ing, f);
+            break;
+        }
+        if(n < READMAX)
+            break;
+    }
+
+    ing->stats.bytes += total;
+    return total;
+}
+
+static void accept_tcp(DNP3_Ingest *ing, Sock *s)
+{
+    for(int round=0; round<ROUNDS; round++) {
+        struct sockaddr_storage a;
+        socklen_t len = sizeof a;
+
+        ing->stats.syscalls++;
+        int fd = accept4(s->src.fd, (struct sockaddr *)&a, &len,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(!AGAIN(errno))
+                ing->stats.recv_errors++;   // e.g. EMFILE
+            break;
+        }
+        if(!flow_open(ing, S_TCP, fd, &a, len))
+            close(fd);
+    }
+}
+
+int dnp3_ingest_run(DNP3_Ingest *ing, int timeout_ms)
+{
+    struct epoll_event ev[NEVENTS];
+    size_t total = 0;
+
+    // NB: a short wait when UDP peers may have to be closed
+    if(ing->nflows > 0 && (timeout_ms < 0 || timeout_ms > 1000))
+        timeout_ms = 1000;
+
+    ing->stats.syscalls++;
+    int n = epoll_wait(ing->epfd, ev, NEVENTS, timeout_ms);
+    if(n < 0)
+        return (errno == EINTR) ? 0 : -1;
+
+    ing->t = now();
+    for(int i=0; i<n; i++) {
+        Source *src = ev[i].data.ptr;
+        switch(src->kind) {
+        case S_UDP:     total += recv_udp(ing, (Sock *)src); break;
+        case S_LISTEN:  accept_tcp(ing, (Sock *)src); break;
+        case S_TCP:     total += recv_tcp(ing, (Flow *)src); break;
+        }
+        // NB: a TCP flow is only closed while handling its own event
+        //     (and UDP flows have none), so no later ev[i] is stale.
+    }
+    sweep_idle(ing);
+
+    return total > INT_MAX ? INT_MAX : (int)total;
+}
+
+
+/// SETUP ///
+
+DNP3_Ingest *dnp3_ingest_new(const DNP3_IngestConfig *config, void *env)
+{
+    DNP3_IngestConfig cfg = {0};
+    if(config)
+        cfg = *config;
+    if(!cfg.open) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if(cfg.batch == 0)
+        cfg.batch = 64;
+    if(cfg.max_flows == 0)
+        cfg.max_flows = 4096;
+    if(cfg.idle_timeout == 0)
+        cfg.idle_timeout = 60;
+
+    DNP3_Ingest *ing = calloc(1, sizeof(DNP3_Ingest));
+    if(!ing)
+        return NULL;
+    ing->cfg = cfg;
+    ing->env = env;
+    ing->t = ing->swept = now();
+
+    size_t b = cfg.batch;
+    ing->msgs   = calloc(b, sizeof(struct mmsghdr));
+    ing->iov    = calloc(b, sizeof(struct iovec));
+    ing->feed   = calloc(b, sizeof(struct iovec));
+    ing->names  = calloc(b, sizeof(struct sockaddr_storage));
+    ing->dgrams = malloc(b * DGRAMMAX);
+    ing->ctrl   = calloc(b, CTRLLEN);
+    ing->rbuf   = malloc(READMAX);
+    ing->epfd   = epoll_create1(EPOLL_CLOEXEC);
+    if(!ing->msgs || !ing->iov || !ing->feed || !ing->names || !ing->dgrams
+       || !ing->ctrl || !ing->rbuf || ing->epfd < 0) {
+        dnp3_ingest_free(ing);
+        return NULL;
+    }
+    for(size_t i=0; i<b; i++) {
+        ing->iov[i].iov_base = ing->dgrams + i * DGRAMMAX;
+        ing->iov[i].iov_len = DGRAMMAX;
+    }
+
+    return ing;
+}
+
+int dnp3_ingest_add(DNP3_Ingest *ing, int fd)
+{
+    int type, listening = 0, one = 1;
+    socklen_t len = sizeof type;
+
+    if(getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0)
+        goto fail;
+    if(type == SOCK_STREAM) {
+        len = sizeof listening;
+        if(getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0)
+            goto fail;
+    } else if(type != SOCK_DGRAM) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    int fl = fcntl(fd, F_GETFL);
+    if(fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0)
+        goto fail;
+
+    // a connected TCP socket: a flow of its own
+    if(type == SOCK_STREAM && !listening) {
+        struct sockaddr_storage a;
+        len = sizeof a;
+        if(getpeername(fd, (struct sockaddr *)&a, &len) < 0)
+            goto fail;
+        if(!flow_open(ing, S_TCP, fd, &a, len)) {
+            errno = ECONNREFUSED;
+            goto fail;
+        }
+        return 0;
+    }
+
+    Sock *s = calloc(1, sizeof(Sock));
+    if(!s)
+        goto fail;
+    s->src.kind = (type == SOCK_DGRAM) ? S_UDP : S_LISTEN;
+    s->src.fd = fd;
+    if(type == SOCK_DGRAM)      // NB: optional, count drops if supported
+        setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof one);
+
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = s};
+    if(epoll_ctl(ing->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        free(s);
+        goto fail;
+    }
+    s->next = ing->socks;
+    ing->socks = s;
+    return 0;
+
+fail:
+    {
+        int e = errno;
+        close(fd);
+        errno = e;
+    }
+    return -1;
+}
+
+int dnp3_ingest_listen(DNP3_Ingest *ing, const char *host, const char *port)
+{
+    struct addrinfo hints = {0}, *res, *ai;
+    int n = 0, e = 0, one = 1;
+
+    hints.ai_flags = AI_PASSIVE;
+    hints.ai_family = AF_UNSPEC;
+    if(getaddrinfo(host, port, &hints, &res) != 0) {
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+
+    for(ai=res; ai; ai=ai->ai_next) {
+        if(ai->ai_socktype != SOCK_STREAM && ai->ai_socktype != SOCK_DGRAM)
+            continue;
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                        ai->ai_protocol);
+        if(fd < 0) {
+            e = errno;
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+        if(ai->ai_family == AF_INET6)   // NB: the IPv4 entry binds separately
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof one);
+        if(ai->ai_socktype == SOCK_DGRAM && ing->cfg.rcvbuf > 0)
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &ing->cfg.rcvbuf,
+                       sizeof ing->cfg.rcvbuf);
+        if(bind(fd, ai->ai_addr, ai->ai_addrlen) < 0
+           || (ai->ai_socktype == SOCK_STREAM && listen(fd, SOMAXCONN) < 0)) {
+            e = errno;
+            close(fd);
+            continue;
+        }
+        if(dnp3_ingest_add(ing, fd) < 0) {
+            e = errno;
+            continue;
+        }
+        n++;
+    }
+    freeaddrinfo(res);
+
+    if(n == 0) {
+        errno = e;
+        return -1;
+    }
+    return n;
+}
+
+void dnp3_ingest_stats(const DNP3_Ingest *ing, DNP3_IngestStats *out)
+{
+    *out = ing->stats;
+}
+
+void dnp3_ingest_free(DNP3_Ingest *ing)
+{
+    for(size_t i=0; i<NBUCKETS; i++) {
+        while(ing->tab[i])
+            flow_close(ing, ing->tab[i]);
+    }
+
+    Sock *s, *next;
+    for(s=ing->socks; s; s=next) {
+        next = s->next;
+        close(s->src.fd);
+        free(s);
+    }
+
+    if(ing->epfd >= 0)
+        close(ing->epfd);
+    free(ing->msgs);
+    free(ing->iov);
+    free(ing->feed);
+    free(ing->names);
+    free(ing->dgrams);
+    free(ing->ctrl);
+    free(ing->rbuf);
+    free(ing);
+}
+
+#else // !__linux__
+
+DNP3_Ingest *dnp3_ingest_new(const DNP3_IngestConfig *config, void *env)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+int dnp3_ingest_add(DNP3_Ingest *ing, int fd)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int dnp3_ingest_listen(DNP3_Ingest *ing, const char *host, const char *port)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int dnp3_ingest_run(DNP3_Ingest *ing, int timeout_ms)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+void dnp3_ingest_stats(const DNP3_Ingest *ing, DNP3_IngestStats *out)
+{
+    memset(out, 0, sizeof *out);
+}
+
+void dnp3_ingest_free(DNP3_Ingest *ing)
+{
+}
+
+#endif // __linux__
@@ -5,56 +5,113 @@
 #include "hammer.h"
 #include <string.h>
 #include "util.h"
+#include "crc.h"
+#include "link.h"
+#include "tables.h"
 
 
 HParser *dnp3_p_link_frame;
 
 
-// from IEEE Std 1815-2012 Annex E
-static const uint16_t crctable[256] = {
-    0x0000, 0x365E, 0x6CBC, 0x5AE2, 0xD978, 0xEF26, 0xB5C4, 0x839A,
-    0xFF89, 0xC9D7, 0x9335, 0xA56B, 0x26F1, 0x10AF, 0x4A4D, 0x7C13,
-    0xB26B, 0x8435, 0xDED7, 0xE889, 0x6B13, 0x5D4D, 0x07AF, 0x31F1,
-    0x4DE2, 0x7BBC, 0x215E, 0x1700, 0x949A, 0xA2C4, 0xF826, 0xCE78,
-    0x29AF, 0x1FF1, 0x4513, 0x734D, 0xF0D7, 0xC689, 0x9C6B, 0xAA35,
-    0xD626, 0xE078, 0xBA9A, 0x8CC4, 0x0F5E, 0x3900, 0x63E2, 0x55BC,
-    0x9BC4, 0xAD9A, 0xF778, 0xC126, 0x42BC, 0x74E2, 0x2E00, 0x185E,
-    0x644D, 0x5213, 0x08F1, 0x3EAF, 0xBD35, 0x8B6B, 0xD189, 0xE7D7,
-    0x535E, 0x6500, 0x3FE2, 0x09BC, 0x8A26, 0xBC78, 0xE69A, 0xD0C4,
-    0xACD7, 0x9A89, 0xC06B, 0xF635, 0x75AF, 0x43F1, 0x1913, 0x2F4D,
-    0xE135, 0xD76B, 0x8D89, 0xBBD7, 0x384D, 0x0E13, 0x54F1, 0x62AF,
-    0x1EBC, 0x28E2, 0x7200, 0x445E, 0xC7C4, 0xF19A, 0xAB78, 0x9D26,
-    0x7AF1, 0x4CAF, 0x164D, 0x2013, 0xA389, 0x95D7, 0xCF35, 0xF96B,
-    0x8578, 0xB326, 0xE9C4, 0xDF9A, 0x5C00, 0x6A5E, 0x30BC, 0x06E2,
-    0xC89A, 0xFEC4, 0xA426, 0x9278, 0x11E2, 0x27BC, 0x7D5E, 0x4B00,
-    0x3713, 0x014D, 0x5BAF, 0x6DF1, 0xEE6B, 0xD835, 0x82D7, 0xB489,
-    0xA6BC, 0x90E2, 0xCA00, 0xFC5E, 0x7FC4, 0x499A, 0x1378, 0x2526,
-    0x5935, 0x6F6B, 0x3589, 0x03D7, 0x804D, 0xB613, 0xECF1, 0xDAAF,
-    0x14D7, 0x2289, 0x786B, 0x4E35, 0xCDAF, 0xFBF1, 0xA113, 0x974D,
-    0xEB5E, 0xDD00, 0x87E2, 0xB1BC, 0x3226, 0x0478, 0x5E9A, 0x68C4,
-    0x8F13, 0xB94D, 0xE3AF, 0xD5F1, 0x566B, 0x6035, 0x3AD7, 0x0C89,
-    0x709A, 0x46C4, 0x1C26, 0x2A78, 0xA9E2, 0x9FBC, 0xC55E, 0xF300,
-    0x3D78, 0x0B26, 0x51C4, 0x679A, 0xE400, 0xD25E, 0x88BC, 0xBEE2,
-    0xC2F1, 0xF4AF, 0xAE4D, 0x9813, 0x1B89, 0x2DD7, 0x7735, 0x416B,
-    0xF5E2, 0xC3BC, 0x995E, 0xAF00, 0x2C9A, 0x1AC4, 0x4026, 0x7678,
-    0x0A6B, 0x3C35, 0x66D7, 0x5089, 0xD313, 0xE54D, 0xBFAF, 0x89F1,
-    0x4789, 0x71D7, 0x2B35, 0x1D6B, 0x9EF1, 0xA8AF, 0xF24D, 0xC413,
-    0xB800, 0x8E5E, 0xD4BC, 0xE2E2, 0x6178, 0x5726, 0x0DC4, 0x3B9A,
-    0xDC4D, 0xEA13, 0xB0F1, 0x86AF, 0x0535, 0x336B, 0x6989, 0x5FD7,
-    0x23C4, 0x159A, 0x4F78, 0x7926, 0xFABC, 0xCCE2, 0x9600, 0xA05E,
-    0x6E26, 0x5878, 0x029A, 0x34C4, 0xB75E, 0x8100, 0xDBE2, 0xEDBC,
-    0x91AF, 0xA7F1, 0xFD13, 0xCB4D, 0x48D7, 0x7E89, 0x246B, 0x1235
-};
-
-uint16_t dnp3_crc(uint8_t *bytes, size_t len)
+static inline uint16_t le16(const uint8_t *p)
 {
-    uint16_t crc = 0;
-    for(size_t i=0; i<len; i++) {
-        crc = (crc>>8) ^ crctable[((uint8_t)crc ^ bytes[i]) & 0xFF];
+    return p[0] | (p[1] << 8);
+}
+
+int dnp3_link_frame_size(const uint8_t *buf, size_t len)
+{
+    // start bytes 0x05 0x64, decide as early as possible
+    if(len < 1)
+        return 0;
+    if(buf[0] != 0x05)
+        return -1;
+    if(len < 2)
+        return 0;
+    if(buf[1] != 0x64)
+        return -1;
+    if(len < 10)
+        return 0;
+
+    // header: start, len, ctrl, dest, source, crc
+    if(le16(buf+8) != dnp3_crc(buf, 8))
+        return -1;
+
+    int n = buf[2] - 5;
+    if(n <= 0)
+        return 10;
+
+    // user data in blocks of 16 bytes, each followed by its CRC
+    return 10 + n + 2*((n+15)/16);
+}
+
+// NB: memchr is vectorized by any libc worth its salt, so candidates are
+//     found much faster than by trying a frame parse at every offset.
+size_t dnp3_link_resync(const uint8_t *buf, size_t len)
+{
+    const uint8_t *p = buf, *end = buf + len;
+
+    while((p = memchr(p, 0x05, end - p))) {
+        size_t n = end - p;
+        if(n < 2 || (p[1] == 0x64 && (n < 10 || le16(p+8) == dnp3_crc(p, 8))))
+            return p - buf;     // a valid header or too little input to tell
+        p++;
+    }
+    return len;
+}
+
+// hand-written equivalent of dnp3_p_link_frame, see dnp3hammer.h
+int dnp3_link_decode_frame(const uint8_t *buf, size_t len,
+                           DNP3_Frame *frame, uint8_t *payload)
+{
+    int size = dnp3_link_frame_size(buf, len);
+    if(size <= 0)
+        return size;
+    if(len < (size_t)size)
+        return 0;
+
+    return dnp3_link_decode_checked(buf, frame, payload);
+}
+
+int dnp3_link_decode_checked(const uint8_t *buf,
+                             DNP3_Frame *frame, uint8_t *payload)
+{
+    int size = 10;
+    uint8_t ctrl = buf[3];
+    bool prm = (ctrl >> 6) & 1;
+
+    frame->len = buf[2] - 5;    // payload length, excl. header bytes
+    frame->dir = ctrl >> 7;
+    frame->fcb = (ctrl >> 5) & 1;
+    if(prm)
+        frame->fcv = (ctrl >> 4) & 1;
+    else
+        frame->dfc = (ctrl >> 4) & 1;
+    frame->func = (prm << 4) | (ctrl & 0x0F);
+    frame->destination = le16(buf+4);
+    frame->source = le16(buf+6);
+    frame->payload = NULL;
+
+    if(frame->len <= 0)
+        return size;
+
+    size_t n = frame->len;
+    size += n + 2*((n+15)/16);
+
+    const uint8_t *p = buf + 10;
+    if(!dnp3_crc_blocks_valid(p, n))
+        return size;    // skip the frame, payload remains NULL
+
+    uint8_t *out = payload;
+    while(n > 0) {
+        size_t k = n<16 ? n : 16;
+        memcpy(out, p, k);
+        out += k;
+        p += k+2;
+        n -= k;
     }
-    crc = ~crc; // invert
+    frame->payload = payload;
 
-    return crc;
+    return size;
 }
 
 static bool validate_crc(HParseResult *p, void *user)
@@ -138,24 +195,6 @@ static HParsedToken *attach_payload(const HParseResult *p, void *user)
     return H_MAKE(DNP3_Frame, frame);
 }
 
-// prebaked parsers for every size of payload
-static HParser *payload[256] = {NULL};
-
-static HParser *k_frame(HAllocator *mm__, const HParsedToken *p, void *user)
-{
-    DNP3_Frame *hdr = H_CAST(DNP3_Frame, p);
-    size_t n;
-
-    if(hdr->len > 0) {
-        assert(hdr->len <= 255);
-        n = hdr->len;
-    } else {
-        n = 0;
-    }
-
-    return h_action__m(mm__, payload[n], attach_payload, hdr);
-}
-
 static bool validate_blocks(HParseResult *p, void *user)
 {
     HCountedArray *blocks = H_FIELD_SEQ(0);
@@ -197,10 +236,48 @@ static bool not_null(HParseResult *p, void *user)
     return (p->ast != NULL);
 }
 
+// parsers for every size of payload, built on first use (build_payload)
+static HParser *payload[256] = {NULL};
+static HParser *bytes_crc[17];      // yield bytes if CRC valid, else NULL
+static HParser *fullblocks[16];     // q full blocks
+
+static HParser *build_payload(void *env, size_t n)
+{
+    HAllocator *mm__ = dnp3_p_mm;
+    size_t q = n / 16, r = n % 16;
+    intptr_t qp = q;
+
+    H_RULE (blocks,    h_sequence__m(mm__, fullblocks[q], bytes_crc[r], NULL));
+    H_RULE (valid,     h_attr_bool__m(mm__, blocks, validate_blocks, (void*)qp));
+    H_RULE (assemble,  h_action__m(mm__, valid, act_assemble, NULL));
+    H_RULE (skip,      h_ignore__m(mm__, blocks));
+
+    return h_choice__m(mm__, assemble, skip, NULL);
+}
+
+static HParser *k_frame(HAllocator *mm__, const HParsedToken *p, void *user)
+{
+    DNP3_Frame *hdr = H_CAST(DNP3_Frame, p);
+    size_t n;
+
+    if(hdr->len > 0) {
+        assert(hdr->len <= 255);
+        n = hdr->len;
+    } else {
+        n = 0;
+    }
+
+    // NB: payload[n] is built once; the action is what remains per frame
+    //     because it carries the header (cf. k_fragment in app.c).
+    HParser *pl = dnp3_p_lazy(&payload[n], build_payload, NULL, n);
+    return h_action__m(mm__, pl, attach_payload, hdr);
+}
+
 void dnp3_p_init_link(void)
 {
+    dnp3_crc_init();
+
     // bake basic parsers for CRC-ed data blocks
-    HParser *bytes_crc[17];          // yield bytes if CRC valid, NULL otherwise
     bytes_crc[0] = h_sequence(NULL); // empty sequence - no crc
     for(int i=1; i<=16; i++)
         bytes_crc[i] = bytes_crc_(i);
@@ -226,23 +303,11 @@ void dnp3_p_init_link(void)
 
     dnp3_p_link_frame = little_endian(frame);
 
-    // bake parsers for data payloads so they don't have to be created on every
-    // call to k_frame...
-    for(int q=0; q<16; q++) {
-        H_RULE(fullblocks, h_repeat_n(bytes_crc[16], q));
-
-        for(int r=0; r<16; r++) {
-            int n = q*16 + r;
-            intptr_t qp = q;
-
-            H_RULE (lastblock, bytes_crc[r]);
-            H_RULE (blocks,    h_sequence(fullblocks, lastblock, NULL));
-            H_ARULE(assemble,  h_attr_bool(blocks, validate_blocks, (void*)qp));
-            H_RULE (skip,      h_ignore(blocks));
-
-            payload[n] = h_choice(assemble, skip, NULL);
-        }
-    }
+    // the payload parsers are built per size on first use (build_payload),
+    // from these
+    for(int q=0; q<16; q++)
+        fullblocks[q] = h_repeat_n(bytes_crc[16], q);
+    memset(payload, 0, sizeof payload);     // from an earlier dnp3_init
 }
 
 bool dnp3_link_validate_frame(const DNP3_Frame *frame)
@@ -1,6 +1,24 @@
 #ifndef DNP3_LINK_H_SEEN
 #define DNP3_LINK_H_SEEN
 
+#include <stdint.h>
+#include <stddef.h>
+#include <dnp3hammer.h> // DNP3_Frame
+
 void dnp3_p_init_link(void);
 
+// check only the header of a link frame and return the size of the frame;
+// 0 if more input is needed for the header, -1 if there is no valid header.
+// NB: the returned size may exceed len.
+int dnp3_link_frame_size(const uint8_t *buf, size_t len);
+
+// decode a frame whose header has already passed dnp3_link_frame_size and
+// that is complete in buf (see dnp3_link_decode_frame)
+int dnp3_link_decode_checked(const uint8_t *buf,
+                             DNP3_Frame *frame, uint8_t *payload);
+
+// find the first offset in buf where a link frame may start, i.e. where
+// dnp3_link_frame_size would not return -1. returns len if there is none.
+size_t dnp3_link_resync(const uint8_t *buf, size_t len);
+
 #endif // DNP3_LINK_H_SEEN
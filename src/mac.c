@@ -0,0 +1,624 @@
+// message authentication codes for secure authentication (g120)
+//
+// HMAC-SHA-256 (RFC 2104, FIPS 180-4) and AES-GMAC (NIST SP 800-38D), the
+// MAC algorithms of DNP3-SAv5 that are not deprecated.
+//
+// both have a portable implementation and one using the x86 SHA extensions
+// (SHA-256) or AES-NI and PCLMULQDQ (GMAC), picked at runtime like
+// dnp3_crc(). keys are prepared once (dnp3_mac_key): for HMAC that is the
+// hash state after the inner and outer padded key block, which leaves two
+// compressions plus one per 64 bytes of message; for GMAC the AES round keys
+// and the hash key H, which leaves one block encryption plus one GF(2^128)
+// multiplication per 16 bytes.
+//
+// NB: the message is passed as two pieces (a, b) so that the caller can
+//     cover stored data (a challenge) and the fragment as received without
+//     copying them together. only partial blocks at the seam are buffered.
+
+#include <dnp3hammer.h>
+#include "mac.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MAC_X86
+#include <immintrin.h>
+#define SHA_TARGET  __attribute__((target("sha,sse4.1,ssse3")))
+#define AES_TARGET  __attribute__((target("aes,pclmul,ssse3")))
+#endif
+
+
+static inline uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static inline void put_be32(uint8_t *p, uint32_t x)
+{
+    p[0] = x >> 24; p[1] = x >> 16; p[2] = x >> 8; p[3] = x;
+}
+
+static inline void put_be64(uint8_t *p, uint64_t x)
+{
+    put_be32(p, x >> 32);
+    put_be32(p + 4, x);
+}
+
+
+/// SHA-256 ///
+
+static const uint32_t K[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5,
+    0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+    0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC,
+    0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7,
+    0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+    0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3,
+    0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5,
+    0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+    0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+static const uint32_t IV[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+#define ROR(x, n) ((x) >> (n) | (x) << (32 - (n)))
+
+static void sha256_blocks_c(uint32_t st[8], const uint8_t *p, size_t n)
+{
+    for(; n > 0; n--, p += 64) {
+        uint32_t w[64];
+
+        for(int i=0; i<16; i++)
+            w[i] = be32(p + 4*i);
+        for(int i=16; i<64; i++) {
+            uint32_t s0 = ROR(w[i-15], 7) ^ ROR(w[i-15], 18) ^ (w[i-15] >> 3);
+            uint32_t s1 = ROR(w[i-2], 17) ^ ROR(w[i-2], 19) ^ (w[i-2] >> 10);
+            w[i] = w[i-16] + s0 + w[i-7] + s1;
+        }
+
+        uint32_t a = st[0], b = st[1], c = st[2], d = st[3];
+        uint32_t e = st[4], f = st[5], g = st[6], h = st[7];
+        for(int i=0; i<64; i++) {
+            uint32_t S1 = ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + S1 + ch + K[i] + w[i];
+            uint32_t S0 = ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + S0 + maj;
+        }
+        st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+        st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+    }
+}
+
+#ifdef MAC_X86
+// after the Intel SHA extensions reference code: the state is kept as ABEF
+// and CDGH; every sha256rnds2 does two rounds.
+SHA_TARGET
+static void sha256_blocks_ni(uint32_t st[8], const uint8_t *p, size_t n)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0C0D0E0F08090A0BULL,
+                                         0x0405060700010203ULL);
+    __m128i t = _mm_loadu_si128((const __m128i *)&st[0]);      // ABCD
+    __m128i s1 = _mm_loadu_si128((const __m128i *)&st[4]);     // EFGH
+
+    t = _mm_shuffle_epi32(t, 0xB1);                 // CDAB
+    s1 = _mm_shuffle_epi32(s1, 0x1B);               // EFGH -> HGFE
+    __m128i s0 = _mm_alignr_epi8(t, s1, 8);         // ABEF
+    s1 = _mm_blend_epi16(s1, t, 0xF0);              // CDGH
+
+    for(; n > 0; n--, p += 64) {
+        __m128i abef = s0, cdgh = s1;
+        __m128i w[4];
+
+        for(int i=0; i<16; i++) {
+            if(i < 4) {
+                w[i] = _mm_shuffle_epi8(
+                    _mm_loadu_si128((const __m128i *)(p + 16*i)), bswap);
+            } else {
+                // W[4i..4i+3] from the previous 16
+                __m128i x = _mm_sha256msg1_epu32(w[i&3], w[(i+1)&3]);
+                x = _mm_add_epi32(x, _mm_alignr_epi8(w[(i+3)&3],
+                                                     w[(i+2)&3], 4));
+                w[i&3] = _mm_sha256msg2_epu32(x, w[(i+3)&3]);
+            }
+
+            __m128i m = _mm_add_epi32(w[i&3],
+                            _mm_loadu_si128((const __m128i *)&K[4*i]));
+            s1 = _mm_sha256rnds2_epu32(s1, s0, m);
+            s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(m, 0x0E));
+        }
+
+        s0 = _mm_add_epi32(s0, abef);
+        s1 = _mm_add_epi32(s1, cdgh);
+    }
+
+    t = _mm_shuffle_epi32(s0, 0x1B);                // FEBA
+    s1 = _mm_shuffle_epi32(s1, 0xB1);               // DCHG
+    s0 = _mm_blend_epi16(t, s1, 0xF0);              // DCBA
+    s1 = _mm_alignr_epi8(s1, t, 8);                 // HGFE
+    _mm_storeu_si128((__m128i *)&st[0], s0);
+    _mm_storeu_si128((__m128i *)&st[4], s1);
+}
+#endif
+
+static void (*sha256_blocks)(uint32_t *, const uint8_t *, size_t);
+static const char *shaname = "none";
+
+typedef struct {
+    uint32_t st[8];
+    uint64_t len;               // bytes hashed
+    uint8_t buf[64];
+    size_t n;                   // bytes in buf
+} Sha256;
+
+static void sha256_start(Sha256 *c, const uint32_t st[8], uint64_t len)
+{
+    memcpy(c->st, st, sizeof c->st);
+    c->len = len;
+    c->n = 0;
+}
+
+static void sha256_update(Sha256 *c, const uint8_t *p, size_t len)
+{
+    c->len += len;
+    if(c->n > 0) {
+        size_t k = 64 - c->n;
+        if(k > len)
+            k = len;
+        memcpy(c->buf + c->n, p, k);
+        c->n += k;
+        p += k;
+        len -= k;
+        if(c->n < 64)
+            return;
+        sha256_blocks(c->st, c->buf, 1);
+        c->n = 0;
+    }
+    if(len >= 64) {
+        sha256_blocks(c->st, p, len / 64);      // straight from the input
+        p += len & ~(size_t)63;
+        len &= 63;
+    }
+    memcpy(c->buf, p, len);
+    c->n = len;
+}
+
+static void sha256_final(Sha256 *c, uint8_t out[32])
+{
+    uint64_t bits = c->len * 8;
+
+    c->buf[c->n++] = 0x80;
+    if(c->n > 56) {
+        memset(c->buf + c->n, 0, 64 - c->n);
+        sha256_blocks(c->st, c->buf, 1);
+        c->n = 0;
+    }
+    memset(c->buf + c->n, 0, 56 - c->n);
+    put_be64(c->buf + 56, bits);
+    sha256_blocks(c->st, c->buf, 1);
+
+    for(int i=0; i<8; i++)
+        put_be32(out + 4*i, c->st[i]);
+}
+
+
+/// AES ///
+
+static const uint8_t sbox[256] = {
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5,
+    0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+    0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0,
+    0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+    0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC,
+    0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A,
+    0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+    0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0,
+    0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+    0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B,
+    0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85,
+    0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+    0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5,
+    0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+    0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17,
+    0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88,
+    0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+    0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C,
+    0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+    0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9,
+    0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6,
+    0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+    0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E,
+    0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+    0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94,
+    0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68,
+    0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+};
+
+static inline uint8_t xtime(uint8_t x)
+{
+    return (x << 1) ^ ((x & 0x80) ? 0x1B : 0);
+}
+
+// FIPS 197 key expansion for nk = 4 or 8 (32-bit) words of key
+static void aes_expand(uint8_t rk[15][16], const uint8_t *key, int nk)
+{
+    uint8_t *w = rk[0];
+    int nw = 4 * (nk + 7);      // 4 * (nr + 1)
+    uint8_t rcon = 1;
+
+    memcpy(w, key, 4 * nk);
+    for(int i=nk; i<nw; i++) {
+        uint8_t t[4];
+
+        memcpy(t, w + 4*(i-1), 4);
+        if(i % nk == 0) {
+            uint8_t x = t[0];
+            t[0] = sbox[t[1]] ^ rcon;
+            t[1] = sbox[t[2]];
+            t[2] = sbox[t[3]];
+            t[3] = sbox[x];
+            rcon = xtime(rcon);
+        } else if(nk > 6 && i % nk == 4) {
+            for(int j=0; j<4; j++)
+                t[j] = sbox[t[j]];
+        }
+        for(int j=0; j<4; j++)
+            w[4*i + j] = w[4*(i-nk) + j] ^ t[j];
+    }
+}
+
+// NB: only used twice per message, so no T-tables  XXX not constant-time
+static void aes_encrypt_c(const uint8_t rk[15][16], int nr,
+                          const uint8_t in[16], uint8_t out[16])
+{
+    uint8_t s[16], t[16];
+
+    for(int i=0; i<16; i++)
+        s[i] = in[i] ^ rk[0][i];
+    for(int r=1; r<=nr; r++) {
+        // SubBytes and ShiftRows; byte (row, col) is s[row + 4*col]
+        for(int c=0; c<4; c++) {
+            for(int row=0; row<4; row++)
+                t[row + 4*c] = sbox[s[row + 4*((c + row) & 3)]];
+        }
+        if(r < nr) {
+            // MixColumns
+            for(int c=0; c<4; c++) {
+                uint8_t a0 = t[4*c], a1 = t[4*c+1], a2 = t[4*c+2], a3 = t[4*c+3];
+                s[4*c]   = xtime(a0) ^ xtime(a1) ^ a1 ^ a2 ^ a3;
+                s[4*c+1] = a0 ^ xtime(a1) ^ xtime(a2) ^ a2 ^ a3;
+                s[4*c+2] = a0 ^ a1 ^ xtime(a2) ^ xtime(a3) ^ a3;
+                s[4*c+3] = xtime(a0) ^ a0 ^ a1 ^ a2 ^ xtime(a3);
+            }
+        } else {
+            memcpy(s, t, 16);
+        }
+        for(int i=0; i<16; i++)
+            s[i] ^= rk[r][i];
+    }
+    memcpy(out, s, 16);
+}
+
+
+/// GHASH ///
+
+// x = (x xor blocks) * h in GF(2^128), blockwise, with the bit order of
+// SP 800-38D (bit 0 is the MSB of byte 0)
+static void ghash_blocks_c(uint8_t x[16], const uint8_t h[16],
+                           const uint8_t *p, size_t n)
+{
+    uint64_t h0 = (uint64_t)be32(h) << 32 | be32(h + 4);
+    uint64_t h1 = (uint64_t)be32(h + 8) << 32 | be32(h + 12);
+    uint64_t x0 = (uint64_t)be32(x) << 32 | be32(x + 4);
+    uint64_t x1 = (uint64_t)be32(x + 8) << 32 | be32(x + 12);
+
+    for(; n > 0; n--, p += 16) {
+        x0 ^= (uint64_t)be32(p) << 32 | be32(p + 4);
+        x1 ^= (uint64_t)be32(p + 8) << 32 | be32(p + 12);
+
+        uint64_t z0 = 0, z1 = 0, v0 = h0, v1 = h1;
+        for(int i=0; i<128; i++) {
+            uint64_t bit = (i < 64 ? x0 >> (63 - i) : x1 >> (127 - i)) & 1;
+            z0 ^= v0 & -bit;
+            z1 ^= v1 & -bit;
+            uint64_t lsb = v1 & 1;
+            v1 = v1 >> 1 | v0 << 63;
+            v0 = (v0 >> 1) ^ (0xE100000000000000ULL & -lsb);
+        }
+        x0 = z0;
+        x1 = z1;
+    }
+
+    put_be64(x, x0);
+    put_be64(x + 8, x1);
+}
+
+#ifdef MAC_X86
+AES_TARGET
+static void aes_encrypt_ni(const uint8_t rk[15][16], int nr,
+                           const uint8_t in[16], uint8_t out[16])
+{
+    __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in),
+                              _mm_loadu_si128((const __m128i *)rk[0]));
+    for(int r=1; r<nr; r++)
+        s = _mm_aesenc_si128(s, _mm_loadu_si128((const __m128i *)rk[r]));
+    s = _mm_aesenclast_si128(s, _mm_loadu_si128((const __m128i *)rk[nr]));
+    _mm_storeu_si128((__m128i *)out, s);
+}
+
+// carry-less multiplication of byte-reflected operands followed by the
+// shift and reduction of the Intel GCM white paper (algorithms 2 and 4)
+AES_TARGET
+static inline __m128i gfmul(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+                                _mm_clmulepi64_si128(a, b, 0x01));
+    __m128i hi = _mm_clmulepi64_si128(a, b, 0x11);
+
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    // shift the 256-bit product left by one
+    __m128i c0 = _mm_srli_epi32(lo, 31);
+    __m128i c1 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    __m128i c2 = _mm_srli_si128(c0, 12);
+    c1 = _mm_slli_si128(c1, 4);
+    c0 = _mm_slli_si128(c0, 4);
+    lo = _mm_or_si128(lo, c0);
+    hi = _mm_or_si128(hi, c1);
+    hi = _mm_or_si128(hi, c2);
+
+    // reduce modulo x^128 + x^7 + x^2 + x + 1
+    __m128i r = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31),
+                                            _mm_slli_epi32(lo, 30)),
+                              _mm_slli_epi32(lo, 25));
+    __m128i r1 = _mm_srli_si128(r, 4);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(r, 12));
+    __m128i s = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1),
+                                            _mm_srli_epi32(lo, 2)),
+                              _mm_srli_epi32(lo, 7));
+    s = _mm_xor_si128(s, r1);
+    lo = _mm_xor_si128(lo, s);
+    return _mm_xor_si128(hi, lo);
+}
+
+AES_TARGET
+static void ghash_blocks_clmul(uint8_t x[16], const uint8_t h[16],
+                               const uint8_t *p, size_t n)
+{
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                       8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i H = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)h), bswap);
+    __m128i X = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)x), bswap);
+
+    for(; n > 0; n--, p += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)p);
+        X = gfmul(_mm_xor_si128(X, _mm_shuffle_epi8(b, bswap)), H);
+    }
+    _mm_storeu_si128((__m128i *)x, _mm_shuffle_epi8(X, bswap));
+}
+#endif
+
+static void (*aes_encrypt)(const uint8_t [15][16], int, const uint8_t *,
+                           uint8_t *);
+static void (*ghash_blocks)(uint8_t *, const uint8_t *, const uint8_t *,
+                            size_t);
+static const char *aesname = "none";
+
+typedef struct {
+    uint8_t x[16];
+    uint8_t buf[16];
+    size_t n;                   // bytes in buf
+    uint64_t len;               // bytes hashed
+} Ghash;
+
+static void ghash_update(Ghash *g, const uint8_t h[16],
+                         const uint8_t *p, size_t len)
+{
+    g->len += len;
+    if(g->n > 0) {
+        size_t k = 16 - g->n;
+        if(k > len)
+            k = len;
+        memcpy(g->buf + g->n, p, k);
+        g->n += k;
+        p += k;
+        len -= k;
+        if(g->n < 16)
+            return;
+        ghash_blocks(g->x, h, g->buf, 1);
+        g->n = 0;
+    }
+    if(len >= 16) {
+        ghash_blocks(g->x, h, p, len / 16);
+        p += len & ~(size_t)15;
+        len &= 15;
+    }
+    memcpy(g->buf, p, len);
+    g->n = len;
+}
+
+
+/// DISPATCH ///
+
+bool dnp3_mac_have_sha(void)
+{
+#ifdef MAC_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+#else
+    return false;
+#endif
+}
+
+bool dnp3_mac_have_aes(void)
+{
+#ifdef MAC_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul")
+        && __builtin_cpu_supports("ssse3");
+#else
+    return false;
+#endif
+}
+
+void dnp3_mac_select(bool hw)
+{
+    sha256_blocks = sha256_blocks_c;
+    shaname = "portable";
+    aes_encrypt = aes_encrypt_c;
+    ghash_blocks = ghash_blocks_c;
+    aesname = "portable";
+
+#ifdef MAC_X86
+    if(hw && dnp3_mac_have_sha()) {
+        sha256_blocks = sha256_blocks_ni;
+        shaname = "sha-ni";
+    }
+    if(hw && dnp3_mac_have_aes()) {
+        aes_encrypt = aes_encrypt_ni;
+        ghash_blocks = ghash_blocks_clmul;
+        aesname = "aes-ni";
+    }
+#endif
+}
+
+// select on first use
+static inline void mac_init(void)
+{
+    if(!__atomic_load_n(&sha256_blocks, __ATOMIC_ACQUIRE))
+        dnp3_mac_select(true);
+}
+
+const char *dnp3_mac_impl_sha(void)
+{
+    mac_init();
+    return shaname;
+}
+
+const char *dnp3_mac_impl_aes(void)
+{
+    mac_init();
+    return aesname;
+}
+
+void dnp3_sha256(const uint8_t *p, size_t len, uint8_t out[32])
+{
+    Sha256 c;
+
+    mac_init();
+    sha256_start(&c, IV, 0);
+    sha256_update(&c, p, len);
+    sha256_final(&c, out);
+}
+
+
+/// MACS ///
+
+bool dnp3_mac_key(DNP3_MacKey *k, int alg, const uint8_t *key, size_t len)
+{
+    mac_init();
+    memset(k, 0, sizeof *k);
+    k->alg = alg;
+
+    switch(alg) {
+    case DNP3_MAC_HMAC_SHA256: {
+        uint8_t pad[64] = {0};
+
+        if(len > 64)
+            dnp3_sha256(key, len, pad);
+        else
+            memcpy(pad, key, len);
+
+        for(int i=0; i<64; i++)
+            pad[i] ^= 0x36;
+        memcpy(k->hmac.inner, IV, sizeof IV);
+        sha256_blocks(k->hmac.inner, pad, 1);
+        for(int i=0; i<64; i++)
+            pad[i] ^= 0x36 ^ 0x5C;
+        memcpy(k->hmac.outer, IV, sizeof IV);
+        sha256_blocks(k->hmac.outer, pad, 1);
+        memset(pad, 0, sizeof pad);
+        return true; }
+
+    case DNP3_MAC_AES_GMAC: {
+        static const uint8_t zero[16] = {0};
+
+        if(len != 16 && len != 32)
+            return false;
+        aes_expand(k->gmac.rk, key, len / 4);
+        k->gmac.nr = len / 4 + 6;
+        aes_encrypt(k->gmac.rk, k->gmac.nr, zero, k->gmac.h);
+        return true; }
+
+    default:
+        return false;
+    }
+}
+
+size_t dnp3_mac(const DNP3_MacKey *k, const uint8_t *iv,
+                const uint8_t *a, size_t alen, const uint8_t *b, size_t blen,
+                uint8_t out[DNP3_MAC_MAXLEN])
+{
+    switch(k->alg) {
+    case DNP3_MAC_HMAC_SHA256: {
+        Sha256 c;
+        uint8_t ihash[32];
+
+        sha256_start(&c, k->hmac.inner, 64);
+        sha256_update(&c, a, alen);
+        sha256_update(&c, b, blen);
+        sha256_final(&c, ihash);
+
+        sha256_start(&c, k->hmac.outer, 64);
+        sha256_update(&c, ihash, 32);
+        sha256_final(&c, out);
+        return 32; }
+
+    case DNP3_MAC_AES_GMAC: {
+        // GCM with the message as additional data and no plaintext:
+        // tag = E(K, IV || 0^31 || 1) xor GHASH(H, A || len(A) || 0)
+        Ghash g = {{0}};
+        uint8_t blk[16];
+
+        ghash_update(&g, k->gmac.h, a, alen);
+        ghash_update(&g, k->gmac.h, b, blen);
+        if(g.n > 0) {
+            memset(g.buf + g.n, 0, 16 - g.n);
+            ghash_blocks(g.x, k->gmac.h, g.buf, 1);
+        }
+        put_be64(blk, g.len * 8);
+        memset(blk + 8, 0, 8);
+        ghash_blocks(g.x, k->gmac.h, blk, 1);
+
+        memcpy(blk, iv, 12);
+        put_be32(blk + 12, 1);
+        aes_encrypt(k->gmac.rk, k->gmac.nr, blk, out);
+        for(int i=0; i<16; i++)
+            out[i] ^= g.x[i];
+        return 16; }
+
+    default:
+        return 0;
+    }
+}
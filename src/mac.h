@@ -0,0 +1,54 @@
+#ifndef DNP3_MAC_H_SEEN
+#define DNP3_MAC_H_SEEN
+
+#include <dnp3hammer.h>     // DNP3_MacAlgorithm
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define DNP3_MAC_MAXLEN 32  // full size of the longest MAC (HMAC-SHA-256)
+
+// the algorithms of dnp3_mac: those of DNP3_MacAlgorithm plus AES-GMAC with
+// an AES-128 or AES-256 key (16 or 32 octets). NB: the key cache does not
+// take GMAC keys, its IEEE 1815 nonce is not implemented (see auth.c).
+enum { DNP3_MAC_AES_GMAC = DNP3_MAC_HMAC_SHA256 + 1 };
+
+// a session key, prepared for computing MACs (see mac.c)
+typedef struct {
+    int alg;                    // DNP3_MacAlgorithm or DNP3_MAC_AES_GMAC
+    union {
+        struct {
+            uint32_t inner[8];  // SHA-256 state after the key xor ipad
+            uint32_t outer[8];  // ditto for opad
+        } hmac;
+        struct {
+            uint8_t rk[15][16]; // AES round keys
+            int nr;             // number of rounds, 10 or 14
+            uint8_t h[16];      // hash key, E(K, 0^128)
+        } gmac;
+    };
+} DNP3_MacKey;
+
+// prepare key k; false if the length does not suit the algorithm
+bool dnp3_mac_key(DNP3_MacKey *k, int alg, const uint8_t *key, size_t len);
+
+// the full MAC over a followed by b; returns its length.
+// iv (12 bytes) is only used with AES-GMAC.
+size_t dnp3_mac(const DNP3_MacKey *k, const uint8_t *iv,
+                const uint8_t *a, size_t alen, const uint8_t *b, size_t blen,
+                uint8_t out[DNP3_MAC_MAXLEN]);
+
+// plain SHA-256, for testing
+void dnp3_sha256(const uint8_t *p, size_t len, uint8_t out[32]);
+
+// the hardware paths: SHA extensions for SHA-256, AES-NI and PCLMULQDQ for
+// GMAC. dnp3_mac_select(false) forces the portable code (for testing).
+bool dnp3_mac_have_sha(void);
+bool dnp3_mac_have_aes(void);
+void dnp3_mac_select(bool hw);
+
+// the names of the implementations in use, e.g. "sha-ni" and "aes-ni"
+const char *dnp3_mac_impl_sha(void);
+const char *dnp3_mac_impl_aes(void);
+
+#endif // DNP3_MAC_H_SEEN
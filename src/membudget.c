@@ -0,0 +1,154 @@
+// memory budget: an HAllocator that refuses to go over a limit
+//
+// like the profiler, every block is preceded by its requested size, so frees
+// and reallocs know how much they give back. the count is kept with atomics
+// and only grows by compare-and-swap, so the limit holds exactly even with
+// many threads (e.g. all dissectors of a sensor) drawing from one budget.
+// NB: the limit covers the bytes handed out plus the headers, not the
+//     overhead of mm itself.
+
+#include <dnp3hammer.h>
+#include "hammer.h"     // h_system_allocator
+#include "membudget.h"
+
+#include <stdint.h>     // SIZE_MAX
+#include <string.h>
+
+
+// NB: keeps the alignment of mm's blocks for any type
+#define HDR 16
+
+typedef struct {
+    HAllocator base;
+    HAllocator *mm;
+    size_t limit;
+    size_t high;            // high-water mark, see dnp3_membudget_excess
+    size_t used;            // incl. headers
+    uint64_t refused;
+} Budget;
+
+#define LOAD(FIELD) __atomic_load_n(&(FIELD), __ATOMIC_RELAXED)
+#define ADD(FIELD, N) __atomic_fetch_add(&(FIELD), (N), __ATOMIC_RELAXED)
+#define SUB(FIELD, N) __atomic_fetch_sub(&(FIELD), (N), __ATOMIC_RELAXED)
+
+// take n more bytes from the budget if they fit
+static bool take(Budget *b, size_t n)
+{
+    size_t used = LOAD(b->used);
+
+    do {
+        if(n > b->limit - used) {
+            ADD(b->refused, 1);
+            return false;
+        }
+    } while(!__atomic_compare_exchange_n(&b->used, &used, used + n, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+static void *budget_alloc(HAllocator *mm, size_t n)
+{
+    Budget *b = (Budget *)mm;
+
+    if(n > SIZE_MAX - HDR || !take(b, HDR + n))
+        return NULL;
+    uint8_t *p = b->mm->alloc(b->mm, HDR + n);
+    if(!p) {
+        SUB(b->used, HDR + n);
+        ADD(b->refused, 1);
+        return NULL;
+    }
+    memcpy(p, &n, sizeof n);
+    return p + HDR;
+}
+
+static void *budget_realloc(HAllocator *mm, void *q, size_t n)
+{
+    Budget *b = (Budget *)mm;
+
+    if(!q)
+        return budget_alloc(mm, n);
+    if(n > SIZE_MAX - HDR)
+        return NULL;
+
+    uint8_t *p = (uint8_t *)q - HDR;
+    size_t old;
+    memcpy(&old, p, sizeof old);
+
+    // NB: a growing block is charged before and a shrinking one credited
+    //     after the move, so the limit holds in between
+    if(n > old && !take(b, n - old))
+        return NULL;
+    p = b->mm->realloc(b->mm, p, HDR + n);
+    if(!p) {
+        if(n > old)
+            SUB(b->used, n - old);
+        ADD(b->refused, 1);
+        return NULL;
+    }
+    memcpy(p, &n, sizeof n);
+    if(n < old)
+        SUB(b->used, old - n);
+    return p + HDR;
+}
+
+static void budget_free(HAllocator *mm, void *q)
+{
+    Budget *b = (Budget *)mm;
+
+    if(!q)
+        return;
+
+    uint8_t *p = (uint8_t *)q - HDR;
+    size_t n;
+    memcpy(&n, p, sizeof n);
+
+    SUB(b->used, HDR + n);
+    b->mm->free(b->mm, p);
+}
+
+HAllocator *h_membudget(HAllocator *mm, size_t limit)
+{
+    if(!mm)
+        mm = h_system_allocator;
+
+    Budget *b = mm->alloc(mm, sizeof(Budget));
+    if(!b)
+        return NULL;
+    b->base.alloc = budget_alloc;
+    b->base.realloc = budget_realloc;
+    b->base.free = budget_free;
+    b->mm = mm;
+    b->limit = limit;
+    b->high = limit - limit / 8;
+    b->used = 0;
+    b->refused = 0;
+
+    return &b->base;
+}
+
+size_t h_membudget_used(HAllocator *mm)
+{
+    return LOAD(((Budget *)mm)->used);
+}
+
+uint64_t h_membudget_refused(HAllocator *mm)
+{
+    return LOAD(((Budget *)mm)->refused);
+}
+
+void h_membudget_free(HAllocator *mm)
+{
+    Budget *b = (Budget *)mm;
+
+    if(b)
+        b->mm->free(b->mm, b);
+}
+
+size_t dnp3_membudget_excess(HAllocator *mm)
+{
+    Budget *b = (Budget *)mm;
+    size_t used = LOAD(b->used);
+
+    return used > b->high ? used - b->high : 0;
+}
@@ -0,0 +1,12 @@
+// memory budget internals for the dissector (membudget.c)
+
+#ifndef DNP3_MEMBUDGET_H_SEEN
+#define DNP3_MEMBUDGET_H_SEEN
+
+#include <dnp3hammer.h>
+
+// bytes in use above the budget's high-water mark (7/8 of the limit), i.e.
+// how much the dissector should give back; 0 if below
+size_t dnp3_membudget_excess(HAllocator *budget);
+
+#endif // DNP3_MEMBUDGET_H_SEEN
@@ -4,6 +4,7 @@
 #include "../hammer.h"
 #include "../app.h"
 #include "../util.h"
+#include "../tables.h"
 
 #include "analog.h"
 
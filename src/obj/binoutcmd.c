@@ -3,6 +3,7 @@
 #include <hammer/glue.h>
 #include "../app.h"
 #include "../util.h"
+#include "../tables.h"
 
 #include "binoutcmd.h"
 
@@ -4,6 +4,7 @@
 #include <hammer/glue.h>
 #include "../app.h"
 #include "../util.h"
+#include "../tables.h"
 
 #include "iin.h"
 
@@ -0,0 +1,29 @@
+#include <dnp3hammer.h>
+
+#include "app.h"        // G_V()
+#include "objects.h"
+
+
+const DNP3_ObjectInfo dnp3_objects[DNP3_NOBJECTS] = {
+#define X(g,v, size,bits,fl,res, val,time, fmt, col,dec,ev) \
+    {G_V(g,v), size, bits, fl, res, OBJ_VAL_##val, OBJ_TIME_##time, col,dec,ev},
+    DNP3_OBJECTS(X)
+#undef X
+};
+
+// registry index + 1 by group and variation, 0 if none.
+// NB: the compiler rejects entries with a variation beyond VMAX.
+#define VMAX 16
+
+static const uint8_t slot[DNP3_GROUP_AUTH+1][VMAX] = {
+#define X(g,v, ...) [G(g)][V(g,v)] = DNP3_OBJ_##g##_##v + 1,
+    DNP3_OBJECTS(X)
+#undef X
+};
+
+const DNP3_ObjectInfo *dnp3_object_info(DNP3_Group g, DNP3_Variation v)
+{
+    if((unsigned)g > DNP3_GROUP_AUTH || (unsigned)v >= VMAX || !slot[g][v])
+        return NULL;
+    return &dnp3_objects[slot[g][v] - 1];
+}
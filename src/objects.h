@@ -0,0 +1,183 @@
+// object registry
+//
+// every object type known to the library in one list. tables that depend on
+// group and variation (column specs, direct decoder layouts, formatter
+// dispatch) are expanded from DNP3_OBJECTS at compile time instead of being
+// kept by hand in each module.
+//
+// NB: the Hammer parsers in obj/*.c and the per-function-code grammar in
+//     app.c (odata) are not generated from here. size, flags and value
+//     columns must agree with them; test /app/objects checks what it can.
+
+#ifndef DNP3_OBJECTS_H_SEEN
+#define DNP3_OBJECTS_H_SEEN
+
+#include <dnp3hammer.h>
+
+
+// columns:
+//   group, variation   as in DNP3_GROUP_*, DNP3_VARIATION_*_*
+//   size       bytes per object; 0 for packed or variable-size objects
+//   bits       bits per packed object, or 0
+//   fl         object starts with a flags octet?
+//   res        bits of the flags octet that must be 0
+//   val        value field: NONE, U16, U32, S16, S32, F32, F64
+//   time       timestamp: NONE, ABS (48 bits), REL (16 bits)
+//   fmt        formatter, see fmt_*() in format.c
+//   col        can be stored in DNP3_Columns (columns.c)
+//   dec        handled by the direct decoder (decode.c)
+//   ev         event object, allowed in unsolicited responses
+//
+// X(group, variation,    size,bits,fl,res,  val,  time, fmt, col,dec,ev)
+#define DNP3_OBJECTS(X)                                                     \
+    /* binary inputs */                                                     \
+    X(BININ,    PACKED,         0, 1, 0, 0,    NONE, NONE, bit,           1,1,0) \
+    X(BININ,    FLAGS,          1, 0, 1, 0x40, NONE, NONE, bin_flags,     1,1,0) \
+    X(BININEV,  NOTIME,         1, 0, 1, 0x40, NONE, NONE, bin_flags,     1,1,1) \
+    X(BININEV,  ABSTIME,        7, 0, 1, 0x40, NONE, ABS,  bin_abstime,   1,1,1) \
+    X(BININEV,  RELTIME,        3, 0, 1, 0x40, NONE, REL,  bin_reltime,   1,1,1) \
+    X(DBLBITIN, PACKED,         0, 2, 0, 0,    NONE, NONE, dblbit,        1,1,0) \
+    X(DBLBITIN, FLAGS,          1, 0, 1, 0,    NONE, NONE, dblbit_flags,  1,0,0) \
+    X(DBLBITINEV, NOTIME,       1, 0, 1, 0,    NONE, NONE, dblbit_flags,  1,0,1) \
+    X(DBLBITINEV, ABSTIME,      7, 0, 1, 0,    NONE, ABS,  dblbit_abstime, 1,0,1) \
+    X(DBLBITINEV, RELTIME,      3, 0, 1, 0,    NONE, REL,  dblbit_reltime, 1,0,1) \
+                                                                            \
+    /* binary outputs */                                                    \
+    X(BINOUT,   PACKED,         0, 1, 0, 0,    NONE, NONE, bit,           1,1,0) \
+    X(BINOUT,   FLAGS,          1, 0, 1, 0x60, NONE, NONE, bin_flags,     1,0,0) \
+    X(BINOUTEV, NOTIME,         1, 0, 1, 0x60, NONE, NONE, bin_flags,     1,0,1) \
+    X(BINOUTEV, ABSTIME,        7, 0, 1, 0x60, NONE, ABS,  bin_abstime,   1,0,1) \
+    X(BINOUTCMD, CROB,         11, 0, 0, 0,    NONE, NONE, crob,          0,0,0) \
+    X(BINOUTCMD, PCB,          11, 0, 0, 0,    NONE, NONE, crob,          0,0,0) \
+    X(BINOUTCMD, PCM,           0, 1, 0, 0,    NONE, NONE, bit,           0,0,0) \
+    X(BINOUTCMDEV, NOTIME,      1, 0, 0, 0,    NONE, NONE, cmdev,         0,0,1) \
+    X(BINOUTCMDEV, ABSTIME,     7, 0, 0, 0,    NONE, ABS,  cmdev_abstime, 0,0,1) \
+                                                                            \
+    /* counters; flag bit 5 (rollover) is obsolete and not checked */      \
+    X(CTR,      32BIT,          5, 0, 1, 0x80, U32,  NONE, ctr_flags,     1,1,0) \
+    X(CTR,      16BIT,          3, 0, 1, 0x80, U16,  NONE, ctr_flags,     1,1,0) \
+    X(CTR,      32BIT_NOFLAG,   4, 0, 0, 0,    U32,  NONE, ctr,           1,1,0) \
+    X(CTR,      16BIT_NOFLAG,   2, 0, 0, 0,    U16,  NONE, ctr,           1,1,0) \
+    X(FROZENCTR, 32BIT,         5, 0, 1, 0x80, U32,  NONE, ctr_flags,     1,0,0) \
+    X(FROZENCTR, 16BIT,         3, 0, 1, 0x80, U16,  NONE, ctr_flags,     1,0,0) \
+    X(FROZENCTR, 32BIT_TIME,   11, 0, 1, 0x80, U32,  ABS,  ctr_abstime,   1,0,0) \
+    X(FROZENCTR, 16BIT_TIME,    9, 0, 1, 0x80, U16,  ABS,  ctr_abstime,   1,0,0) \
+    X(FROZENCTR, 32BIT_NOFLAG,  4, 0, 0, 0,    U32,  NONE, ctr,           1,0,0) \
+    X(FROZENCTR, 16BIT_NOFLAG,  2, 0, 0, 0,    U16,  NONE, ctr,           1,0,0) \
+    X(CTREV,    32BIT,          5, 0, 1, 0x80, U32,  NONE, ctr_flags,     1,1,1) \
+    X(CTREV,    16BIT,          3, 0, 1, 0x80, U16,  NONE, ctr_flags,     1,1,1) \
+    X(CTREV,    32BIT_TIME,    11, 0, 1, 0x80, U32,  ABS,  ctr_abstime,   1,1,1) \
+    X(CTREV,    16BIT_TIME,     9, 0, 1, 0x80, U16,  ABS,  ctr_abstime,   1,1,1) \
+    X(FROZENCTREV, 32BIT,       5, 0, 1, 0x80, U32,  NONE, ctr_flags,     1,0,1) \
+    X(FROZENCTREV, 16BIT,       3, 0, 1, 0x80, U16,  NONE, ctr_flags,     1,0,1) \
+    X(FROZENCTREV, 32BIT_TIME, 11, 0, 1, 0x80, U32,  ABS,  ctr_abstime,   1,0,1) \
+    X(FROZENCTREV, 16BIT_TIME,  9, 0, 1, 0x80, U16,  ABS,  ctr_abstime,   1,0,1) \
+                                                                            \
+    /* analog inputs */                                                     \
+    X(ANAIN,    32BIT,          5, 0, 1, 0x80, S32,  NONE, ana_flags,     1,1,0) \
+    X(ANAIN,    16BIT,          3, 0, 1, 0x80, S16,  NONE, ana_flags,     1,1,0) \
+    X(ANAIN,    32BIT_NOFLAG,   4, 0, 0, 0,    S32,  NONE, ana,           1,1,0) \
+    X(ANAIN,    16BIT_NOFLAG,   2, 0, 0, 0,    S16,  NONE, ana,           1,1,0) \
+    X(ANAIN,    FLOAT,          5, 0, 1, 0x80, F32,  NONE, flt_flags,     1,1,0) \
+    X(ANAIN,    DOUBLE,         9, 0, 1, 0x80, F64,  NONE, flt_flags,     1,1,0) \
+    X(FROZENANAIN, 32BIT,       5, 0, 1, 0x80, S32,  NONE, ana_flags,     1,0,0) \
+    X(FROZENANAIN, 16BIT,       3, 0, 1, 0x80, S16,  NONE, ana_flags,     1,0,0) \
+    X(FROZENANAIN, 32BIT_TIME, 11, 0, 1, 0x80, S32,  ABS,  ana_abstime,   1,0,0) \
+    X(FROZENANAIN, 16BIT_TIME,  9, 0, 1, 0x80, S16,  ABS,  ana_abstime,   1,0,0) \
+    X(FROZENANAIN, 32BIT_NOFLAG, 4, 0, 0, 0,   S32,  NONE, ana,           1,0,0) \
+    X(FROZENANAIN, 16BIT_NOFLAG, 2, 0, 0, 0,   S16,  NONE, ana,           1,0,0) \
+    X(FROZENANAIN, FLOAT,       5, 0, 1, 0x80, F32,  NONE, flt_flags,     1,0,0) \
+    X(FROZENANAIN, DOUBLE,      9, 0, 1, 0x80, F64,  NONE, flt_flags,     1,0,0) \
+    X(ANAINEV,  32BIT,          5, 0, 1, 0x80, S32,  NONE, ana_flags,     1,1,1) \
+    X(ANAINEV,  16BIT,          3, 0, 1, 0x80, S16,  NONE, ana_flags,     1,1,1) \
+    X(ANAINEV,  32BIT_TIME,    11, 0, 1, 0x80, S32,  ABS,  ana_abstime,   1,1,1) \
+    X(ANAINEV,  16BIT_TIME,     9, 0, 1, 0x80, S16,  ABS,  ana_abstime,   1,1,1) \
+    X(ANAINEV,  FLOAT,          5, 0, 1, 0x80, F32,  NONE, flt_flags,     1,1,1) \
+    X(ANAINEV,  DOUBLE,         9, 0, 1, 0x80, F64,  NONE, flt_flags,     1,1,1) \
+    X(ANAINEV,  FLOAT_TIME,    11, 0, 1, 0x80, F32,  ABS,  flt_abstime,   1,1,1) \
+    X(ANAINEV,  DOUBLE_TIME,   15, 0, 1, 0x80, F64,  ABS,  flt_abstime,   1,1,1) \
+    X(FROZENANAINEV, 32BIT,     5, 0, 1, 0x80, S32,  NONE, ana_flags,     1,0,1) \
+    X(FROZENANAINEV, 16BIT,     3, 0, 1, 0x80, S16,  NONE, ana_flags,     1,0,1) \
+    X(FROZENANAINEV, 32BIT_TIME, 11, 0, 1, 0x80, S32, ABS, ana_abstime,   1,0,1) \
+    X(FROZENANAINEV, 16BIT_TIME, 9, 0, 1, 0x80, S16, ABS,  ana_abstime,   1,0,1) \
+    X(FROZENANAINEV, FLOAT,     5, 0, 1, 0x80, F32,  NONE, flt_flags,     1,0,1) \
+    X(FROZENANAINEV, DOUBLE,    9, 0, 1, 0x80, F64,  NONE, flt_flags,     1,0,1) \
+    X(FROZENANAINEV, FLOAT_TIME, 11, 0, 1, 0x80, F32, ABS, flt_abstime,   1,0,1) \
+    X(FROZENANAINEV, DOUBLE_TIME, 15, 0, 1, 0x80, F64, ABS, flt_abstime,  1,0,1) \
+    X(ANAINDEADBAND, 16BIT,     2, 0, 0, 0,    U16,  NONE, ana,           0,0,0) \
+    X(ANAINDEADBAND, 32BIT,     4, 0, 0, 0,    U32,  NONE, ana,           0,0,0) \
+    X(ANAINDEADBAND, FLOAT,     4, 0, 0, 0,    F32,  NONE, flt,           0,0,0) \
+                                                                            \
+    /* analog outputs; the g41 and g43 status octet follows the value */    \
+    X(ANAOUTSTATUS, 32BIT,      5, 0, 1, 0x80, S32,  NONE, ana_flags,     0,0,0) \
+    X(ANAOUTSTATUS, 16BIT,      3, 0, 1, 0x80, S16,  NONE, ana_flags,     0,0,0) \
+    X(ANAOUTSTATUS, FLOAT,      5, 0, 1, 0x80, F32,  NONE, flt_flags,     0,0,0) \
+    X(ANAOUTSTATUS, DOUBLE,     9, 0, 1, 0x80, F64,  NONE, flt_flags,     0,0,0) \
+    X(ANAOUT,   32BIT,          5, 0, 0, 0,    S32,  NONE, anaout,        0,0,0) \
+    X(ANAOUT,   16BIT,          3, 0, 0, 0,    S16,  NONE, anaout,        0,0,0) \
+    X(ANAOUT,   FLOAT,          5, 0, 0, 0,    F32,  NONE, anaout_flt,    0,0,0) \
+    X(ANAOUT,   DOUBLE,         9, 0, 0, 0,    F64,  NONE, anaout_flt,    0,0,0) \
+    X(ANAOUTEV, 32BIT,          5, 0, 1, 0x80, S32,  NONE, ana_flags,     0,0,1) \
+    X(ANAOUTEV, 16BIT,          3, 0, 1, 0x80, S16,  NONE, ana_flags,     0,0,1) \
+    X(ANAOUTEV, 32BIT_TIME,    11, 0, 1, 0x80, S32,  ABS,  ana_abstime,   0,0,1) \
+    X(ANAOUTEV, 16BIT_TIME,     9, 0, 1, 0x80, S16,  ABS,  ana_abstime,   0,0,1) \
+    X(ANAOUTEV, FLOAT,          5, 0, 1, 0x80, F32,  NONE, flt_flags,     0,0,1) \
+    X(ANAOUTEV, DOUBLE,         9, 0, 1, 0x80, F64,  NONE, flt_flags,     0,0,1) \
+    X(ANAOUTEV, FLOAT_TIME,    11, 0, 1, 0x80, F32,  ABS,  flt_abstime,   0,0,1) \
+    X(ANAOUTEV, DOUBLE_TIME,   15, 0, 1, 0x80, F64,  ABS,  flt_abstime,   0,0,1) \
+    X(ANAOUTCMDEV, 32BIT,       5, 0, 0, 0,    S32,  NONE, anaout,        0,0,1) \
+    X(ANAOUTCMDEV, 16BIT,       3, 0, 0, 0,    S16,  NONE, anaout,        0,0,1) \
+    X(ANAOUTCMDEV, 32BIT_TIME, 11, 0, 0, 0,    S32,  ABS,  anaout_abstime, 0,0,1) \
+    X(ANAOUTCMDEV, 16BIT_TIME,  9, 0, 0, 0,    S16,  ABS,  anaout_abstime, 0,0,1) \
+    X(ANAOUTCMDEV, FLOAT,       5, 0, 0, 0,    F32,  NONE, anaout_flt,    0,0,1) \
+    X(ANAOUTCMDEV, DOUBLE,      9, 0, 0, 0,    F64,  NONE, anaout_flt,    0,0,1) \
+    X(ANAOUTCMDEV, FLOAT_TIME, 11, 0, 0, 0,    F32,  ABS,  anaout_flt_abstime, 0,0,1) \
+    X(ANAOUTCMDEV, DOUBLE_TIME, 15, 0, 0, 0,   F64,  ABS,  anaout_flt_abstime, 0,0,1) \
+                                                                            \
+    /* time and other */                                                    \
+    X(TIME,     TIME,           6, 0, 0, 0,    NONE, ABS,  abstime,       0,0,0) \
+    X(TIME,     TIME_INTERVAL, 10, 0, 0, 0,    NONE, ABS,  time_interval, 0,0,0) \
+    X(TIME,     RECORDED_TIME,  6, 0, 0, 0,    NONE, ABS,  abstime,       0,0,0) \
+    X(TIME,     INDEXED_TIME,  11, 0, 0, 0,    NONE, ABS,  indexed_time,  0,0,0) \
+    X(CTO,      SYNC,           6, 0, 0, 0,    NONE, ABS,  abstime,       0,0,0) \
+    X(CTO,      UNSYNC,         6, 0, 0, 0,    NONE, ABS,  cto_unsync,    0,0,0) \
+    X(DELAY,    S,              2, 0, 0, 0,    U16,  NONE, delay,         0,0,0) \
+    X(DELAY,    MS,             2, 0, 0, 0,    U16,  NONE, delay,         0,0,0) \
+    X(IIN,      PACKED,         0, 1, 0, 0,    NONE, NONE, bit,           0,0,0) \
+    X(APPL,     ID,             0, 0, 0, 0,    NONE, NONE, applid,        0,0,0)
+
+// value and time fields
+enum { OBJ_VAL_NONE, OBJ_VAL_U16, OBJ_VAL_U32, OBJ_VAL_S16, OBJ_VAL_S32,
+       OBJ_VAL_F32, OBJ_VAL_F64 };
+enum { OBJ_TIME_NONE, OBJ_TIME_ABS, OBJ_TIME_REL };
+
+// one index per registry entry, in order
+enum {
+#define X(g,v, size,bits,fl,res, val,time, fmt, col,dec,ev) DNP3_OBJ_##g##_##v,
+    DNP3_OBJECTS(X)
+#undef X
+    DNP3_NOBJECTS
+};
+
+typedef struct {
+    DNP3_Group      group;
+    DNP3_Variation  variation;
+    uint8_t         size;
+    uint8_t         bits;
+    bool            flags;
+    uint8_t         reserved;
+    uint8_t         value;      // OBJ_VAL_*
+    uint8_t         time;       // OBJ_TIME_*
+    bool            columnar;
+    bool            decode;
+    bool            event;
+} DNP3_ObjectInfo;
+
+// all registry entries, indexed by DNP3_OBJ_*
+extern const DNP3_ObjectInfo dnp3_objects[DNP3_NOBJECTS];
+
+// the entry for the given group and variation, NULL if none
+const DNP3_ObjectInfo *dnp3_object_info(DNP3_Group g, DNP3_Variation v);
+
+
+#endif // DNP3_OBJECTS_H_SEEN
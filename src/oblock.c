@@ -3,10 +3,17 @@
 
 #include <hammer/hammer.h>
 #include <hammer/glue.h>
+#include <assert.h>
 #include <stdlib.h>     // malloc
+#include <string.h>
 #include "hammer.h"
 #include "app.h"
 #include "util.h"
+#include "columns.h"
+#include "tables.h"
+
+
+bool dnp3_p_columnar;
 
 
 static HParser *range_index;
@@ -106,26 +113,47 @@ HParsedToken *count_idxs_objs(HArena *arena, size_t count, uint32_t *idxs, DNP3_
     return res;
 }
 
+// helper: the (count,idxs,cols) triple for columnar blocks
+static HParsedToken *count_idxs_cols(HArena *arena, size_t count, uint32_t *idxs, DNP3_Columns *cols)
+{
+    HParsedToken *res = h_make_seqn(arena, 3);
+    h_seq_snoc(res, h_make_uint(arena, count));
+    h_seq_snoc(res, h_make(arena, TT_USER, idxs));
+    h_seq_snoc(res, h_make(arena, TT_DNP3_Columns, cols));
+    return res;
+}
+
 // semantic actions to generate the (count,idxs,objs) triple in different cases
+// user is the DNP3_ColumnSpec to store objects in columns, or NULL.
 static HParsedToken *act_indexes_objects(const HParseResult *p, void *user)
 {
     // p->ast = ((idx,obj)...)
+    const DNP3_ColumnSpec *spec = user;
     size_t n = h_seq_len(p->ast);
 
     uint32_t    *indexes = NULL;
     DNP3_Object *objects = NULL;
+    DNP3_Columns *cols = NULL;
+    if(spec)
+        cols = dnp3_columns_new(p->arena, spec, n);
     if(n > 0) {
         indexes = h_arena_malloc(p->arena, 4*n);
-        objects = h_arena_malloc(p->arena, sizeof(DNP3_Object) * n);
+        if(!spec)
+            objects = h_arena_malloc(p->arena, sizeof(DNP3_Object) * n);
 
         for(size_t i=0; i<n; i++) {
             HParsedToken *i_o = h_seq_index(p->ast, i);
 
             indexes[i] = H_INDEX_UINT(i_o, 0);
-            objects[i] = *H_INDEX(DNP3_Object, i_o, 1);
+            if(spec)
+                dnp3_columns_set(cols, spec, i, H_INDEX(DNP3_Object, i_o, 1));
+            else
+                objects[i] = *H_INDEX(DNP3_Object, i_o, 1);
         }
     }
 
+    if(spec)
+        return count_idxs_cols(p->arena, n, indexes, cols);
     return count_idxs_objs(p->arena, n, indexes, objects);
 }
 static HParsedToken *act_indexes_only(const HParseResult *p, void *user)
@@ -147,8 +175,18 @@ static HParsedToken *act_indexes_only(const HParseResult *p, void *user)
 static HParsedToken *act_objects_only(const HParseResult *p, void *user)
 {
     // p->ast = (obj...)
+    const DNP3_ColumnSpec *spec = user;
     size_t n = h_seq_len(p->ast);
 
+    if(spec) {
+        DNP3_Columns *cols = dnp3_columns_new(p->arena, spec, n);
+
+        for(size_t i=0; i<n; i++)
+            dnp3_columns_set(cols, spec, i, H_FIELD(DNP3_Object, i));
+
+        return count_idxs_cols(p->arena, n, NULL, cols);
+    }
+
     DNP3_Object *objects = NULL;
     if(n > 0) {
         objects = h_arena_malloc(p->arena, sizeof(DNP3_Object) * n);
@@ -161,7 +199,8 @@ static HParsedToken *act_objects_only(const HParseResult *p, void *user)
     return count_idxs_objs(p->arena, n, NULL, objects);
 }
 
-static HParser *prefixed_index(HParser *idx, HParser *p)
+static HParser *prefixed_index(HParser *idx, HParser *p,
+                               const DNP3_ColumnSpec *spec)
 {
     HParser *obj;
     HAction act;
@@ -174,37 +213,77 @@ static HParser *prefixed_index(HParser *idx, HParser *p)
         act = act_indexes_only;
     }
 
-    return h_action(h_length_value(range_count, obj), act, NULL);
+    return h_action(h_length_value(range_count, obj), act, (void *)spec);
+}
+
+// variable-format object parsers for the common (small) sizes, one table per
+// constructor. built per size on first use (build_vf).
+#define VFCACHE 256
+#define NVFCACHE 4
+struct VFCache {
+    HParser *(*q)(HAllocator *, size_t);
+    HParser *p[VFCACHE];
+};
+static struct VFCache vfcache[NVFCACHE];
+static int nvfcache = 0;
+
+static struct VFCache *vfcache_get(HParser *(*q)(HAllocator *, size_t))
+{
+    for(int i=0; i<nvfcache; i++) {
+        if(vfcache[i].q == q)
+            return &vfcache[i];
+    }
+
+    assert(nvfcache < NVFCACHE);
+    struct VFCache *c = &vfcache[nvfcache++];
+    c->q = q;
+    memset(c->p, 0, sizeof c->p);
+    return c;
+}
+
+static HParser *build_vf(void *env, size_t n)
+{
+    struct VFCache *c = env;
+    return c->q(dnp3_p_mm, n);
 }
 
 static HParser *k_bindvf(HAllocator *mm__, const HParsedToken *n, void *user)
 {
-    HParser *(*q)(HAllocator *, size_t) = user;
+    struct VFCache *c = user;
+    uint64_t k = H_CAST_UINT(n);
 
-    return q(mm__, H_CAST_UINT(n));
+    if(k < VFCACHE)
+        return dnp3_p_lazy(&c->p[k], build_vf, c, k);
+    return c->q(mm__, k);
 }
 static HParser *prefixed_size(HParser *vfcnt, HParser *p, HParser *(*q)(HAllocator *, size_t))
 {
-    return h_action(h_length_value(vfcnt, h_bind(p, k_bindvf, q)),
+    return h_action(h_length_value(vfcnt, h_bind(p, k_bindvf, vfcache_get(q))),
                     act_objects_only, NULL);
 }
 
-static HParser *oblock_range_(HParser *p)
+static HParser *oblock_range_(HParser *p, const DNP3_ColumnSpec *spec)
 {
     H_RULE(range,   h_choice(range_index, range_addr, NULL));
         // XXX are address ranges really allowed with all types of objects or
         //     only where the spec actually says so (g102, g110)?
     H_RULE(objs,    h_action(h_length_value(range, p),
-                             act_objects_only, NULL));
+                             act_objects_only, (void *)spec));
 
     return noprefix(objs);
 }
 
-static HParser *oblock_index_(HParser *p)
+static HParser *oblock_index_(HParser *p, const DNP3_ColumnSpec *spec)
+{
+    return h_choice(withpc(1, prefixed_index(h_uint8(), p, spec)),
+                    withpc(2, prefixed_index(h_uint16(), p, spec)),
+                    withpc(3, prefixed_index(h_uint32(), p, spec)), NULL);
+}
+
+// the column layout to use for blocks of g/v, if any
+static const DNP3_ColumnSpec *columns(DNP3_Group g, DNP3_Variation v)
 {
-    return h_choice(withpc(1, prefixed_index(h_uint8(), p)), 
-                    withpc(2, prefixed_index(h_uint16(), p)),
-                    withpc(3, prefixed_index(h_uint32(), p)), NULL);
+    return dnp3_p_columnar ? dnp3_column_spec(g, v) : NULL;
 }
 
 static HParser *oblock_vf_(HParser *cnt, HParser *(*p)(HAllocator *mm__, size_t))
@@ -216,6 +295,8 @@ static HParser *oblock_vf_(HParser *cnt, HParser *(*p)(HAllocator *mm__, size_t)
 
 void init_oblock(void)
 {
+    nvfcache = 0;   // tables of an earlier dnp3_init
+
     // qualifier codes and their meanings:
     //
     //   0[0-2]      index range
@@ -249,7 +330,7 @@ void init_oblock(void)
     ohdr_max    = noprefix(range_max);
     ohdr_count1 = noprefix(range_count1);
 
-    H_RULE(rblock_index, oblock_index_(NULL));
+    H_RULE(rblock_index, oblock_index_(NULL, NULL));
     rblock_ = h_choice(ohdr_irange, ohdr_arange, ohdr_all, ohdr_count,
                        rblock_index, NULL);
 
@@ -301,10 +382,13 @@ static HParsedToken *act_block(const HParseResult *p, void *user)
     tok = H_INDEX_TOKEN(p->ast, 2, 0, 1);
         // tok corresponds to the block_ argument of block()
     if(tok->token_type == TT_SEQUENCE) {
-        // tok = (count,idxs,objs)
+        // tok = (count,idxs,objs) or (count,idxs,cols)
         ob->count   = H_INDEX_UINT(tok, 0);
         ob->indexes = h_assert_type(TT_USER, H_INDEX_TOKEN(tok, 1))->user;
-        ob->objects = H_INDEX(DNP3_Object, tok, 2);
+        if(H_INDEX_TOKEN(tok, 2)->token_type == (HTokenType)TT_DNP3_Columns)
+            ob->columns = H_INDEX(DNP3_Columns, tok, 2);
+        else
+            ob->objects = H_INDEX(DNP3_Object, tok, 2);
     } else {
         // tok = count
         ob->count = H_CAST_UINT(tok);
@@ -338,9 +422,8 @@ HParser *dnp3_p_rblock(DNP3_Group g, ...)
     va_end(args);
 
     // assemble array of parsers for the given variations 
-    // XXX this array is never freed (but no parsers ever are)
     // XXX ensure we call parser-allocating functions only once during init
-    vs = malloc((n+2) * sizeof(HParser *));
+    vs = dnp3_p_mm->alloc(dnp3_p_mm, (n+2) * sizeof(HParser *));
     vs[0] = variation(DNP3_VARIATION_ANY);
     va_start(args, g);
     for(i=1; i<=n; i++)
@@ -348,7 +431,7 @@ HParser *dnp3_p_rblock(DNP3_Group g, ...)
     va_end(args);
     vs[i] = NULL;
 
-    return block(group(g), h_choice__a((void **)vs), rblock_);
+    return block(group(g), h_choice__ma(dnp3_p_mm, (void **)vs), rblock_);
 }
 
 HParser *dnp3_p_specific_rblock(DNP3_Group g, DNP3_Variation v)
@@ -386,15 +469,16 @@ HParser *dnp3_p_single_vf(DNP3_Group g, DNP3_Variation v, HParser *(*obj)(HAlloc
 
 HParser *dnp3_p_oblock(DNP3_Group g, DNP3_Variation v, HParser *obj)
 {
-    H_RULE(oblock_, h_choice(oblock_index_(obj),
-                             oblock_range_(obj), NULL));
+    const DNP3_ColumnSpec *spec = columns(g, v);
+    H_RULE(oblock_, h_choice(oblock_index_(obj, spec),
+                             oblock_range_(obj, spec), NULL));
 
     return block(group(g), variation(v), oblock_);
 }
 
 HParser *dnp3_p_oblock_packed(DNP3_Group g, DNP3_Variation v, HParser *obj)
 {
-    return block(group(g), variation(v), oblock_range_(obj));
+    return block(group(g), variation(v), oblock_range_(obj, columns(g, v)));
 }
 
 HParser *dnp3_p_oblock_vf(DNP3_Group g, DNP3_Variation v, HParser *(*obj)(HAllocator *mm__, size_t))
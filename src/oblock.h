@@ -14,6 +14,9 @@
 
 void init_oblock(void);
 
+// store objects in DNP3_Columns where possible; read when parsers are built
+extern bool dnp3_p_columnar;
+
 // parse an "rblock" for the given group/variations, that is a block of object
 // headers and possibly object prefixes, as used in read requests.
 // allows variation 0 ("any").
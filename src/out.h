@@ -0,0 +1,124 @@
+// buffered output to caller buffers and DNP3_FormatWriters (format.c,
+// export.c)
+
+#ifndef DNP3_OUT_H_SEEN
+#define DNP3_OUT_H_SEEN
+
+#include <dnp3hammer.h>
+
+#include <stdio.h>      // vsnprintf
+#include <stdlib.h>     // realloc
+#include <string.h>     // memcpy
+#include <stdarg.h>
+#include <assert.h>
+
+
+// output state. the result goes to buf; with a writer, buf is a chunk that
+// is passed on whenever it fills up. len counts the whole output, including
+// what did not fit into a caller's buffer.
+typedef struct {
+    char *buf;
+    size_t cap;             // usable bytes in buf (less the null, if any)
+    size_t pos;             // bytes held in buf
+    size_t len;
+    DNP3_FormatWriter write;
+    void *env;
+    bool err;
+} Out;
+
+#define CHUNK 256
+
+static inline void flush(Out *out)
+{
+    if(out->write && out->pos > 0 && !out->err) {
+        if(out->write(out->env, out->buf, out->pos) < 0)
+            out->err = true;
+        out->pos = 0;
+    }
+}
+
+static inline void put(Out *out, const char *s, size_t n)
+{
+    out->len += n;
+    while(n > 0 && !out->err) {
+        size_t k = out->cap - out->pos;
+        if(k > n) k = n;
+        memcpy(out->buf + out->pos, s, k);
+        out->pos += k;
+        s += k;
+        n -= k;
+
+        if(!out->write)
+            break;          // truncated
+        if(out->pos == out->cap)
+            flush(out);
+    }
+}
+
+static inline void putstr(Out *out, const char *s)
+{
+    put(out, s, strlen(s));
+}
+
+static inline void appendf(Out *out, const char *fmt, ...)
+{
+    // NB: the longest piece is a "%.1f" of a huge double (~310 chars)
+    char tmp[512];
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = vsnprintf(tmp, sizeof(tmp), fmt, args);
+    va_end(args);
+    assert(n < (int)sizeof(tmp));
+    if(n < 0 || n >= sizeof(tmp))
+        out->err = true;
+    else
+        put(out, tmp, n);
+}
+
+static inline int finish(Out *out)
+{
+    flush(out);
+    if(!out->write && out->buf)
+        out->buf[out->pos] = '\0';
+    return out->err ? -1 : (int)out->len;
+}
+
+// writer that collects the output in a growing malloc'd string
+typedef struct {
+    char *s;
+    size_t len, size;
+} Str;
+
+static inline int str_write(void *env, const char *p, size_t n)
+{
+    Str *str = env;
+
+    if(str->len + n + 1 > str->size) {
+        size_t size = str->size ? str->size : CHUNK;
+        while(size < str->len + n + 1)
+            size *= 2;
+        char *s = realloc(str->s, size);
+        if(!s) return -1;
+        str->s = s;
+        str->size = size;
+    }
+    memcpy(str->s + str->len, p, n);
+    str->len += n;
+    str->s[str->len] = '\0';
+
+    return 0;
+}
+
+static inline char *finish_str(Out *out, Str *str)
+{
+    if(finish(out) < 0 || str_write(str, "", 0) < 0) {
+        free(str->s);
+        return NULL;
+    }
+    return str->s;
+}
+
+
+#endif // DNP3_OUT_H_SEEN
@@ -0,0 +1,293 @@
+// point database: the last known state of every point of every outstation
+//
+// the objects of response fragments are applied to the database one block
+// at a time. a point is reported when it is new or any of the fields
+// carried by the object differ from what is stored; event objects are
+// always reported. each point type (see types[]) is kept per outstation in
+// arrays indexed by point index: a bitmap of known points, the flags octets
+// and, except for binaries, the values.
+
+#include <dnp3hammer.h>
+
+#include <string.h>
+#include "hammer.h"     // h_system_allocator
+#include "columns.h"    // dnp3_flags_encode
+#include "objects.h"
+#include "points.h"
+
+
+#define MAXINDEX 65536  // points with higher indexes are ignored  XXX
+#define NBUCKETS 256    // outstation hash table
+
+// point types by static group, and their event groups
+static const struct {
+    DNP3_Group stat, event;
+} types[] = {
+    {DNP3_GROUP_BININ,          DNP3_GROUP_BININEV},
+    {DNP3_GROUP_DBLBITIN,       DNP3_GROUP_DBLBITINEV},
+    {DNP3_GROUP_BINOUT,         DNP3_GROUP_BINOUTEV},
+    {DNP3_GROUP_CTR,            DNP3_GROUP_CTREV},
+    {DNP3_GROUP_FROZENCTR,      DNP3_GROUP_FROZENCTREV},
+    {DNP3_GROUP_ANAIN,          DNP3_GROUP_ANAINEV},
+    {DNP3_GROUP_FROZENANAIN,    DNP3_GROUP_FROZENANAINEV},
+    {DNP3_GROUP_ANAOUTSTATUS,   DNP3_GROUP_ANAOUTEV},
+};
+#define NTYPES (sizeof(types) / sizeof(*types))
+
+// the points of one type
+struct Points {
+    size_t n;                   // allocated indexes
+    uint8_t *known;             // bitmap
+    uint8_t *flags;             // as on the wire (dnp3_flags_encode)
+    double *value;              // NULL for binaries
+};
+
+struct Outstation {
+    struct Outstation *next;    // hash chain
+    uint16_t addr;
+    struct Points pt[NTYPES];
+};
+
+struct DNP3_PointDB_ {
+    HAllocator *mm;
+    struct Outstation *tab[NBUCKETS];
+};
+
+
+// the point type of group g, -1 if none
+static int point_type(DNP3_Group g)
+{
+    for(size_t k=0; k<NTYPES; k++) {
+        if(types[k].stat == g || types[k].event == g)
+            return k;
+    }
+    return -1;
+}
+
+static bool has_value(int k)
+{
+    switch(types[k].stat) {
+    case DNP3_GROUP_BININ:
+    case DNP3_GROUP_DBLBITIN:
+    case DNP3_GROUP_BINOUT:     return false;
+    default:                    return true;
+    }
+}
+
+static void *grow(HAllocator *mm, void *p, size_t old, size_t new)
+{
+    uint8_t *q = mm->alloc(mm, new);
+
+    if(!q)
+        return NULL;
+    if(p)
+        memcpy(q, p, old);
+    memset(q + old, 0, new - old);
+    if(p)
+        mm->free(mm, p);
+    return q;
+}
+
+// make room for point i; false if out of memory
+static bool reserve(HAllocator *mm, struct Points *pts, int k, size_t i)
+{
+    size_t n = pts->n ? pts->n : 64;
+
+    if(i < pts->n)
+        return true;
+    while(n <= i)
+        n *= 2;
+
+    uint8_t *known = grow(mm, pts->known, pts->n / 8, n / 8);
+    if(!known)
+        return false;
+    pts->known = known;
+    uint8_t *flags = grow(mm, pts->flags, pts->n, n);
+    if(!flags)
+        return false;
+    pts->flags = flags;
+    if(has_value(k)) {
+        double *value = grow(mm, pts->value, pts->n * sizeof(double),
+                             n * sizeof(double));
+        if(!value)
+            return false;
+        pts->value = value;
+    }
+
+    pts->n = n;
+    return true;
+}
+
+static struct Outstation *outstation(DNP3_PointDB *db, uint16_t addr,
+                                     bool create)
+{
+    struct Outstation **b = &db->tab[(addr ^ addr >> 8) % NBUCKETS];
+    struct Outstation *o;
+
+    for(o = *b; o; o = o->next) {
+        if(o->addr == addr)
+            return o;
+    }
+    if(!create)
+        return NULL;
+
+    o = db->mm->alloc(db->mm, sizeof(struct Outstation));
+    if(!o)
+        return NULL;
+    memset(o, 0, sizeof(struct Outstation));
+    o->addr = addr;
+    o->next = *b;
+    *b = o;
+    return o;
+}
+
+// the value field of object o, by registry entry
+static double object_value(const DNP3_ObjectInfo *x, const DNP3_Object *o)
+{
+    switch(x->value) {
+    case OBJ_VAL_U16:
+    case OBJ_VAL_U32:   return o->ctr.value;
+    case OBJ_VAL_S16:
+    case OBJ_VAL_S32:   return o->ana.sint;
+    case OBJ_VAL_F32:
+    case OBJ_VAL_F64:   return o->ana.flt;
+    default:            return 0;
+    }
+}
+
+// the flags octet for object o given the stored one, by registry entry.
+// packed objects only carry the state.
+static uint8_t object_flags(const DNP3_ObjectInfo *x, const DNP3_Object *o,
+                            uint8_t old)
+{
+    DNP3_Group g = x->group;
+
+    if(x->flags)
+        return dnp3_flags_encode(g, o->flags);
+    if(x->bits) {
+        DNP3_Flags f = dnp3_flags_decode(g, old);
+        f.state = (x->bits == 2) ? o->dblbit : o->bit;
+        return dnp3_flags_encode(g, f);
+    }
+    return old;
+}
+
+size_t dnp3_pointdb_apply_block(DNP3_PointDB *db, uint16_t addr,
+                                const DNP3_ObjectBlock *ob,
+                                void (*f)(void *env, const DNP3_PointChange *c),
+                                void *env)
+{
+    const DNP3_ObjectInfo *x = dnp3_object_info(ob->group, ob->variation);
+    int k = point_type(ob->group);
+    size_t changes = 0;
+
+    if(k < 0 || !x)
+        return 0;
+    dnp3_oblock_force(ob);
+    if(!ob->objects && !ob->columns)
+        return 0;                       // no object data
+    if(!ob->indexes && ob->rangespec > 5)
+        return 0;                       // objects without index
+
+    struct Outstation *os = outstation(db, addr, true);
+    if(!os)
+        return 0;
+    struct Points *pts = &os->pt[k];
+    bool event = (ob->group == types[k].event);
+
+    for(size_t i=0; i<ob->count; i++) {
+        uint32_t idx = ob->indexes ? ob->indexes[i] : ob->range_base + i;
+        if(idx >= MAXINDEX || !reserve(db->mm, pts, k, idx))
+            continue;
+
+        DNP3_Object o = dnp3_oblock_object(ob, i);
+        uint8_t bit = 1 << (idx % 8);
+        bool known = pts->known[idx / 8] & bit;
+        uint8_t flags = object_flags(x, &o, pts->flags[idx]);
+        bool changed = !known || flags != pts->flags[idx];
+
+        pts->flags[idx] = flags;
+        if(pts->value && x->value != OBJ_VAL_NONE) {
+            double v = object_value(x, &o);
+            changed = changed || v != pts->value[idx];
+            pts->value[idx] = v;
+        }
+        pts->known[idx / 8] |= bit;
+
+        if(changed || event) {
+            DNP3_PointChange c = {addr, ob->group, ob->variation, idx, o,
+                                  event};
+            if(f)
+                f(env, &c);
+            changes++;
+        }
+    }
+
+    return changes;
+}
+
+size_t dnp3_pointdb_apply(DNP3_PointDB *db, uint16_t addr,
+                          const DNP3_Fragment *frag,
+                          void (*f)(void *env, const DNP3_PointChange *c),
+                          void *env)
+{
+    size_t changes = 0;
+
+    if(frag->fc != DNP3_RESPONSE && frag->fc != DNP3_UNSOLICITED_RESPONSE)
+        return 0;
+    for(size_t i=0; i<frag->nblocks && frag->odata; i++)
+        changes += dnp3_pointdb_apply_block(db, addr, frag->odata[i], f, env);
+    return changes;
+}
+
+bool dnp3_pointdb_get(const DNP3_PointDB *db, uint16_t addr, DNP3_Group g,
+                      uint32_t index, uint8_t *flags, double *value)
+{
+    struct Outstation *os = outstation((DNP3_PointDB *)db, addr, false);
+    int k = point_type(g);
+
+    if(!os || k < 0 || index >= os->pt[k].n)
+        return false;
+
+    const struct Points *pts = &os->pt[k];
+    if(!(pts->known[index / 8] & (1 << (index % 8))))
+        return false;
+    if(flags)
+        *flags = pts->flags[index];
+    if(value)
+        *value = pts->value ? pts->value[index] : 0;
+    return true;
+}
+
+DNP3_PointDB *dnp3_pointdb_new(HAllocator *mm)
+{
+    if(!mm)
+        mm = h_system_allocator;
+
+    DNP3_PointDB *db = mm->alloc(mm, sizeof(DNP3_PointDB));
+    if(!db)
+        return NULL;
+    memset(db, 0, sizeof(DNP3_PointDB));
+    db->mm = mm;
+    return db;
+}
+
+void dnp3_pointdb_free(DNP3_PointDB *db)
+{
+    HAllocator *mm = db->mm;
+
+    for(size_t b=0; b<NBUCKETS; b++) {
+        struct Outstation *o;
+        while((o = db->tab[b])) {
+            db->tab[b] = o->next;
+            for(size_t k=0; k<NTYPES; k++) {
+                struct Points *pts = &o->pt[k];
+                if(pts->known) mm->free(mm, pts->known);
+                if(pts->flags) mm->free(mm, pts->flags);
+                if(pts->value) mm->free(mm, pts->value);
+            }
+            mm->free(mm, o);
+        }
+    }
+    mm->free(mm, db);
+}
@@ -0,0 +1,16 @@
+// point database, see points.c
+
+#ifndef DNP3_POINTS_H_SEEN
+#define DNP3_POINTS_H_SEEN
+
+#include <dnp3hammer.h>
+
+
+// apply a single object block, cf. dnp3_pointdb_apply
+size_t dnp3_pointdb_apply_block(DNP3_PointDB *db, uint16_t addr,
+                                const DNP3_ObjectBlock *ob,
+                                void (*f)(void *env, const DNP3_PointChange *c),
+                                void *env);
+
+
+#endif // DNP3_POINTS_H_SEEN
@@ -0,0 +1,216 @@
+// allocation profiling: an HAllocator that counts by dissector stage
+//
+// every block is preceded by its requested size, so frees and reallocs know
+// how much they give back. the counts are updated with relaxed atomics, so
+// the profiler can sit under allocators shared between threads (e.g.
+// mm_results of a dissector group); a snapshot is not taken atomically.
+
+#include <dnp3hammer.h>
+#include "hammer.h"     // h_system_allocator
+#include "out.h"
+#include "profile.h"
+
+#include <string.h>
+
+
+__thread unsigned dnp3_stage_ = DNP3_STAGE_OTHER;
+
+// NB: keeps the alignment of mm's blocks for any type
+#define HDR 16
+
+typedef struct {
+    HAllocator base;
+    HAllocator *mm;
+    DNP3_AllocProfile p;
+} Profiler;
+
+#define ADD(FIELD, N) __atomic_fetch_add(&(FIELD), (N), __ATOMIC_RELAXED)
+#define SUB(FIELD, N) __atomic_fetch_sub(&(FIELD), (N), __ATOMIC_RELAXED)
+
+static inline int size_bin(size_t n)
+{
+    int i = 0;
+    while(n > 1 && i < DNP3_STATS_NBINS-1) {
+        n >>= 1;
+        i++;
+    }
+    return i;
+}
+
+static void count_live(Profiler *prof, size_t n)
+{
+    uint64_t live = ADD(prof->p.live, n) + n;
+    uint64_t peak = __atomic_load_n(&prof->p.peak, __ATOMIC_RELAXED);
+
+    while(live > peak && !__atomic_compare_exchange_n(&prof->p.peak, &peak,
+                              live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// count a request of n bytes in the current stage
+static DNP3_AllocCounts *count_request(Profiler *prof, size_t n)
+{
+    unsigned stage = dnp3_stage_ & 0xFF;
+    DNP3_AllocCounts *c = &prof->p.stage[stage < DNP3_NSTAGES ? stage : 0];
+
+    ADD(c->bytes, n);
+    ADD(c->sizes[size_bin(n)], 1);
+    if(stage == DNP3_STAGE_OBJECTS)
+        ADD(prof->p.group_bytes[dnp3_stage_ >> 8 & 0xFF], n);
+    return c;
+}
+
+static void *prof_alloc(HAllocator *mm, size_t n)
+{
+    Profiler *prof = (Profiler *)mm;
+
+    ADD(count_request(prof, n)->allocs, 1);
+    uint8_t *p = prof->mm->alloc(prof->mm, HDR + n);
+    if(!p) {
+        ADD(prof->p.failed, 1);
+        return NULL;
+    }
+    memcpy(p, &n, sizeof n);
+    count_live(prof, n);
+    return p + HDR;
+}
+
+static void *prof_realloc(HAllocator *mm, void *q, size_t n)
+{
+    Profiler *prof = (Profiler *)mm;
+
+    if(!q)
+        return prof_alloc(mm, n);
+
+    uint8_t *p = (uint8_t *)q - HDR;
+    size_t old;
+    memcpy(&old, p, sizeof old);
+
+    ADD(count_request(prof, n)->reallocs, 1);
+    p = prof->mm->realloc(prof->mm, p, HDR + n);
+    if(!p) {
+        ADD(prof->p.failed, 1);
+        return NULL;
+    }
+    memcpy(p, &n, sizeof n);
+    SUB(prof->p.live, old);
+    count_live(prof, n);
+    return p + HDR;
+}
+
+static void prof_free(HAllocator *mm, void *q)
+{
+    Profiler *prof = (Profiler *)mm;
+    unsigned stage = dnp3_stage_ & 0xFF;
+
+    if(!q)
+        return;
+
+    uint8_t *p = (uint8_t *)q - HDR;
+    size_t n;
+    memcpy(&n, p, sizeof n);
+
+    ADD(prof->p.stage[stage < DNP3_NSTAGES ? stage : 0].frees, 1);
+    SUB(prof->p.live, n);
+    prof->mm->free(prof->mm, p);
+}
+
+HAllocator *h_profiler(HAllocator *mm)
+{
+    if(!mm)
+        mm = h_system_allocator;
+
+    Profiler *prof = mm->alloc(mm, sizeof(Profiler));
+    if(!prof)
+        return NULL;
+    memset(prof, 0, sizeof *prof);
+    prof->base.alloc = prof_alloc;
+    prof->base.realloc = prof_realloc;
+    prof->base.free = prof_free;
+    prof->mm = mm;
+
+    return &prof->base;
+}
+
+void h_profiler_get(HAllocator *mm, DNP3_AllocProfile *out)
+{
+    const uint64_t *p = (const uint64_t *)&((Profiler *)mm)->p;
+    uint64_t *q = (uint64_t *)out;
+
+    for(size_t i=0; i<sizeof(DNP3_AllocProfile)/sizeof(uint64_t); i++)
+        q[i] = __atomic_load_n(&p[i], __ATOMIC_RELAXED);
+}
+
+void h_profiler_reset(HAllocator *mm)
+{
+    Profiler *prof = (Profiler *)mm;
+    uint64_t *q = (uint64_t *)&prof->p;
+    uint64_t live = __atomic_load_n(&prof->p.live, __ATOMIC_RELAXED);
+
+    for(size_t i=0; i<sizeof(DNP3_AllocProfile)/sizeof(uint64_t); i++) {
+        if(&q[i] != &prof->p.live)
+            __atomic_store_n(&q[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&prof->p.peak, live, __ATOMIC_RELAXED);
+}
+
+void h_profiler_free(HAllocator *mm)
+{
+    Profiler *prof = (Profiler *)mm;
+
+    if(prof)
+        prof->mm->free(prof->mm, prof);
+}
+
+
+/// REPORT ///
+
+static const char *stage_names[DNP3_NSTAGES] = {
+    "other", "link", "transport", "app", "objects", "results"
+};
+
+static void report(Out *out, const DNP3_AllocProfile *p)
+{
+    appendf(out, "%-10s %10s %10s %10s %12s  %s\n", "stage", "allocs",
+            "reallocs", "frees", "bytes", "sizes (log2:count)");
+    for(int s=0; s<DNP3_NSTAGES; s++) {
+        const DNP3_AllocCounts *c = &p->stage[s];
+
+        if(c->allocs + c->reallocs + c->frees == 0)
+            continue;
+        appendf(out, "%-10s %10llu %10llu %10llu %12llu ", stage_names[s],
+                (unsigned long long)c->allocs,
+                (unsigned long long)c->reallocs,
+                (unsigned long long)c->frees,
+                (unsigned long long)c->bytes);
+        for(int i=0; i<DNP3_STATS_NBINS; i++) {
+            if(c->sizes[i])
+                appendf(out, " %d:%llu", i, (unsigned long long)c->sizes[i]);
+        }
+        put(out, "\n", 1);
+    }
+
+    bool any = false;
+    for(int g=0; g<256; g++) {
+        if(!p->group_bytes[g])
+            continue;
+        appendf(out, "%s g%d:%llu", any ? "" : "objects by group (bytes):",
+                g, (unsigned long long)p->group_bytes[g]);
+        any = true;
+    }
+    if(any)
+        put(out, "\n", 1);
+
+    appendf(out, "live %llu bytes, peak %llu, %llu failed\n",
+            (unsigned long long)p->live, (unsigned long long)p->peak,
+            (unsigned long long)p->failed);
+}
+
+int h_profiler_report(DNP3_FormatWriter write, void *env,
+                      const DNP3_AllocProfile *p)
+{
+    char chunk[CHUNK];
+    Out o_ = {chunk, CHUNK, .write=write, .env=env}, *out = &o_;
+
+    report(out, p);
+    return finish(out);
+}
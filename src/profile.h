@@ -0,0 +1,24 @@
+// dissector stages for allocation profiling (profile.c)
+
+#ifndef DNP3_PROFILE_H_SEEN
+#define DNP3_PROFILE_H_SEEN
+
+#include <dnp3hammer.h>
+
+// the calling thread's stage (low byte) and object group (high byte)
+extern __thread unsigned dnp3_stage_;
+
+// enter a stage; returns the previous one for dnp3_stage_leave
+static inline unsigned dnp3_stage_enter(DNP3_Stage s, DNP3_Group g)
+{
+    unsigned old = dnp3_stage_;
+    dnp3_stage_ = s | (unsigned)g << 8;
+    return old;
+}
+
+static inline void dnp3_stage_leave(unsigned old)
+{
+    dnp3_stage_ = old;
+}
+
+#endif // DNP3_PROFILE_H_SEEN
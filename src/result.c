@@ -0,0 +1,177 @@
+// owned copies of parse results
+//
+// a copied fragment is a single allocation holding, in this order, a small
+// header, the DNP3_Fragment, its auth data and MAC, its odata array, and then
+// every object block followed by its indexes, objects or columns, and
+// strings. so it can be kept around (or handed to another thread) and freed
+// in one go.
+// copies are reference counted, see dnp3_fragment_retain.
+
+#include <dnp3hammer.h>
+#include "hammer.h"
+#include "columns.h"    // dnp3_oblock_force
+#include "profile.h"    // dnp3_stage_enter
+#include "result.h"
+
+#include <assert.h>
+#include <string.h>
+
+
+#define ALIGN 8         // enough for double and DNP3_Time
+#define ROUND(n) (((n) + ALIGN-1) & ~(size_t)(ALIGN-1))
+
+static size_t coltype_size(DNP3_ColumnType t)
+{
+    switch(t) {
+    case DNP3_COL_INT32:    return sizeof(int32_t);
+    case DNP3_COL_UINT32:   return sizeof(uint32_t);
+    case DNP3_COL_FLOAT:    return sizeof(float);
+    case DNP3_COL_DOUBLE:   return sizeof(double);
+    default:                return 0;
+    }
+}
+
+// sizes of the arrays in a DNP3_Columns with n elements
+struct ColSizes {
+    size_t bits, flags, values, times;
+};
+
+static struct ColSizes col_sizes(const DNP3_Columns *c, size_t n)
+{
+    struct ColSizes s;
+
+    s.bits   = c->bits   ? (n * c->bitwidth + 7) / 8 : 0;
+    s.flags  = c->flags  ? n : 0;
+    s.values = c->values ? n * coltype_size(c->valuetype) : 0;
+    s.times  = c->times  ? n * sizeof(DNP3_Time) : 0;
+    return s;
+}
+
+static size_t oblock_size(const DNP3_ObjectBlock *ob)
+{
+    dnp3_oblock_force(ob);      // NB: before copy_oblock
+
+    size_t n = ROUND(sizeof(DNP3_ObjectBlock));
+
+    if(ob->indexes)
+        n += ROUND(ob->count * sizeof(uint32_t));
+    if(ob->objects) {
+        n += ROUND(ob->count * sizeof(DNP3_Object));
+        if(ob->group == DNP3_GROUP_APPL) {
+            for(size_t i=0; i<ob->count; i++)
+                n += ROUND(ob->objects[i].applid.len + 1);
+        }
+    }
+    if(ob->columns) {
+        struct ColSizes s = col_sizes(ob->columns, ob->count);
+        n += ROUND(sizeof(DNP3_Columns));
+        n += ROUND(s.bits) + ROUND(s.flags) + ROUND(s.values) + ROUND(s.times);
+    }
+    return n;
+}
+
+// carve n bytes off the block at *p; copy from src if given
+static void *take(uint8_t **p, size_t n, const void *src)
+{
+    void *q = *p;
+
+    if(src)
+        memcpy(q, src, n);
+    *p += ROUND(n);
+    return q;
+}
+
+static DNP3_ObjectBlock *copy_oblock(uint8_t **p, const DNP3_ObjectBlock *ob)
+{
+    DNP3_ObjectBlock *c = take(p, sizeof *ob, ob);
+
+    assert(!ob->lazy);
+
+    if(ob->indexes)
+        c->indexes = take(p, ob->count * sizeof(uint32_t), ob->indexes);
+    if(ob->objects) {
+        c->objects = take(p, ob->count * sizeof(DNP3_Object), ob->objects);
+        if(ob->group == DNP3_GROUP_APPL) {
+            for(size_t i=0; i<ob->count; i++) {
+                size_t len = ob->objects[i].applid.len;
+                char *s = take(p, len + 1, NULL);
+                memcpy(s, ob->objects[i].applid.str, len);
+                s[len] = '\0';
+                c->objects[i].applid.str = s;
+            }
+        }
+    }
+    if(ob->columns) {
+        const DNP3_Columns *col = ob->columns;
+        struct ColSizes s = col_sizes(col, ob->count);
+        DNP3_Columns *cc = c->columns = take(p, sizeof *col, col);
+
+        if(col->bits)   cc->bits   = take(p, s.bits, col->bits);
+        if(col->flags)  cc->flags  = take(p, s.flags, col->flags);
+        if(col->values) cc->values = take(p, s.values, col->values);
+        if(col->times)  cc->times  = take(p, s.times, col->times);
+    }
+    return c;
+}
+
+DNP3_Fragment *dnp3_fragment_copy(HAllocator *mm, const DNP3_Fragment *frag)
+{
+    if(!mm)
+        mm = h_system_allocator;
+
+    // pass 1: size
+    size_t size = ROUND(sizeof(struct Result));
+    if(frag->auth)
+        size += ROUND(sizeof(DNP3_AuthData)) + ROUND(frag->auth->maclen);
+    if(frag->odata)
+        size += ROUND(frag->nblocks * sizeof(DNP3_ObjectBlock *));
+    for(size_t i=0; i<frag->nblocks && frag->odata; i++)
+        size += oblock_size(frag->odata[i]);
+
+    unsigned st = dnp3_stage_enter(DNP3_STAGE_RESULTS, 0);
+    struct Result *r = mm->alloc(mm, size);
+    dnp3_stage_leave(st);
+    if(!r)
+        return NULL;
+
+    // pass 2: copy
+    uint8_t *p = (uint8_t *)r + ROUND(sizeof(struct Result));
+    r->mm = mm;
+    r->refs = 1;
+    r->frag = *frag;
+    if(frag->auth) {
+        DNP3_AuthData *a = take(&p, sizeof(DNP3_AuthData), frag->auth);
+        a->mac = take(&p, a->maclen, a->mac);
+        r->frag.auth = a;
+    }
+    if(frag->odata) {
+        r->frag.odata = take(&p, frag->nblocks * sizeof(DNP3_ObjectBlock *),
+                             NULL);
+        for(size_t i=0; i<frag->nblocks; i++)
+            r->frag.odata[i] = copy_oblock(&p, frag->odata[i]);
+    }
+    assert(p == (uint8_t *)r + size);
+
+    return &r->frag;
+}
+
+DNP3_Fragment *dnp3_fragment_retain(const DNP3_Fragment *frag)
+{
+    struct Result *r = RESULT_OF(frag);
+
+    if(__atomic_load_n(&r->refs, __ATOMIC_RELAXED) == 0)
+        return dnp3_fragment_copy(r->mm, frag);     // transient
+
+    __atomic_add_fetch(&r->refs, 1, __ATOMIC_RELAXED);
+    return &r->frag;
+}
+
+void dnp3_fragment_release(DNP3_Fragment *frag)
+{
+    if(frag) {
+        struct Result *r = RESULT_OF(frag);
+        assert(r->refs > 0);
+        if(__atomic_sub_fetch(&r->refs, 1, __ATOMIC_ACQ_REL) == 0)
+            r->mm->free(r->mm, r);
+    }
+}
@@ -0,0 +1,21 @@
+// owned copies of parse results (see result.c)
+
+#ifndef DNP3_RESULT_H_SEEN
+#define DNP3_RESULT_H_SEEN
+
+#include <dnp3hammer.h>
+#include <stddef.h>     // offsetof
+
+
+// every fragment passed to app_fragment() is preceded by this header, so
+// dnp3_fragment_retain() can tell a copy from a transient parse result.
+// the dissector wraps its transient results in one on the stack (refs = 0).
+struct Result {
+    HAllocator *mm;     // allocator of the copy, or to copy into
+    int refs;           // 0 = transient
+    DNP3_Fragment frag;
+};
+#define RESULT_OF(f) \
+    ((struct Result *)((uint8_t *)(f) - offsetof(struct Result, frag)))
+
+#endif // DNP3_RESULT_H_SEEN
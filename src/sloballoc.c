@@ -1,171 +1,391 @@
-// first-fit SLOB (simple list of blocks) allocator
+// SLOB (simple list of blocks) allocator with segregated free lists
+//
+// every block starts with a header holding its size and two flags: whether
+// the block itself is free and whether its left neighbour is. free blocks
+// also repeat their size at the end (the boundary tag), so both neighbours
+// of a block are found in constant time.
+//
+// free blocks are kept in doubly-linked lists, one per power-of-two size
+// class, with a bitmap of the non-empty lists. allocation takes the first
+// block of the smallest class that is guaranteed to fit, so it is O(1).
+// only when no such class is available, the class of the request itself
+// is scanned first-fit, as a last resort before failing.
+//
+// the data of every block is aligned to SLOBALIGN, its header just before
+// it. so sizes (of data) are rounded to a multiple of SLOBALIGN less a
+// header, and the data area starts and ends a header short of an aligned
+// address.
 
 #include "sloballoc.h"
 #include <stdint.h>
 #include <assert.h>
+#include <string.h>
+
+#define SIZEBITS (sizeof(size_t) * 8)
+
+// flags in the top bits of the header
+#define FREE     ((size_t)1 << (SIZEBITS-1))    // block is free
+#define PREVFREE ((size_t)1 << (SIZEBITS-2))    // left neighbour is free
+#define FLAGS    (FREE | PREVFREE)
 
 struct alloc {
-    size_t size;
+    size_t size;        // size of data, plus flags
     uint8_t data[];
 };
 
 struct block {
     struct alloc alloc;
     struct block *next;
+    struct block *prev;
+    // ... size_t tag at the end of data
 };
 
+#define ALIGN SLOBALIGN
+#define ROUND(n) ((((n) + sizeof(struct alloc) + ALIGN-1) & ~(ALIGN-1)) \
+                  - sizeof(struct alloc))
+
+// minimum size of data, so any block can be turned into a free block
+#define MINSIZE \
+    ROUND(sizeof(struct block) - sizeof(struct alloc) + sizeof(size_t))
+
 struct slob {
-    size_t size;
-    struct block *head;
-    uint8_t data[];
+    size_t size;        // size of the data area
+    size_t map;         // bit i set iff bin[i] is non-empty
+    unsigned nbins;
+    uint8_t *data;
+    struct block *bin[];
+    // ... then data
 };
 
 
+static inline size_t bsize(const struct alloc *a)
+{
+    return a->size & ~FLAGS;
+}
+
+static inline void *end(SLOB *slob)
+{
+    return slob->data + slob->size;
+}
+
+static inline struct alloc *right_of(struct alloc *a)
+{
+    return (struct alloc *)(a->data + bsize(a));
+}
+
+static inline size_t *tag(struct alloc *a)
+{
+    return (size_t *)(a->data + bsize(a)) - 1;
+}
+
+// helper: floor(log2(x)); x > 0
+static inline unsigned log2floor(size_t x)
+{
+#ifdef __GNUC__
+    return sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(x);
+#else
+    unsigned k = 0;
+    while(x >>= 1) k++;
+    return k;
+#endif
+}
+
+// size classes are powers of two counted from MINSIZE, so the smallest
+// blocks, which are the most common, get an exact class of their own:
+// class k holds the sizes MINSIZE + [2^k - 1, 2^(k+1) - 1).
+static inline unsigned size_class(size_t size)
+{
+    assert(size >= MINSIZE);
+    return log2floor(size - MINSIZE + 1);
+}
+
+// smallest class whose blocks all have at least the given size
+static inline unsigned fit_class(size_t size)
+{
+    size_t x = size - MINSIZE + 1;
+    unsigned k = log2floor(x);
+    return (x & (x - 1)) ? k+1 : k;
+}
+
+static void link_block(SLOB *slob, struct block *b)
+{
+    unsigned k = size_class(bsize(&b->alloc));
+
+    assert(k < slob->nbins);
+    b->prev = NULL;
+    b->next = slob->bin[k];
+    if(b->next)
+        b->next->prev = b;
+    slob->bin[k] = b;
+    slob->map |= (size_t)1 << k;
+}
+
+static void unlink_block(SLOB *slob, struct block *b)
+{
+    unsigned k = size_class(bsize(&b->alloc));
+
+    if(b->prev)
+        b->prev->next = b->next;
+    else
+        slob->bin[k] = b->next;
+    if(b->next)
+        b->next->prev = b->prev;
+    if(!slob->bin[k])
+        slob->map &= ~((size_t)1 << k);
+}
+
+// helper: set the flag on the right neighbour of a, if there is one
+static inline void set_prevfree(SLOB *slob, struct alloc *a, int free)
+{
+    struct alloc *r = right_of(a);
+
+    if((void *)r == end(slob))
+        return;
+    if(free)
+        r->size |= PREVFREE;
+    else
+        r->size &= ~PREVFREE;
+}
+
+// helper: mark a block free and put it on its list
+static inline void make_free(SLOB *slob, struct block *b, size_t size)
+{
+    b->alloc.size = (b->alloc.size & PREVFREE) | FREE | size;
+    *tag(&b->alloc) = size;
+    link_block(slob, b);
+}
+
+
 SLOB *slobinit(void *mem, size_t size)
 {
     SLOB *slob = mem;
+    size_t hdr;
+    unsigned nbins;
 
-    assert(size >= sizeof(SLOB) + sizeof(struct block));
     assert(size < UINTPTR_MAX - (uintptr_t)mem);
 
-    slob = mem;
-    slob->size = size - sizeof(SLOB);
-    slob->head = mem + sizeof(SLOB);
-    slob->head->alloc.size = slob->size - sizeof(struct alloc);
-    slob->head->next = NULL;
+    // one bin per size class that can occur in the area
+    if(size < sizeof(SLOB))
+        return NULL;
+    nbins = log2floor(size) + 1;
+    if(nbins > SIZEBITS - 2)
+        nbins = SIZEBITS - 2;   // the top 2 bits are flags
+    hdr = sizeof(SLOB) + nbins * sizeof(struct block *);
+
+    // place the data area, see above
+    uintptr_t base = (uintptr_t)mem;
+    uintptr_t start = ((base + hdr + sizeof(struct alloc) + ALIGN-1)
+                       & ~(uintptr_t)(ALIGN-1)) - sizeof(struct alloc);
+    if(start + sizeof(struct alloc) + MINSIZE > base + size)
+        return NULL;
+    size_t dsize = (base + size - start) & ~(size_t)(ALIGN-1);
+
+    slob->size = dsize;
+    slob->map = 0;
+    slob->nbins = nbins;
+    slob->data = (uint8_t *)start;
+    memset(slob->bin, 0, nbins * sizeof(struct block *));
+
+    struct block *b = (struct block *)slob->data;
+    b->alloc.size = 0;
+    make_free(slob, b, slob->size - sizeof(struct alloc));
 
     return slob;
 }
 
+size_t slobmax(SLOB *slob)
+{
+    return slob->size - sizeof(struct alloc);
+}
+
 void *sloballoc(SLOB *slob, size_t size)
 {
-    struct block *b, **p;
-    size_t fitblock, remblock;
-
-    // size must be enough to extend to a struct block in case of free
-    fitblock = sizeof(struct block) - sizeof(struct alloc);
-    if(size < fitblock) size = fitblock;
-
-    // need this much to fit another block in the remaining space
-    remblock = size + sizeof(struct block);
-    if(remblock < size) return NULL;    // overflow
-
-    // scan list for the first block of sufficient size
-    for(p=&slob->head; (b=*p); p=&b->next) {
-        if(b->alloc.size >= remblock) {
-            // cut from the end of the block
-            b->alloc.size -= sizeof(struct alloc) + size;
-            struct alloc *a = (void *)b->alloc.data + b->alloc.size;
-            a->size = size;
-            return a->data;
-        } else if(b->alloc.size >= size) {
-            // when a block fills, it converts directly to a struct alloc
-            *p = b->next;       // unlink
-            return b->alloc.data;
+    struct block *b = NULL;
+    unsigned k;
+
+    // size must be enough to extend to a free block on free
+    if(size < MINSIZE) size = MINSIZE;
+    if(size > slobmax(slob)) return NULL;
+    size = ROUND(size);     // NB: still <= slobmax
+
+    // take the first block of the smallest class that surely fits
+    k = fit_class(size);
+    if(k < slob->nbins) {
+        size_t m = slob->map & ~(((size_t)1 << k) - 1);
+        if(m) {
+#ifdef __GNUC__
+            k = __builtin_ctzll(m);
+#else
+            for(k=0; !(m & 1); m>>=1) k++;
+#endif
+            b = slob->bin[k];
         }
     }
 
-    return NULL;
+    // otherwise, search the class of size itself
+    if(!b) {
+        for(b = slob->bin[size_class(size)]; b; b = b->next)
+            if(bsize(&b->alloc) >= size)
+                break;
+        if(!b)
+            return NULL;
+    }
+
+    size_t bs = bsize(&b->alloc);
+    unlink_block(slob, b);
+    if(bs >= size + sizeof(struct alloc) + MINSIZE) {
+        // cut from the end of the block; b remains free
+        size_t rest = bs - sizeof(struct alloc) - size;
+        make_free(slob, b, rest);
+        struct alloc *a = right_of(&b->alloc);
+        a->size = PREVFREE | size;
+        set_prevfree(slob, a, 0);
+        return a->data;
+    } else {
+        // use the whole block
+        b->alloc.size &= ~FREE;
+        set_prevfree(slob, &b->alloc, 0);
+        return b->alloc.data;
+    }
 }
 
 void slobfree(SLOB *slob, void *a_)
 {
-    struct alloc *a = a_ - sizeof(struct alloc);
-    struct block *b, **p, *left=NULL, *right=NULL, **rightp;
+    struct alloc *a = (struct alloc *)((uint8_t *)a_ - sizeof(struct alloc));
+    struct alloc *r;
+    size_t size;
 
-    // sanity check: a lies inside slob
-    assert((void *)a >= (void *)slob->data);
-    assert((void *)a->data + a->size <= (void *)slob->data + slob->size);
+    // sanity check: a lies inside slob and is allocated
+    assert((uint8_t *)a >= slob->data);
+    assert((void *)right_of(a) <= end(slob));
+    assert(!(a->size & FREE));
 
-    // scan list for blocks adjacent to a
-    for(p=&slob->head; (b=*p); p=&b->next) {
-        if((void *)a == b->alloc.data + b->alloc.size) {
-            assert(!left);
-            left = b;
-        }
-        if((void *)a->data + a->size == b) {
-            assert(!right);
-            right = b;
-            rightp = p;
-        }
+    size = bsize(a);
 
-        if(left && right) {
-            // extend left and unlink right
-            left->alloc.size += sizeof(*a) + a->size +
-                                sizeof(right->alloc) + right->alloc.size;
-            *rightp = right->next;
-            return;
-        }
+    // absorb the right neighbour
+    r = right_of(a);
+    if((void *)r != end(slob) && (r->size & FREE)) {
+        unlink_block(slob, (struct block *)r);
+        size += sizeof(struct alloc) + bsize(r);
     }
 
-    if(left) {
-        // extend left to absorb a
-        left->alloc.size += sizeof(*a) + a->size;
-    } else if(right) {
-        // shift and extend right to absorb a
-        right->alloc.size += sizeof(*a) + a->size;
-        *rightp = (struct block *)a; **rightp = *right;
-    } else {
-        // spawn new block over a
-        struct block *b = (struct block *)a;
-        b->next = slob->head; slob->head = b;
+    // merge into the left neighbour
+    if(a->size & PREVFREE) {
+        size_t lsize = *((size_t *)a - 1);
+        struct alloc *l = (struct alloc *)((uint8_t *)a - lsize) - 1;
+
+        assert(l->size & FREE);
+        assert(bsize(l) == lsize);
+        unlink_block(slob, (struct block *)l);
+        size += sizeof(struct alloc) + lsize;
+        a = l;
     }
+
+    make_free(slob, (struct block *)a, size);
+    set_prevfree(slob, a, 1);
 }
 
 int slobcheck(SLOB *slob)
 {
     // invariants:
     // 1. memory area is divided seamlessly and exactly into n blocks
-    // 2. every block is large enough to hold a 'struct block'.
-    // 3. free list has at most n elements.
-    // 4. every element of the free list is one of the valid blocks.
-    // 5. every block appears at most once in the free list.
+    // 2. every block is large enough to hold a free block.
+    // 3. the flags of every block match its left neighbour.
+    // 4. no two free blocks are adjacent.
+    // 5. every free block carries its size in its boundary tag.
+    // 6. every list element is a free block of the list's size class.
+    // 7. the bitmap marks exactly the non-empty lists.
+    // 8. lists are properly linked and hold every free block exactly once.
+    // 9. the data of every block is aligned to ALIGN.
 
-    void *p;
-    size_t nblocks=0, nfree=0;
+    uint8_t *p;
+    size_t nblocks=0, nfree=0, nlisted=0;
+    int prevfree = 0;
 
     #define FORBLOCKS \
         for(p = slob->data; \
-            p != slob->data + slob->size; \
-            p += sizeof(struct alloc) + ((struct alloc *)p)->size)
+            p != (uint8_t *)end(slob); \
+            p += sizeof(struct alloc) + bsize((struct alloc *)p))
 
     // 1. memory area is divided seamlessly and exactly into n blocks
     FORBLOCKS {
-        if(p < (void *)slob->data)
+        if(p < slob->data)
             return 1;
-        if(p > (void *)slob->data + slob->size)
+        if(p > (uint8_t *)end(slob) - sizeof(struct alloc))
             return 2;
         nblocks++;
 
-        struct alloc *a = p;
-        if(a->size > UINTPTR_MAX - (uintptr_t)p)
+        struct alloc *a = (struct alloc *)p;
+        if(bsize(a) > (size_t)((uint8_t *)end(slob) - a->data))
             return 3;
 
-        // 2. every block is large enough to hold a 'struct block'.
-        if(a->size + sizeof(struct alloc) < sizeof(struct block))
+        // 2. every block is large enough to hold a free block.
+        if(bsize(a) < MINSIZE)
             return 4;
-    }
 
-    // 3. free list has at most n elements.
-    for(struct block *b=slob->head; b; b=b->next) {
-        nfree++;
-        if(nfree > nblocks)
+        // 9. the data of every block is aligned to ALIGN.
+        if((uintptr_t)a->data % ALIGN != 0)
+            return 16;
+
+        // 3. the flags of every block match its left neighbour.
+        if(!!(a->size & PREVFREE) != prevfree)
             return 5;
 
-        // 4. every element of the free list is one of the valid blocks.
-        FORBLOCKS
-            if(p == b) break;
-        if(!p)
-            return 6;
+        if(a->size & FREE) {
+            // 4. no two free blocks are adjacent.
+            if(prevfree)
+                return 6;
+
+            // 5. every free block carries its size in its boundary tag.
+            if(*tag(a) != bsize(a))
+                return 7;
+            nfree++;
+        }
+        prevfree = !!(a->size & FREE);
+    }
+
+    for(unsigned k=0; k<slob->nbins; k++) {
+        struct block *prev = NULL;
+
+        // 7. the bitmap marks exactly the non-empty lists.
+        if(!!(slob->map & ((size_t)1 << k)) != !!slob->bin[k])
+            return 8;
+
+        for(struct block *b=slob->bin[k]; b; prev=b, b=b->next) {
+            // 8. lists hold every free block exactly once.
+            if(++nlisted > nfree)
+                return 9;
+
+            // 6. every list element is a free block of the right class.
+            FORBLOCKS
+                if(p == (uint8_t *)b) break;
+            if(p == (uint8_t *)end(slob))
+                return 10;
+            if(!(b->alloc.size & FREE))
+                return 11;
+            if(size_class(bsize(&b->alloc)) != k)
+                return 12;
+
+            // 8. lists are properly linked.
+            if(b->prev != prev)
+                return 13;
+        }
     }
+    if(slob->nbins < SIZEBITS && (slob->map >> slob->nbins))
+        return 8;
 
-    // 5. every block appears at most once in the free list.
+    // 8. lists hold every free block exactly once.
+    // (each listed block is free and the counts match, so with no
+    // duplicates every free block is listed.)
+    if(nlisted != nfree)
+        return 14;
     FORBLOCKS {
         size_t count=0;
-        for(struct block *b=slob->head; b; b=b->next)
-            if(p == b) count++;
+        for(unsigned k=0; k<slob->nbins; k++)
+            for(struct block *b=slob->bin[k]; b; b=b->next)
+                if(p == (uint8_t *)b) count++;
         if(count > 1)
-            return 7;
+            return 15;
     }
 
     #undef FORBLOCKS
@@ -5,10 +5,21 @@
 
 typedef struct slob SLOB;
 
+// every allocation is aligned for any type, like malloc's
+struct slob_align_ {
+    char c;
+    union { long double ld; long long ll; void *p; void (*f)(void); } u;
+};
+#define SLOBALIGN offsetof(struct slob_align_, u)
+
+// mem must be aligned for a pointer; blocks are aligned to SLOBALIGN
 SLOB *slobinit(void *mem, size_t size);
 void *sloballoc(SLOB *slob, size_t size);
 void slobfree(SLOB *slob, void *p);
 
+// size of the largest possible allocation, i.e. of the initial free block
+size_t slobmax(SLOB *slob);
+
 // consistency check (verify internal invariants); returns 0 on success
 int slobcheck(SLOB *slob);
 
@@ -0,0 +1,142 @@
+// global parser tables
+//
+// all global parsers are allocated through a tracking allocator (dnp3_p_mm)
+// that keeps its blocks on a list, so dnp3_free() can release them in one
+// go. the grammar code builds them with the __m combinators on dnp3_p_mm
+// (see tables.h); the system allocator is never touched, so other users of
+// hammer in the process are not affected. tables that are filled in on
+// first use are built the same way, see dnp3_p_lazy().
+
+#include <dnp3hammer.h>
+#include "hammer.h"     // h_system_allocator
+#include "tables.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+
+
+// every tracked allocation is preceded by one of these
+struct Block {
+    struct Block *prev, *next;
+    size_t size;
+};
+#define HDR ((sizeof(struct Block) + 15) & ~(size_t)15)
+#define BLOCK_OF(p) ((struct Block *)((uint8_t *)(p) - HDR))
+
+static struct Block *blocks;
+static size_t nbytes;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t build_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void link_block(struct Block *b, size_t size)
+{
+    b->size = size;
+    b->prev = NULL;
+    b->next = blocks;
+    if(blocks)
+        blocks->prev = b;
+    blocks = b;
+    nbytes += size;
+}
+
+static void unlink_block(struct Block *b)
+{
+    if(b->prev)
+        b->prev->next = b->next;
+    else
+        blocks = b->next;
+    if(b->next)
+        b->next->prev = b->prev;
+    nbytes -= b->size;
+}
+
+static void *track_alloc(HAllocator *self, size_t size)
+{
+    HAllocator *mm = h_system_allocator;
+    struct Block *b = mm->alloc(mm, HDR + size);
+
+    if(!b)
+        return NULL;
+    pthread_mutex_lock(&blocks_lock);
+    link_block(b, size);
+    pthread_mutex_unlock(&blocks_lock);
+    return (uint8_t *)b + HDR;
+}
+
+static void *track_realloc(HAllocator *self, void *p, size_t size)
+{
+    HAllocator *mm = h_system_allocator;
+
+    if(!p)
+        return track_alloc(self, size);
+
+    struct Block *b = BLOCK_OF(p);
+    pthread_mutex_lock(&blocks_lock);
+    unlink_block(b);
+    struct Block *nb = mm->realloc(mm, b, HDR + size);
+    if(nb)
+        b = nb;
+    link_block(b, nb ? size : b->size);
+    pthread_mutex_unlock(&blocks_lock);
+    return nb ? (uint8_t *)nb + HDR : NULL;
+}
+
+static void track_free(HAllocator *self, void *p)
+{
+    HAllocator *mm = h_system_allocator;
+
+    if(!p)
+        return;
+
+    struct Block *b = BLOCK_OF(p);
+    pthread_mutex_lock(&blocks_lock);
+    unlink_block(b);
+    pthread_mutex_unlock(&blocks_lock);
+    mm->free(mm, b);
+}
+
+static HAllocator tracker = {track_alloc, track_realloc, track_free};
+HAllocator *dnp3_p_mm = &tracker;
+
+
+void dnp3_tables_free(void)
+{
+    HAllocator *mm = h_system_allocator;
+    struct Block *b;
+
+    pthread_mutex_lock(&blocks_lock);
+    while((b = blocks)) {
+        unlink_block(b);
+        mm->free(mm, b);
+    }
+    assert(nbytes == 0);
+    pthread_mutex_unlock(&blocks_lock);
+}
+
+size_t dnp3_table_size(void)
+{
+    pthread_mutex_lock(&blocks_lock);
+    size_t n = nbytes;
+    pthread_mutex_unlock(&blocks_lock);
+    return n;
+}
+
+HParser *dnp3_p_lazy(HParser **slot, HParser *(*build)(void *env, size_t i),
+                     void *env, size_t i)
+{
+    HParser *p = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+    if(p)
+        return p;
+
+    pthread_mutex_lock(&build_lock);
+    p = *slot;
+    if(!p) {
+        p = build(env, i);
+        __atomic_store_n(slot, p, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&build_lock);
+    return p;
+}
@@ -0,0 +1,76 @@
+// global parser tables, see tables.c
+
+#ifndef DNP3_TABLES_H_SEEN
+#define DNP3_TABLES_H_SEEN
+
+#include <stddef.h>
+#include <hammer/hammer.h>
+#include <hammer/glue.h>
+#include "hammer.h"
+
+// allocator for all global parsers.
+// everything taken from it is released by dnp3_free().
+extern HAllocator *dnp3_p_mm;
+
+// release everything allocated through dnp3_p_mm
+void dnp3_tables_free(void);
+
+// return *slot, building it with build(env, i) first if it is NULL.
+// safe to call from any number of threads; build runs at most once per
+// slot, under a lock, and should allocate from dnp3_p_mm.
+HParser *dnp3_p_lazy(HParser **slot, HParser *(*build)(void *env, size_t i),
+                     void *env, size_t i);
+
+// the grammar is built from the plain combinators (and the glue.h rule
+// macros on top of them) in any file that includes this header; make
+// them all allocate from dnp3_p_mm.
+//
+// NB: these only catch calls. passing a combinator by name (as a function
+//     pointer) takes the plain version; use the __m one explicitly there.
+#define h_token(...)        h_token__m(dnp3_p_mm, __VA_ARGS__)
+#define h_ch(...)           h_ch__m(dnp3_p_mm, __VA_ARGS__)
+#define h_ch_range(...)     h_ch_range__m(dnp3_p_mm, __VA_ARGS__)
+#define h_int_range(...)    h_int_range__m(dnp3_p_mm, __VA_ARGS__)
+#define h_bits(...)         h_bits__m(dnp3_p_mm, __VA_ARGS__)
+#define h_with_endianness(...) h_with_endianness__m(dnp3_p_mm, __VA_ARGS__)
+#define h_left(...)         h_left__m(dnp3_p_mm, __VA_ARGS__)
+#define h_right(...)        h_right__m(dnp3_p_mm, __VA_ARGS__)
+#define h_middle(...)       h_middle__m(dnp3_p_mm, __VA_ARGS__)
+#define h_action(...)       h_action__m(dnp3_p_mm, __VA_ARGS__)
+#define h_in(...)           h_in__m(dnp3_p_mm, __VA_ARGS__)
+#define h_not_in(...)       h_not_in__m(dnp3_p_mm, __VA_ARGS__)
+#define h_many(...)         h_many__m(dnp3_p_mm, __VA_ARGS__)
+#define h_many1(...)        h_many1__m(dnp3_p_mm, __VA_ARGS__)
+#define h_repeat_n(...)     h_repeat_n__m(dnp3_p_mm, __VA_ARGS__)
+#define h_optional(...)     h_optional__m(dnp3_p_mm, __VA_ARGS__)
+#define h_ignore(...)       h_ignore__m(dnp3_p_mm, __VA_ARGS__)
+#define h_sepBy(...)        h_sepBy__m(dnp3_p_mm, __VA_ARGS__)
+#define h_length_value(...) h_length_value__m(dnp3_p_mm, __VA_ARGS__)
+#define h_attr_bool(...)    h_attr_bool__m(dnp3_p_mm, __VA_ARGS__)
+#define h_and(...)          h_and__m(dnp3_p_mm, __VA_ARGS__)
+#define h_not(...)          h_not__m(dnp3_p_mm, __VA_ARGS__)
+#define h_bind_indirect(...) h_bind_indirect__m(dnp3_p_mm, __VA_ARGS__)
+#define h_bind(...)         h_bind__m(dnp3_p_mm, __VA_ARGS__)
+#define h_put_value(...)    h_put_value__m(dnp3_p_mm, __VA_ARGS__)
+#define h_get_value(...)    h_get_value__m(dnp3_p_mm, __VA_ARGS__)
+#define h_aligned(...)      h_aligned__m(dnp3_p_mm, __VA_ARGS__)
+#define h_unit(...)         h_unit__m(dnp3_p_mm, __VA_ARGS__)
+#define h_error(...)        h_error__m(dnp3_p_mm, __VA_ARGS__)
+#define h_sequence(...)     h_sequence__m(dnp3_p_mm, __VA_ARGS__)
+#define h_choice(...)       h_choice__m(dnp3_p_mm, __VA_ARGS__)
+#define h_int64()           h_int64__m(dnp3_p_mm)
+#define h_int32()           h_int32__m(dnp3_p_mm)
+#define h_int16()           h_int16__m(dnp3_p_mm)
+#define h_int8()            h_int8__m(dnp3_p_mm)
+#define h_uint64()          h_uint64__m(dnp3_p_mm)
+#define h_uint32()          h_uint32__m(dnp3_p_mm)
+#define h_uint16()          h_uint16__m(dnp3_p_mm)
+#define h_uint8()           h_uint8__m(dnp3_p_mm)
+#define h_end_p()           h_end_p__m(dnp3_p_mm)
+#define h_nothing_p()       h_nothing_p__m(dnp3_p_mm)
+#define h_epsilon_p()       h_epsilon_p__m(dnp3_p_mm)
+#define h_indirect()        h_indirect__m(dnp3_p_mm)
+#define h_float32()         h_float32__m(dnp3_p_mm)
+#define h_float64()         h_float64__m(dnp3_p_mm)
+
+#endif // DNP3_TABLES_H_SEEN
@@ -0,0 +1,265 @@
+// thread-local allocator: every thread allocates from its own slabs,
+// frees from other threads go back through a lock-free list
+
+#include <dnp3hammer.h>
+#include "hammer.h"
+#include "sloballoc.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+
+#define ALIGN sizeof(void *)
+#define ROUND(n) (((n) + ALIGN-1) & ~(ALIGN-1))
+#define DEFAULT_SLABSIZE (256 * 1024)
+
+struct heap;
+
+// a slab is a SLOB area owned by one heap
+struct slab {
+    struct slab *next;
+    struct heap *heap;
+    // ... then the SLOB
+};
+#define SLAB_SLOB(s) ((SLOB *)((uint8_t *)(s) + ROUND(sizeof(struct slab))))
+
+// every allocation is preceded by its slab (NULL if taken from mm directly)
+// and its size. while a block is on a remote free list, its first word
+// links to the next one.
+struct hdr {
+    struct slab *slab;
+    size_t size;
+};
+#define HDR ROUND(sizeof(struct hdr))
+#define HDR_OF(p) ((struct hdr *)((uint8_t *)(p) - HDR))
+
+// XXX empty slabs are kept for reuse, never returned to mm
+struct heap {
+    struct heap *next;          // all heaps of the allocator
+    struct slab *slabs;
+    void *remote;               // frees from other threads (MPSC stack)
+    int abandoned;              // owning thread has exited
+};
+
+typedef struct {
+    HAllocator base;
+    HAllocator *mm;             // source of slabs, must be thread-safe
+    size_t slabsize;
+    pthread_key_t key;          // the calling thread's heap
+    pthread_mutex_t lock;       // protects heaps
+    struct heap *heaps;
+} TLAlloc;
+
+
+// push a block onto the remote free list of its heap (any thread)
+static void push_remote(struct heap *h, void *p)
+{
+    void *head = __atomic_load_n(&h->remote, __ATOMIC_RELAXED);
+
+    do {
+        *(void **)p = head;
+    } while(!__atomic_compare_exchange_n(&h->remote, &head, p, true,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// take back all blocks freed by other threads (owning thread only)
+// NB: the consumer takes the whole list at once, so there is no ABA.
+static void drain_remote(struct heap *h)
+{
+    void *p = __atomic_exchange_n(&h->remote, NULL, __ATOMIC_ACQUIRE);
+
+    while(p) {
+        void *next = *(void **)p;
+        struct hdr *b = HDR_OF(p);
+        slobfree(SLAB_SLOB(b->slab), b);
+        p = next;
+    }
+}
+
+static void heap_exit(void *arg)
+{
+    struct heap *h = arg;
+
+    // blocks can still come in, the next thread to adopt h will get them
+    drain_remote(h);
+    __atomic_store_n(&h->abandoned, 1, __ATOMIC_RELEASE);
+}
+
+// the calling thread's heap; adopts an abandoned heap or makes a new one
+static struct heap *get_heap(TLAlloc *a)
+{
+    struct heap *h = pthread_getspecific(a->key);
+    if(h)
+        return h;
+
+    pthread_mutex_lock(&a->lock);
+    for(h = a->heaps; h; h = h->next) {
+        if(__atomic_load_n(&h->abandoned, __ATOMIC_ACQUIRE)) {
+            h->abandoned = 0;
+            break;
+        }
+    }
+    if(!h) {
+        h = a->mm->alloc(a->mm, sizeof(struct heap));
+        if(h) {
+            h->slabs = NULL;
+            h->remote = NULL;
+            h->abandoned = 0;
+            h->next = a->heaps;
+            a->heaps = h;
+        }
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    if(h && pthread_setspecific(a->key, h) != 0) {
+        __atomic_store_n(&h->abandoned, 1, __ATOMIC_RELEASE);
+        h = NULL;
+    }
+    return h;
+}
+
+static void *tl_alloc(HAllocator *mm, size_t size)
+{
+    TLAlloc *a = (TLAlloc *)mm;
+    struct heap *h;
+    struct hdr *b = NULL;
+    size_t n = HDR + ROUND(size);
+    struct slab *s;
+
+    if(n < size)
+        return NULL;    // overflow
+
+    // large allocations come from mm directly
+    if(n > a->slabsize / 2) {
+        b = a->mm->alloc(a->mm, n);
+        if(!b)
+            return NULL;
+        b->slab = NULL;
+        b->size = size;
+        return (uint8_t *)b + HDR;
+    }
+
+    if(!(h = get_heap(a)))
+        return NULL;
+    drain_remote(h);
+
+    for(s = h->slabs; s; s = s->next)
+        if((b = sloballoc(SLAB_SLOB(s), n)))
+            break;
+
+    if(!b) {
+        s = a->mm->alloc(a->mm, a->slabsize);
+        if(!s)
+            return NULL;
+        s->heap = h;
+        s->next = h->slabs;
+        SLOB *slob = slobinit(SLAB_SLOB(s),
+                              a->slabsize - ROUND(sizeof(struct slab)));
+        assert(slob == SLAB_SLOB(s));
+        h->slabs = s;
+        b = sloballoc(slob, n);
+        assert(b);
+    }
+
+    b->slab = s;
+    b->size = size;
+    return (uint8_t *)b + HDR;
+}
+
+static void tl_free(HAllocator *mm, void *p)
+{
+    TLAlloc *a = (TLAlloc *)mm;
+
+    if(!p)
+        return;
+
+    struct hdr *b = HDR_OF(p);
+    if(!b->slab) {
+        a->mm->free(a->mm, b);
+        return;
+    }
+
+    struct heap *h = b->slab->heap;
+    if(h == pthread_getspecific(a->key))
+        slobfree(SLAB_SLOB(b->slab), b);
+    else
+        push_remote(h, p);
+}
+
+static void *tl_realloc(HAllocator *mm, void *p, size_t size)
+{
+    if(!p)
+        return tl_alloc(mm, size);
+
+    size_t old = HDR_OF(p)->size;
+    if(size <= old && size > old / 2) {
+        HDR_OF(p)->size = size;
+        return p;
+    }
+
+    void *q = tl_alloc(mm, size);
+    if(q) {
+        memcpy(q, p, size < old ? size : old);
+        tl_free(mm, p);
+    }
+    return q;
+}
+
+HAllocator *h_tlalloc(HAllocator *mm, size_t slabsize)
+{
+    if(!mm)
+        mm = h_system_allocator;
+    if(slabsize == 0)
+        slabsize = DEFAULT_SLABSIZE;
+    if(slabsize < 4096)
+        slabsize = 4096;
+
+    TLAlloc *a = mm->alloc(mm, sizeof(TLAlloc));
+    if(!a)
+        return NULL;
+
+    a->base.alloc = tl_alloc;
+    a->base.realloc = tl_realloc;
+    a->base.free = tl_free;
+    a->mm = mm;
+    a->slabsize = slabsize;
+    a->heaps = NULL;
+    if(pthread_key_create(&a->key, heap_exit) != 0) {
+        mm->free(mm, a);
+        return NULL;
+    }
+    if(pthread_mutex_init(&a->lock, NULL) != 0) {
+        pthread_key_delete(a->key);
+        mm->free(mm, a);
+        return NULL;
+    }
+
+    assert((HAllocator *)a == &a->base);
+    return &a->base;
+}
+
+void h_tlalloc_free(HAllocator *mm)
+{
+    TLAlloc *a = (TLAlloc *)mm;
+    struct heap *h, *hnext;
+    struct slab *s, *snext;
+
+    if(!mm)
+        return;
+
+    // NB: the calling thread's key value is not cleared by key_delete,
+    //     but it is never looked at again.
+    pthread_key_delete(a->key);
+    pthread_mutex_destroy(&a->lock);
+    for(h = a->heaps; h; h = hnext) {
+        hnext = h->next;
+        for(s = h->slabs; s; s = snext) {
+            snext = s->next;
+            a->mm->free(a->mm, s);
+        }
+        a->mm->free(a->mm, h);
+    }
+    a->mm->free(a->mm, a);
+}
@@ -0,0 +1,39 @@
+// static tracepoints (USDT) in the dissector, provider "dnp3hammer"
+//
+// with DNP3_USDT (cmake finds sys/sdt.h), every TRACEn is a single nop in
+// the code and a note in the binary that bpftrace, perf or SystemTap can
+// attach to at run time. otherwise they compile to nothing and their
+// arguments are not evaluated.
+//
+// probe                    arguments
+// frame                    src, dst, func, len (raw frame)
+// frame__invalid           src, dst, func, len
+// context__lookup          src, dst, new (1 if allocated or recycled)
+// context__evict           src, dst, bytes pending
+// segment                  src, dst, transport header, payload len
+// series__done             src, dst, payload len
+// series__discard          src, dst, bytes
+// fragment                 src, dst, function code, nblocks (streamed: only
+//                          counted with a filter or point database)
+// app__error               src, dst, error (DNP3_ParseError, 0: unparseable)
+//
+// NB: a double underscore reads as '-' in the probe name.
+
+#ifndef DNP3_TRACE_H_SEEN
+#define DNP3_TRACE_H_SEEN
+
+#ifdef DNP3_USDT
+
+#include <sys/sdt.h>
+
+#define TRACE3(NAME, A, B, C) DTRACE_PROBE3(dnp3hammer, NAME, A, B, C)
+#define TRACE4(NAME, A, B, C, D) DTRACE_PROBE4(dnp3hammer, NAME, A, B, C, D)
+
+#else
+
+#define TRACE3(NAME, A, B, C) ((void)0)
+#define TRACE4(NAME, A, B, C, D) ((void)0)
+
+#endif // DNP3_USDT
+
+#endif // DNP3_TRACE_H_SEEN
@@ -3,17 +3,35 @@
 
 #include <hammer/hammer.h>
 #include <hammer/glue.h>
+#include "tables.h"
 
 
 HParser *dnp3_p_transport_segment;
 
+// hand-written equivalent of dnp3_p_transport_segment, see dnp3hammer.h
+bool dnp3_transport_decode_segment(const uint8_t *buf, size_t len,
+                                   DNP3_Segment *seg)
+{
+    if(len < 1)
+        return false;
+
+    seg->fin = buf[0] >> 7;
+    seg->fir = (buf[0] >> 6) & 1;
+    seg->seq = buf[0] & 0x3F;
+    seg->len = len - 1;
+    seg->payload = (uint8_t *)buf + 1;  // no copy
+
+    return true;
+}
+
 static HParsedToken *act_segment(const HParseResult *p, void *user)
 {
     DNP3_Segment *s = H_ALLOC(DNP3_Segment);
+    uint8_t hdr = H_FIELD_UINT(0);
 
-    s->fin = H_FIELD_UINT(0, 0);
-    s->fir = H_FIELD_UINT(0, 1);
-    s->seq = H_FIELD_UINT(0, 2);
+    s->fin = hdr >> 7;
+    s->fir = (hdr >> 6) & 1;
+    s->seq = hdr & 0x3F;
 
     HCountedArray *a = H_FIELD_SEQ(1);
     s->len = a->used;
@@ -28,16 +46,20 @@ static HParsedToken *act_segment(const HParseResult *p, void *user)
 
 void dnp3_p_init_transport(void)
 {
-    H_RULE(bit,     h_bits(1, false));
     H_RULE(byte,    h_uint8());
 
-    H_RULE(fir,     bit);
-    H_RULE(fin,     bit);
-    H_RULE(seqno,   h_bits(6, false));
-    H_RULE(hdr,     h_sequence(fin, fir, seqno, NULL));     // big-endian
-    
+    // NB: the header (fin,fir,seqno) is taken as a whole octet and split in
+    //     act_segment. sub-octet h_bits would rule out the CFG backends.
+    H_RULE(hdr,     byte);
+
     H_ARULE(segment, h_sequence(hdr, h_many(byte), NULL));
         // XXX is there a minimum number of bytes in the transport payload?
 
+    // LL(1) suffices and avoids packrat memoization over every payload byte
+    // NB: the table must come from dnp3_p_mm explicitly, it is not freed
+    //     until the parser is recompiled, i.e. possibly after dnp3_init.
+    int segment_compile = !h_compile__m(dnp3_p_mm, segment, PB_LLk, NULL);
+    assert(segment_compile);
+
     dnp3_p_transport_segment = segment;
 }
@@ -4,6 +4,7 @@
 #include "hammer.h" // XXX placeholder for extensions
 #include <assert.h>
 #include "util.h"
+#include "tables.h"
 
 
 static bool is_zero(HParseResult *p, void *user)
@@ -32,7 +33,7 @@ HParser *dnp3_p_objchoice(HParser *p, ...)
     H_RULE(ohdr_,       h_repeat_n(octet, 3));  // (grp,var,qc)
     H_RULE(unk,         h_right(ohdr_, dnp3_p_err_obj_unknown));
 
-    H_RULE(ps,          h_choice__v(p, ap));
+    H_RULE(ps,          h_choice__mv(dnp3_p_mm, p, ap));
     H_RULE(ochoice,     h_choice(ps, unk, NULL));
 
     va_end(ap);
@@ -44,11 +45,17 @@ static bool not_err(HParseResult *p, void *user)
     return !H_ISERR(p->ast->token_type);
 }
 
-static HParser *many_(HParser *(*fmany)(const HParser *), HParser *p)
+HParser *dnp3_p_trailer;
+
+static HParser *many_(HParser *(*fmany)(HAllocator *, const HParser *),
+                      HParser *p)
 {
+    if(dnp3_p_trailer)
+        p = h_right(h_not(dnp3_p_trailer), p);
+
     H_RULE(p_ok,    h_attr_bool(p, not_err, NULL));
 
-    H_RULE(ps,      fmany(p_ok));
+    H_RULE(ps,      fmany(dnp3_p_mm, p_ok));
     H_RULE(err,     h_right(ps, p));    // fails or yields error
     H_RULE(many,    h_choice(err, ps, NULL));
 
@@ -57,12 +64,12 @@ static HParser *many_(HParser *(*fmany)(const HParser *), HParser *p)
 
 HParser *dnp3_p_many(HParser *p)
 {
-    return many_(h_many, p);
+    return many_(h_many__m, p);
 }
 
 HParser *dnp3_p_many1(HParser *p)
 {
-    return many_(h_many1, p);
+    return many_(h_many1__m, p);
 }
 
 HParser *dnp3_p_seq(HParser *p, HParser *q)
@@ -90,6 +97,11 @@ static bool is_err(HParseResult *p, void *user)
     return H_ISERR(p->ast->token_type);
 }
 
+HParser *dnp3_p_packet(HParser *p)
+{
+    return dnp3_p_packet__m(dnp3_p_mm, p);
+}
+
 HParser *dnp3_p_packet__m(HAllocator *mm__, HParser *p)
 {
     H_RULE(err, h_attr_bool__m(mm__, p, is_err, NULL));
@@ -108,6 +120,8 @@ HParser *dnp3_p_err_obj_unknown;
 
 void dnp3_p_init_util(void)
 {
+    dnp3_p_trailer = NULL;  // from an earlier dnp3_init
+
     // byte-alignment (used in block())
     H_RULE(zero,    dnp3_p_reserved(1));
     H_RULE(pad,     h_indirect());
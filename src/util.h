@@ -22,7 +22,10 @@ HParser *dnp3_p_int_exact(HParser *p, uint64_t x);
 // like h_choice but defaults to a ERR_OBJ_UNKNOWN case
 HParser *dnp3_p_objchoice(HParser *p, ...);
 
-// like h_many/h_many1 but stops on and propagates TT_ERR and friends
+// like h_many/h_many1 but stops on and propagates TT_ERR and friends.
+// also stops before dnp3_p_trailer if set (the aggressive-mode MAC, which
+// must end a fragment; see g120_auth.c). read when parsers are built.
+extern HParser *dnp3_p_trailer;
 HParser *dnp3_p_many(HParser *p);
 HParser *dnp3_p_many1(HParser *p);
 
@@ -35,6 +38,7 @@ HParser *dnp3_p_seq(HParser *p, HParser *q);
 HParsedToken *dnp3_p_act_flatten(const HParseResult *p, void* user);
 
 // like h_left(p, h_end_p()) but propagates TT_ERR and friends
+HParser *dnp3_p_packet(HParser *p);
 HParser *dnp3_p_packet__m(HAllocator *mm__, HParser *p);
 
 #define little_endian(p)  h_with_endianness(BIT_LITTLE_ENDIAN|BYTE_LITTLE_ENDIAN, p)
@@ -0,0 +1,653 @@
+// throughput and latency benchmarks for the parsing stack
+//
+// usage: dnp3-bench [-a] [-r rounds] [samples/*.hex ...]
+//
+// every traffic mix is generated as a raw stream of link frames. the frames,
+// transport segments and app fragments therein are extracted once with a
+// dissector and then fed to the respective parsers. each parser is run on
+// every Hammer backend it compiles to (stage/backend).
+//
+// with -a, the allocations of the dissector's latency pass are broken down
+// by stage (h_profiler) and reported per mix at the end.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hammer/hammer.h>
+#include <dnp3hammer.h>
+
+#define SEGMAX 249  // max. transport segment payload
+
+
+/// growable buffers ///
+
+typedef struct {
+    uint8_t *data;
+    size_t len, cap;
+} Buf;
+
+static void buf_put(Buf *b, const uint8_t *p, size_t n)
+{
+    if(b->len + n > b->cap) {
+        b->cap = 2 * (b->len + n);
+        b->data = realloc(b->data, b->cap);
+        if(!b->data) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void buf_byte(Buf *b, uint8_t x)
+{
+    buf_put(b, &x, 1);
+}
+
+static void buf_le16(Buf *b, uint16_t x)
+{
+    buf_byte(b, x & 0xFF);
+    buf_byte(b, x >> 8);
+}
+
+static void buf_le32(Buf *b, uint32_t x)
+{
+    buf_le16(b, x & 0xFFFF);
+    buf_le16(b, x >> 16);
+}
+
+// a list of items, stored back to back
+typedef struct {
+    Buf bytes;
+    size_t *off;    // n+1 entries
+    size_t n, cap;
+} Items;
+
+static void items_add(Items *it, const uint8_t *p, size_t n)
+{
+    if(it->n + 2 > it->cap) {
+        it->cap = 2 * (it->n + 2);
+        it->off = realloc(it->off, it->cap * sizeof(size_t));
+        if(!it->off) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    if(it->n == 0)
+        it->off[0] = 0;
+    buf_put(&it->bytes, p, n);
+    it->off[++it->n] = it->bytes.len;
+}
+
+static void items_free(Items *it)
+{
+    free(it->bytes.data);
+    free(it->off);
+    memset(it, 0, sizeof(Items));
+}
+
+#define ITEM(IT, I) ((IT)->bytes.data + (IT)->off[I])
+#define ITEMLEN(IT, I) ((IT)->off[(I)+1] - (IT)->off[I])
+
+
+/// traffic generation ///
+
+// append a frame with the given user data to the stream
+static void put_frame(Buf *out, bool dir, uint16_t dst, uint16_t src,
+                      const uint8_t *data, size_t n)
+{
+    uint8_t hdr[8] = {0x05, 0x64, 5+n, dir ? 0xC4 : 0x44,   // UNCONF. DATA
+                      dst & 0xFF, dst >> 8, src & 0xFF, src >> 8};
+
+    buf_put(out, hdr, 8);
+    buf_le16(out, dnp3_crc(hdr, 8));
+    for(size_t i=0; i<n; i+=16) {
+        size_t k = n-i < 16 ? n-i : 16;
+        buf_put(out, data+i, k);
+        buf_le16(out, dnp3_crc(data+i, k));
+    }
+}
+
+// split an app fragment into segments and frames
+static void put_fragment(Buf *out, bool dir, uint16_t dst, uint16_t src,
+                         const Buf *frag)
+{
+    static uint8_t seq = 0;
+    uint8_t seg[1+SEGMAX];
+
+    for(size_t i=0; i==0 || i<frag->len; i+=SEGMAX) {
+        size_t k = frag->len-i < SEGMAX ? frag->len-i : SEGMAX;
+        seg[0] = ((i+k == frag->len) << 7) | ((i == 0) << 6) | (seq++ % 64);
+        memcpy(seg+1, frag->data+i, k);
+        put_frame(out, dir, dst, src, seg, 1+k);
+    }
+}
+
+static void response_header(Buf *b, uint8_t seq)
+{
+    buf_byte(b, 0xC0 | (seq & 0x0F));   // fir, fin
+    buf_byte(b, 0x81);                  // RESPONSE
+    buf_le16(b, 0);                     // IIN
+}
+
+// class 0 polls and short binary/analog responses, 32 outstations
+static void mix_class0(Buf *out)
+{
+    static const uint8_t poll[] = {0xC0, 0x01, 0x3C, 0x01, 0x06};
+
+    for(int i=0; i<2000; i++) {
+        uint16_t os = 10 + i % 32;
+        Buf frag = {0};
+
+        buf_put(&frag, poll, sizeof(poll));
+        frag.data[0] = 0xC0 | (i & 0x0F);
+        put_fragment(out, 1, os, 1, &frag);
+
+        frag.len = 0;
+        response_header(&frag, i);
+        buf_put(&frag, (const uint8_t *)"\x01\x02\x00\x00\x0F", 5); // g1v2
+        for(int j=0; j<16; j++)
+            buf_byte(&frag, 0x01 | (rand()&1) << 7);
+        buf_put(&frag, (const uint8_t *)"\x1E\x01\x00\x00\x07", 5); // g30v1
+        for(int j=0; j<8; j++) {
+            buf_byte(&frag, 0x01);
+            buf_le32(&frag, rand());
+        }
+        put_fragment(out, 0, 1, os, &frag);
+        free(frag.data);
+    }
+}
+
+// large g30v1 responses of 400 points (about 2000 bytes, 9 segments)
+static void mix_g30(Buf *out)
+{
+    for(int i=0; i<200; i++) {
+        Buf frag = {0};
+
+        response_header(&frag, i);
+        buf_put(&frag, (const uint8_t *)"\x1E\x01\x01", 3);     // qc=01
+        buf_le16(&frag, 0);
+        buf_le16(&frag, 399);
+        for(int j=0; j<400; j++) {
+            buf_byte(&frag, 0x01);
+            buf_le32(&frag, rand());
+        }
+        put_fragment(out, 0, 1, 10 + i % 4, &frag);
+        free(frag.data);
+    }
+}
+
+// bursts of small event responses (g2v2 and g32v1, 2-byte index prefix)
+static void mix_events(Buf *out)
+{
+    for(int i=0; i<3000; i++) {
+        int n = 1 + rand() % 10;
+        Buf frag = {0};
+
+        response_header(&frag, i);
+        buf_put(&frag, (const uint8_t *)"\x02\x02\x28", 3);     // qc=28
+        buf_le16(&frag, n);
+        for(int j=0; j<n; j++) {
+            buf_le16(&frag, rand() % 1000);
+            buf_byte(&frag, 0x01 | (rand()&1) << 7);
+            buf_le32(&frag, 1423689252 + i);                   // 48-bit time
+            buf_le16(&frag, 0x014B);
+        }
+        buf_put(&frag, (const uint8_t *)"\x20\x01\x28", 3);
+        buf_le16(&frag, n);
+        for(int j=0; j<n; j++) {
+            buf_le16(&frag, rand() % 1000);
+            buf_byte(&frag, 0x01);
+            buf_le32(&frag, rand());
+        }
+        put_fragment(out, 0, 1, 10 + i % 8, &frag);
+        free(frag.data);
+    }
+}
+
+// multi-segment g1v2 responses of 1500 points and varying length
+static void mix_multiseg(Buf *out)
+{
+    for(int i=0; i<300; i++) {
+        int n = 250 + rand() % 1250;
+        Buf frag = {0};
+
+        response_header(&frag, i);
+        buf_put(&frag, (const uint8_t *)"\x01\x02\x01", 3);
+        buf_le16(&frag, 0);
+        buf_le16(&frag, n-1);
+        for(int j=0; j<n; j++)
+            buf_byte(&frag, 0x01 | (rand()&1) << 7);
+        put_fragment(out, 0, 1, 10 + i % 16, &frag);
+        free(frag.data);
+    }
+}
+
+// class polls with garbage and corrupted frames in between
+static void mix_noisy(Buf *out)
+{
+    static const uint8_t poll[] = {0xC0, 0x01, 0x3C, 0x02, 0x06,
+                                   0x3C, 0x03, 0x06, 0x3C, 0x04, 0x06};
+
+    for(int i=0; i<3000; i++) {
+        Buf frag = {0};
+
+        buf_put(&frag, poll, sizeof(poll));
+        put_fragment(out, 1, 10 + i % 32, 1, &frag);
+        free(frag.data);
+
+        switch(rand() % 4) {
+        case 0:     // garbage, including fake start bytes
+            for(int j=rand()%40; j>0; j--)
+                buf_byte(out, (rand()%4 == 0) ? 0x05 : ((rand()%4 == 0) ? 0x64 : rand()));
+            break;
+        case 1:     // corrupt a data CRC of the last frame
+            out->data[out->len-1] ^= 0xFF;
+            break;
+        }
+    }
+}
+
+// raw frames from sample files: lines of hex digits, other chars ignored
+static void mix_samples(Buf *out, int nfiles, char **files)
+{
+    for(int f=0; f<nfiles; f++) {
+        FILE *fp = fopen(files[f], "r");
+        int c, hi = -1;
+
+        if(!fp) {
+            perror(files[f]);
+            exit(1);
+        }
+        while((c = fgetc(fp)) != EOF) {
+            if(!isxdigit(c))
+                continue;
+            int v = isdigit(c) ? c-'0' : tolower(c)-'a'+10;
+            if(hi < 0) {
+                hi = v;
+            } else {
+                buf_byte(out, hi << 4 | v);
+                hi = -1;
+            }
+        }
+        fclose(fp);
+    }
+}
+
+
+/// measurement ///
+
+static uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// allocator that counts calls
+static size_t nallocs;
+
+static void *count_alloc(HAllocator *mm, size_t n)
+{
+    nallocs++;
+    return malloc(n);
+}
+
+static void *count_realloc(HAllocator *mm, void *p, size_t n)
+{
+    nallocs++;
+    return realloc(p, n);
+}
+
+static void count_free(HAllocator *mm, void *p)
+{
+    free(p);
+}
+
+static HAllocator counting_allocator = {count_alloc, count_realloc, count_free};
+
+// allocation profiles of the dissector per mix (-a)
+#define MAXPROFILES 8
+static bool profiling;
+static struct {
+    const char *mix;
+    DNP3_AllocProfile p;
+} profiles[MAXPROFILES];
+static size_t nprofiles;
+
+static int write_stdout(void *env, const char *s, size_t len)
+{
+    return fwrite(s, 1, len, stdout) == len ? 0 : -1;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    size_t items;
+    size_t bytes;
+    uint64_t ns;        // total for all rounds
+    size_t allocs;      // in a single round
+    uint64_t *lat;      // per item, single round
+    size_t nlat;
+} Result;
+
+static void report(const char *mix, const char *stage, Result *r, int rounds)
+{
+    double sec = r->ns / 1e9;
+    uint64_t p50 = 0, p99 = 0;
+
+    if(r->nlat > 0) {
+        qsort(r->lat, r->nlat, sizeof(uint64_t), cmp_u64);
+        p50 = r->lat[r->nlat / 2];
+        p99 = r->lat[r->nlat * 99 / 100];
+    }
+
+    printf("%-9s %-17s %8zu %12.0f %9.2f %9.2f %9llu %9llu\n", mix, stage,
+           r->items, rounds * r->items / sec, rounds * r->bytes / sec / 1e6,
+           r->items ? (double)r->allocs / r->items : 0.0,
+           (unsigned long long)p50, (unsigned long long)p99);
+    free(r->lat);
+}
+
+// parse an item; p = NULL selects the direct decoder, falling back to the
+// grammar. mm = NULL selects the system allocator.
+static HParseResult *parse_item(HAllocator *mm, const HParser *p,
+                                const uint8_t *input, size_t len)
+{
+    HParseResult *res;
+
+    if(p)
+        return mm ? h_parse__m(mm, p, input, len) : h_parse(p, input, len);
+    if((res = dnp3_app_decode_fragment(mm, input, len)))
+        return res;
+    return parse_item(mm, dnp3_p_app_fragment, input, len);
+}
+
+// run a parser on every item
+static void bench_parser(const char *mix, const char *stage,
+                         const HParser *p, const Items *it, int rounds)
+{
+    Result r = {0};
+
+    if(it->n == 0)
+        return;
+
+    r.items = it->n;
+    r.bytes = it->bytes.len;
+    r.lat = malloc(it->n * sizeof(uint64_t));
+
+    // latency and allocations
+    nallocs = 0;
+    for(size_t i=0; i<it->n; i++) {
+        uint64_t t0 = now();
+        HParseResult *res = parse_item(&counting_allocator, p,
+                                       ITEM(it, i), ITEMLEN(it, i));
+        if(res)
+            h_parse_result_free(res);
+        r.lat[r.nlat++] = now() - t0;
+    }
+    r.allocs = nallocs;
+
+    // throughput
+    uint64_t t0 = now();
+    for(int k=0; k<rounds; k++) {
+        for(size_t i=0; i<it->n; i++) {
+            HParseResult *res = parse_item(NULL, p, ITEM(it, i), ITEMLEN(it, i));
+            if(res)
+                h_parse_result_free(res);
+        }
+    }
+    r.ns = now() - t0;
+
+    report(mix, stage, &r, rounds);
+}
+
+// run bench_parser once per backend that p compiles to
+// NB: recompiles the global parser p, restoring its backend afterwards.
+static void bench_backends(const char *mix, const char *stage, HParser *p,
+                           const Items *it, int rounds)
+{
+    static const struct {
+        HParserBackend backend;
+        const char *name;
+    } backends[] = {
+        {PB_PACKRAT, "packrat"},
+        {PB_REGULAR, "regular"},
+        {PB_LLk,     "llk"},
+        {PB_LALR,    "lalr"},
+        {PB_GLR,     "glr"}
+    };
+    HParserBackend orig = p->backend;
+    char name[32];
+
+    for(size_t i=0; i<sizeof(backends)/sizeof(*backends); i++) {
+        if(h_compile(p, backends[i].backend, NULL) != 0)
+            continue;
+        snprintf(name, sizeof(name), "%s/%s", stage, backends[i].name);
+        bench_parser(mix, name, p, it, rounds);
+    }
+
+    h_compile(p, orig, NULL);
+}
+
+// items extracted from a stream, see extract()
+typedef struct {
+    Items frames;
+    Items segments;
+    Items fragments;
+} Extract;
+
+static int cb_link_frame(void *env, const DNP3_Frame *frame,
+                         const uint8_t *buf, size_t len)
+{
+    items_add(&((Extract *)env)->frames, buf, len);
+    return 0;
+}
+
+static void cb_transport_segment(void *env, const DNP3_Segment *seg)
+{
+    uint8_t s[1+SEGMAX];
+
+    s[0] = (seg->fin << 7) | (seg->fir << 6) | seg->seq;
+    memcpy(s+1, seg->payload, seg->len);
+    items_add(&((Extract *)env)->segments, s, 1+seg->len);
+}
+
+static void cb_transport_payload(void *env, const uint8_t *s, size_t n)
+{
+    items_add(&((Extract *)env)->fragments, s, n);
+}
+
+static void extract(Extract *ex, const Buf *stream)
+{
+    DNP3_Callbacks cb = {NULL};
+
+    cb.link_frame = cb_link_frame;
+    cb.transport_segment = cb_transport_segment;
+    cb.transport_payload = cb_transport_payload;
+
+    StreamProcessor *p = dnp3_dissector(cb, ex);
+    if(!p) {
+        fprintf(stderr, "dissector init failed\n");
+        exit(1);
+    }
+    p->feed_external(p, stream->data, stream->len);
+    p->finish(p);
+}
+
+// time between the ends of consecutive app fragments
+static uint64_t *e2e_lat;
+static size_t e2e_nlat;
+static uint64_t e2e_last;
+
+static void cb_app_done(void)
+{
+    uint64_t t = now();
+    e2e_lat[e2e_nlat++] = t - e2e_last;
+    e2e_last = t;
+}
+
+static void cb_app_fragment(void *env, const DNP3_Fragment *fragment,
+                            const uint8_t *buf, size_t len)
+{
+    cb_app_done();
+}
+
+static void cb_app_invalid(void *env, DNP3_ParseError e)
+{
+    cb_app_done();
+}
+
+#define CHUNK 65536 // bytes fed at once
+
+static void feed_all(StreamProcessor *p, const Buf *stream)
+{
+    for(size_t i=0; i<stream->len; i+=CHUNK) {
+        size_t n = stream->len-i < CHUNK ? stream->len-i : CHUNK;
+        p->feed_external(p, stream->data+i, n);
+    }
+}
+
+// the full dissector on the raw stream; items = app fragments
+static void bench_dissector(const char *mix, const Buf *stream,
+                            const Extract *ex, int rounds)
+{
+    DNP3_Callbacks cb = {NULL};
+    Result r = {0};
+    HAllocator *mm = &counting_allocator;
+
+    cb.app_fragment = cb_app_fragment;
+    cb.app_invalid = cb_app_invalid;
+
+    r.items = ex->fragments.n;
+    r.bytes = stream->len;
+    r.lat = e2e_lat = malloc((r.items + 1) * sizeof(uint64_t));
+    e2e_nlat = 0;
+
+    // latency and allocations
+    nallocs = 0;
+    if(profiling && nprofiles < MAXPROFILES)
+        mm = h_profiler(&counting_allocator);
+    StreamProcessor *p = dnp3_dissector__m(mm, mm, mm, mm, NULL, cb, NULL);
+    e2e_last = now();
+    feed_all(p, stream);
+    p->finish(p);
+    r.allocs = nallocs;
+    r.nlat = e2e_nlat;
+    if(mm != &counting_allocator) {
+        profiles[nprofiles].mix = mix;
+        h_profiler_get(mm, &profiles[nprofiles].p);
+        nprofiles++;
+        h_profiler_free(mm);
+    }
+
+    // throughput
+    cb.app_fragment = NULL;
+    cb.app_invalid = NULL;
+    uint64_t t0 = now();
+    for(int k=0; k<rounds; k++) {
+        p = dnp3_dissector(cb, NULL);
+        feed_all(p, stream);
+        p->finish(p);
+    }
+    r.ns = now() - t0;
+
+    report(mix, "dissector", &r, rounds);
+}
+
+static void bench_mix(const char *name, const Buf *stream, int rounds)
+{
+    Extract ex;
+
+    memset(&ex, 0, sizeof(ex));
+
+    extract(&ex, stream);
+    bench_backends(name, "link", dnp3_p_link_frame, &ex.frames, rounds);
+    bench_backends(name, "transport", dnp3_p_transport_segment, &ex.segments,
+                   rounds);
+    bench_backends(name, "app", dnp3_p_app_fragment, &ex.fragments, rounds);
+    bench_parser(name, "app-fast", NULL, &ex.fragments, rounds);
+    bench_dissector(name, stream, &ex, rounds);
+
+    items_free(&ex.frames);
+    items_free(&ex.segments);
+    items_free(&ex.fragments);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *name;
+        void (*gen)(Buf *);
+    } mixes[] = {
+        {"class0",   mix_class0},
+        {"g30",      mix_g30},
+        {"events",   mix_events},
+        {"multiseg", mix_multiseg},
+        {"noisy",    mix_noisy}
+    };
+    int rounds = 5;
+    int c;
+
+    while((c = getopt(argc, argv, "ar:")) != -1) {
+        switch(c) {
+        case 'a':
+            profiling = true;
+            break;
+        case 'r':
+            rounds = atoi(optarg);
+            if(rounds > 0)
+                break;
+            // fall through
+        default:
+            fprintf(stderr, "usage: %s [-a] [-r rounds] [file.hex ...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // startup: build time and size of the parser tables; the lazily built
+    // parts show up in the size after the runs below
+    uint64_t t0 = now();
+    dnp3_init();
+    uint64_t tinit = now() - t0;
+    size_t tables = dnp3_table_size();
+    srand(1);
+
+    printf("%-9s %-17s %8s %12s %9s %9s %9s %9s\n", "mix", "stage", "items",
+           "items/s", "MB/s", "allocs", "p50 ns", "p99 ns");
+    for(size_t i=0; i<sizeof(mixes)/sizeof(*mixes); i++) {
+        Buf stream = {0};
+        mixes[i].gen(&stream);
+        bench_mix(mixes[i].name, &stream, rounds);
+        free(stream.data);
+    }
+
+    if(optind < argc) {
+        Buf stream = {0};
+        mix_samples(&stream, argc - optind, argv + optind);
+        bench_mix("samples", &stream, rounds);
+        free(stream.data);
+    }
+
+    for(size_t i=0; i<nprofiles; i++) {
+        printf("\nallocations of the dissector, %s:\n", profiles[i].mix);
+        h_profiler_report(write_stdout, NULL, &profiles[i].p);
+    }
+
+    printf("\ninit %.3f ms, tables %zu KiB, %zu KiB after use\n",
+           tinit / 1e6, tables / 1024, dnp3_table_size() / 1024);
+    t0 = now();
+    dnp3_free();
+    printf("free %.3f ms\n", (now() - t0) / 1e6);
+
+    return 0;
+}
@@ -0,0 +1,305 @@
+// algorithmic-complexity fuzzer: worst-case time and memory per input byte
+//
+// usage (libFuzzer, cmake -DFUZZ=ON):
+//     DNP3_FUZZ_WORST=worst/ dnp3-fuzz [libFuzzer options] corpus/
+//   runs every input through dnp3_p_app_fragment, dnp3_p_link_frame and a
+//   dissector, measuring time and peak memory of each. every input that sets
+//   a new per-byte record for a target is saved to $DNP3_FUZZ_WORST as
+//   <target>-<ns|mem>-<n>, so the directory accumulates the worst cases
+//   seen. an input exceeding the bounds below aborts, which makes libFuzzer
+//   keep it as a crash.
+//
+// usage (replay):
+//     dnp3-fuzz-replay [file ...]
+//   runs the given (raw binary) inputs the same way, reports the worst cost
+//   per target and exits with status 1 if any exceeded the bounds.
+//
+// cost bounds: FIXED + PERBYTE * input length, overridable through the
+// environment. time is only checked by the fuzzer if DNP3_FUZZ_NS_PERBYTE
+// is set explicitly; it is too noisy to be on by default.
+//     DNP3_FUZZ_NS_FIXED, DNP3_FUZZ_NS_PERBYTE        nanoseconds
+//     DNP3_FUZZ_MEM_FIXED, DNP3_FUZZ_MEM_PERBYTE      bytes (peak)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <hammer/hammer.h>
+#include <dnp3hammer.h>
+
+#define NS_FIXED        1000000     // 1 ms
+#define NS_PERBYTE      20000
+#define MEM_FIXED       (1 << 20)   // 1 MiB
+#define MEM_PERBYTE     16384
+
+
+/// measurement ///
+
+static uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// allocator that tracks the live and peak number of bytes
+static size_t live, peak;
+
+#define HDR 16      // size prefix, keeps alignment
+
+static void *track_alloc(HAllocator *mm, size_t n)
+{
+    uint8_t *p = malloc(HDR + n);
+    if(!p)
+        return NULL;
+    *(size_t *)p = n;
+    live += n;
+    if(live > peak)
+        peak = live;
+    return p + HDR;
+}
+
+static void track_free(HAllocator *mm, void *q)
+{
+    if(q) {
+        uint8_t *p = (uint8_t *)q - HDR;
+        live -= *(size_t *)p;
+        free(p);
+    }
+}
+
+static void *track_realloc(HAllocator *mm, void *q, size_t n)
+{
+    if(!q)
+        return track_alloc(mm, n);
+
+    uint8_t *p = (uint8_t *)q - HDR;
+    size_t old = *(size_t *)p;
+    p = realloc(p, HDR + n);
+    if(!p)
+        return NULL;
+    *(size_t *)p = n;
+    live = live - old + n;
+    if(live > peak)
+        peak = live;
+    return p + HDR;
+}
+
+static HAllocator tracking_allocator = {track_alloc, track_realloc, track_free};
+
+
+/// targets ///
+
+static void run_parser(const HParser *p, const uint8_t *data, size_t len)
+{
+    HParseResult *res = h_parse__m(&tracking_allocator, p, data, len);
+    if(res)
+        h_parse_result_free(res);
+}
+
+static void run_app(const uint8_t *data, size_t len)
+{
+    run_parser(dnp3_p_app_fragment, data, len);
+}
+
+static void run_link(const uint8_t *data, size_t len)
+{
+    run_parser(dnp3_p_link_frame, data, len);
+}
+
+static void run_dissector(const uint8_t *data, size_t len)
+{
+    HAllocator *mm = &tracking_allocator;
+    DNP3_Callbacks cb = {NULL};
+    StreamProcessor *p = dnp3_dissector__m(mm, mm, mm, mm, NULL, cb, NULL);
+
+    if(!p)
+        abort();
+    p->feed_external(p, data, len);
+    p->finish(p);
+}
+
+static struct Target {
+    const char *name;
+    void (*run)(const uint8_t *, size_t);
+    double ns, mem;             // worst per byte seen
+    unsigned nsaved;
+} targets[] = {
+    {"app",       run_app},
+    {"link",      run_link},
+    {"dissector", run_dissector},
+};
+#define NTARGETS (sizeof(targets) / sizeof(*targets))
+
+static struct {
+    double ns_fixed, ns_perbyte;
+    double mem_fixed, mem_perbyte;
+    bool check_ns;
+    const char *worst;          // where to save records, NULL: nowhere
+} bound;
+
+static double env(const char *name, double dflt, bool *set)
+{
+    const char *s = getenv(name);
+
+    if(set)
+        *set = (s != NULL);
+    return s ? atof(s) : dflt;
+}
+
+static void init(bool fuzzer)
+{
+    bound.ns_fixed    = env("DNP3_FUZZ_NS_FIXED", NS_FIXED, NULL);
+    bound.ns_perbyte  = env("DNP3_FUZZ_NS_PERBYTE", NS_PERBYTE,
+                            &bound.check_ns);
+    bound.mem_fixed   = env("DNP3_FUZZ_MEM_FIXED", MEM_FIXED, NULL);
+    bound.mem_perbyte = env("DNP3_FUZZ_MEM_PERBYTE", MEM_PERBYTE, NULL);
+    bound.check_ns = bound.check_ns || !fuzzer;
+    bound.worst = getenv("DNP3_FUZZ_WORST");
+    if(bound.worst && mkdir(bound.worst, 0777) < 0 && errno != EEXIST) {
+        perror(bound.worst);
+        bound.worst = NULL;
+    }
+
+    dnp3_init();
+}
+
+static void save(struct Target *t, const char *metric,
+                 const uint8_t *data, size_t len)
+{
+    char path[4096];
+    FILE *f;
+
+    if(!bound.worst)
+        return;
+    snprintf(path, sizeof path, "%s/%s-%s-%u", bound.worst, t->name, metric,
+             t->nsaved++);
+    if(!(f = fopen(path, "wb"))) {
+        perror(path);
+        return;
+    }
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+// run all targets on an input; returns false if a bound was exceeded
+static bool run(const uint8_t *data, size_t len)
+{
+    bool ok = true;
+
+    for(size_t i=0; i<NTARGETS; i++) {
+        struct Target *t = &targets[i];
+
+        live = peak = 0;
+        uint64_t t0 = now();
+        t->run(data, len);
+        uint64_t ns = now() - t0;
+
+        // per byte, counting an empty input as one byte
+        double n = len ? len : 1;
+        if(ns / n > t->ns) {
+            t->ns = ns / n;
+            save(t, "ns", data, len);
+        }
+        if(peak / n > t->mem) {
+            t->mem = peak / n;
+            save(t, "mem", data, len);
+        }
+
+        if(bound.check_ns && ns > bound.ns_fixed + bound.ns_perbyte * len) {
+            fprintf(stderr, "%s: %zu bytes took %llu ns\n", t->name, len,
+                    (unsigned long long)ns);
+            ok = false;
+        }
+        if(peak > bound.mem_fixed + bound.mem_perbyte * len) {
+            fprintf(stderr, "%s: %zu bytes took %zu bytes of memory\n",
+                    t->name, len, peak);
+            ok = false;
+        }
+        if(live != 0) {
+            fprintf(stderr, "%s: %zu bytes leaked\n", t->name, live);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+
+#ifdef DNP3_LIBFUZZER
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    init(true);
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if(!run(data, size))
+        abort();        // libFuzzer keeps the input
+    return 0;
+}
+
+#else
+
+static uint8_t *slurp(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *buf = NULL;
+    size_t n = 0, cap = 0;
+
+    if(!f)
+        return NULL;
+    for(;;) {
+        if(n == cap) {
+            cap = cap ? cap * 2 : 4096;
+            uint8_t *b = realloc(buf, cap);
+            if(!b)
+                break;
+            buf = b;
+        }
+        size_t k = fread(buf + n, 1, cap - n, f);
+        if(k == 0)
+            break;
+        n += k;
+    }
+    fclose(f);
+    *len = n;
+    return buf ? buf : malloc(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int r = 0;
+
+    init(false);
+
+    for(int i=1; i<argc; i++) {
+        size_t len;
+        uint8_t *data = slurp(argv[i], &len);
+
+        if(!data) {
+            perror(argv[i]);
+            r = 1;
+            continue;
+        }
+        if(!run(data, len)) {
+            fprintf(stderr, "%s: over bound\n", argv[i]);
+            r = 1;
+        }
+        free(data);
+    }
+
+    printf("%-9s %12s %12s\n", "target", "ns/byte", "mem/byte");
+    for(size_t i=0; i<NTARGETS; i++) {
+        printf("%-9s %12.1f %12.1f\n", targets[i].name, targets[i].ns,
+               targets[i].mem);
+    }
+    return r;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include <catch.hpp>
+
+#include <algorithm>
+
+#include "fixtures/PluginFixture.h"
+#include "fixtures/DNP3Helpers.h"
+
+#define SUITE(name) "PluginContext - " name
+
+static size_t Count(const PluginFixture& fix, Event e)
+{
+    return std::count(fix.events.begin(), fix.events.end(), e);
+}
+
+TEST_CASE(SUITE("Recycles least recently used context"))
+{
+    DNP3_DissectorConfig config = {};
+    config.max_contexts = 2;
+    PluginFixture fix(&config);
+
+    REQUIRE(fix.Parse(TPDUS("C0 01", true, 1)));
+    REQUIRE(fix.Parse(TPDUS("C0 01", true, 2)));
+    REQUIRE(Count(fix, Event::CONTEXT_EVICT) == 0);
+
+    REQUIRE(fix.Parse(TPDUS("C0 01", true, 3)));    // evicts 1
+    REQUIRE(Count(fix, Event::CONTEXT_EVICT) == 1);
+
+    REQUIRE(fix.Parse(TPDUS("C0 01", true, 2)));    // still there
+    REQUIRE(Count(fix, Event::CONTEXT_EVICT) == 1);
+
+    REQUIRE(fix.Parse(TPDUS("C0 01", true, 1)));    // evicts 3
+    REQUIRE(Count(fix, Event::CONTEXT_EVICT) == 2);
+}
+
+TEST_CASE(SUITE("Keeps many contexts without eviction"))
+{
+    PluginFixture fix;
+
+    for(uint16_t dest = 1; dest <= 1000; ++dest)
+    {
+        REQUIRE(fix.Parse(TPDUS("C0 01", true, dest)));
+    }
+    REQUIRE(Count(fix, Event::CONTEXT_EVICT) == 0);
+}
+
+TEST_CASE(SUITE("Passes raw frames to app_fragment"))
+{
+    PluginFixture fix;
+
+    REQUIRE(fix.Parse(TPDUS("C0 01 3C 01 06")));   // class 0 poll
+    REQUIRE(fix.CheckEvents({Event::LINK_FRAME, Event::TRANS_SEGMENT, Event::TRANS_PAYLOAD, Event::APP_FRAG}));
+    REQUIRE(fix.rawFrameBytes == 10 + 6 + 2);
+}
+
+TEST_CASE(SUITE("Skips raw frames when configured"))
+{
+    DNP3_DissectorConfig config = {};
+    config.skip_raw_frames = true;
+    PluginFixture fix(&config);
+
+    REQUIRE(fix.Parse(TPDUS("C0 01 3C 01 06")));
+    REQUIRE(fix.CheckEvents({Event::LINK_FRAME, Event::TRANS_SEGMENT, Event::TRANS_PAYLOAD, Event::APP_FRAG}));
+    REQUIRE(fix.rawFrameBytes == 0);
+}
+
+TEST_CASE(SUITE("Reassembles multi-segment series"))
+{
+    PluginFixture fix;
+
+    REQUIRE(fix.Parse(TPDUS("C0 01 3C 01 06", true, 1, 1024, 0, 2)));
+    REQUIRE(fix.CheckEvents({Event::LINK_FRAME, Event::TRANS_SEGMENT,
+                             Event::LINK_FRAME, Event::TRANS_SEGMENT,
+                             Event::LINK_FRAME, Event::TRANS_SEGMENT,
+                             Event::TRANS_PAYLOAD, Event::APP_FRAG}));
+    REQUIRE(fix.rawFrameBytes == 2*(10 + 3 + 2) + (10 + 2 + 2));
+}
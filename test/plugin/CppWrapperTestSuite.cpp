@@ -0,0 +1,133 @@
+#include <catch.hpp>
+
+#include <dnp3hammer.hpp>
+
+#include <vector>
+
+#include "fixtures/DNP3Helpers.h"
+#include "fixtures/HexData.h"
+
+#define SUITE(name) "CppWrapper - " name
+
+// only what it defines gets hooked up
+struct FragmentHandler
+{
+    std::vector<DNP3_FunctionCode> fcs;
+    std::vector<DNP3_Group> groups;
+    std::vector<int32_t> values;
+    std::vector<uint32_t> indexes;
+    dnp3::Owned kept;
+
+    void app_fragment(dnp3::Fragment f, dnp3::Span<const uint8_t> raw)
+    {
+        fcs.push_back(f.fc());
+        for(dnp3::Block b : f)
+        {
+            groups.push_back(b.group());
+            for(auto pt : b.values<int32_t>())
+            {
+                indexes.push_back(pt.index);
+                values.push_back(pt.value);
+            }
+        }
+        kept = dnp3::Owned(f);
+    }
+};
+
+struct LinkHandler
+{
+    size_t frames = 0;
+
+    int link_frame(const DNP3_Frame &, dnp3::Span<const uint8_t> raw)
+    {
+        frames++;
+        return 0;
+    }
+};
+
+static void Feed(dnp3::Dissector<FragmentHandler>& d, const std::string& hex)
+{
+    HexData data(hex);
+    REQUIRE(d.feed(data.Buffer(), data.Size()) == 0);
+}
+
+TEST_CASE(SUITE("callbacks go to the handler"))
+{
+    FragmentHandler h;
+    dnp3::Dissector<FragmentHandler> d(h);
+    REQUIRE(d.valid());
+
+    DNP3_Callbacks cb = dnp3::detail::callbacks<FragmentHandler>();
+    REQUIRE(cb.app_fragment != nullptr);
+    REQUIRE(cb.link_frame == nullptr);
+    REQUIRE(cb.app_object_block == nullptr);
+
+    Feed(d, TPDUS("C0 01 3C 01 06"));   // class 0 poll
+
+    REQUIRE(h.fcs.size() == 1);
+    REQUIRE(h.fcs[0] == DNP3_READ);
+    REQUIRE(h.groups.size() == 1);
+    REQUIRE(h.groups[0] == DNP3_GROUP_CLASS);
+}
+
+TEST_CASE(SUITE("typed values and indexes"))
+{
+    FragmentHandler h;
+    dnp3::Dissector<FragmentHandler> d(h);
+
+    // response: g30v1, range 3-4, values 5 and -1
+    Feed(d, TPDUS("C0 81 00 00 1E 01 00 03 04 01 05 00 00 00 01 FF FF FF FF", false));
+
+    REQUIRE(h.fcs.size() == 1);
+    REQUIRE(h.fcs[0] == DNP3_RESPONSE);
+    REQUIRE(h.values == (std::vector<int32_t>{5, -1}));
+    REQUIRE(h.indexes == (std::vector<uint32_t>{3, 4}));
+
+    // the kept fragment outlives the callback
+    REQUIRE(h.kept);
+    dnp3::Block b = (*h.kept)[0];
+    REQUIRE(b.is(DNP3_GROUP_ANAIN, DNP3_VARIATION_ANAIN_32BIT));
+    REQUIRE(b.size() == 2);
+    REQUIRE(b[1].value<int32_t>() == -1);
+    REQUIRE(b[1].index() == 4);
+}
+
+TEST_CASE(SUITE("move-only dissector"))
+{
+    LinkHandler h;
+    dnp3::Dissector<LinkHandler> a(h);
+    dnp3::Dissector<LinkHandler> b(std::move(a));
+
+    REQUIRE_FALSE(a.valid());
+    REQUIRE(b.valid());
+
+    HexData data(LPDU("C0 C0 01"));
+    REQUIRE(b.feed(data.Buffer(), data.Size()) == 0);
+    REQUIRE(h.frames == 1);
+
+    REQUIRE(b.finish() == 0);
+    REQUIRE_FALSE(b.valid());
+}
+
+TEST_CASE(SUITE("lazy blocks are decoded on access"))
+{
+    DNP3_DissectorConfig cfg = {};
+    cfg.lazy_objects = true;
+
+    FragmentHandler h;
+    dnp3::Dissector<FragmentHandler> d(h, &cfg);
+
+    // response: g32v1 events, qualifier 0x28, index 5 = 42 and 7 = -1
+    Feed(d, TPDUS("C0 81 00 00 20 01 28 02 00 05 00 01 2A 00 00 00 07 00 01 FF FF FF FF", false));
+
+    REQUIRE(h.fcs.size() == 1);
+    REQUIRE(h.indexes == (std::vector<uint32_t>{5, 7}));
+    REQUIRE(h.values == (std::vector<int32_t>{42, -1}));
+
+    dnp3::Block b = (*h.kept)[0];
+    REQUIRE(b.is(DNP3_GROUP_ANAINEV, DNP3_VARIATION_ANAINEV_32BIT));
+    REQUIRE(b.indexes().size() == 2);
+    REQUIRE(b.indexes()[1] == 7);
+    REQUIRE(b[0].index() == 5);
+    REQUIRE(b[0].value<int32_t>() == 42);
+}
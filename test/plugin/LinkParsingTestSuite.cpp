@@ -21,3 +21,30 @@ TEST_CASE(SUITE("Parses until encountering start octets"))
     fix.CheckEvents({Event::LINK_FRAME});
 }
 
+
+TEST_CASE(SUITE("Parses caller memory in arbitrary pieces"))
+{
+    std::string frames = "05 05 64 05 C0 01 00 00 04 E9 21 " + TPDUS("C0 01 3C 01 06", true, 1, 1024, 0, 2);
+
+    for(size_t chunk = 1; chunk <= 60; ++chunk)
+    {
+        PluginFixture fix;
+
+        REQUIRE(fix.ParseExternal(frames, chunk));
+        REQUIRE(fix.CheckEvents({Event::LINK_FRAME,
+                                 Event::LINK_FRAME, Event::TRANS_SEGMENT,
+                                 Event::LINK_FRAME, Event::TRANS_SEGMENT,
+                                 Event::LINK_FRAME, Event::TRANS_SEGMENT,
+                                 Event::TRANS_PAYLOAD, Event::APP_FRAG}));
+    }
+}
+
+TEST_CASE(SUITE("Buffers incomplete frames between feeds"))
+{
+    PluginFixture fix;
+
+    REQUIRE(fix.Parse("05 64 05 C0 01"));
+    REQUIRE(fix.CheckEvents({}));
+    REQUIRE(fix.Parse("00 00 04 E9 21"));
+    REQUIRE(fix.CheckEvents({Event::LINK_FRAME}));
+}
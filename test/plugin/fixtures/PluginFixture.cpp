@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <cstring>
 #include <cstdint>
+#include <algorithm>
 
 #include "HexData.h"
 
@@ -32,19 +33,26 @@ void cb_app_invalid(void *env, DNP3_ParseError e)
 void cb_app_fragment(void *env, const DNP3_Fragment *fragment, const uint8_t *buf, size_t len)
 {
     static_cast<PluginFixture*>(env)->events.push_back(Event::APP_FRAG);
+    static_cast<PluginFixture*>(env)->rawFrameBytes = buf ? len : 0;
 }
 
-PluginFixture::PluginFixture()
+void cb_context_evict(void *env, uint16_t src, uint16_t dst, size_t n)
 {
-    DNP3_Callbacks callbacks;
+    static_cast<PluginFixture*>(env)->events.push_back(Event::CONTEXT_EVICT);
+}
+
+PluginFixture::PluginFixture(const DNP3_DissectorConfig *config)
+{
+    DNP3_Callbacks callbacks = {};
 
     callbacks.link_frame = cb_link_frame;
     callbacks.transport_segment = cb_transport_segment;
     callbacks.transport_payload = cb_transport_payload;
     callbacks.app_invalid = cb_app_invalid;
     callbacks.app_fragment = cb_app_fragment;
+    callbacks.context_evict = cb_context_evict;
 
-    m_plugin = dnp3_dissector(callbacks, this);
+    m_plugin = dnp3_dissector__m(NULL, NULL, NULL, NULL, config, callbacks, this);
     assert(m_plugin);
 }
 
@@ -58,6 +66,22 @@ bool PluginFixture::Parse(const std::string& hex)
     return m_plugin->feed(m_plugin, data.Size()) == 0;
 }
 
+bool PluginFixture::ParseExternal(const std::string& hex, size_t chunk)
+{
+    HexData data(hex);
+
+    for(size_t i = 0; i < data.Size(); i += chunk)
+    {
+        size_t n = std::min(chunk, data.Size() - i);
+        if(m_plugin->feed_external(m_plugin, data.Buffer() + i, n) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool PluginFixture::CheckEvents(std::initializer_list<Event> expected) const
 {
     if(expected.size() != events.size())
@@ -13,6 +13,7 @@ void cb_transport_segment(void *env, const DNP3_Segment *segment);
 void cb_transport_payload(void *env, const uint8_t *s, size_t n);
 void cb_app_invalid(void *env, DNP3_ParseError e);
 void cb_app_fragment(void *env, const DNP3_Fragment *fragment, const uint8_t *buf, size_t len);
+void cb_context_evict(void *env, uint16_t src, uint16_t dst, size_t n);
 
 // corresponding event enums
 enum class Event
@@ -21,7 +22,8 @@ enum class Event
     TRANS_SEGMENT,
     TRANS_PAYLOAD,
     APP_INVALID,
-    APP_FRAG
+    APP_FRAG,
+    CONTEXT_EVICT
 };
 
 
@@ -30,14 +32,16 @@ typedef std::pair<const uint8_t*, size_t> slice_t;
 class PluginFixture
 {
     public:
-        PluginFixture();
+        PluginFixture(const DNP3_DissectorConfig *config = nullptr);
         ~PluginFixture();
 
         bool Parse(const std::string& hex);
+        bool ParseExternal(const std::string& hex, size_t chunk);   // via feed_external
 
         bool CheckEvents(std::initializer_list<Event> expected) const;
 
         std::vector<Event> events;
+        size_t rawFrameBytes = 0;   // len passed to the last app_fragment
 
     private:
         StreamProcessor* m_plugin;
@@ -2,11 +2,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>   // PRIu64
+#include <pthread.h>
+#include <unistd.h>     // close, unlink
+#ifdef __linux__
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
 #include <glib.h>
 
 #include <hammer/hammer.h>
 #include "../../src/hammer.h"
 #include "../../src/sloballoc.h"
+#include "../../src/crc.h"
+#include "../../src/mac.h"
+#include "../../src/link.h"
+#include "../../src/bits.h"
+#include "../../src/objects.h"
 #include <dnp3hammer.h>
 
 #define H_ISERR(tt) ((tt) >= TT_ERR && (tt) < TT_USER)  // XXX
@@ -1213,6 +1224,146 @@ static void test_link_skip(void)
                      "\x01\x02\x03\x04\xB4\x67",52, 52);
 }
 
+// compare dnp3_link_decode_frame against the grammar (dnp3_p_link_frame)
+static void do_check_decode(const uint8_t *input, size_t len, int LINE)
+{
+    uint8_t payload[DNP3_LINK_MAXPAYLOAD];
+    DNP3_Frame frame;
+
+    HParseResult *res = h_parse(dnp3_p_link_frame, input, len);
+    int n = dnp3_link_decode_frame(input, len, &frame, payload);
+
+    if(!res) {
+      if(n > 0) {
+        g_test_message("Decoder consumed %d bytes on line %d, grammar failed",
+                       n, LINE);
+        g_test_fail();
+      }
+      return;
+    }
+
+    check_cmp_size(n, ==, res->bit_length/8);
+    if(n > 0) {
+      char *cres = format(res->ast);
+      char *cdec = dnp3_format_frame(&frame);
+      check_string(cdec, ==, cres);
+      free(cdec);
+      free(cres);
+    }
+    h_parse_result_free(res);
+
+    // any prefix of a frame must ask for more input
+    for(size_t k=0; k<n; k++)
+      check_cmp_size(dnp3_link_decode_frame(input, k, &frame, payload), ==, 0);
+}
+
+#define check_decode(input, len) \
+    do_check_decode((const uint8_t *)(input), len, __LINE__)
+
+static void test_link_decode(void)
+{
+    check_decode("\x05\x64\x05\xF2\x01\x00\xEF\xFF\xBF\xB5",10);
+    check_decode("\x05\x64\x05\xF2\x01\x00\xEF\xFF\xBF\xB5\x00\x00",12);
+    check_decode("\x05\x64\x05\xF2\x01\x00\xEF\xFF\xBF\xB4",10);     // crc error
+    check_decode("\x05\x64\x05\xF2\x01\x00\xF0\xFF\x62\x82",10);
+    check_decode("\x05\x64\x06\xF2\x01\x00\xEF\xFF\xEF\x26\x01\xA1\xC9",13);
+    check_decode("\x05\x64\x05\xB3\x01\x00\xEF\xFF\x03\xA6",10);
+    check_decode("\x05\x64\x05\x90\x01\x00\xEF\xFF\x54\xDB",10);
+    check_decode("\x05\x64\x05\xC2\x01\x00\xEF\xFF\x70\x07",10);
+    check_decode("\x05\x64\x03\xF2\x05\x64\x05\x64\xA9\x8E\x00\x00",12); // len 3
+    check_decode("\x05\x64\x07\xE4\xFD\xFF\xEF\xFF\x7A\x1A\x00\x00\xFF\xFF",14);
+    check_decode("\x05\x64\x09\xF3\x01\x00\xEF\xFF\x0B\x41\x01\x02\x03\x04\xB4\x67\x58",17);
+    check_decode("\x05\x64\x09\xF3\x01\x00\xEF\xFF\x0B\x41\x01\x02\x03\x05\xB4\x67\x58",17);
+    check_decode("\x05\x64\x26\xF3\x01\x00\xEF\xFF\x6B\xF4"
+                 "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0A\x0B\x0C\x0D\x0E\x0F\xEC\x10"
+                 "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1A\x1B\x1C\x1D\x1E\x1F\x27\x03"
+                 "\x20\x50\xD6",49);
+    check_decode("\x05\x64\x29\xF3\x01\x00\xEF\xFF\x89\xB0"
+                 "___4___8__12__16\x34\x90"
+                 "___4___8__12__16\xFF\xFF"               // wrong CRC
+                 "\x01\x02\x03\x04\xB4\x67",52);
+    check_decode("\x00\x05\x64\x05\xF2\x01\x00\xEF\xFF\xBF\xB5",11); // garbage
+    check_decode("\x05\x65\x05\xF2\x01\x00\xEF\xFF\xBF\xB5",10);     // bad start
+}
+
+// dnp3_link_resync finds the first offset that dnp3_link_frame_size accepts
+static void do_check_resync(const uint8_t *buf, size_t len, int LINE)
+{
+    size_t i;
+
+    for(i=0; i<len; i++) {
+        if(dnp3_link_frame_size(buf+i, len-i) != -1)
+            break;
+    }
+    check_cmp_size(dnp3_link_resync(buf, len), ==, i);
+}
+
+#define check_resync(input, len) \
+    do_check_resync((const uint8_t *)(input), len, __LINE__)
+
+static void test_link_resync(void)
+{
+    uint8_t buf[1000];
+    int LINE = __LINE__;
+
+    check_cmp_size(dnp3_link_resync(NULL, 0), ==, 0);
+    check_resync("\x00\x01\x02", 3);                                  // none
+    check_resync("\x00\x05", 2);                                       // short
+    check_resync("\x05\x65\x05\x64\x05", 5);                            // short
+    check_resync("\x00\x05\x64\x05\xF2\x01\x00\xEF\xFF\xBF\xB5", 11);    // frame
+    check_resync("\x05\x64\x05\xF2\x01\x00\xEF\xFF\xBF\xB4"              // bad crc
+                 "\x05\x64\x05\xF2\x01\x00\xEF\xFF\xBF\xB5", 20);
+    check_resync("\x05\x64\x05\x05\x64\x05\xF2\x01\x00\xEF\xFF\xBF\xB5", 13);
+
+    // noise with plenty of start bytes and a frame somewhere
+    for(int k=0; k<50; k++) {
+        for(size_t i=0; i<sizeof(buf); i++)
+            buf[i] = (i * 7 + k) % 3 ? 0x05 : 0x64;
+        memcpy(buf + k*17, "\x05\x64\x05\xF2\x01\x00\xEF\xFF\xBF\xB5", 10);
+        do_check_resync(buf, sizeof(buf), __LINE__);
+        do_check_resync(buf, k*17 + 5, __LINE__);
+    }
+}
+
+static void test_link_crc(void)
+{
+    const uint8_t *hdr = (const uint8_t *)"\x05\x64\x05\xF2\x01\x00\xEF\xFF";
+    const uint8_t *frame = (const uint8_t *)"\x05\x64\x26\xF3\x01\x00\xEF\xFF\x6B\xF4"
+        "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0A\x0B\x0C\x0D\x0E\x0F\xEC\x10"
+        "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1A\x1B\x1C\x1D\x1E\x1F\x27\x03"
+        "\x20\x50\xD6";
+    uint8_t buf[300];
+    int LINE = __LINE__;
+
+    check_inttype("0x%.4X", unsigned, dnp3_crc(hdr, 8), ==, 0xB5BF);
+    check_inttype("0x%.4X", unsigned, dnp3_crc_bytewise(hdr, 8), ==, 0xB5BF);
+    check_inttype("0x%.4X", unsigned, dnp3_crc_slice8(hdr, 8), ==, 0xB5BF);
+    if(dnp3_crc_have_clmul())
+        check_inttype("0x%.4X", unsigned, dnp3_crc_clmul(hdr, 8), ==, 0xB5BF);
+
+    // all implementations agree on all lengths
+    for(size_t i=0; i<sizeof(buf); i++)
+        buf[i] = i * 151 + 7;
+    for(size_t n=0; n<=sizeof(buf); n++) {
+        uint16_t crc = dnp3_crc_bytewise(buf, n);
+        check_inttype("0x%.4X", unsigned, dnp3_crc_slice8(buf, n), ==, crc);
+        check_inttype("0x%.4X", unsigned, dnp3_crc(buf, n), ==, crc);
+        if(dnp3_crc_have_clmul())
+            check_inttype("0x%.4X", unsigned, dnp3_crc_clmul(buf, n), ==, crc);
+    }
+
+    // batch verification of data blocks
+    memcpy(buf, frame, 49);
+    check_inttype("%d", int, dnp3_crc_blocks_valid(buf+10, 33), ==, true);
+    check_inttype("%d", int, dnp3_crc_blocks_valid(buf+10, 16), ==, true);
+    buf[30] ^= 1;   // second block
+    check_inttype("%d", int, dnp3_crc_blocks_valid(buf+10, 33), ==, false);
+    check_inttype("%d", int, dnp3_crc_blocks_valid(buf+10, 16), ==, true);
+    buf[30] ^= 1;
+    buf[48] ^= 0x80; // last crc
+    check_inttype("%d", int, dnp3_crc_blocks_valid(buf+10, 33), ==, false);
+}
+
 static void test_transport(void)
 {
     check_parse(dnp3_p_transport_segment, "\x4A\x01\x02\x03\x04\x05\x06",7,
@@ -1221,6 +1372,1633 @@ static void test_transport(void)
     check_parse_fail(dnp3_p_transport_segment, "",0);
 }
 
+static void test_transport_decode(void)
+{
+    const uint8_t *input = (const uint8_t *)"\x4A\x01\x02\x03\x04\x05\x06";
+    DNP3_Segment seg;
+    int LINE = __LINE__;
+
+    check_inttype("%d", int, dnp3_transport_decode_segment(input, 7, &seg), ==, true);
+    char *cres = dnp3_format_segment(&seg);
+    check_string(cres, ==, "(fir) segment 10: 01 02 03 04 05 06");
+    free(cres);
+    check_cmp_ptr(seg.payload, ==, input+1);    // no copy
+
+    check_inttype("%d", int, dnp3_transport_decode_segment((const uint8_t *)"\x9A", 1, &seg), ==, true);
+    cres = dnp3_format_segment(&seg);
+    check_string(cres, ==, "(fin) segment 26:");
+    free(cres);
+
+    check_inttype("%d", int, dnp3_transport_decode_segment(input, 0, &seg), ==, false);
+}
+
+// the transport function as a Hammer grammar, cf. src/dissect.c
+HParser *dnp3_p_transport_function(void);
+
+static bool segment_equal(const DNP3_Segment *a, const DNP3_Segment *b)
+{
+    return (a->fir == b->fir && a->fin == b->fin && a->seq == b->seq &&
+            a->len == b->len && memcmp(a->payload, b->payload, a->len) == 0);
+}
+
+static uint8_t *store_ptr(uint8_t *p, uintptr_t ptr)
+{
+    // NB: hammer is big-endian by default
+    int n = 8 * sizeof(DNP3_Segment *);
+    while(n>0) {
+        n -= 8;
+        *p++ = (ptr >> n) & 0xFF;
+    }
+    return p;
+}
+
+// convert a transport segment into input tokens for the grammar
+static size_t transport_tokens(const DNP3_Segment *seg, const DNP3_Segment *last,
+                               uint8_t *buf)
+{
+    uint8_t *p = buf;
+
+    if(seg->fir)
+        *p++ = 'A';
+    else if(!last)
+        *p++ = '_';
+    else if(segment_equal(seg, last))
+        *p++ = '=';
+    else if(seg->seq == (last->seq + 1)%64)
+        *p++ = '+';
+    else
+        *p++ = '!';
+    p = store_ptr(p, (uintptr_t)seg);
+
+    if(seg->fin) {
+        *p++ = 'Z';
+        p = store_ptr(p, 0);
+    }
+
+    return (p-buf);
+}
+
+// wrap a segment into a link frame (unconfirmed user data, src -> 1)
+static size_t make_frame_from(uint8_t *out, const DNP3_Segment *seg,
+                              uint16_t src)
+{
+    uint8_t data[DNP3_LINK_MAXPAYLOAD];
+    size_t n = 1 + seg->len;
+    uint16_t crc;
+
+    data[0] = (seg->fin << 7) | (seg->fir << 6) | seg->seq;
+    memcpy(data+1, seg->payload, seg->len);
+
+    uint8_t hdr[] = {0x05, 0x64, 5+n, 0xC4, 0x01, 0x00, src & 0xFF, src >> 8};
+    memcpy(out, hdr, 8);
+    crc = dnp3_crc(out, 8);
+    out[8] = crc & 0xFF;
+    out[9] = crc >> 8;
+
+    uint8_t *p = out + 10;
+    for(size_t i=0; i<n; i+=16) {
+        size_t k = n-i < 16 ? n-i : 16;
+        memcpy(p, data+i, k);
+        crc = dnp3_crc(p, k);
+        p[k] = crc & 0xFF;
+        p[k+1] = crc >> 8;
+        p += k+2;
+    }
+
+    return (p-out);
+}
+
+static size_t make_frame(uint8_t *out, const DNP3_Segment *seg)
+{
+    return make_frame_from(out, seg, 2);
+}
+
+// transport payloads, each prefixed by its length
+struct Payloads {
+    uint8_t buf[16384];
+    size_t n;
+};
+
+static void add_payload(void *env, const uint8_t *s, size_t n)
+{
+    struct Payloads *out = env;
+
+    g_assert(out->n + 2 + n <= sizeof(out->buf));
+    out->buf[out->n++] = n & 0xFF;
+    out->buf[out->n++] = n >> 8;
+    memcpy(out->buf + out->n, s, n);
+    out->n += n;
+}
+
+#define NSEG 40
+
+// compare the dissector's transport function against the grammar on random
+// segment sequences
+static void test_transport_function(void)
+{
+    static struct {
+        DNP3_Segment seg;
+        uint8_t data[20];
+    } segs[NSEG];
+    static uint8_t tok[NSEG * 2 * (1+sizeof(void *))];
+    size_t tokpos[NSEG+1];
+    static struct Payloads expect, result;
+    int LINE = __LINE__;
+
+    for(int round=0; round<500; round++) {
+        DNP3_Segment *last = NULL;
+        size_t ntok = 0;
+        int nseg;
+
+        // generate segments
+        for(int i=0; i<NSEG; i++) {
+            DNP3_Segment *seg = &segs[i].seg;
+
+            if(last && g_test_rand_int_range(0, 8) == 0) {
+                *seg = *last;                                       // =
+            } else {
+                seg->fir = g_test_rand_int_range(0, 3) == 0;
+                seg->fin = g_test_rand_int_range(0, 3) == 0;
+                if(last && g_test_rand_int_range(0, 8) != 0)
+                    seg->seq = (last->seq + 1) % 64;                // +
+                else
+                    seg->seq = g_test_rand_int_range(0, 64);
+                seg->len = g_test_rand_int_range(0, 21);
+                for(size_t k=0; k<seg->len; k++)
+                    segs[i].data[k] = g_test_rand_int_range(0, 256);
+            }
+            seg->payload = segs[i].data;
+
+            tokpos[i] = ntok;
+            ntok += transport_tokens(seg, last, tok + ntok);
+            last = seg;
+        }
+        tokpos[NSEG] = ntok;
+
+        // run the grammar, cut the sequence where it fails (A after [+=])
+        expect.n = 0;
+        size_t pos = 0;
+        while(pos < ntok) {
+            HParseResult *r = h_parse(dnp3_p_transport_function(),
+                                      tok+pos, ntok-pos);
+            if(!r)
+                break;
+            if(r->ast && r->ast->token_type == TT_BYTES)
+                add_payload(&expect, r->ast->bytes.token, r->ast->bytes.len);
+            g_assert(r->bit_length > 0);
+            pos += r->bit_length / 8;
+            h_parse_result_free(r);
+        }
+        for(nseg=0; tokpos[nseg] < pos; nseg++);
+        if(pos < ntok)
+            g_assert(tokpos[nseg] == pos);
+
+        // feed the corresponding frames to a dissector
+        DNP3_Callbacks cb = {NULL};
+        cb.transport_payload = add_payload;
+        result.n = 0;
+        StreamProcessor *p = dnp3_dissector(cb, &result);
+        g_assert(p != NULL);
+        for(int i=0; i<nseg; i++) {
+            size_t n = make_frame(p->buf, &segs[i].seg);
+            check_inttype("%d", int, p->feed(p, n), ==, 0);
+        }
+        p->finish(p);
+
+        check_cmp_size(result.n, ==, expect.n);
+        if(result.n == expect.n && memcmp(result.buf, expect.buf, expect.n)) {
+            g_test_message("transport payloads differ in round %d", round);
+            g_test_fail();
+        }
+    }
+}
+
+#undef NSEG
+
+// inputs for the concurrency tests; format() of each must not change
+static const struct {
+    const char *input;
+    size_t len;
+} par_inputs[] = {
+    {"\xC0\x01\x01\x00\x17\x03\x41\x43\x42", 9},
+    {"\xC0\x01\x02\x03\x00\x03\x41", 7},
+    {"\xC0\x01\x01\x00\x17\x00", 6},
+    {"\x00\x81\x00\x00\x1E\x01\x17\x01\x01\x21\x12\x34\x56\x78", 14},
+    {"\x00\x81\x00\x00\x1E\x05\x17\x01\x01\x21\x00\x00\x80\xBF", 14},
+    {"\x00\x81\x00\x00\x1E\x06\x17\x01\x01\x40\x00\x00\x00\x00\x00\x00\xF0\x3F", 18}
+};
+#define NPAR (sizeof(par_inputs) / sizeof(*par_inputs))
+
+static char *par_expect[NPAR];
+
+static gpointer parse_worker(gpointer data)
+{
+    int *failed = data;
+
+    for(int i=0; i<500; i++) {
+        size_t k = i % NPAR;
+        HParseResult *r = h_parse(dnp3_p_app_fragment,
+                                  (const uint8_t *)par_inputs[k].input,
+                                  par_inputs[k].len);
+        char *cres = format(r ? r->ast : NULL);
+        if(strcmp(cres, par_expect[k]) != 0)
+            g_atomic_int_inc(failed);
+        free(cres);
+        if(r)
+            h_parse_result_free(r);
+    }
+
+    return NULL;
+}
+
+// the global parsers can be used from several threads at once
+static void test_parse_threads(void)
+{
+    GThread *threads[4];
+    int failed = 0;
+    int LINE = __LINE__;
+
+    for(size_t k=0; k<NPAR; k++) {
+        HParseResult *r = h_parse(dnp3_p_app_fragment,
+                                  (const uint8_t *)par_inputs[k].input,
+                                  par_inputs[k].len);
+        par_expect[k] = format(r ? r->ast : NULL);
+        if(r)
+            h_parse_result_free(r);
+    }
+
+    for(int i=0; i<4; i++)
+        threads[i] = g_thread_new("parse", parse_worker, &failed);
+    for(int i=0; i<4; i++)
+        g_thread_join(threads[i]);
+
+    check_inttype("%d", int, failed, ==, 0);
+    for(size_t k=0; k<NPAR; k++)
+        free(par_expect[k]);
+}
+
+#undef NPAR
+
+static void count_payload(void *env, const uint8_t *s, size_t n)
+{
+    int *count = env;
+    g_atomic_int_inc(count);
+}
+
+// a dissector group delivers the same payloads as a single dissector
+static void test_dissector_group(void)
+{
+    static uint8_t stream[100000];
+    size_t len = 0;
+    uint8_t data[32];
+    int single = 0, group = 0;
+    int LINE = __LINE__;
+
+    // single-segment series from various sources, with some garbage
+    for(int i=0; len + 300 < sizeof(stream); i++) {
+        DNP3_Segment seg = {0};
+        seg.fir = seg.fin = 1;
+        seg.seq = i % 64;
+        seg.len = 2 + i % 20;
+        seg.payload = data;
+        memset(data, i, sizeof(data));
+
+        len += make_frame_from(stream + len, &seg, i % 7);
+        if(i % 5 == 0)
+            stream[len++] = 0x05;
+    }
+
+    DNP3_Callbacks cb = {NULL};
+    cb.transport_payload = count_payload;
+
+    StreamProcessor *p = dnp3_dissector(cb, &single);
+    g_assert(p != NULL);
+    p->feed_external(p, stream, len);
+    p->finish(p);
+
+    p = dnp3_dissector_group_new(3, cb, &group);
+    g_assert(p != NULL);
+    for(size_t i=0; i<len; i+=1000)
+        p->feed_external(p, stream+i, len-i < 1000 ? len-i : 1000);
+    p->finish(p);
+
+    check_cmp_size(single, >, 0);
+    check_cmp_size(group, ==, single);
+}
+
+static void log_skip(void *env, size_t n)
+{
+    g_string_append_printf(env, "s%zu ", n);
+}
+
+static int log_frame(void *env, const DNP3_Frame *frame,
+                     const uint8_t *buf, size_t len)
+{
+    g_string_append_printf(env, "f%u ", (unsigned)frame->source);
+    return 0;
+}
+
+// frames decoded ahead in batches are still processed in input order,
+// with the garbage between them reported in place
+static void test_dissector_batch(void)
+{
+    static uint8_t stream[10000];
+    size_t off[51], len = 0;
+    uint8_t data[] = {0xC0, 0x01, 0x3C, 0x01, 0x06};
+    DNP3_Callbacks cb = {NULL};
+    GString *out[2];
+    int LINE = __LINE__;
+
+    for(int i=0; i<50; i++) {
+        DNP3_Segment seg = {0};
+        seg.fir = seg.fin = 1;
+        seg.len = sizeof data;
+        seg.payload = data;
+
+        off[i] = len;
+        len += make_frame_from(stream + len, &seg, i % 23);
+        if(i % 3 == 0) {
+            stream[len++] = 0x00;
+            stream[len++] = 0x11;
+        }
+    }
+    off[50] = len;
+
+    cb.link_skip = log_skip;
+    cb.link_frame = log_frame;
+    for(int k=0; k<2; k++) {
+        out[k] = g_string_new(NULL);
+        StreamProcessor *p = dnp3_dissector(cb, out[k]);
+        g_assert(p != NULL);
+        if(k == 0) {
+            p->feed_external(p, stream, len);
+        } else {
+            for(int i=0; i<50; i++)
+                p->feed_external(p, stream + off[i], off[i+1] - off[i]);
+        }
+        p->finish(p);
+    }
+    g_assert(strstr(out[0]->str, "f0 s2 f1 f2 f3 s2 f4 ") == out[0]->str);
+    check_string(out[0]->str, ==, out[1]->str);
+    g_string_free(out[0], true);
+    g_string_free(out[1], true);
+}
+
+static void count_fragment(void *env, const DNP3_Fragment *fragment,
+                           const uint8_t *buf, size_t len)
+{
+    int *count = env;
+    count[0]++;
+}
+
+static void count_invalid(void *env, DNP3_ParseError e)
+{
+    int *count = env;
+    count[1]++;
+}
+
+// fragments are parsed as requests or responses by the DIR bit
+static void test_dissector_dir(void)
+{
+    uint8_t stream[100];
+    uint8_t data[] = {0xC0, 0x01, 0x3C, 0x02, 0x06};    // READ class 1
+    DNP3_Segment seg = {0};
+    DNP3_DissectorConfig config = {0};
+    DNP3_Callbacks cb = {NULL};
+    size_t len;
+    int LINE = __LINE__;
+
+    seg.fir = seg.fin = 1;
+    seg.payload = data;
+    seg.len = sizeof(data);
+    len = make_frame(stream, &seg);     // master to outstation
+
+    // same frame, outstation to master
+    memcpy(stream+len, stream, len);
+    stream[len+3] &= 0x7F;
+    uint16_t crc = dnp3_crc(stream+len, 8);
+    stream[len+8] = crc & 0xFF;
+    stream[len+9] = crc >> 8;
+    len *= 2;
+
+    cb.app_fragment = count_fragment;
+    cb.app_invalid = count_invalid;
+    for(int ignore=0; ignore<2; ignore++) {
+        int count[2] = {0, 0};
+        config.ignore_dir = ignore;
+        StreamProcessor *p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config,
+                                               cb, count);
+        g_assert(p != NULL);
+        p->feed_external(p, stream, len);
+        p->finish(p);
+
+        check_inttype("%d", int, count[0], ==, ignore ? 2 : 1);
+        check_inttype("%d", int, count[1], ==, ignore ? 0 : 1);
+    }
+}
+
+static void count_skip(void *env, size_t n)
+{
+    size_t *skipped = env;
+    *skipped += n;
+}
+
+// garbage between frames is reported through link_skip
+static void test_dissector_resync(void)
+{
+    static uint8_t stream[10000];
+    uint8_t data[] = {0xC0, 0x01, 0x3C, 0x02, 0x06};    // READ class 1
+    DNP3_Segment seg = {0};
+    DNP3_Callbacks cb = {NULL};
+    size_t len = 0, garbage = 0, skipped = 0;
+    int LINE = __LINE__;
+
+    seg.fir = seg.fin = 1;
+    seg.payload = data;
+    seg.len = sizeof(data);
+    for(int i=0; len + 400 < sizeof(stream); i++) {
+        len += make_frame(stream+len, &seg);
+        for(int j=0; j<i%100; j++) {
+            stream[len++] = (j % 3) ? 0x05 : 0x64;
+            garbage++;
+        }
+    }
+    len += make_frame(stream+len, &seg);    // no garbage left at the end
+
+    cb.link_skip = count_skip;
+    StreamProcessor *p = dnp3_dissector(cb, &skipped);
+    g_assert(p != NULL);
+    for(size_t i=0; i<len; i+=777)
+        p->feed_external(p, stream+i, len-i < 777 ? len-i : 777);
+    p->finish(p);
+
+    check_cmp_size(skipped, ==, garbage);
+}
+
+// input trickling in a few bytes at a time gives the same result
+static void test_dissector_trickle(void)
+{
+    static uint8_t stream[5000];
+    uint8_t data[64];
+    size_t len = 0;
+    int LINE = __LINE__;
+
+    for(int i=0; len + 300 < sizeof(stream); i++) {
+        DNP3_Segment seg = {0};
+        seg.fir = seg.fin = 1;
+        seg.seq = i % 64;
+        seg.len = 1 + i * 13 % sizeof(data);
+        seg.payload = data;
+        memset(data, i, sizeof(data));
+
+        len += make_frame_from(stream + len, &seg, i % 3);
+        if(i % 4 == 0)
+            stream[len++] = 0x05;       // garbage
+    }
+
+    DNP3_Callbacks cb = {NULL};
+    cb.transport_payload = count_payload;
+
+    int whole = 0;
+    StreamProcessor *p = dnp3_dissector(cb, &whole);
+    g_assert(p != NULL);
+    p->feed_external(p, stream, len);
+    p->finish(p);
+    check_cmp_size(whole, >, 0);
+
+    for(size_t chunk=1; chunk<=7; chunk+=3) {
+        int fed = 0, external = 0;
+        StreamProcessor *q;
+
+        p = dnp3_dissector(cb, &fed);
+        q = dnp3_dissector(cb, &external);
+        g_assert(p != NULL && q != NULL);
+        for(size_t i=0; i<len; i+=chunk) {
+            size_t k = len-i < chunk ? len-i : chunk;
+            memcpy(p->buf, stream+i, k);
+            p->feed(p, k);
+            q->feed_external(q, stream+i, k);
+        }
+        p->finish(p);
+        q->finish(q);
+
+        check_cmp_size(fed, ==, whole);
+        check_cmp_size(external, ==, whole);
+    }
+}
+
+static void save_payload_len(void *env, const uint8_t *s, size_t n)
+{
+    size_t *len = env;
+    *len = n;
+}
+
+// series beyond the default limit, with a large input buffer
+static void test_dissector_config(void)
+{
+    static uint8_t stream[20000];
+    static uint8_t data[10000];
+    DNP3_Segment seg = {0};
+    DNP3_DissectorConfig config = {0};
+    DNP3_Callbacks cb = {NULL};
+    size_t len = 0;
+    int LINE = __LINE__;
+
+    for(size_t i=0; i<sizeof(data); i++)
+        data[i] = i;
+    for(size_t off=0; off<sizeof(data); off+=249) {
+        seg.fir = (off == 0);
+        seg.fin = (off + 249 >= sizeof(data));
+        seg.len = seg.fin ? sizeof(data) - off : 249;
+        seg.payload = data + off;
+        len += make_frame(stream+len, &seg);
+        seg.seq = (seg.seq + 1) % 64;
+    }
+    g_assert(len <= sizeof(stream));
+
+    cb.transport_payload = save_payload_len;
+    for(int big=0; big<2; big++) {
+        size_t plen = 0;
+
+        config.input_buffer = big ? 65536 : 0;
+        config.max_series = big ? 16384 : 0;
+        StreamProcessor *p = dnp3_dissector__m(NULL, NULL, NULL, NULL,
+                                               &config, cb, &plen);
+        g_assert(p != NULL);
+        check_cmp_size(p->bufsize, ==, big ? 65536 : 4619);
+        for(size_t i=0; i<len; ) {
+            size_t k = len-i < p->bufsize ? len-i : p->bufsize;
+            memcpy(p->buf, stream+i, k);
+            p->feed(p, k);
+            i += k;
+        }
+        p->finish(p);
+
+        check_cmp_size(plen, ==, big ? sizeof(data) : 0);
+    }
+}
+
+// filtered traffic is dropped by address, function code, and group
+static void test_dissector_filter(void)
+{
+    static const struct {
+        uint16_t src;
+        const char *data;
+        size_t len;
+        bool pass;
+    } cases[] = {
+        {2, "\xC0\x03\x0C\x01\x17\x01\x00"                // SELECT g12v1
+            "\x01\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00", 18, true},
+        {3, "\xC0\x03\x0C\x01\x17\x01\x00"                // other source
+            "\x01\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00", 18, false},
+        {2, "\xC0\x01\x3C\x02\x06", 5, false},              // READ
+        {2, "\xC0\x05\x29\x02\x17\x01\x00\x64\x00\x00", 10, false},
+                                                            // DIRECT_OPERATE g41
+    };
+    uint8_t stream[400];
+    DNP3_DissectorConfig config = {0};
+    DNP3_Callbacks cb = {NULL};
+    DNP3_Filter filter;
+    size_t len = 0;
+    int LINE = __LINE__;
+
+    for(size_t i=0; i<G_N_ELEMENTS(cases); i++) {
+        DNP3_Segment seg = {0};
+        seg.fir = seg.fin = 1;
+        seg.payload = (uint8_t *)cases[i].data;
+        seg.len = cases[i].len;
+        len += make_frame_from(stream+len, &seg, cases[i].src);
+    }
+
+    dnp3_filter_init(&filter);
+    filter.addr_deny = false;
+    dnp3_filter_set(filter.addr, 2, true);
+    memset(filter.fc, 0, sizeof(filter.fc));
+    dnp3_filter_set(filter.fc, DNP3_SELECT, true);
+    dnp3_filter_set(filter.fc, DNP3_DIRECT_OPERATE, true);
+    memset(filter.group, 0, sizeof(filter.group));
+    dnp3_filter_set(filter.group, DNP3_GROUP_BINOUTCMD, true);
+    g_assert(dnp3_filter_test(filter.group, 12));
+    g_assert(!dnp3_filter_test(filter.group, 41));
+
+    cb.app_fragment = count_fragment;
+    cb.app_invalid = count_invalid;
+    for(int filtered=0; filtered<2; filtered++) {
+        int count[2] = {0, 0};
+        config.filter = filtered ? &filter : NULL;
+        StreamProcessor *p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config,
+                                               cb, count);
+        g_assert(p != NULL);
+        p->feed_external(p, stream, len);
+#ifdef DNP3_STATS
+        DNP3_Stats st;
+        check_inttype("%d", int, dnp3_dissector_stats(p, &st), ==, 0);
+        check_inttype("%d", int, (int)st.filtered, ==, filtered ? 3 : 0);
+#endif
+        p->finish(p);
+
+        check_inttype("%d", int, count[0], ==, filtered ? 1 : 4);
+        check_inttype("%d", int, count[1], ==, 0);
+    }
+}
+
+static void log_fragment(void *env, const DNP3_Fragment *fragment,
+                         const uint8_t *buf, size_t len)
+{
+    char *s = dnp3_format_fragment(fragment);
+    g_string_append_printf(env, "%s\n", s);
+    free(s);
+}
+
+static void log_invalid(void *env, DNP3_ParseError e)
+{
+    g_string_append_printf(env, "error %d\n", (int)e);
+}
+
+// the request cache gives the same results, with the right sequence numbers
+static void test_dissector_cache(void)
+{
+    static const struct {
+        const char *data;
+        size_t len;
+    } reqs[] = {
+        {"\xC0\x01\x3C\x02\x06\x3C\x03\x06\x3C\x04\x06", 11},   // class 1-3
+        {"\xC0\x01\x3C\x01\x06", 5},                                // class 0
+        {"\xC0\x70", 2},                              // unsupported function
+    };
+    static uint8_t stream[20000];
+    DNP3_DissectorConfig config = {0};
+    DNP3_Callbacks cb = {NULL};
+    GString *out[2];
+    size_t len = 0;
+    int LINE = __LINE__;
+
+    for(int i=0; i<300; i++) {
+        uint8_t data[16];
+        DNP3_Segment seg = {0};
+        size_t k = i % 3;
+
+        memcpy(data, reqs[k].data, reqs[k].len);
+        data[0] |= i % 16;                      // sequence number
+        seg.fir = seg.fin = 1;
+        seg.seq = i % 64;
+        seg.payload = data;
+        seg.len = reqs[k].len;
+        len += make_frame(stream+len, &seg);
+    }
+    g_assert(len <= sizeof(stream));
+
+    cb.app_fragment = log_fragment;
+    cb.app_invalid = log_invalid;
+    for(int cached=0; cached<2; cached++) {
+        out[cached] = g_string_new("");
+        config.request_cache = cached ? 1024 : 0;
+        StreamProcessor *p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config,
+                                               cb, out[cached]);
+        g_assert(p != NULL);
+        p->feed_external(p, stream, len);
+#ifdef DNP3_STATS
+        DNP3_Stats st;
+        check_inttype("%d", int, dnp3_dissector_stats(p, &st), ==, 0);
+        // NB: entries of colliding requests replace each other
+        check_inttype("%d", int, (int)(st.cache_hits + st.cache_misses), ==,
+                      cached ? 300 : 0);
+        check_inttype("%d", int, (int)st.cache_hits, >=, cached ? 100 : 0);
+#endif
+        p->finish(p);
+    }
+    check_string(out[1]->str, ==, out[0]->str);
+    check_cmp_size(out[0]->len, >, 0);
+
+    g_string_free(out[0], true);
+    g_string_free(out[1], true);
+}
+
+struct DupCount {
+    int fragments, frames, payloads;
+};
+
+static void dup_fragment(void *env, const DNP3_Fragment *fragment,
+                         const uint8_t *buf, size_t len)
+{
+    ((struct DupCount *)env)->fragments++;
+}
+
+static void dup_frame(void *env, const uint8_t *buf, size_t len)
+{
+    ((struct DupCount *)env)->frames++;
+}
+
+static void dup_payload(void *env, const uint8_t *s, size_t n)
+{
+    ((struct DupCount *)env)->payloads++;
+}
+
+// copies of frames and retransmitted fragments are dropped
+static void test_dissector_dedup(void)
+{
+    uint8_t a[] = {0xC0, 0x01, 0x3C, 0x01, 0x06};       // class 0, seq 0
+    uint8_t b[] = {0xC2, 0x01, 0x3C, 0x02, 0x06};       // class 1, seq 2
+    uint8_t c[] = {0xC1, 0x01, 0x3C, 0x01, 0x06};       // class 0, seq 1
+    static uint8_t stream[200];
+    DNP3_DissectorConfig config = {0};
+    DNP3_Callbacks cb = {NULL};
+    DNP3_Segment seg = {0};
+    size_t len = 0, k;
+    int LINE = __LINE__;
+
+    seg.fir = seg.fin = 1;
+    seg.payload = a;
+    seg.len = 5;
+    len += make_frame(stream+len, &seg);
+    len += make_frame(stream+len, &seg);        // frame copy
+    seg.seq = 1;
+    seg.payload = b;
+    k = make_frame(stream+len, &seg);
+    memcpy(stream+len+k, stream+len, k);
+    stream[len+11] ^= 0x01;                     // corrupt first copy
+    len += 2*k;
+    seg.seq = 2;
+    seg.payload = a;
+    len += make_frame(stream+len, &seg);        // fragment retransmitted
+    seg.seq = 3;
+    seg.payload = c;
+    len += make_frame(stream+len, &seg);
+
+    cb.app_fragment = dup_fragment;
+    cb.link_duplicate = dup_frame;
+    cb.transport_duplicate = dup_payload;
+    for(int dedup=0; dedup<2; dedup++) {
+        struct DupCount n = {0};
+        config.dedup_window = dedup ? 4 : 0;
+        StreamProcessor *p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config,
+                                               cb, &n);
+        g_assert(p != NULL);
+        p->feed_external(p, stream, len);
+#ifdef DNP3_STATS
+        DNP3_Stats st;
+        check_inttype("%d", int, dnp3_dissector_stats(p, &st), ==, 0);
+        check_inttype("%d", int, (int)st.link_duplicates, ==, dedup);
+        check_inttype("%d", int, (int)st.transport_duplicates, ==, dedup);
+#endif
+        p->finish(p);
+        check_inttype("%d", int, n.fragments, ==, dedup ? 3 : 5);
+        check_inttype("%d", int, n.frames, ==, dedup);
+        check_inttype("%d", int, n.payloads, ==, dedup);
+    }
+}
+
+// a standby restored from a checkpoint completes the series in flight
+static void test_dissector_checkpoint(void)
+{
+    uint8_t a[] = {0xC0, 0x01, 0x3C};                   // class 0 read,
+    uint8_t b[] = {0x01, 0x06};                         // in two segments
+    static uint8_t stream[200];
+    DNP3_DissectorConfig config = {0};
+    DNP3_Callbacks cb = {NULL};
+    DNP3_Segment seg = {0};
+    struct DupCount n = {0}, m = {0};
+    size_t len1, len2;
+    int LINE = __LINE__;
+
+    seg.fir = 1;
+    seg.payload = a;
+    seg.len = 3;
+    len1 = make_frame(stream, &seg);
+    seg.fir = 0;
+    seg.fin = 1;
+    seg.seq = 1;
+    seg.payload = b;
+    seg.len = 2;
+    len2 = make_frame(stream+len1, &seg);
+
+    config.dedup_window = 4;
+    cb.app_fragment = dup_fragment;
+    cb.link_duplicate = dup_frame;
+    StreamProcessor *p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config,
+                                           cb, &n);
+    StreamProcessor *q = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config,
+                                           cb, &m);
+    g_assert(p != NULL && q != NULL);
+
+    check_inttype("%d", int, dnp3_dissector_checkpoint(p, NULL, 0), ==, 17);
+    p->feed_external(p, stream, len1);
+    int size = dnp3_dissector_checkpoint(p, NULL, 0);
+    g_assert(size > 17);
+    uint8_t *ckp = calloc(1, size);
+    g_assert(ckp != NULL);
+    check_inttype("%d", int, dnp3_dissector_checkpoint(p, ckp, size-1), ==,
+                  size);
+    check_inttype("%d", int, dnp3_dissector_restore(q, ckp, size), ==, -1);
+    check_inttype("%d", int, dnp3_dissector_checkpoint(p, ckp, size), ==,
+                  size);
+
+    ckp[20] ^= 0x01;
+    check_inttype("%d", int, dnp3_dissector_restore(q, ckp, size), ==, -1);
+    ckp[20] ^= 0x01;
+    check_inttype("%d", int, dnp3_dissector_restore(q, ckp, size), ==, 0);
+
+    // the same state again
+    uint8_t *ckq = calloc(1, size);
+    g_assert(ckq != NULL);
+    check_inttype("%d", int, dnp3_dissector_checkpoint(q, ckq, size), ==,
+                  size);
+    g_assert(memcmp(ckp, ckq, size) == 0);
+
+    // the restored dedup window knows the first frame
+    q->feed_external(q, stream, len1 + len2);
+    q->finish(q);
+    check_inttype("%d", int, m.frames, ==, 1);
+    check_inttype("%d", int, m.fragments, ==, 1);
+
+    // without the checkpoint, the second segment is lost
+    memset(&m, 0, sizeof m);
+    q = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config, cb, &m);
+    g_assert(q != NULL);
+    q->feed_external(q, stream+len1, len2);
+    q->finish(q);
+    check_inttype("%d", int, m.fragments, ==, 0);
+
+    p->feed_external(p, stream+len1, len2);
+    p->finish(p);
+    check_inttype("%d", int, n.fragments, ==, 1);
+    free(ckp);
+    free(ckq);
+}
+
+struct MemCount {
+    int fragments, discards;
+};
+
+static void mem_fragment(void *env, const DNP3_Fragment *fragment,
+                         const uint8_t *buf, size_t len)
+{
+    ((struct MemCount *)env)->fragments++;
+}
+
+static void mem_discard(void *env, size_t n)
+{
+    ((struct MemCount *)env)->discards++;
+}
+
+// a memory budget bounds the series in flight; feeding signals when it runs
+// out
+static void test_dissector_memory(void)
+{
+    uint8_t a[] = {0xC0, 0x01, 0x3C};                   // class 0 read,
+    uint8_t b[] = {0x01, 0x06};                         // in two segments
+    uint8_t c[] = {0xC0, 0x01, 0x3C, 0x01, 0x06};       // or one
+    static uint8_t stream[200*20];
+    uint8_t one[300];
+    DNP3_DissectorConfig config = {0};
+    DNP3_Callbacks cb = {NULL};
+    DNP3_Segment seg = {0};
+    struct MemCount n = {0};
+    size_t len = 0, k;
+    int LINE = __LINE__;
+
+    // 200 series started, the last one finished
+    seg.fir = 1;
+    seg.payload = a;
+    seg.len = 3;
+    for(int src=1; src<=200; src++)
+        len += make_frame_from(stream+len, &seg, src);
+    seg.fir = 0;
+    seg.fin = 1;
+    seg.seq = 1;
+    seg.payload = b;
+    seg.len = 2;
+    k = make_frame_from(stream+len, &seg, 200);
+
+    HAllocator *budget = h_membudget(NULL, 1000000);
+    g_assert(budget != NULL);
+    config.memory = budget;
+    cb.app_fragment = mem_fragment;
+    cb.transport_discard = mem_discard;
+    StreamProcessor *p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config,
+                                           cb, &n);
+    g_assert(p != NULL);
+    check_inttype("%d", int, p->feed_external(p, stream, len + k), ==, 0);
+    g_assert(h_membudget_used(budget) <= 1000000);
+    check_inttype("%d", int, n.fragments, ==, 1);   // the most recent kept
+    g_assert(n.discards > 50);
+#ifdef DNP3_STATS
+    DNP3_Stats st;
+    check_inttype("%d", int, dnp3_dissector_stats(p, &st), ==, 0);
+    check_inttype("%d", int, (int)st.memory_evictions, >=, n.discards);
+#endif
+    check_inttype("%d", int, (int)h_membudget_refused(budget), ==, 0);
+    p->finish(p);
+    check_cmp_size(h_membudget_used(budget), ==, 0);
+    h_membudget_free(budget);
+
+    // no room for a context
+    budget = h_membudget(NULL, 100000);
+    g_assert(budget != NULL);
+    config.memory = budget;
+    p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config, cb, &n);
+    g_assert(p != NULL);
+    void *hog = budget->alloc(budget, 100000 - h_membudget_used(budget) - 32);
+    g_assert(hog != NULL);
+    check_inttype("%d", int, p->feed_external(p, stream+len, k), ==,
+                  DNP3_BACKPRESSURE);
+    check_inttype("%d", int, p->feed_external(p, stream, 0), ==, 0);
+    budget->free(budget, hog);
+    check_inttype("%d", int, p->feed_external(p, stream+len, k), ==, 0);
+    p->finish(p);
+    check_cmp_size(h_membudget_used(budget), ==, 0);
+
+    // room for a context but not for the parse, which completes anyway
+    seg.fir = 1;
+    seg.fin = 1;
+    seg.seq = 0;
+    seg.payload = c;
+    seg.len = 5;
+    size_t k1 = make_frame_from(one, &seg, 9);
+    seg.seq = 1;
+    c[0] = 0xC1;
+    size_t k2 = make_frame_from(one+k1, &seg, 9);
+    p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config, cb, &n);
+    g_assert(p != NULL);
+    hog = budget->alloc(budget, 80000 - h_membudget_used(budget));
+    g_assert(hog != NULL);
+    n.fragments = 0;
+    check_inttype("%d", int, p->feed_external(p, one, k1), ==,
+                  DNP3_BACKPRESSURE);
+    check_inttype("%d", int, n.fragments, ==, 1);
+    g_assert(h_membudget_used(budget) <= 100000);
+    check_inttype("%d", int, p->feed_external(p, one+k1, k2), ==,
+                  DNP3_BACKPRESSURE);
+    check_inttype("%d", int, n.fragments, ==, 2);
+    budget->free(budget, hog);
+    p->finish(p);
+    check_cmp_size(h_membudget_used(budget), ==, 0);
+
+    // nor for the dissector
+    hog = budget->alloc(budget, 90000);
+    g_assert(hog != NULL);
+    g_assert(dnp3_dissector__m(NULL, NULL, NULL, NULL, &config, cb, &n)
+             == NULL);
+    budget->free(budget, hog);
+    check_cmp_size(h_membudget_used(budget), ==, 0);
+    h_membudget_free(budget);
+}
+
+static void shed_fragment(void *env, const DNP3_Fragment *fragment,
+                          const uint8_t *buf, size_t len)
+{
+    GString *out = env;
+    g_string_append_c(out, fragment->shed ? 's' : 'f');
+    if(fragment->shed)
+        g_assert(fragment->nblocks == 1 && fragment->odata[0]->lazy != NULL);
+}
+
+// under overload, selected responses are delivered with headers only
+static void test_dissector_shed(void)
+{
+    uint8_t ana[] = {0xC0, 0x81, 0x00, 0x00, 0x1E, 0x01, 0x00, 0x00, 0x00,
+                     0x01, 0x12, 0x34, 0x56, 0x78};         // g30v1 0-0
+    uint8_t stream[8][64];
+    size_t len[8];
+    DNP3_ShedPolicy shed;
+    DNP3_DissectorConfig config = {0};
+    DNP3_Callbacks cb = {NULL};
+    static const char *expect[] = {"ffffffff", "fsssssss", "fssfssfs",
+                                   "ffffffff"};
+    int LINE = __LINE__;
+
+    for(int i=0; i<8; i++) {
+        DNP3_Segment seg = {0};
+        seg.fir = seg.fin = 1;
+        seg.seq = i;
+        seg.len = sizeof ana;
+        seg.payload = ana;
+        ana[0] = 0xC0 | i;
+        len[i] = make_frame(stream[i], &seg);
+    }
+
+    // every feed call counts as overload, the first one decides
+    dnp3_shed_init(&shed);
+    shed.max_feed_ns = 1;
+    config.ignore_dir = true;
+    cb.app_fragment = shed_fragment;
+    for(int k=0; k<4; k++) {
+        GString *out = g_string_new(NULL);
+        config.shed = (k == 0) ? NULL : &shed;
+        shed.sample = (k == 2) ? 3 : 0;
+        if(k == 3)
+            dnp3_filter_set(shed.select.fc, DNP3_RESPONSE, false);
+
+        StreamProcessor *p = dnp3_dissector__m(NULL, NULL, NULL, NULL,
+                                               &config, cb, out);
+        g_assert(p != NULL);
+        for(int i=0; i<8; i++)
+            p->feed_external(p, stream[i], len[i]);
+#ifdef DNP3_STATS
+        DNP3_Stats st;
+        check_inttype("%d", int, dnp3_dissector_stats(p, &st), ==, 0);
+        check_inttype("%d", int, (int)st.overloads, ==, k > 0);
+#endif
+        p->finish(p);
+        check_string(out->str, ==, expect[k]);
+        g_string_free(out, true);
+    }
+}
+
+static void count_change(void *env, const DNP3_PointChange *c)
+{
+    int *count = env;
+    (*count)++;
+}
+
+static size_t apply_bytes(DNP3_PointDB *db, uint16_t addr, const char *s,
+                          size_t len)
+{
+    HParseResult *r = dnp3_app_decode_fragment(NULL, (const uint8_t *)s, len);
+    g_assert(r != NULL);
+    size_t n = dnp3_pointdb_apply(db, addr, r->ast->user, NULL, NULL);
+    h_parse_result_free(r);
+    return n;
+}
+
+// only new and changed points and events are reported
+static void test_points(void)
+{
+    const char *ana = "\xC0\x81\x00\x00\x1E\x01\x00\x00\x02"      // g30v1 0-2
+                      "\x01\x12\x34\x56\x78\x01\xFF\xFF\xFF\xFF"
+                      "\x01\x00\x00\x00\x80";
+    const char *ana2 = "\xC0\x81\x00\x00\x1E\x01\x00\x01\x01"     // g30v1 1
+                       "\x01\x07\x00\x00\x00";
+    const char *ev = "\xC0\x81\x00\x00\x02\x01\x17\x01\x03\x81";  // g2v1 #3
+    DNP3_PointDB *db = dnp3_pointdb_new(NULL);
+    uint8_t flags;
+    double value;
+    int LINE = __LINE__;
+
+    g_assert(db != NULL);
+    check_cmp_size(apply_bytes(db, 1, ana, 24), ==, 3);
+    check_cmp_size(apply_bytes(db, 1, ana, 24), ==, 0);
+    check_cmp_size(apply_bytes(db, 2, ana, 24), ==, 3);   // other outstation
+    check_cmp_size(apply_bytes(db, 1, ana2, 14), ==, 1);
+    check_cmp_size(apply_bytes(db, 1, ana, 24), ==, 1);
+    check_cmp_size(apply_bytes(db, 1, ev, 10), ==, 1);
+    check_cmp_size(apply_bytes(db, 1, ev, 10), ==, 1);    // events always
+
+    g_assert(dnp3_pointdb_get(db, 1, DNP3_GROUP_ANAIN, 0, &flags, &value));
+    check_inttype("0x%.2X", unsigned, flags, ==, 0x01);
+    check_inttype("%d", int, (int)value, ==, 0x78563412);
+    g_assert(dnp3_pointdb_get(db, 1, DNP3_GROUP_BININ, 3, &flags, &value));
+    check_inttype("0x%.2X", unsigned, flags, ==, 0x81);
+    g_assert(!dnp3_pointdb_get(db, 1, DNP3_GROUP_BININ, 0, NULL, NULL));
+    g_assert(!dnp3_pointdb_get(db, 3, DNP3_GROUP_ANAIN, 0, NULL, NULL));
+    dnp3_pointdb_free(db);
+
+    // through the dissector
+    static uint8_t stream[200];
+    DNP3_DissectorConfig config = {0};
+    DNP3_Callbacks cb = {NULL};
+    DNP3_Segment seg = {0};
+    size_t len = 0;
+    int changes = 0;
+
+    seg.fir = seg.fin = 1;
+    seg.payload = (uint8_t *)ana;
+    seg.len = 24;
+    len += make_frame(stream+len, &seg);
+    seg.seq = 1;
+    len += make_frame(stream+len, &seg);
+
+    config.point_db = true;
+    config.ignore_dir = true;
+    cb.point_change = count_change;
+    StreamProcessor *p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config,
+                                           cb, &changes);
+    g_assert(p != NULL);
+    p->feed_external(p, stream, len);
+    p->finish(p);
+    check_inttype("%d", int, changes, ==, 3);
+}
+
+static void collect_record(void *env, const DNP3_ArchiveRecord *r)
+{
+    GArray *a = env;
+    g_array_append_val(a, *r);
+}
+
+static int add_bytes(DNP3_ArchiveWriter *w, uint16_t addr, DNP3_Time t,
+                     const char *s, size_t len)
+{
+    HParseResult *r = dnp3_app_decode_fragment(NULL, (const uint8_t *)s, len);
+    g_assert(r != NULL);
+    const DNP3_Fragment *frag = r->ast->user;
+    int n = 0;
+    for(size_t i=0; i<frag->nblocks; i++)
+        n += dnp3_archive_add(w, addr, t, frag->odata[i]);
+    h_parse_result_free(r);
+    return n;
+}
+
+static void test_archive(void)
+{
+    const char *ana = "\xC0\x81\x00\x00\x1E\x01\x00\x00\x02"      // g30v1 0-2
+                      "\x01\x12\x34\x56\x78\x01\xFF\xFF\xFF\xFF"
+                      "\x01\x00\x00\x00\x80";
+    const char *ctr = "\xC0\x81\x00\x00\x14\x01\x00\x05\x05"      // g20v1 5
+                      "\x01\x2A\x00\x00\x00";
+    const char *tim = "\xC0\x81\x00\x00\x32\x01\x07\x01"          // g50v1
+                      "\x00\x00\x00\x00\x00\x00";
+    char path[] = "/tmp/dnp3-archive-XXXXXX";
+    GArray *recs = g_array_new(false, false, sizeof(DNP3_ArchiveRecord));
+    DNP3_Filter filter;
+    int LINE = __LINE__;
+
+    int fd = mkstemp(path);
+    g_assert(fd >= 0);
+    close(fd);
+
+    DNP3_ArchiveWriter *w = dnp3_archive_create(path, NULL);
+    g_assert(w != NULL);
+    for(int i=0; i<10; i++) {
+        check_inttype("%d", int, add_bytes(w, 1, 1000+100*i, ana, 24), ==, 3);
+        check_inttype("%d", int, add_bytes(w, 2, 1000+100*i, ctr, 14), ==, 1);
+    }
+    check_inttype("%d", int, add_bytes(w, 1, 5000, tim, 14), ==, 0);
+    check_inttype("%d", int, dnp3_archive_flush(w), ==, 0);
+
+    // readable up to the last flush before it is finished
+    DNP3_Archive *a = dnp3_archive_open(path, NULL);
+    g_assert(a != NULL);
+    check_cmp_size(dnp3_archive_size(a), ==, 40);
+    dnp3_archive_free(a);
+
+    check_inttype("%d", int, add_bytes(w, 1, 2000, ana, 24), ==, 3);
+    check_inttype("%d", int, dnp3_archive_finish(w), ==, 0);
+
+    a = dnp3_archive_open(path, NULL);
+    g_assert(a != NULL);
+    check_cmp_size(dnp3_archive_size(a), ==, 43);
+    g_assert(dnp3_archive_query(a, 0, UINT64_MAX, NULL, collect_record, recs)
+             == 43);
+    check_cmp_size(recs->len, ==, 43);
+
+    int nana = 0, nctr = 0;
+    for(size_t i=0; i<recs->len; i++) {
+        const DNP3_ArchiveRecord *r = &g_array_index(recs, DNP3_ArchiveRecord, i);
+        if(r->group == DNP3_GROUP_ANAIN) {
+            check_inttype("%d", int, r->outstation, ==, 1);
+            g_assert(r->index < 3);
+            if(r->index == 0)
+                check_inttype("%d", int, r->object.ana.sint, ==, 0x78563412);
+            if(r->index == 2)
+                check_inttype("%d", int, r->object.ana.sint, ==, INT32_MIN);
+            nana++;
+        } else {
+            check_inttype("%d", int, r->group, ==, DNP3_GROUP_CTR);
+            check_inttype("%d", int, r->outstation, ==, 2);
+            check_inttype("%d", int, r->index, ==, 5);
+            check_inttype("%u", unsigned, r->object.ctr.value, ==, 42);
+            check_inttype("%d", int, (int)r->time, ==, 1000+100*nctr);
+            nctr++;
+        }
+    }
+    check_inttype("%d", int, nana, ==, 33);
+    check_inttype("%d", int, nctr, ==, 10);
+
+    // time range
+    g_array_set_size(recs, 0);
+    g_assert(dnp3_archive_query(a, 1200, 1400, NULL, collect_record, recs)
+             == 3 * 4);
+    for(size_t i=0; i<recs->len; i++) {
+        const DNP3_ArchiveRecord *r = &g_array_index(recs, DNP3_ArchiveRecord, i);
+        g_assert(r->time >= 1200 && r->time <= 1400);
+    }
+
+    // by group
+    dnp3_filter_init(&filter);
+    memset(filter.group, 0, sizeof(filter.group));
+    dnp3_filter_set(filter.group, DNP3_GROUP_CTR, true);
+    g_array_set_size(recs, 0);
+    g_assert(dnp3_archive_query(a, 0, UINT64_MAX, &filter, collect_record,
+                                recs) == 10);
+
+    // by outstation
+    dnp3_filter_init(&filter);
+    dnp3_filter_set(filter.addr, 2, true);      // deny
+    g_array_set_size(recs, 0);
+    g_assert(dnp3_archive_query(a, 0, UINT64_MAX, &filter, collect_record,
+                                recs) == 33);
+
+    dnp3_archive_free(a);
+    g_array_free(recs, true);
+    unlink(path);
+}
+
+// both implementations against RFC 4231 and the GCM spec (via openssl)
+static void test_mac(void)
+{
+    const uint8_t sha_abc[32] =
+        "\xBA\x78\x16\xBF\x8F\x01\xCF\xEA\x41\x41\x40\xDE\x5D\xAE\x22\x23"
+        "\xB0\x03\x61\xA3\x96\x17\x7A\x9C\xB4\x10\xFF\x61\xF2\x00\x15\xAD";
+    const uint8_t hmac_jefe[32] =
+        "\x5B\xDC\xC1\x46\xBF\x60\x75\x4E\x6A\x04\x24\x26\x08\x95\x75\xC7"
+        "\x5A\x00\x3F\x08\x9D\x27\x39\x83\x9D\xEC\x58\xB9\x64\xEC\x38\x43";
+    const uint8_t gmac_abc[16] =
+        "\x35\x44\x2B\xB2\xBB\x8A\x21\xE5\x00\x05\xE4\x0D\xB9\x14\x72\x18";
+    const uint8_t key[16] = "\x00\x01\x02\x03\x04\x05\x06\x07"
+                            "\x08\x09\x0A\x0B\x0C\x0D\x0E\x0F";
+    const uint8_t iv[12] = "\xA0\xA1\xA2\xA3\xA4\xA5\xA6\xA7\xA8\xA9\xAA\xAB";
+    uint8_t out[DNP3_MAC_MAXLEN];
+    DNP3_MacKey k;
+    int LINE = __LINE__;
+
+    for(int hw=1; hw>=0; hw--) {
+        dnp3_mac_select(hw);
+        g_test_message("sha: %s, aes: %s", dnp3_mac_impl_sha(),
+                       dnp3_mac_impl_aes());
+
+        dnp3_sha256((const uint8_t *)"abc", 3, out);
+        g_assert(memcmp(out, sha_abc, 32) == 0);
+
+        g_assert(dnp3_mac_key(&k, DNP3_MAC_HMAC_SHA256,
+                              (const uint8_t *)"Jefe", 4));
+        check_cmp_size(dnp3_mac(&k, NULL, (const uint8_t *)"what do ya", 10,
+                                (const uint8_t *)" want for nothing?", 18,
+                                out), ==, 32);
+        g_assert(memcmp(out, hmac_jefe, 32) == 0);
+
+        g_assert(dnp3_mac_key(&k, DNP3_MAC_AES_GMAC, key, 16));
+        check_cmp_size(dnp3_mac(&k, iv, (const uint8_t *)"abc", 3,
+                                (const uint8_t *)"defg", 4, out), ==, 16);
+        g_assert(memcmp(out, gmac_abc, 16) == 0);
+
+        g_assert(!dnp3_mac_key(&k, DNP3_MAC_AES_GMAC, key, 15));
+    }
+    dnp3_mac_select(true);
+}
+
+// an aggressive-mode request through the key cache
+static void test_auth(void)
+{
+    // outstation 10 to master 1: challenge, csq 1, data DEADBEEF
+    const uint8_t chal[] = "\xC0\x83\x00\x00\x78\x01\x5B\x01\x0C\x00"
+                           "\x01\x00\x00\x00\x01\x00\x04\x01"
+                           "\xDE\xAD\xBE\xEF";
+    // master 1 to outstation 10: g120v3 csq 2, class 0 poll, g120v9
+    uint8_t req[] = "\xC1\x01\x78\x03\x07\x01\x02\x00\x00\x00\x01\x00"
+                    "\x3C\x01\x06"
+                    "\x78\x09\x5B\x01\x10\x00"
+                    "\x68\xA1\xD2\x49\xE8\x23\xC8\x32"
+                    "\xE7\x4A\x88\x85\xC9\x77\x3F\x87";
+    const uint8_t key[16] = "\x00\x01\x02\x03\x04\x05\x06\x07"
+                            "\x08\x09\x0A\x0B\x0C\x0D\x0E\x0F";
+    size_t len = sizeof(req) - 1;
+    uint8_t big[18 + 300];      // the same with 300 octets of challenge data
+    uint8_t gmac[sizeof chal];  // the same asking for AES-GMAC (mal 6)
+    int LINE = __LINE__;
+
+    memcpy(big, chal, 18);
+    big[8] = (8 + 300) & 0xFF;
+    big[9] = (8 + 300) >> 8;
+    memset(big + 18, 0xAA, 300);
+    memcpy(gmac, chal, sizeof chal);
+    gmac[16] = 6;
+
+    HParseResult *r = h_parse(dnp3_p_app_request, req, len);
+    g_assert(r != NULL);
+    check_inttype("%d", int, r->ast->token_type, ==, TT_DNP3_Fragment);
+    const DNP3_Fragment *frag = r->ast->user;
+    g_assert(frag->auth != NULL);
+    check_cmp_size(frag->nblocks, ==, 1);
+    check_inttype("%d", int, frag->odata[0]->group, ==, DNP3_GROUP_CLASS);
+    check_inttype("%u", unsigned, frag->auth->csq, ==, 2);
+    check_inttype("%u", unsigned, frag->auth->usr, ==, 1);
+    check_cmp_size(frag->auth->maclen, ==, 16);
+    check_cmp_size(frag->auth->machdr, ==, 6);
+    check_inttype("%d", int, frag->auth->status, ==, DNP3_AUTH_UNCHECKED);
+
+    DNP3_KeyCache *kc = dnp3_keycache_new(NULL);
+    g_assert(kc != NULL);
+    g_assert(!dnp3_keycache_set(kc, 1, 10, DNP3_MAC_NONE, key, 16));
+    g_assert(dnp3_keycache_set(kc, 1, 10, DNP3_MAC_HMAC_SHA256, key, 16));
+    check_inttype("%d", int, dnp3_keycache_verify(kc, 1, 10, frag->auth,
+                                                  req, len),
+                  ==, DNP3_AUTH_UNCHECKED);     // no challenge yet
+    dnp3_keycache_challenge(kc, 1, 10, chal, sizeof(chal) - 1); // wrong way
+    check_inttype("%d", int, dnp3_keycache_verify(kc, 1, 10, frag->auth,
+                                                  req, len),
+                  ==, DNP3_AUTH_UNCHECKED);
+    dnp3_keycache_challenge(kc, 10, 1, chal, sizeof(chal) - 1);
+    check_inttype("%d", int, dnp3_keycache_verify(kc, 1, 10, frag->auth,
+                                                  req, len),
+                  ==, DNP3_AUTH_OK);
+    req[13] = 0x02;                             // class 1, same MAC
+    check_inttype("%d", int, dnp3_keycache_verify(kc, 1, 10, frag->auth,
+                                                  req, len),
+                  ==, DNP3_AUTH_FAILED);
+    req[13] = 0x01;
+    g_assert(!dnp3_keycache_challenge(kc, 10, 1, big, sizeof(big)));
+    check_inttype("%d", int, dnp3_keycache_verify(kc, 1, 10, frag->auth,
+                                                  req, len),
+                  ==, DNP3_AUTH_UNCHECKED);     // challenge not kept
+    g_assert(dnp3_keycache_challenge(kc, 10, 1, chal, sizeof(chal) - 1));
+    check_inttype("%d", int, dnp3_keycache_verify(kc, 1, 10, frag->auth,
+                                                  req, len),
+                  ==, DNP3_AUTH_OK);
+    g_assert(!dnp3_keycache_challenge(kc, 10, 1, gmac, sizeof(gmac) - 1));
+    check_inttype("%d", int, dnp3_keycache_verify(kc, 1, 10, frag->auth,
+                                                  req, len),
+                  ==, DNP3_AUTH_UNCHECKED);     // not HMAC-SHA-256
+    g_assert(dnp3_keycache_challenge(kc, 10, 1, chal, sizeof(chal) - 1));
+    g_assert(dnp3_keycache_set(kc, 1, 10, DNP3_MAC_NONE, NULL, 0));
+    check_inttype("%d", int, dnp3_keycache_verify(kc, 1, 10, frag->auth,
+                                                  req, len),
+                  ==, DNP3_AUTH_UNCHECKED);     // key removed
+    dnp3_keycache_free(kc);
+    h_parse_result_free(r);
+}
+
+static int count_frame(void *env, const DNP3_Frame *frame,
+                       const uint8_t *buf, size_t len)
+{
+    int *count = env;
+    (*count)++;
+    return 0;
+}
+
+// feed_budget stops after the given number of frames and resumes
+static void test_dissector_budget(void)
+{
+    uint8_t data[] = {0xC0, 0x01, 0x3C, 0x02, 0x06};    // READ class 1
+    DNP3_Segment seg = {0};
+    DNP3_Callbacks cb = {NULL};
+    uint8_t last[100];
+    int count = 0, r;
+    size_t len = 0;
+    int LINE = __LINE__;
+
+    cb.link_frame = count_frame;
+    StreamProcessor *p = dnp3_dissector(cb, &count);
+    g_assert(p != NULL);
+    g_assert(p->feed_budget != NULL);
+
+    seg.fir = seg.fin = 1;
+    seg.payload = data;
+    seg.len = sizeof(data);
+    for(int i=0; i<20; i++)
+        len += make_frame(p->buf + len, &seg);
+    size_t flen = make_frame(last, &seg);
+    memcpy(p->buf + len, last, flen - 1);       // incomplete
+    len += flen - 1;
+
+    r = p->feed_budget(p, len, 7, 0);
+    check_inttype("%d", int, count, ==, 7);
+    check_inttype("%d", int, r, ==, len - 7*flen);
+    r = p->feed_budget(p, 0, 7, 0);
+    check_inttype("%d", int, count, ==, 14);
+    r = p->feed_budget(p, 0, 0, 1);             // time limit
+    check_inttype("%d", int, count, ==, 15);
+    check_inttype("%d", int, r, ==, len - 15*flen);
+    r = p->feed_budget(p, 0, 4, 0);
+    check_inttype("%d", int, count, ==, 19);
+    check_inttype("%d", int, r, ==, len - 19*flen);
+    r = p->feed_budget(p, 0, 1, 0);             // spent on the last one
+    check_inttype("%d", int, count, ==, 20);
+    check_inttype("%d", int, r, ==, 0);         // only the incomplete frame
+    r = p->feed_budget(p, 0, 0, 0);             // no limit
+    check_inttype("%d", int, count, ==, 20);
+    check_inttype("%d", int, r, ==, 0);
+
+    // complete the last frame
+    p->buf[0] = last[flen - 1];
+    r = p->feed_budget(p, 1, 1, 0);
+    check_inttype("%d", int, count, ==, 21);
+    check_inttype("%d", int, r, ==, 0);
+    p->finish(p);
+}
+
+#ifdef __linux__
+struct IngestCount {
+    int opened, closed;
+    int udp_frames, tcp_frames;
+    int feedv, feedv_iov;       // calls, datagrams passed in them
+};
+
+// a processor per ingest flow, counting what it is fed on the way to a
+// dissector
+struct IngestFlow {
+    StreamProcessor base;
+    StreamProcessor *d;
+    struct IngestCount *n;
+    bool udp;
+};
+
+static int ingest_frame(void *env, const DNP3_Frame *frame,
+                        const uint8_t *buf, size_t len)
+{
+    struct IngestFlow *f = env;
+    if(f->udp)
+        f->n->udp_frames++;
+    else
+        f->n->tcp_frames++;
+    return 0;
+}
+
+static int ingest_feed_external(StreamProcessor *base, const uint8_t *data,
+                                size_t n)
+{
+    struct IngestFlow *f = (struct IngestFlow *)base;
+    return f->d->feed_external(f->d, data, n);
+}
+
+static int ingest_feedv(StreamProcessor *base, const struct iovec *iov,
+                        int iovcnt)
+{
+    struct IngestFlow *f = (struct IngestFlow *)base;
+    f->n->feedv++;
+    f->n->feedv_iov += iovcnt;
+    return f->d->feedv(f->d, iov, iovcnt);
+}
+
+static int ingest_finish(StreamProcessor *base)
+{
+    struct IngestFlow *f = (struct IngestFlow *)base;
+    int r = f->d->finish(f->d);
+    free(f);
+    return r;
+}
+
+static StreamProcessor *ingest_open(void *env, const DNP3_IngestFlow *flow)
+{
+    struct IngestFlow *f = calloc(1, sizeof(struct IngestFlow));
+    DNP3_Callbacks cb = {NULL};
+
+    g_assert(f != NULL);
+    cb.link_frame = ingest_frame;
+    f->d = dnp3_dissector(cb, f);
+    g_assert(f->d != NULL);
+    f->base.feed_external = ingest_feed_external;
+    f->base.feedv = ingest_feedv;
+    f->base.finish = ingest_finish;
+    f->n = env;
+    f->udp = flow->udp;
+    f->n->opened++;
+    return &f->base;
+}
+
+static void ingest_close(void *env, const DNP3_IngestFlow *flow)
+{
+    ((struct IngestCount *)env)->closed++;
+}
+
+// run ing until *x reaches v, for a few seconds at most
+static void ingest_until(DNP3_Ingest *ing, const int *x, int v)
+{
+    for(int i=0; i<50 && *x < v; i++)
+        g_assert(dnp3_ingest_run(ing, 100) >= 0);
+}
+
+// live ingest from loopback sockets
+static void test_ingest(void)
+{
+    uint8_t data[] = {0xC0, 0x01, 0x3C, 0x02, 0x06};    // READ class 1
+    DNP3_Segment seg = {0};
+    DNP3_IngestConfig config = {0};
+    DNP3_IngestStats st;
+    struct IngestCount n = {0};
+    struct sockaddr_in a = {0};
+    socklen_t alen = sizeof a;
+    uint8_t frame[300];
+    int LINE = __LINE__;
+
+    seg.fir = seg.fin = 1;
+    seg.payload = data;
+    seg.len = sizeof(data);
+    int flen = make_frame(frame, &seg);
+
+    config.open = ingest_open;
+    config.close = ingest_close;
+    config.idle_timeout = 1;
+    DNP3_Ingest *ing = dnp3_ingest_new(&config, &n);
+    g_assert(ing != NULL);
+
+    // a TCP and a UDP socket on some free port
+    check_inttype("%d", int, dnp3_ingest_listen(ing, "127.0.0.1", "0"), ==, 2);
+
+    // consecutive datagrams from one peer are fed together
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int udp = socket(AF_INET, SOCK_DGRAM, 0);
+    g_assert(udp >= 0);
+    g_assert(bind(udp, (struct sockaddr *)&a, sizeof a) == 0);
+    g_assert(getsockname(udp, (struct sockaddr *)&a, &alen) == 0);
+    check_inttype("%d", int, dnp3_ingest_add(ing, udp), ==, 0);
+
+    int peer = socket(AF_INET, SOCK_DGRAM, 0);
+    g_assert(peer >= 0);
+    for(int i=0; i<3; i++) {
+        g_assert(sendto(peer, frame, flen, 0, (struct sockaddr *)&a, sizeof a)
+                 == flen);
+    }
+    check_inttype("%d", int, dnp3_ingest_run(ing, 1000), ==, 3*flen);
+    check_inttype("%d", int, n.opened, ==, 1);
+    check_inttype("%d", int, n.udp_frames, ==, 3);
+    check_inttype("%d", int, n.feedv, ==, 1);
+    check_inttype("%d", int, n.feedv_iov, ==, 3);
+
+    // a connection through a listening socket, closed by the peer
+    int srv = socket(AF_INET, SOCK_STREAM, 0);
+    g_assert(srv >= 0);
+    a.sin_port = 0;
+    alen = sizeof a;
+    g_assert(bind(srv, (struct sockaddr *)&a, sizeof a) == 0);
+    g_assert(listen(srv, 1) == 0);
+    g_assert(getsockname(srv, (struct sockaddr *)&a, &alen) == 0);
+    check_inttype("%d", int, dnp3_ingest_add(ing, srv), ==, 0);
+
+    int cli = socket(AF_INET, SOCK_STREAM, 0);
+    g_assert(cli >= 0);
+    g_assert(connect(cli, (struct sockaddr *)&a, sizeof a) == 0);
+    ingest_until(ing, &n.opened, 2);
+    check_inttype("%d", int, n.opened, ==, 2);
+    g_assert(write(cli, frame, flen) == flen);
+    g_assert(write(cli, frame, flen) == flen);
+    ingest_until(ing, &n.tcp_frames, 2);
+    check_inttype("%d", int, n.tcp_frames, ==, 2);
+    check_inttype("%d", int, n.closed, ==, 0);
+    close(cli);
+    ingest_until(ing, &n.closed, 1);
+    check_inttype("%d", int, n.closed, ==, 1);
+
+    // the UDP peer times out
+    ingest_until(ing, &n.closed, 2);
+    check_inttype("%d", int, n.closed, ==, 2);
+    check_inttype("%d", int, n.udp_frames, ==, 3);
+    close(peer);
+
+    dnp3_ingest_stats(ing, &st);
+    check_inttype("%d", int, (int)st.flows, ==, 2);
+    check_inttype("%d", int, (int)st.datagrams, ==, 3);
+    check_inttype("%d", int, (int)st.bytes, ==, 5*flen);
+    check_inttype("%d", int, (int)st.flows_refused, ==, 0);
+    check_inttype("%d", int, (int)st.feed_errors, ==, 0);
+    check_inttype("%d", int, (int)st.recv_errors, ==, 0);
+    dnp3_ingest_free(ing);
+    check_inttype("%d", int, n.closed, ==, 2);
+}
+#endif
+
+#ifdef DNP3_STATS
+static void test_dissector_stats(void)
+{
+    uint8_t stream[1000];
+    uint8_t data[20] = {0xC0, 0x01};    // READ
+    DNP3_Segment seg = {0};
+    DNP3_DissectorConfig config = {0};
+    DNP3_Callbacks cb = {NULL};
+    DNP3_Stats st;
+    size_t len = 0;
+    int LINE = __LINE__;
+
+    seg.fir = seg.fin = 1;
+    seg.payload = data;
+    seg.len = 2;
+    len += make_frame(stream+len, &seg);
+    memcpy(stream+len, "\x05\x64\x05", 3);  // garbage
+    len += 3;
+    len += make_frame(stream+len, &seg);
+    stream[len-1] ^= 1;                     // crc error
+    seg.fir = 0;
+    len += make_frame(stream+len, &seg);    // discarded
+    seg.fir = 1;
+    data[1] = 0x77;                         // unknown function code
+    len += make_frame(stream+len, &seg);
+
+    config.stats_timing = true;
+    StreamProcessor *p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config,
+                                           cb, NULL);
+    g_assert(p != NULL);
+    p->feed_external(p, stream, len);
+    check_inttype("%d", int, dnp3_dissector_stats(p, &st), ==, 0);
+    p->finish(p);
+
+    check_inttype("%" PRIu64, uint64_t, st.frames, ==, 4);
+    check_inttype("%" PRIu64, uint64_t, st.bytes_skipped, ==, 3);
+    check_inttype("%" PRIu64, uint64_t, st.crc_errors, ==, 1);
+    check_inttype("%" PRIu64, uint64_t, st.transport_discards, ==, 1);
+    check_inttype("%" PRIu64, uint64_t, st.app_fragments, ==, 1);
+    check_inttype("%" PRIu64, uint64_t,
+                  st.app_errors[ERR_FUNC_NOT_SUPP - TT_ERR], ==, 1);
+
+    uint64_t nlink = 0, napp = 0;
+    for(int i=0; i<DNP3_STATS_NBINS; i++) {
+        nlink += st.link_time[i];
+        napp += st.app_time[i];
+    }
+    check_inttype("%" PRIu64, uint64_t, nlink, ==, 4);
+    check_inttype("%" PRIu64, uint64_t, napp, ==, 2);
+}
+#endif
+
 #define check_sloballoc_invariants() do {                                   \
     int err = slobcheck(slob);                                              \
     if(err) {                                                               \
@@ -1247,12 +3025,22 @@ static void test_transport(void)
     slobfree(slob, P);              \
   } while(0)
 
+// sizes (of data) as sloballoc rounds them, see sloballoc.c
+#define H sizeof(size_t)
+#define SLOBROUND(n) ((((n) + H + SLOBALIGN-1) & ~(SLOBALIGN-1)) - H)
+#define MINBLOCK SLOBROUND(2*sizeof(void *) + H)
+
+// where blocks are cut from: the data area ends a header short of an
+// aligned address, here the end of mem
+#define TOP (N - H % SLOBALIGN)
+
 #define N 1024
 
 #define SLOBALLOC_FIXTURE                                                   \
-    static uint8_t mem[N] = {0x58};                                         \
+    static union { uint8_t b[N]; long double align; } mem_ = {{0x58}};      \
+    uint8_t *mem = mem_.b;                                                  \
     SLOB *slob = slobinit(mem, N);                                          \
-    size_t max = N - 2*sizeof(size_t) - sizeof(void *);                     \
+    size_t max = slob ? slobmax(slob) : 0;                                  \
     (void)max;  /* silence warning */                                       \
     if(!slob) {                                                             \
         g_test_message("SLOB allocator init failed on line %d", __LINE__);  \
@@ -1264,13 +3052,13 @@ static void test_sloballoc_size(void)
     SLOBALLOC_FIXTURE
     void *p;
 
-    check_sloballoc(p, max, N-max);
+    check_sloballoc(p, max, TOP-max);
     check_slobfree(p);
 
     check_sloballoc_fail(N);
     check_sloballoc_fail(max+1);
 
-    check_sloballoc(p, max, N-max);
+    check_sloballoc(p, max, TOP-max);
     check_slobfree(p);
 
     check_sloballoc_invariants();
@@ -1281,24 +3069,26 @@ static void test_sloballoc_merge(void)
     SLOBALLOC_FIXTURE
     void *p, *q, *r;
 
-    check_sloballoc(p, 100, N-100);
+    check_sloballoc(p, 100, TOP-SLOBROUND(100));
     check_slobfree(p);
-    check_sloballoc(p, max, N-max);
+    check_sloballoc(p, max, TOP-max);
     check_slobfree(p);
 
-    check_sloballoc(p, 100, N-100);
-    check_sloballoc(q, 100, N-200-sizeof(size_t));
+    check_sloballoc(p, 100, TOP-SLOBROUND(100));
+    check_sloballoc(q, 100, TOP-2*SLOBROUND(100)-H);
     check_slobfree(p);
-    check_sloballoc(p,  50, N-50);
-    check_sloballoc(r, 100, N-300-2*sizeof(size_t));
+    check_sloballoc(p,  50, TOP-SLOBROUND(50));
+    check_sloballoc(r, 100, TOP-3*SLOBROUND(100)-2*H);
     check_slobfree(q);
-    check_sloballoc(q, 150, N-200-sizeof(size_t));
+    // the gap of 150 is in a class that does not guarantee a fit, so the
+    // allocation is cut from the large block
+    check_sloballoc(q, 150, TOP-3*SLOBROUND(100)-SLOBROUND(150)-3*H);
     check_slobfree(p);
     check_slobfree(r);
     check_slobfree(q);  // merge left and right
 
     check_sloballoc_fail(max+1);
-    check_sloballoc(p, max, N-max);
+    check_sloballoc(p, max, TOP-max);
     check_slobfree(p);
 
     check_sloballoc_invariants();
@@ -1309,11 +3099,11 @@ static void test_sloballoc_small(void)
     SLOBALLOC_FIXTURE
     void *p, *q, *r;
 
-    check_sloballoc(p, 100, N-100);
-    check_sloballoc(q,   1, N-100-sizeof(size_t)-sizeof(void *));
-    check_sloballoc(r, 100, N-200-2*sizeof(size_t)-sizeof(void *));
+    check_sloballoc(p, 100, TOP-SLOBROUND(100));
+    check_sloballoc(q,   1, TOP-SLOBROUND(100)-H-MINBLOCK);
+    check_sloballoc(r, 100, TOP-2*SLOBROUND(100)-2*H-MINBLOCK);
     check_slobfree(q);
-    check_sloballoc(q,   1, N-100-sizeof(size_t)-sizeof(void *));
+    check_sloballoc(q,   1, TOP-SLOBROUND(100)-H-MINBLOCK);
     check_slobfree(p);
     check_slobfree(r);
 
@@ -1333,7 +3123,8 @@ static void test_sloballoc_small(void)
 
 static void test_sloballoc_hammer(void)
 {
-    static uint8_t mem[N] = {0x58};
+    static union { uint8_t b[N]; long double align; } mem_ = {{0x58}};
+    uint8_t *mem = mem_.b;
     HAllocator *mm = h_sloballoc(mem, N); int line = __LINE__;
     SLOB *slob = ((void *)mm) + sizeof(HAllocator);
     void *p, *q, *r;
@@ -1343,11 +3134,11 @@ static void test_sloballoc_hammer(void)
         g_test_fail();
     }
 
-    check_h_sloballoc(p, 100, N-100);
-    check_h_sloballoc(q,   1, N-100-sizeof(size_t)-sizeof(void *));
-    check_h_sloballoc(r, 100, N-200-2*sizeof(size_t)-sizeof(void *));
+    check_h_sloballoc(p, 100, TOP-SLOBROUND(100));
+    check_h_sloballoc(q,   1, TOP-SLOBROUND(100)-H-MINBLOCK);
+    check_h_sloballoc(r, 100, TOP-2*SLOBROUND(100)-2*H-MINBLOCK);
     check_h_slobfree(q);
-    check_h_sloballoc(q,   1, N-100-sizeof(size_t)-sizeof(void *));
+    check_h_sloballoc(q,   1, TOP-SLOBROUND(100)-H-MINBLOCK);
     check_h_slobfree(p);
     check_h_slobfree(r);
 
@@ -1356,10 +3147,1106 @@ static void test_sloballoc_hammer(void)
 
 #undef N
 
+#define N 65536
+#define NLIVE 256
+
+// random size, mostly small like parse results, sometimes large
+static size_t stress_size(void)
+{
+    if(g_test_rand_int_range(0, 16) == 0)
+        return g_test_rand_int_range(1, 4096);
+    return g_test_rand_int_range(1, 65);
+}
+
+static void test_sloballoc_stress(void)
+{
+    static union { uint8_t b[N]; long double align; } mem_;
+    uint8_t *mem = mem_.b;
+    SLOB *slob = slobinit(mem, N);
+    uint8_t *live[NLIVE] = {NULL};
+    size_t size[NLIVE];
+
+    g_assert(slob != NULL);
+    size_t max = slobmax(slob);
+
+    for(int i=0; i<20000; i++) {
+        int k = g_test_rand_int_range(0, NLIVE);
+
+        if(live[k]) {
+            // contents must be intact
+            for(size_t j=0; j<size[k]; j++) {
+                if(live[k][j] != (uint8_t)k) {
+                    g_test_message("block %d overwritten at step %d", k, i);
+                    g_test_fail();
+                    return;
+                }
+            }
+            slobfree(slob, live[k]);
+            live[k] = NULL;
+        } else {
+            size[k] = stress_size();
+            live[k] = sloballoc(slob, size[k]);
+            if(live[k])
+                memset(live[k], k, size[k]);
+        }
+
+        if(i % 64 == 0)
+            check_sloballoc_invariants();
+    }
+
+    // everything coalesces back into one block
+    for(int k=0; k<NLIVE; k++)
+        if(live[k]) slobfree(slob, live[k]);
+    check_sloballoc_invariants();
+    uint8_t *p = sloballoc(slob, max);
+    check_cmp_ptr(p, ==, mem + TOP - max);
+}
+
+// time alloc/free pairs on a fresh and on a fragmented heap;
+// with size classes, both should take about the same.
+static double bench_slob(SLOB *slob, long iters)
+{
+    void *ring[64] = {NULL};
+
+    g_test_timer_start();
+    for(long i=0; i<iters; i++) {
+        void **p = &ring[i & 63];
+        if(*p) slobfree(slob, *p);
+        *p = sloballoc(slob, 8 + (i * 37) % 120);
+    }
+    double sec = g_test_timer_elapsed();
+
+    for(int i=0; i<64; i++)
+        if(ring[i]) slobfree(slob, ring[i]);
+
+    return iters / sec;
+}
+
+static void test_sloballoc_bench(void)
+{
+    static uint8_t mem[16*N];
+    SLOB *slob = slobinit(mem, sizeof(mem));
+    static void *hold[16*N/64];
+    long iters = 2000000;
+    int n = 0;
+
+    g_assert(slob != NULL);
+    g_test_maximized_result(bench_slob(slob, iters),
+                            "alloc/free pairs per second, fresh heap");
+
+    // fragment: fill the heap with small blocks and free every other one
+    while(n < (int)(sizeof(hold)/sizeof(*hold)) &&
+          (hold[n] = sloballoc(slob, 16 + n % 32)))
+        n++;
+    for(int i=0; i<n; i+=2)
+        slobfree(slob, hold[i]);
+    g_test_message("fragmented heap: %d free blocks", (n+1)/2);
+
+    g_test_maximized_result(bench_slob(slob, iters),
+                            "alloc/free pairs per second, fragmented heap");
+
+    for(int i=1; i<n; i+=2)
+        slobfree(slob, hold[i]);
+    check_sloballoc_invariants();
+}
+
+#undef NLIVE
+#undef N
+#undef TOP
+#undef MINBLOCK
+#undef SLOBROUND
+#undef H
+
 
 
+// allocator that counts calls into the system allocator (thread-safe)
+static int ncalls;
+static void *counted_alloc(HAllocator *mm, size_t n)
+{
+    g_atomic_int_inc(&ncalls);
+    return h_system_allocator->alloc(h_system_allocator, n);
+}
+static void *counted_realloc(HAllocator *mm, void *p, size_t n)
+{
+    g_atomic_int_inc(&ncalls);
+    return h_system_allocator->realloc(h_system_allocator, p, n);
+}
+static void counted_free(HAllocator *mm, void *p)
+{
+    g_atomic_int_inc(&ncalls);
+    h_system_allocator->free(h_system_allocator, p);
+}
+static HAllocator counted = {counted_alloc, counted_realloc, counted_free};
+
+static void test_region(void)
+{
+    HAllocator *mm = h_region(&counted, 1024);
+    uint8_t *p, *q, *r;
+    int LINE = __LINE__;
+
+    g_assert(mm != NULL);
+    ncalls = 0;
+    p = mm->alloc(mm, 100);
+    check_inttype("%d", int, ncalls, ==, 1);        // first chunk
+    check_cmp_size((uintptr_t)p % sizeof(void *), ==, 0);
+    memset(p, 0x58, 100);
+
+    // most recent allocation grows in place
+    q = mm->alloc(mm, 10);
+    r = mm->realloc(mm, q, 200);
+    check_cmp_ptr(r, ==, q);
+    r = mm->realloc(mm, p, 200);                    // copy
+    check_cmp_ptr(r, !=, p);
+    check_inttype("%d", int, r[99], ==, 0x58);
+
+    // chains new chunks, including oversized ones
+    q = mm->alloc(mm, 800);
+    g_assert(q != NULL);
+    q = mm->alloc(mm, 5000);
+    g_assert(q != NULL);
+    int n = ncalls;
+    check_inttype("%d", int, n, ==, 3);
+
+    // reset reuses the chunks, without calls to the system allocator
+    for(int i=0; i<10; i++) {
+        h_region_reset(mm);
+        check_cmp_ptr(mm->alloc(mm, 100), ==, p);
+        mm->alloc(mm, 900);
+        mm->alloc(mm, 3000);
+    }
+    check_inttype("%d", int, ncalls, ==, n);
+
+    // freeing the last allocation makes room for the next
+    h_region_reset(mm);
+    p = mm->alloc(mm, 100);
+    mm->free(mm, p);
+    check_cmp_ptr(mm->alloc(mm, 50), ==, p);
+
+    // hammer arenas on top, steady state after the first parse
+    for(int i=0; i<10; i++) {
+        h_region_reset(mm);
+        if(i == 1)
+            n = ncalls;
+        HParseResult *res = h_parse__m(mm, dnp3_p_app_fragment,
+                                       (const uint8_t *)"\xC0\x01\x01\x00\x17\x03\x41\x43\x42", 9);
+        g_assert(res != NULL);
+        h_parse_result_free(res);
+    }
+    check_inttype("%d", int, ncalls, ==, n);
+
+    h_region_free(mm);
+}
+
+#define NTHR 4
+#define NBLK 500
+
+static HAllocator *tl_mm;
+static uint8_t *tl_blocks[NTHR][NBLK];
+static int tl_ready;     // workers done allocating, for all rounds
+
+static size_t tl_size(int i)
+{
+    return 1 + (i * 37) % 200;
+}
+
+static gpointer tl_worker(gpointer arg)
+{
+    uint8_t **blocks = arg;
+
+    for(int i=0; i<NBLK; i++) {
+        blocks[i] = tl_mm->alloc(tl_mm, tl_size(i));
+        if(blocks[i])
+            memset(blocks[i], i, tl_size(i));
+    }
+
+    // keep all threads alive together, so each of them uses its own heap
+    int n = g_atomic_int_add(&tl_ready, 1) + 1;
+    n = (n + NTHR-1) / NTHR * NTHR;
+    while(g_atomic_int_get(&tl_ready) < n)
+        g_thread_yield();
+
+    return NULL;
+}
+
+// allocate on NTHR threads, free everything on this one
+static int tl_round(void)
+{
+    GThread *threads[NTHR];
+    int bad = 0;
+
+    for(int t=0; t<NTHR; t++)
+        threads[t] = g_thread_new("tlalloc", tl_worker, tl_blocks[t]);
+    for(int t=0; t<NTHR; t++)
+        g_thread_join(threads[t]);
+
+    for(int t=0; t<NTHR; t++) {
+        for(int i=0; i<NBLK; i++) {
+            uint8_t *p = tl_blocks[t][i];
+            if(!p || (uintptr_t)p % sizeof(void *) != 0)
+                bad++;
+            else if(p[0] != (uint8_t)i || p[tl_size(i)-1] != (uint8_t)i)
+                bad++;
+            tl_mm->free(tl_mm, p);
+        }
+    }
+    return bad;
+}
+
+static void test_tlalloc(void)
+{
+    int LINE = __LINE__;
+
+    tl_mm = h_tlalloc(&counted, 4096);
+    g_assert(tl_mm != NULL);
+    tl_ready = 0;
+
+    ncalls = 0;
+    check_inttype("%d", int, tl_round(), ==, 0);
+    int n = ncalls;
+    g_assert(n > 0);
+
+    // exited threads leave their heaps behind, new threads adopt them and
+    // take back the blocks freed remotely; no new slabs are needed
+    for(int k=0; k<3; k++)
+        check_inttype("%d", int, tl_round(), ==, 0);
+    check_inttype("%d", int, ncalls, ==, n);
+
+    // large blocks and realloc
+    uint8_t *p = tl_mm->alloc(tl_mm, 10000);
+    g_assert(p != NULL);
+    memset(p, 0x58, 10000);
+    p = tl_mm->realloc(tl_mm, p, 100);
+    g_assert(p != NULL);
+    check_inttype("%d", int, p[99], ==, 0x58);
+    p = tl_mm->realloc(tl_mm, p, 1000);
+    g_assert(p != NULL);
+    check_inttype("%d", int, p[99], ==, 0x58);
+    tl_mm->free(tl_mm, p);
+
+    h_tlalloc_free(tl_mm);
+}
+
+#undef NBLK
+#undef NTHR
+
 /// ...
 
+// responses with columnar blocks, and their expected formatting
+static const struct {
+    const char *input;
+    size_t len;
+    const char *result;
+} columnar_cases[] = {
+    {"\xC0\x81\x00\x00\x01\x01\x00\x03\x08\x19",10, "[0] (fir,fin) RESPONSE {g1v1 qc=00 #3..8: 1 0 0 1 1 0}"},
+    {"\xC0\x81\x00\x00\x01\x02\x17\x01\x03\x80",10, "[0] (fir,fin) RESPONSE {g1v2 qc=17 #3:1}"},
+    {"\xC0\x81\x00\x00\x01\x02\x17\x01\x03\x83",10, "[0] (fir,fin) RESPONSE {g1v2 qc=17 #3:(online,restart)1}"},
+    {"\xC0\x81\x00\x00\x02\x02\x17\x01\x03\x80\x00\x00\x00\x00\x00\x00",16, "[0] (fir,fin) RESPONSE {g2v2 qc=17 #3:1@0s}"},
+    {"\xC0\x81\x00\x00\x02\x02\x17\x01\x03\x01\x00\x00\x00\x00\x00\x80",16, "[0] (fir,fin) RESPONSE {g2v2 qc=17 #3:(online)0@140737488355.328s}"},
+    {"\xC0\x81\x00\x00\x02\x03\x17\x01\x03\x80\x00\x00",12, "[0] (fir,fin) RESPONSE {g2v3 qc=17 #3:1@+0s}"},
+    {"\xC0\x81\x00\x00\x02\x03\x17\x01\x03\x81\xE0\x56",12, "[0] (fir,fin) RESPONSE {g2v3 qc=17 #3:(online)1@+22.240s}"},
+    {"\xC0\x81\x00\x00\x03\x01\x00\x00\x03\x36",10, "[0] (fir,fin) RESPONSE {g3v1 qc=00 #0..3: 1 0 - ~}"},
+    {"\xC0\x81\x00\x00\x03\x01\x00\x00\x02\x06",10, "[0] (fir,fin) RESPONSE {g3v1 qc=00 #0..2: 1 0 ~}"},
+    {"\xC0\x81\x00\x00\x04\x03\x17\x01\x03\x80\x00\x00",12, "[0] (fir,fin) RESPONSE {g4v3 qc=17 #3:1@+0s}"},
+    {"\xC0\x81\x00\x00\x04\x03\x17\x01\x03\x81\xE0\x56",12, "[0] (fir,fin) RESPONSE {g4v3 qc=17 #3:(online)1@+22.240s}"},
+    {"\xC1\x81\x00\x00\x0A\x01\x00\x00\x08\x5E\x01",11, "[1] (fir,fin) RESPONSE {g10v1 qc=00 #0..8: 0 1 1 1 1 0 1 0 1}"},
+    {"\x00\x81\x00\x00\x14\x01\x17\x01\x01\x41\x12\x34\x56\x78",14, "[0] RESPONSE {g20v1 qc=17 #1:(online,discontinuity)2018915346}"},
+    {"\x00\x81\x00\x00\x14\x05\x17\x01\x01\x12\x34\x56\x78",13, "[0] RESPONSE {g20v5 qc=17 #1:2018915346}"},
+    {"\x00\x81\x00\x00\x15\x05\x17\x01\x01\x41\x12\x34\x56\x78\x00\x00\x00\x00\x00\x00",20, "[0] RESPONSE {g21v5 qc=17 #1:(online,discontinuity)2018915346@0s}"},
+    {"\x00\x81\x00\x00\x16\x05\x17\x01\x01\x41\x12\x34\x56\x78\x00\x00\x00\x00\x00\x00",20, "[0] RESPONSE {g22v5 qc=17 #1:(online,discontinuity)2018915346@0s}"},
+    {"\x00\x81\x00\x00\x1E\x01\x17\x01\x01\x21\x12\x34\x56\x78",14, "[0] RESPONSE {g30v1 qc=17 #1:(online,over_range)2018915346}"},
+    {"\x00\x81\x00\x00\x1E\x03\x17\x01\x01\x12\x34\x56\x78",13, "[0] RESPONSE {g30v3 qc=17 #1:2018915346}"},
+    {"\x00\x81\x00\x00\x1E\x05\x17\x01\x01\x21\x00\x00\x80\xBF",14, "[0] RESPONSE {g30v5 qc=17 #1:(online,over_range)-1.0}"},
+    {"\x00\x81\x00\x00\x1E\x06\x17\x01\x01\x40\x00\x00\x00\x00\x00\x00\xF0\x3F",18, "[0] RESPONSE {g30v6 qc=17 #1:(reference_err)1.0}"},
+    {"\x00\x81\x00\x00\x20\x03\x17\x01\x01\x21\x12\x34\x56\x78\x00\x00\x00\x00\x00\x00",20, "[0] RESPONSE {g32v3 qc=17 #1:(online,over_range)2018915346@0s}"},
+    {"\x00\x81\x00\x00\x20\x07\x17\x01\x01\x21\x00\x00\x80\xBF\x00\x00\x00\x00\x00\x00",20, "[0] RESPONSE {g32v7 qc=17 #1:(online,over_range)-1.0@0s}"},
+};
+
+static void test_columnar(void)
+{
+    DNP3_ParserConfig cfg = {.columnar = true};
+    int LINE = __LINE__;
+
+    // NB: this rebuilds the global parsers; restored to defaults below
+    dnp3_init_with(&cfg);
+
+    for(size_t i=0; i<sizeof(columnar_cases)/sizeof(*columnar_cases); i++) {
+        const uint8_t *input = (const uint8_t *)columnar_cases[i].input;
+        size_t len = columnar_cases[i].len;
+
+        do_check_parse(dnp3_p_app_response, input, len,
+                       columnar_cases[i].result, LINE);
+
+        HParseResult *r = h_parse(dnp3_p_app_response, input, len);
+        g_assert(r != NULL);
+        const DNP3_Fragment *frag = r->ast->user;
+        check_cmp_ptr(frag->odata[0]->objects, ==, NULL);
+        check_cmp_ptr(frag->odata[0]->columns, !=, NULL);
+        h_parse_result_free(r);
+    }
+
+    // accessors
+    HParseResult *r = h_parse(dnp3_p_app_response, (const uint8_t *)
+        "\xC0\x81\x00\x00\x1E\x01\x00\x00\x02\x21\x12\x34\x56\x78"
+                                       "\x01\xFF\xFF\xFF\xFF"
+                                       "\x40\x00\x00\x00\x80", 24);
+    g_assert(r != NULL);
+    const DNP3_ObjectBlock *ob = ((DNP3_Fragment *)r->ast->user)->odata[0];
+    check_cmp_size(ob->count, ==, 3);
+    check_inttype("%d", int, ob->columns->valuetype, ==, DNP3_COL_INT32);
+    check_inttype("%d", int, dnp3_oblock_int(ob, 0), ==, 0x78563412);
+    check_inttype("%d", int, dnp3_oblock_int(ob, 1), ==, -1);
+    check_inttype("%d", int, dnp3_oblock_int(ob, 2), ==, INT32_MIN);
+    check_inttype("%d", int, dnp3_oblock_flags(ob, 0).over_range, ==, 1);
+    check_inttype("%d", int, dnp3_oblock_flags(ob, 1).online, ==, 1);
+    check_inttype("%d", int, dnp3_oblock_flags(ob, 2).reference_err, ==, 1);
+    h_parse_result_free(r);
+
+    r = h_parse(dnp3_p_app_response, (const uint8_t *)
+                "\xC0\x81\x00\x00\x03\x01\x00\x00\x03\x36", 10);
+    g_assert(r != NULL);
+    ob = ((DNP3_Fragment *)r->ast->user)->odata[0];
+    check_cmp_size(ob->count, ==, 4);
+    check_inttype("%d", int, ob->columns->bitwidth, ==, 2);
+    check_inttype("%d", int, dnp3_oblock_state(ob, 0), ==, DNP3_DETERMINED_ON);
+    check_inttype("%d", int, dnp3_oblock_state(ob, 2), ==, DNP3_INDETERMINATE);
+    h_parse_result_free(r);
+
+    // back to default parsers for the other tests
+    dnp3_init();
+}
+
+// compare dnp3_app_decode_fragment against the grammar (dnp3_p_app_fragment)
+// returns whether the decoder handled the input
+static void append_oblock(void *env, const DNP3_Fragment *frag,
+                          const DNP3_ObjectBlock *ob)
+{
+    char *s = dnp3_format_oblock(ob);
+    g_string_append_printf(env, "%s;", s);
+    free(s);
+}
+
+static bool do_check_app_decode(const uint8_t *input, size_t len, int LINE)
+{
+    HParseResult *dec = dnp3_app_decode_fragment(NULL, input, len);
+
+    // the streaming variant yields the same blocks
+    GString *streamed = g_string_new("");
+    DNP3_Fragment hdr;
+    bool ok = dnp3_app_decode_blocks(NULL, input, len, &hdr, append_oblock,
+                                     streamed);
+    check_inttype("%d", int, ok, ==, dec != NULL);
+    if(ok && dec) {
+        const DNP3_Fragment *frag = dec->ast->user;
+        GString *blocks = g_string_new("");
+        for(size_t i=0; i<frag->nblocks; i++)
+            append_oblock(blocks, frag, frag->odata[i]);
+        check_string(streamed->str, ==, blocks->str);
+        check_cmp_ptr(hdr.odata, ==, NULL);
+        check_inttype("%d", int, hdr.fc, ==, frag->fc);
+        g_string_free(blocks, true);
+    }
+    g_string_free(streamed, true);
+
+    // so does the lazy variant, decoding objects on first use
+    HParseResult *lazy = dnp3_app_decode_headers(NULL, input, len);
+    check_inttype("%d", int, lazy != NULL, ==, dec != NULL);
+    if(lazy && dec) {
+        const DNP3_Fragment *frag = lazy->ast->user;
+        char *hdrs = dnp3_format_fragment_ohdrs(frag);
+        char *chdrs = dnp3_format_fragment_ohdrs(dec->ast->user);
+        check_string(hdrs, ==, chdrs);
+        for(size_t i=0; i<frag->nblocks; i++) {
+            check_cmp_ptr(frag->odata[i]->lazy, !=, NULL);
+            check_cmp_ptr(frag->odata[i]->objects, ==, NULL);
+            check_cmp_ptr(frag->odata[i]->columns, ==, NULL);
+        }
+        char *clazy = format(lazy->ast);
+        char *cdec = format(dec->ast);
+        check_string(clazy, ==, cdec);
+        for(size_t i=0; i<frag->nblocks; i++)
+            check_cmp_ptr(frag->odata[i]->lazy, ==, NULL);
+        free(cdec);
+        free(clazy);
+        free(chdrs);
+        free(hdrs);
+    }
+    if(lazy)
+        h_parse_result_free(lazy);
+
+    if(!dec)
+        return false;
+
+    HParseResult *res = h_parse(dnp3_p_app_fragment, input, len);
+    if(!res || H_ISERR(res->ast->token_type)) {
+        char *cdec = format(dec->ast);
+        g_test_message("Decoder yielded %s on line %d, grammar did not",
+                       cdec, LINE);
+        g_test_fail();
+        free(cdec);
+    } else {
+        char *cres = format(res->ast);
+        char *cdec = format(dec->ast);
+        check_string(cdec, ==, cres);
+        free(cdec);
+        free(cres);
+    }
+
+    h_parse_result_free(res);
+    h_parse_result_free(dec);
+    return true;
+}
+
+// fragments the decoder should handle, in addition to columnar_cases
+static const struct {
+    const char *input;
+    size_t len;
+} decode_cases[] = {
+    {"\xC0\x81\x00\x00\x1E\x01\x00\x00\x02\x21\x12\x34\x56\x78"
+                               "\x01\xFF\xFF\xFF\xFF"
+                               "\x40\x00\x00\x00\x80", 24},
+    {"\xC0\x81\x10\x04\x1E\x04\x01\x05\x00\x06\x00\xFE\xFF\x01\x00", 15},
+    {"\xC0\x81\x00\x00\x1E\x02\x03\x00\x01\x01\x00\x80"
+                               "\x01\xFF\x7F", 15},
+    {"\xC0\x81\x00\x00\x14\x02\x28\x01\x00\x05\x01\x01\x34\x12"
+                               "\x14\x06\x00\x07\x07\x34\x12", 21},
+    {"\xC0\x81\x00\x00\x01\x02\x00\x00\x02\x81\x01\xA0"
+                               "\x02\x01\x17\x01\x00\x81", 18},
+    {"\xF3\x82\x00\x00\x20\x01\x28\x01\x00\x0A\x00\x01\x12\x34\x56\x78", 16},
+    {"\xF3\x82\x00\x00\x20\x05\x38\x01\x00\x0A\x00\x00\x00\x01"
+                               "\x00\x00\x80\x3F", 18},
+    {"\xF3\x82\x00\x00\x16\x06\x17\x01\x03\x01\x34\x12"
+                               "\x01\x02\x03\x04\x05\x06", 18},
+    {"\xC0\x81\x00\x00\x01\x01\x01\x00\x00\x63\x00"      // 100 bits
+     "\x5A\xA5\xFF\x00\x01\x80\x66\x99\x12\x34\x56\x78\x0F", 24},
+    {"\xC0\x81\x00\x00\x03\x01\x00\x05\x2D"                 // 41 dblbits
+     "\x1B\xE4\x00\xFF\x55\xAA\x36\xC9\x12\x48\x02", 20},
+    {"\xC0\x81\x00\x00\x0A\x01\x00\x00\x1F"                 // 32 bits
+     "\x01\x02\x04\x08\x01\x01\x00\x10\x17\xA5", 19},
+};
+
+static void test_app_decode(void)
+{
+    DNP3_ParserConfig cfg = {.columnar = false};
+    int LINE = __LINE__;
+
+    // NB: this rebuilds the global parsers; restored to defaults below
+    for(int mode=0; mode<2; mode++) {
+        cfg.columnar = mode;
+        dnp3_init_with(&cfg);
+
+        for(size_t i=0; i<sizeof(columnar_cases)/sizeof(*columnar_cases); i++) {
+            const uint8_t *input = (const uint8_t *)columnar_cases[i].input;
+            size_t len = columnar_cases[i].len;
+
+            // g21 and g4 are not in the table
+            if(input[4] == 0x15 || input[4] == 0x04)
+                continue;
+            if(!do_check_app_decode(input, len, LINE)) {
+                g_test_message("Decoder did not handle case %zu", i);
+                g_test_fail();
+            }
+        }
+
+        for(size_t i=0; i<sizeof(decode_cases)/sizeof(*decode_cases); i++) {
+            const uint8_t *input = (const uint8_t *)decode_cases[i].input;
+            size_t len = decode_cases[i].len;
+            uint8_t buf[64];
+
+            if(!do_check_app_decode(input, len, LINE)) {
+                g_test_message("Decoder did not handle decode_cases[%zu]", i);
+                g_test_fail();
+            }
+
+            // every single bit flip and truncation must agree as well
+            g_assert(len <= sizeof(buf));
+            for(size_t k=0; k<len*8; k++) {
+                memcpy(buf, input, len);
+                buf[k/8] ^= 1 << (k%8);
+                do_check_app_decode(buf, len, LINE);
+            }
+            for(size_t n=0; n<len; n++)
+                do_check_app_decode(input, n, LINE);
+        }
+
+        // requests and other responses are left to the grammar
+        check_cmp_ptr(dnp3_app_decode_fragment(NULL, (const uint8_t *)
+                      "\xC0\x01\x1E\x00\x06", 5), ==, NULL);
+        check_cmp_ptr(dnp3_app_decode_fragment(NULL, (const uint8_t *)
+                      "\xC0\x81\x00\x00\x33\x01\x07\x01\x00\x00\x00\x00"
+                      "\x00\x00", 14), ==, NULL);
+        check_cmp_ptr(dnp3_app_decode_fragment(NULL, (const uint8_t *)
+                      "\xF3\x82\x00\x00\x1E\x01\x17\x01\x01\x21\x12\x34"
+                      "\x56\x78", 14), ==, NULL);    // g30 not in unsolicited
+    }
+
+    // back to default parsers for the other tests
+    dnp3_init();
+}
+
+// relative timestamps get resolved against the preceding CTO
+static void test_app_cto(void)
+{
+    DNP3_ParserConfig cfg = {.columnar = false};
+    int LINE = __LINE__;
+    static const char sync[] =      // g51v1 @1000s, g2v3 #5 @+100ms
+        "\xC0\x81\x00\x00\x33\x01\x07\x01\x40\x42\x0F\x00\x00\x00"
+        "\x02\x03\x28\x01\x00\x05\x00\x81\x64\x00";
+    static const char unsync[] =    // g51v2, same
+        "\xC0\x81\x00\x00\x33\x02\x07\x01\x40\x42\x0F\x00\x00\x00"
+        "\x02\x03\x28\x01\x00\x05\x00\x81\x64\x00";
+    static const char nocto[] =     // g2v3 alone
+        "\xC0\x81\x00\x00\x02\x03\x28\x01\x00\x05\x00\x81\x64\x00";
+
+    for(int mode=0; mode<2; mode++) {
+        cfg.columnar = mode;
+        dnp3_init_with(&cfg);
+
+        HParseResult *res = h_parse(dnp3_p_app_response, (const uint8_t *)sync,
+                                    sizeof(sync) - 1);
+        g_assert(res != NULL);
+        const DNP3_Fragment *frag = res->ast->user;
+        check_cmp_size(frag->nblocks, ==, 2);
+        DNP3_Object o = dnp3_oblock_object(frag->odata[1], 0);
+        check_inttype("%u", unsigned, o.timed.reltime, ==, 100);
+        check_inttype("%" PRIu64, uint64_t, o.timed.abstime, ==, 1000100);
+        check_inttype("%u", unsigned, o.timed.cto, ==, DNP3_VARIATION_CTO_SYNC);
+        check_inttype("%" PRIu64, uint64_t, frag->odata[1]->cto, ==, 1000000);
+        h_parse_result_free(res);
+
+        res = h_parse(dnp3_p_app_response, (const uint8_t *)unsync,
+                      sizeof(unsync) - 1);
+        g_assert(res != NULL);
+        o = dnp3_oblock_object(((DNP3_Fragment *)res->ast->user)->odata[1], 0);
+        check_inttype("%" PRIu64, uint64_t, o.timed.abstime, ==, 1000100);
+        check_inttype("%u", unsigned, o.timed.cto, ==, DNP3_VARIATION_CTO_UNSYNC);
+        h_parse_result_free(res);
+
+        res = h_parse(dnp3_p_app_response, (const uint8_t *)nocto,
+                      sizeof(nocto) - 1);
+        g_assert(res != NULL);
+        o = dnp3_oblock_object(((DNP3_Fragment *)res->ast->user)->odata[0], 0);
+        check_inttype("%u", unsigned, o.timed.reltime, ==, 100);
+        check_inttype("%" PRIu64, uint64_t, o.timed.abstime, ==, 0);
+        check_inttype("%u", unsigned, o.timed.cto, ==, 0);
+        h_parse_result_free(res);
+    }
+
+    dnp3_init();
+}
+
+// the global parsers: tables filled in on first use, release and re-init
+static void test_app_tables(void)
+{
+    static const char req[] = "\xC0\x01\x01\x00\x17\x03\x41\x43\x42";
+    static const char *expect = "[0] (fir,fin) READ {g1v0 qc=17 #65 #67 #66}";
+    int LINE = __LINE__;
+
+    dnp3_free();
+    check_cmp_size(dnp3_table_size(), ==, 0);
+
+    dnp3_init();
+    size_t n = dnp3_table_size();
+    check_cmp_size(n, >, 0);
+
+    // the first READ builds its body parser, the second one does not
+    check_parse(dnp3_p_app_request, req, 9, expect);
+    size_t m = dnp3_table_size();
+    check_cmp_size(m, >, n);
+    check_parse(dnp3_p_app_request, req, 9, expect);
+    check_cmp_size(dnp3_table_size(), ==, m);
+
+    // down and up again
+    dnp3_free();
+    check_cmp_size(dnp3_table_size(), ==, 0);
+    dnp3_init();
+    check_cmp_size(dnp3_table_size(), ==, n);
+    check_parse(dnp3_p_app_request, req, 9, expect);
+}
+
+// consistency of the object registry
+static void test_app_objects(void)
+{
+    static const size_t valsize[] = {0, 2, 4, 2, 4, 4, 8};
+    static const size_t timesize[] = {0, 6, 2};
+    int LINE = __LINE__;
+
+    for(size_t i=0; i<DNP3_NOBJECTS; i++) {
+        const DNP3_ObjectInfo *x = &dnp3_objects[i];
+        DNP3_Object o = {0};
+
+        check_cmp_ptr(dnp3_object_info(x->group, x->variation), ==, x);
+
+        // everything but packed objects is flags, value, time
+        if(x->bits) {
+            check_cmp_size(x->size, ==, 0);
+        } else if(x->columnar || x->decode) {
+            check_cmp_size(x->size, ==,
+                           x->flags + valsize[x->value] + timesize[x->time]);
+        }
+        if(!x->flags)
+            check_inttype("0x%.2X", unsigned, x->reserved, ==, 0);
+        if(x->decode)
+            g_assert(x->columnar);
+
+        // every entry is formatted
+        char *s = dnp3_format_object(x->group, x->variation, o);
+        if(strcmp(s, "?") == 0) {
+            g_test_message("line %d: g%dv%d not formatted", LINE,
+                           (int)x->group, (int)x->variation);
+            g_test_fail();
+        }
+        free(s);
+    }
+
+    check_cmp_ptr(dnp3_object_info(DNP3_GROUP_CLASS, 1), ==, NULL);
+    check_cmp_ptr(dnp3_object_info(DNP3_GROUP_AUTH, 1), ==, NULL);
+    check_cmp_ptr(dnp3_object_info(200, 1), ==, NULL);
+    check_cmp_ptr(dnp3_object_info(DNP3_GROUP_ANAIN, 200), ==, NULL);
+}
+
+static int write_gstring(void *env, const char *s, size_t len)
+{
+    g_string_append_len(env, s, len);
+    return 0;
+}
+
+static int write_fail(void *env, const char *s, size_t len)
+{
+    (*(int *)env)++;
+    return -1;
+}
+
+// the profiler attributes the dissector's allocations to its stages
+static void test_profiler(void)
+{
+    uint8_t stream[1000];
+    static const uint8_t poll[] = {0xC0, 0x01, 0x3C, 0x01, 0x06};
+    DNP3_AllocProfile prof;
+    size_t len = 0;
+    int LINE = __LINE__;
+
+    for(int i=0; i<10; i++) {
+        DNP3_Segment seg = {0};
+        seg.fir = seg.fin = 1;
+        seg.seq = i;
+        seg.len = sizeof poll;
+        seg.payload = poll;
+        len += make_frame(stream + len, &seg);
+    }
+
+    HAllocator *mm = h_profiler(NULL);
+    g_assert(mm != NULL);
+
+    DNP3_Callbacks cb = {NULL};
+    StreamProcessor *p = dnp3_dissector__m(mm, mm, mm, mm, NULL, cb, NULL);
+    g_assert(p != NULL);
+    p->feed_external(p, stream, len);
+    h_profiler_get(mm, &prof);
+    check_cmp_size(prof.stage[DNP3_STAGE_LINK].allocs, >, 0);
+    check_cmp_size(prof.stage[DNP3_STAGE_APP].allocs, >, 0);
+    check_cmp_size(prof.live, >, 0);
+    check_cmp_size(prof.peak, >=, prof.live);
+    p->finish(p);
+
+    h_profiler_get(mm, &prof);
+    check_cmp_size(prof.live, ==, 0);
+    check_cmp_size(prof.failed, ==, 0);
+
+    GString *s = g_string_new(NULL);
+    check_inttype("%d", int, h_profiler_report(write_gstring, s, &prof), ==, 0);
+    g_assert(strstr(s->str, "link") != NULL);
+    g_assert(strstr(s->str, "app") != NULL);
+    g_string_free(s, true);
+
+    h_profiler_reset(mm);
+    h_profiler_get(mm, &prof);
+    check_cmp_size(prof.stage[DNP3_STAGE_LINK].allocs, ==, 0);
+    h_profiler_free(mm);
+}
+
+// the allocation-free formatting variants agree with the malloc'd ones
+static void test_format_into(void)
+{
+    int LINE = __LINE__;
+
+    for(size_t i=0; i<G_N_ELEMENTS(decode_cases); i++) {
+        HParseResult *r = dnp3_app_decode_fragment(NULL,
+            (const uint8_t *)decode_cases[i].input, decode_cases[i].len);
+        if(!r)
+            continue;
+        const DNP3_Fragment *frag = r->ast->user;
+        char *s = dnp3_format_fragment(frag);
+        int n = strlen(s);
+        char buf[1024];
+
+        // truncated output is a null-terminated prefix
+        size_t caps[] = {1, 2, 10, n, n+1, sizeof(buf)};
+        check_inttype("%d", int,
+                      dnp3_format_fragment_into(NULL, 0, frag), ==, n);
+        for(size_t k=0; k<G_N_ELEMENTS(caps); k++) {
+            size_t cap = caps[k];
+            memset(buf, 'x', sizeof(buf));
+            check_inttype("%d", int,
+                          dnp3_format_fragment_into(buf, cap, frag), ==, n);
+            check_cmp_size(strlen(buf), ==, MIN(n, cap-1));
+            check_inttype("%d", int, strncmp(buf, s, cap-1), ==, 0);
+        }
+
+        GString *str = g_string_new("");
+        check_inttype("%d", int,
+                      dnp3_format_fragment_to(write_gstring, str, frag), ==, n);
+        check_string(str->str, ==, s);
+        g_string_free(str, true);
+
+        // writer errors are reported, and it is not called again
+        int calls = 0;
+        check_inttype("%d", int,
+                      dnp3_format_fragment_to(write_fail, &calls, frag), ==, -1);
+        check_inttype("%d", int, calls, ==, 1);
+
+        free(s);
+        h_parse_result_free(r);
+    }
+}
+
+static void test_export(void)
+{
+    int LINE = __LINE__;
+    GString *str = g_string_new("");
+
+    // JSON
+    const uint8_t *input = (const uint8_t *)decode_cases[0].input;
+    HParseResult *r = dnp3_app_decode_fragment(NULL, input, decode_cases[0].len);
+    g_assert(r);
+    int n = dnp3_export_fragment(DNP3_EXPORT_JSON, write_gstring, str,
+                                 r->ast->user);
+    check_string(str->str, ==,
+        "{\"seq\":0,\"fir\":true,\"fin\":true,\"con\":false,\"uns\":false,"
+        "\"fc\":129,\"iin\":0,\"blocks\":[{\"group\":30,\"variation\":1,"
+        "\"qc\":0,\"start\":0,\"count\":3,\"objects\":["
+        "{\"index\":0,\"flags\":33,\"value\":2018915346},"
+        "{\"index\":1,\"flags\":1,\"value\":-1},"
+        "{\"index\":2,\"flags\":64,\"value\":-2147483648}]}]}");
+    check_inttype("%d", int, n, ==, str->len);
+    h_parse_result_free(r);
+
+    DNP3_Object o = {0};
+    o.applid.str = "a\"b\x01";
+    o.applid.len = 4;
+    g_string_truncate(str, 0);
+    dnp3_export_object(DNP3_EXPORT_JSON, write_gstring, str,
+                       DNP3_GROUP_APPL, DNP3_VARIATION_APPL_ID, o);
+    check_string(str->str, ==, "{\"applid\":\"a\\\"b\\u0001\"}");
+
+    // CBOR, {"flags": 1, "value": -70000}
+    static const char cbor[] = "\xBF\x65" "flags" "\x01\x65" "value"
+                               "\x3A\x00\x01\x11\x6F\xFF";
+    memset(&o, 0, sizeof(o));
+    o.ana.flags.online = 1;
+    o.ana.sint = -70000;
+    g_string_truncate(str, 0);
+    n = dnp3_export_object(DNP3_EXPORT_CBOR, write_gstring, str,
+                           DNP3_GROUP_ANAIN, DNP3_VARIATION_ANAIN_32BIT, o);
+    check_inttype("%d", int, n, ==, sizeof(cbor)-1);
+    check_inttype("%d", int, memcmp(str->str, cbor, n), ==, 0);
+
+    g_string_free(str, true);
+}
+
+// parsed fragments re-encode to their input
+// a copy formats and encodes like the original, after that is freed
+static void check_copy(HParseResult *r, const uint8_t *input, size_t len,
+                       int LINE)
+{
+    uint8_t buf[256];
+
+    g_assert(r && r->ast->token_type == TT_DNP3_Fragment);
+    char *orig = dnp3_format_fragment(r->ast->user);
+    DNP3_Fragment *copy = dnp3_fragment_copy(NULL, r->ast->user);
+    g_assert(copy != NULL);
+    h_parse_result_free(r);
+
+    char *out = dnp3_format_fragment(copy);
+    check_string(out, ==, orig);
+    check_inttype("%d", int, dnp3_encode_fragment(buf, sizeof(buf), copy),
+                  ==, len);
+    check_inttype("%d", int, memcmp(buf, input, len), ==, 0);
+
+    // retaining a copy counts a reference
+    check_cmp_ptr(dnp3_fragment_retain(copy), ==, copy);
+    dnp3_fragment_release(copy);
+    dnp3_fragment_release(copy);
+    free(out);
+    free(orig);
+}
+
+static void test_app_copy(void)
+{
+    DNP3_ParserConfig cfg = {.columnar = false};
+    int LINE = __LINE__;
+
+    for(int mode=0; mode<2; mode++) {
+        cfg.columnar = mode;
+        dnp3_init_with(&cfg);
+
+        for(size_t i=0; i<G_N_ELEMENTS(decode_cases); i++) {
+            const uint8_t *input = (const uint8_t *)decode_cases[i].input;
+            size_t len = decode_cases[i].len;
+
+            check_copy(h_parse(dnp3_p_app_response, input, len),
+                       input, len, LINE);
+            check_copy(dnp3_app_decode_fragment(NULL, input, len),
+                       input, len, LINE);
+        }
+    }
+    dnp3_init();
+
+    // indexes, commands, and strings
+    const uint8_t *input = (const uint8_t *)
+        "\xC3\x10\x5A\x01\x5B\x01\x03\x00\x43\x4C\x36";
+    check_copy(h_parse(dnp3_p_app_request, input, 11), input, 11, LINE);
+    input = (const uint8_t *)"\xC3\x02\x32\x01\x07\x01\xAC\xE9\x00\x40\x08\x01";
+    check_copy(h_parse(dnp3_p_app_request, input, 12), input, 12, LINE);
+    input = (const uint8_t *)
+        "\xC3\x03\x0C\x01\x17\x01\x0A\x41\x01\xFA\x00\x00\x00"
+        "\x00\x00\x00\x00\x00"
+        "\x0C\x02\x07\x01\x41\x03\xF4\x01\x00\x00\xD0\x07\x00\x00\x00"
+        "\x0C\x03\x00\x05\x0F\x21\x04"
+        "\x29\x01\x17\x01\x01\x12\x34\x56\x78\x00";
+    check_copy(h_parse(dnp3_p_app_request, input, 50), input, 50, LINE);
+}
+
+struct Delivery {
+    GPtrArray *results;     // formatted fragments and errors, in order
+    GPtrArray *retained;    // fragments kept with dnp3_fragment_retain
+    bool owned;             // release fragments?
+    pthread_t feeder;
+    int other_thread;       // callbacks not on the feeder thread
+};
+
+static void deliver_fragment(void *env, const DNP3_Fragment *fragment,
+                             const uint8_t *buf, size_t len)
+{
+    struct Delivery *d = env;
+
+    d->other_thread += !pthread_equal(pthread_self(), d->feeder);
+    g_ptr_array_add(d->results, dnp3_format_fragment(fragment));
+    if(d->retained)
+        g_ptr_array_add(d->retained, dnp3_fragment_retain(fragment));
+    if(d->owned)
+        dnp3_fragment_release((DNP3_Fragment *)fragment);
+}
+
+static void deliver_invalid(void *env, DNP3_ParseError e)
+{
+    struct Delivery *d = env;
+    char tmp[32];
+
+    d->other_thread += !pthread_equal(pthread_self(), d->feeder);
+
+    snprintf(tmp, sizeof(tmp), "invalid %d", (int)e);
+    g_ptr_array_add(d->results, strdup(tmp));
+}
+
+// asynchronous delivery yields the same results, from another thread
+static void test_dissector_async(void)
+{
+    static uint8_t stream[20000];
+    size_t len = 0;
+    DNP3_Segment seg = {0};
+    DNP3_DissectorConfig config = {.ignore_dir = true};
+    DNP3_Callbacks cb = {NULL};
+    struct Delivery sync = {g_ptr_array_new_with_free_func(free),
+                            g_ptr_array_new_with_free_func(NULL), false};
+    struct Delivery async = {g_ptr_array_new_with_free_func(free),
+                             NULL, true};
+    int LINE = __LINE__;
+
+    seg.fir = seg.fin = 1;
+    for(int i=0; i<200; i++) {
+        if(i % 7 == 3) {
+            seg.payload = (uint8_t *)"\xC0\x77";  // unknown FC
+            seg.len = 2;
+        } else {
+            size_t k = i % G_N_ELEMENTS(decode_cases);
+            seg.payload = (uint8_t *)decode_cases[k].input;
+            seg.len = decode_cases[k].len;
+        }
+        seg.seq = i % 64;
+        len += make_frame(stream+len, &seg);
+    }
+    g_assert(len <= sizeof(stream));
+
+    cb.app_fragment = deliver_fragment;
+    cb.app_invalid = deliver_invalid;
+    sync.feeder = async.feeder = pthread_self();
+
+    StreamProcessor *p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config,
+                                           cb, &sync);
+    g_assert(p != NULL);
+    p->feed_external(p, stream, len);
+    p->finish(p);
+
+    config.async_queue = 4;     // small, the feeder will have to wait
+    p = dnp3_dissector__m(NULL, NULL, NULL, NULL, &config, cb, &async);
+    g_assert(p != NULL);
+    for(size_t i=0; i<len; i+=500)
+        p->feed_external(p, stream+i, len-i < 500 ? len-i : 500);
+    p->finish(p);
+
+    check_cmp_size(sync.results->len, ==, 200);
+    check_cmp_size(async.results->len, ==, sync.results->len);
+    for(size_t i=0; i<sync.results->len && i<async.results->len; i++)
+        check_string(async.results->pdata[i], ==, sync.results->pdata[i]);
+    check_inttype("%d", int, sync.other_thread, ==, 0);
+    check_inttype("%d", int, async.other_thread, ==, async.results->len);
+
+    // fragments retained during the callbacks outlive the dissector
+    size_t k = 0;
+    for(size_t i=0; i<sync.results->len; i++) {
+        if(strncmp(sync.results->pdata[i], "invalid", 7) == 0)
+            continue;
+        g_assert(k < sync.retained->len);
+        char *s = dnp3_format_fragment(sync.retained->pdata[k]);
+        check_string(s, ==, sync.results->pdata[i]);
+        dnp3_fragment_release(sync.retained->pdata[k]);
+        free(s);
+        k++;
+    }
+    check_cmp_size(k, ==, sync.retained->len);
+    g_ptr_array_free(sync.retained, true);
+
+    g_ptr_array_free(sync.results, true);
+    g_ptr_array_free(async.results, true);
+}
+
+static void test_encode(void)
+{
+    static const struct {
+        bool response;
+        const char *input;
+        size_t len;
+    } cases[] = {
+        {0, "\xC3\x14\x3C\x02\x06\x3C\x03\x06\x3C\x04\x06", 11},
+        {0, "\xC0\x01\x3C\x03\x07\x23", 6},
+        {0, "\xC3\x02\x22\x01\x17\x03\x06\x12\x00\x08\x4A\x00\x14\xFF\xFF", 15},
+        {0, "\xC3\x02\x32\x01\x07\x01\xAC\xE9\x00\x40\x08\x01", 12},
+        {0, "\xC3\x03\x0C\x01\x17\x01\x0A\x41\x01\xFA\x00\x00\x00"
+            "\x00\x00\x00\x00\x00"
+            "\x0C\x02\x07\x01\x41\x03\xF4\x01\x00\x00\xD0\x07\x00\x00\x00"
+            "\x0C\x03\x00\x05\x0F\x21\x04"
+            "\x29\x01\x17\x01\x01\x12\x34\x56\x78\x00", 50},
+        {0, "\xC3\x10\x5A\x01\x5B\x01\x03\x00\x43\x4C\x36", 11},
+        {1, "\xC3\x81\x00\x04\x0C\x02\x07\x01\x41\x03\xF4\x01\x00\x00"
+            "\xD0\x07\x00\x00\x04\x0C\x03\x00\x05\x0F", 24},
+    };
+    int LINE = __LINE__;
+    uint8_t buf[256];
+
+    for(size_t i=0; i<G_N_ELEMENTS(cases)+G_N_ELEMENTS(decode_cases); i++) {
+        const uint8_t *input;
+        size_t len;
+        HParseResult *r;
+
+        if(i < G_N_ELEMENTS(cases)) {
+            input = (const uint8_t *)cases[i].input;
+            len = cases[i].len;
+            r = h_parse(cases[i].response ? dnp3_p_app_response
+                                          : dnp3_p_app_request, input, len);
+        } else {
+            input = (const uint8_t *)decode_cases[i-G_N_ELEMENTS(cases)].input;
+            len = decode_cases[i-G_N_ELEMENTS(cases)].len;
+            r = h_parse(dnp3_p_app_response, input, len);
+        }
+        g_assert(r && r->ast->token_type == TT_DNP3_Fragment);
+
+        memset(buf, 0, sizeof(buf));
+        check_inttype("%d", int,
+                      dnp3_encode_fragment(buf, sizeof(buf), r->ast->user),
+                      ==, len);
+        check_inttype("%d", int, memcmp(buf, input, len), ==, 0);
+
+        // short buffer: same result, truncated
+        memset(buf, 0xEE, sizeof(buf));
+        check_inttype("%d", int, dnp3_encode_fragment(buf, 3, r->ast->user),
+                      ==, len);
+        check_inttype("%d", int, memcmp(buf, input, 3), ==, 0);
+        check_inttype("0x%.2X", unsigned, buf[3], ==, 0xEE);
+
+        h_parse_result_free(r);
+    }
+
+    // payload -> segments -> frames -> back
+    uint8_t payload[600], out[1024], data[DNP3_LINK_MAXPAYLOAD];
+    for(size_t i=0; i<sizeof(payload); i++)
+        payload[i] = i * 7;
+    DNP3_Frame link = {.dir=1, .func=DNP3_UNCONFIRMED_USER_DATA,
+                       .source=1024, .destination=1};
+    uint8_t seq = 62;
+    int n = dnp3_encode_frames(out, sizeof(out), &link, &seq,
+                               payload, sizeof(payload));
+    check_inttype("%d", int, n, ==, 3*10 + 3*1 + 600 + 2*((250+15)/16)*2
+                                    + 2*((103+15)/16));
+    check_inttype("%d", int, seq, ==, 1);
+
+    size_t off = 0, pos = 0;
+    for(int k=0; k<3; k++) {
+        DNP3_Frame f;
+        int sz = dnp3_link_decode_frame(out+off, n-off, &f, data);
+        g_assert(sz > 0 && f.payload);
+        check_inttype("%d", int, f.source, ==, 1024);
+        check_inttype("%d", int, f.dir, ==, 1);
+        check_inttype("0x%.2X", unsigned, data[0], ==,
+                      (k==2) << 7 | (k==0) << 6 | ((62+k) & 0x3F));
+        check_inttype("%d", int, memcmp(data+1, payload+pos, f.len-1), ==, 0);
+
+        // and the frame encoder yields the same bytes
+        uint8_t again[300];
+        check_inttype("%d", int, dnp3_encode_frame(again, sizeof(again), &f),
+                      ==, sz);
+        check_inttype("%d", int, memcmp(again, out+off, sz), ==, 0);
+
+        pos += f.len - 1;
+        off += sz;
+    }
+    check_cmp_size(pos, ==, sizeof(payload));
+    check_cmp_size(off, ==, n);
+}
+
+static void test_app_unpack(void)
+{
+    uint8_t buf[80], a[640], b[640];
+    int LINE = __LINE__;
+
+    for(size_t i=0; i<sizeof(buf); i++)
+        buf[i] = i * 151 + 7;
+
+    // vector and plain versions agree on all counts and offsets
+    for(unsigned w=1; w<=2; w++) {
+        for(size_t n=0; n<=(sizeof(buf)-8)*8/w; n++) {
+            for(size_t off=0; off<8; off++) {
+                memset(a, 0xEE, sizeof(a));
+                memset(b, 0xEE, sizeof(b));
+                dnp3_unpack_bits(buf+off, n, w, a);
+                dnp3_unpack_bits_scalar(buf+off, n, w, b);
+                if(memcmp(a, b, sizeof(a)) != 0) {
+                    g_test_message("%s line %d: unpack mismatch (w=%u n=%zu,"
+                                   " %s)", __FILE__, LINE, w, n,
+                                   dnp3_unpack_impl());
+                    g_test_fail();
+                    return;
+                }
+            }
+        }
+    }
+
+    dnp3_unpack_bits((const uint8_t *)"\x5A\xE4", 4, 2, a);
+    check_inttype("%u", unsigned, a[0], ==, 2);
+    check_inttype("%u", unsigned, a[1], ==, 2);
+    check_inttype("%u", unsigned, a[2], ==, 1);
+    check_inttype("%u", unsigned, a[3], ==, 1);
+}
+
 int main(int argc, char *argv[])
 {
     g_test_init(&argc, &argv, NULL);
@@ -1430,13 +4317,59 @@ int main(int argc, char *argv[])
     g_test_add_func("/app/obj/class", test_obj_class);
     g_test_add_func("/app/obj/iin", test_obj_iin);
     g_test_add_func("/transport", test_transport);
+    g_test_add_func("/transport/decode", test_transport_decode);
+    g_test_add_func("/transport/function", test_transport_function);
+    g_test_add_func("/dissector/group", test_dissector_group);
+    g_test_add_func("/dissector/batch", test_dissector_batch);
+    g_test_add_func("/dissector/dir", test_dissector_dir);
+    g_test_add_func("/dissector/resync", test_dissector_resync);
+    g_test_add_func("/dissector/trickle", test_dissector_trickle);
+    g_test_add_func("/dissector/budget", test_dissector_budget);
+    g_test_add_func("/dissector/config", test_dissector_config);
+    g_test_add_func("/dissector/filter", test_dissector_filter);
+    g_test_add_func("/dissector/cache", test_dissector_cache);
+    g_test_add_func("/dissector/dedup", test_dissector_dedup);
+    g_test_add_func("/dissector/checkpoint", test_dissector_checkpoint);
+    g_test_add_func("/dissector/memory", test_dissector_memory);
+    g_test_add_func("/dissector/shed", test_dissector_shed);
+#ifdef __linux__
+    g_test_add_func("/ingest", test_ingest);
+#endif
+    g_test_add_func("/points", test_points);
+    g_test_add_func("/archive", test_archive);
+    g_test_add_func("/mac", test_mac);
+    g_test_add_func("/auth", test_auth);
+#ifdef DNP3_STATS
+    g_test_add_func("/dissector/stats", test_dissector_stats);
+#endif
+    g_test_add_func("/app/threads", test_parse_threads);
     g_test_add_func("/link/raw", test_link_raw);
     g_test_add_func("/link/valid", test_link_valid);
     g_test_add_func("/link/skip", test_link_skip);
+    g_test_add_func("/link/decode", test_link_decode);
+    g_test_add_func("/link/resync", test_link_resync);
+    g_test_add_func("/link/crc", test_link_crc);
     g_test_add_func("/sloballoc/size", test_sloballoc_size);
     g_test_add_func("/sloballoc/merge", test_sloballoc_merge);
     g_test_add_func("/sloballoc/small", test_sloballoc_small);
     g_test_add_func("/sloballoc/hammer", test_sloballoc_hammer);
+    g_test_add_func("/sloballoc/stress", test_sloballoc_stress);
+    if(g_test_perf())
+        g_test_add_func("/sloballoc/bench", test_sloballoc_bench);
+    g_test_add_func("/region", test_region);
+    g_test_add_func("/tlalloc", test_tlalloc);
+    g_test_add_func("/profiler", test_profiler);
+    g_test_add_func("/app/columnar", test_columnar);   // rebuilds parsers
+    g_test_add_func("/app/decode", test_app_decode);    // rebuilds parsers
+    g_test_add_func("/app/cto", test_app_cto);          // rebuilds parsers
+    g_test_add_func("/app/tables", test_app_tables);    // rebuilds parsers
+    g_test_add_func("/app/unpack", test_app_unpack);
+    g_test_add_func("/app/objects", test_app_objects);
+    g_test_add_func("/format/into", test_format_into);
+    g_test_add_func("/export", test_export);
+    g_test_add_func("/encode", test_encode);
+    g_test_add_func("/app/copy", test_app_copy);
+    g_test_add_func("/dissector/async", test_dissector_async);
 
     g_test_run();
 }